@@ -1,128 +1,239 @@
 #include <flute/common/AsyncLogging.h>
 #include <flute/common/LogFile.h>
+#include <flute/common/LogLine.h>
 #include <flute/common/Timestamp.h>
+#include <assert.h>
 #include <stdio.h>
 
+#include <algorithm>
+
 namespace flute {
 
+const size_t AsyncLogging::kDefaultStagingSize;
+const size_t AsyncLogging::kMaxBuffersPerWrite;
+
 AsyncLogging::AsyncLogging(const string& basename, off_t rollsize,
                            int flushInterval)
     : m_flush_interval(flushInterval),
       m_is_running(false),
       m_basename(basename),
       m_rollsize(rollsize),
+      m_overflow_policy(kBlock),
+      m_staging_size(kDefaultStagingSize),
+      m_preallocate(false),
+      m_output_format(kTextFormat),
+      m_compression(LogArchiver::kNoCompression),
+      m_max_files(0),
+      m_max_bytes(0),
+      m_dropped_lines(0),
+      m_thread_ring(),
       m_backend_thread(std::bind(&AsyncLogging::backend_thread_func, this),
                        "AsyncLogging"),
       m_backend_latch(1),
       m_mutex(),
       m_wakeup(m_mutex),
-      m_cur_buffer_ptr(new Buffer),
-      m_reserved_buffer_ptr(new Buffer),
-      m_used_buffers() {
-  m_cur_buffer_ptr->reset_buffer();
-  m_reserved_buffer_ptr->reset_buffer();
-  m_used_buffers.reserve(kNumBuffers);
-}
+      m_drained(m_mutex),
+      m_wakeup_pending(false),
+      m_num_waiting(0),
+      m_rings() {}
 
 void AsyncLogging::append(const char* logline, int len) {
-  flute::MutexLockGuard lock(m_mutex);
-  if (m_cur_buffer_ptr->avail() > len) {
-    m_cur_buffer_ptr->append(logline, len);
-  } else {
-    // current buffer need to be archived
-    m_used_buffers.push_back(std::move(m_cur_buffer_ptr));
-
-    if (m_reserved_buffer_ptr) {
-      // we can directly use the reserved buffer instead of creating one
-      // ourselves. Actually, there could be more than one reserved buffers.
-      // That's the space-time trade-off.
-      m_cur_buffer_ptr = std::move(m_reserved_buffer_ptr);
-    } else {
-      // Or we should create a new buffer
-      m_cur_buffer_ptr.reset(new Buffer);
+  LogRing& ring = thread_ring();
+  size_t length = static_cast<size_t>(len);
+  if (!ring.fits(length)) {
+    ++m_dropped_lines;
+    return;
+  }
+  size_t used_bytes = ring.try_append(logline, length);
+  while (used_bytes == 0) {
+    switch (m_overflow_policy) {
+      case kBlock:
+        if (!m_is_running) {
+          ++m_dropped_lines;
+          return;
+        }
+        wait_for_room();
+        break;
+      case kDropOldest:
+        m_dropped_lines += ring.drop_oldest(length);
+        break;
+      case kDropNewest:
+        ++m_dropped_lines;
+        return;
     }
-    // Then we are always writting to the buffer that we call "current"
-    m_cur_buffer_ptr->append(logline, len);
-    m_wakeup.notify();
+    used_bytes = ring.try_append(logline, length);
+  }
+  // Wake up the backend once the ring gets half full, instead of for every
+  // line. Otherwise it drains the ring every flush interval.
+  const size_t half = ring.capacity() / 2;
+  if (used_bytes >= half && used_bytes - LogRing::kHeaderSize - length < half) {
+    wake_up_backend();
   }
 }
 
+LogRing& AsyncLogging::thread_ring() {
+  LogRingPtr& ring_ptr = m_thread_ring.value();
+  if (!ring_ptr) {
+    // The first line of this thread. The backend keeps a reference, so lines
+    // left by an exited thread are still written.
+    ring_ptr.reset(new LogRing(m_staging_size));
+    MutexLockGuard lock(m_mutex);
+    m_rings.push_back(ring_ptr);
+  }
+  return *ring_ptr;
+}
+
+void AsyncLogging::wait_for_room() {
+  MutexLockGuard lock(m_mutex);
+  m_wakeup_pending = true;
+  m_wakeup.notify();
+  ++m_num_waiting;
+  // The backend drains all rings after the wakeup above, the timeout only
+  // guards against a stopping backend.
+  m_drained.wait_for_seconds(0.1);
+  --m_num_waiting;
+}
+
+void AsyncLogging::wake_up_backend() {
+  MutexLockGuard lock(m_mutex);
+  m_wakeup_pending = true;
+  m_wakeup.notify();
+}
+
 void AsyncLogging::backend_thread_func() {
   assert(m_is_running == true);
   m_backend_latch.countdown();
-  LogFile output(m_basename, m_rollsize, false);
-  BufferPtr new_buffer_ptr1(new Buffer);
-  BufferPtr new_buffer_ptr2(new Buffer);
-  new_buffer_ptr1->reset_buffer();
-  new_buffer_ptr2->reset_buffer();
-  BufferPtrVector buffers_to_write;
-  buffers_to_write.reserve(kNumBuffers);
-
-  while (m_is_running) {
-    assert(new_buffer_ptr1 && new_buffer_ptr1->length() == 0);
-    assert(new_buffer_ptr2 && new_buffer_ptr2->length() == 0);
-    assert(buffers_to_write.empty());
+  LogFile output(m_basename, m_rollsize, false, m_flush_interval, 1024,
+                 m_preallocate);
+  if (m_compression != LogArchiver::kNoCompression) {
+    output.set_compression(m_compression);
+  }
+  if (m_max_files > 0 || m_max_bytes > 0) {
+    output.set_retention(m_max_files, m_max_bytes);
+  }
+  // A line always fits in a buffer as large as a ring.
+  const size_t buffer_size = LogRing::rounded_capacity(m_staging_size);
+  std::vector<std::vector<char>> buffers(1, std::vector<char>(buffer_size));
+  std::vector<size_t> lengths;
+  std::vector<string> decoded(kMaxBuffersPerWrite);
+  std::vector<struct iovec> iov;
+  iov.reserve(kMaxBuffersPerWrite + 1);
+  LogRingPtrVector rings;
+  int64_t reported_dropped_lines = 0;
+  char dropped_message[256];
+  string encoded_dropped_message;
+  bool running = true;
 
+  while (running) {
     {
-      flute::MutexLockGuard lock(m_mutex);
-      if (m_used_buffers.empty())  // unusual usage!
-      {
-        // continue even if m_buffers is empty
+      MutexLockGuard lock(m_mutex);
+      if (!m_wakeup_pending && m_is_running) {
         m_wakeup.wait_for_seconds(m_flush_interval);
       }
-      m_used_buffers.push_back(std::move(m_cur_buffer_ptr));
-      // std::move will set the ptr to empty
-      m_cur_buffer_ptr = std::move(new_buffer_ptr1);
-      // m_wriiten buffers are swapped to empty
-      buffers_to_write.swap(m_used_buffers);
-      if (!m_reserved_buffer_ptr) {
-        m_reserved_buffer_ptr = std::move(new_buffer_ptr2);
-      }
-    }
-
-    assert(!buffers_to_write.empty());
-
-    if (buffers_to_write.size() > 2) {
-      char buf[256];
-      snprintf(buf, sizeof buf,
-               "Dropped log messages at %s, %zd larger buffers\n",
-               Timestamp::now().to_formatted_string().c_str(),
-               buffers_to_write.size() - 2);
-      fputs(buf, stderr);
-      output.append(buf, static_cast<int>(strlen(buf)));
-      // abondon the extra buffers
-      buffers_to_write.erase(buffers_to_write.begin() + 2,
-                             buffers_to_write.end());
+      m_wakeup_pending = false;
+      running = m_is_running;
+      rings = m_rings;
     }
 
-    for (const auto& buffer : buffers_to_write) {
-      // FIXME: use unbuffered stdio FILE ? or use ::writev ?
-      output.append(buffer->data(), buffer->length());
-    }
+    // buffers[0, cur] hold the lines drained in this round, lengths tells the
+    // bytes used in each of them.
+    size_t cur = 0;
+    lengths.assign(buffers.size(), 0);
+    auto write_buffers = [&]() {
+      // Binary records are formatted and encoded here, off the logging
+      // threads.
+      const bool decode =
+          LogLine::has_used_binary() || m_output_format != kTextFormat;
+      for (size_t i = 0; i <= cur; ++i) {
+        if (lengths[i] == 0) {
+          continue;
+        }
+        if (decode) {
+          decoded[i].clear();
+          decode_binary_log(buffers[i].data(), lengths[i], &decoded[i],
+                            m_output_format);
+          iov.push_back({&decoded[i][0], decoded[i].size()});
+        } else {
+          iov.push_back({buffers[i].data(), lengths[i]});
+        }
+        lengths[i] = 0;
+      }
+      if (!iov.empty()) {
+        output.append(iov.data(), static_cast<int>(iov.size()));
+      }
+      iov.clear();
+      cur = 0;
+    };
 
-    if (buffers_to_write.size() > 2) {
-      // drop non-reset_buffer-ed buffers, avoid trashing
-      buffers_to_write.resize(2);
+    for (const auto& ring : rings) {
+      // Drain at most a ring of lines, so that a busy thread does not starve
+      // the others.
+      size_t drained = 0;
+      while (drained < ring->capacity()) {
+        size_t& length = lengths[cur];
+        size_t n = ring->drain(buffers[cur].data() + length,
+                               buffer_size - length);
+        if (n > 0) {
+          length += n;
+          drained += n;
+          continue;
+        }
+        if (length == 0 || ring->empty()) {
+          break;
+        }
+        // the next line does not fit in this buffer, move on to another one
+        if (cur + 1 == kMaxBuffersPerWrite) {
+          write_buffers();
+        } else {
+          ++cur;
+          if (cur == buffers.size()) {
+            buffers.emplace_back(buffer_size);
+            lengths.push_back(0);
+          }
+        }
+      }
     }
 
-    // In fact new_buffer_ptr1 is always empty. We have move it to the
-    if (!new_buffer_ptr1) {
-      assert(!buffers_to_write.empty());
-      new_buffer_ptr1 = std::move(buffers_to_write.back());
-      buffers_to_write.pop_back();
-      new_buffer_ptr1->reset_cur();
+    int64_t dropped_lines = m_dropped_lines.load();
+    if (dropped_lines != reported_dropped_lines) {
+      int len = snprintf(
+          dropped_message, sizeof dropped_message,
+          "Dropped %lld log lines at %s\n",
+          static_cast<long long>(dropped_lines - reported_dropped_lines),
+          Timestamp::now().to_formatted_string().c_str());
+      fputs(dropped_message, stderr);
+      if (m_output_format == kTextFormat) {
+        iov.push_back({dropped_message, static_cast<size_t>(len)});
+      } else {
+        encoded_dropped_message.clear();
+        decode_binary_log(dropped_message, static_cast<size_t>(len),
+                          &encoded_dropped_message, m_output_format);
+        iov.push_back({&encoded_dropped_message[0],
+                       encoded_dropped_message.size()});
+      }
+      reported_dropped_lines = dropped_lines;
     }
+    write_buffers();
+    output.flush();
 
-    if (!new_buffer_ptr2) {
-      assert(!buffers_to_write.empty());
-      new_buffer_ptr2 = std::move(buffers_to_write.back());
-      buffers_to_write.pop_back();
-      new_buffer_ptr2->reset_cur();
+    rings.clear();
+    {
+      MutexLockGuard lock(m_mutex);
+      if (m_num_waiting > 0) {
+        m_drained.notify_all();
+      }
+      // Forget the drained rings of exited threads, held by m_rings only. A
+      // live thread holds its ring too, even before its first line is in.
+      for (size_t i = 0; i < m_rings.size();) {
+        if (m_rings[i].use_count() == 1 && m_rings[i]->empty()) {
+          m_rings[i] = m_rings.back();
+          m_rings.pop_back();
+        } else {
+          ++i;
+        }
+      }
     }
-    buffers_to_write.clear();
-    output.flush();
   }
-  output.flush();
 }
 
-}  // namespace flute
\ No newline at end of file
+}  // namespace flute
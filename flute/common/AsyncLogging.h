@@ -6,21 +6,37 @@
 #ifndef FLUTE_COMMON_ASYNCLOGGING_H
 #define FLUTE_COMMON_ASYNCLOGGING_H
 
-#include <flute/common/BlockingDeque.h>
-#include <flute/common/BoundedBlockingDeque.h>
+#include <flute/common/BinaryLog.h>
 #include <flute/common/CountdownLatch.h>
-#include <flute/common/FixedBuffer.h>
-#include <flute/common/LogStream.h>
+#include <flute/common/LogArchiver.h>
+#include <flute/common/LogRing.h>
 #include <flute/common/Mutex.h>
 #include <flute/common/Thread.h>
+#include <flute/common/ThreadLocal.h>
 
 #include <atomic>
+#include <memory>
 #include <vector>
 
 namespace flute {
 
+///
+/// Every thread appends its log lines to its own staging ring without any
+/// lock, and the backend thread drains the rings into the log file.
+///
+/// Lines of one thread keep their order, lines of different threads are
+/// interleaved ring by ring.
 class AsyncLogging : noncopyable {
  public:
+  // What a thread does when its staging ring is full.
+  enum OverflowPolicy {
+    kBlock,       // wait for the backend to drain the ring
+    kDropOldest,  // discard the oldest lines in the ring
+    kDropNewest,  // discard the new line
+  };
+
+  static const size_t kDefaultStagingSize = 1024 * 1024;
+
   AsyncLogging(const string& basename, off_t rollSize, int flushInterval = 3);
 
   ~AsyncLogging() {
@@ -29,41 +45,77 @@ class AsyncLogging : noncopyable {
     }
   }
 
+  // Settings, call them before start().
+  void set_overflow_policy(OverflowPolicy policy) { m_overflow_policy = policy; }
+  // bytes of the staging ring of each thread
+  void set_staging_size(size_t staging_size) { m_staging_size = staging_size; }
+  // reserve the disk space of each log file when it is created
+  void set_preallocate(bool on) { m_preallocate = on; }
+  // Write JSON lines or logfmt instead of text. The fields of flute::kv()
+  // keep their keys and types only in binary mode, see LogLine::set_binary().
+  void set_output_format(LogFormat format) { m_output_format = format; }
+  // see LogFile::set_compression() and LogFile::set_retention()
+  void set_compression(LogArchiver::Compression compression) {
+    m_compression = compression;
+  }
+  void set_retention(int max_files, off_t max_bytes) {
+    m_max_files = max_files;
+    m_max_bytes = max_bytes;
+  }
+
   // thread safe
   void append(const char* logline, int len);
 
+  // number of lines dropped for full rings
+  int64_t dropped_lines() const { return m_dropped_lines.load(); }
+
   void start() {
     m_is_running = true;
     m_backend_thread.start();
     m_backend_latch.wait();
   }
 
-  void stop() NO_THREAD_SAFETY_ANALYSIS {
+  void stop() {
     m_is_running = false;
-    m_wakeup.notify();
+    wake_up_backend();
     m_backend_thread.join();
   }
 
  private:
-  void backend_thread_func();
+  typedef std::shared_ptr<LogRing> LogRingPtr;
+  typedef std::vector<LogRingPtr> LogRingPtrVector;
 
-  static const int kNumBuffers;
+  LogRing& thread_ring();
+  void wait_for_room();
+  void wake_up_backend();
+  void backend_thread_func();
 
-  typedef FixedBuffer<kLogBufferSize> Buffer;
-  typedef std::vector<std::unique_ptr<Buffer>> BufferPtrVector;
-  typedef BufferPtrVector::value_type BufferPtr;
+  // The backend drains the rings into a few buffers as large as a ring, and
+  // writes them with one writev(2).
+  static const size_t kMaxBuffersPerWrite = 16;
 
   const int m_flush_interval;
   std::atomic<bool> m_is_running;
   const string m_basename;
   const off_t m_rollsize;
+  OverflowPolicy m_overflow_policy;
+  size_t m_staging_size;
+  bool m_preallocate;
+  LogFormat m_output_format;
+  LogArchiver::Compression m_compression;
+  int m_max_files;
+  off_t m_max_bytes;
+  std::atomic<int64_t> m_dropped_lines;
+  ThreadLocal<LogRingPtr> m_thread_ring;
   Thread m_backend_thread;
   CountdownLatch m_backend_latch;
   MutexLock m_mutex;
   Condition m_wakeup GUARDED_BY(m_mutex);
-  BufferPtr m_cur_buffer_ptr GUARDED_BY(m_mutex);
-  BufferPtr m_reserved_buffer_ptr GUARDED_BY(m_mutex);
-  BufferPtrVector m_used_buffers GUARDED_BY(m_mutex);
+  // signaled when the backend has drained the rings
+  Condition m_drained GUARDED_BY(m_mutex);
+  bool m_wakeup_pending GUARDED_BY(m_mutex);
+  int m_num_waiting GUARDED_BY(m_mutex);
+  LogRingPtrVector m_rings GUARDED_BY(m_mutex);
 };
 
 }  // namespace flute
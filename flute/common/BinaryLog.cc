@@ -0,0 +1,469 @@
+#include <flute/common/BinaryLog.h>
+#include <flute/common/Digital.h>
+#include <flute/common/LogLine.h>
+#include <flute/common/Mutex.h>
+
+#include <string.h>
+#include <time.h>
+
+#include <map>
+#include <tuple>
+#include <vector>
+
+namespace flute {
+
+namespace {
+
+class LogSiteRegistry : noncopyable {
+ public:
+  uint32_t add(const LogSite& site) {
+    MutexLockGuard lock(m_mutex);
+    // sites of LOG_* macros are registered once, others are looked up
+    Key key(site.file, site.line, site.type);
+    std::map<Key, uint32_t>::iterator it = m_ids.find(key);
+    if (it != m_ids.end()) {
+      return it->second;
+    }
+    m_sites.push_back(site);
+    uint32_t site_id = static_cast<uint32_t>(m_sites.size());
+    m_ids[key] = site_id;
+    return site_id;
+  }
+
+  bool find(uint32_t site_id, LogSite* site) {
+    MutexLockGuard lock(m_mutex);
+    if (site_id == 0 || site_id > m_sites.size()) {
+      return false;
+    }
+    *site = m_sites[site_id - 1];
+    return true;
+  }
+
+ private:
+  typedef std::tuple<const char*, int, const char*> Key;
+
+  MutexLock m_mutex;
+  std::vector<LogSite> m_sites GUARDED_BY(m_mutex);
+  std::map<Key, uint32_t> m_ids GUARDED_BY(m_mutex);
+};
+
+template <typename T>
+bool read_value(const char*& p, const char* end, T* value) {
+  if (end - p < static_cast<ptrdiff_t>(sizeof(T))) {
+    return false;
+  }
+  memcpy(value, p, sizeof(T));
+  p += sizeof(T);
+  return true;
+}
+
+bool read_string(const char*& p, const char* end, StringPiece* str) {
+  uint16_t len = 0;
+  if (!read_value(p, end, &len) || end - p < len) {
+    return false;
+  }
+  str->set(p, len);
+  p += len;
+  return true;
+}
+
+// An argument of a record, a field if it has a key.
+struct Argument {
+  int tag;
+  StringPiece key;
+  int64_t i;
+  uint64_t u;
+  double d;
+  StringPiece str;
+};
+
+// Return false if the payload is corrupted, the arguments before are kept.
+bool parse_arguments(const char* p, const char* end,
+                     std::vector<Argument>* args) {
+  StringPiece key;
+  while (p < end) {
+    Argument arg;
+    arg.tag = static_cast<unsigned char>(*p++);
+    arg.i = 0;
+    arg.u = 0;
+    arg.d = 0;
+    bool ok = true;
+    switch (arg.tag) {
+      case kTagInt64:
+        ok = read_value(p, end, &arg.i);
+        break;
+      case kTagUInt64:
+      case kTagPointer:
+        ok = read_value(p, end, &arg.u);
+        break;
+      case kTagDouble:
+        ok = read_value(p, end, &arg.d);
+        break;
+      case kTagChar: {
+        ok = end - p >= 1;
+        if (ok) {
+          arg.str.set(p, 1);
+          ++p;
+        }
+        break;
+      }
+      case kTagBool: {
+        char b = 0;
+        ok = read_value(p, end, &b);
+        arg.u = b != 0 ? 1 : 0;
+        break;
+      }
+      case kTagString:
+        ok = read_string(p, end, &arg.str);
+        break;
+      case kTagKey:
+        ok = read_string(p, end, &key);
+        if (ok) {
+          // the key goes with the next value
+          continue;
+        }
+        break;
+      default:
+        ok = false;
+        break;
+    }
+    if (!ok) {
+      return false;
+    }
+    arg.key = key;
+    key.clear();
+    args->push_back(arg);
+  }
+  return true;
+}
+
+// the value in text, as LogStream writes it
+void append_value(LogStream& stream, const Argument& arg) {
+  switch (arg.tag) {
+    case kTagInt64:
+      stream << static_cast<long long>(arg.i);
+      break;
+    case kTagUInt64:
+      stream << static_cast<unsigned long long>(arg.u);
+      break;
+    case kTagPointer:
+      stream << reinterpret_cast<const void*>(static_cast<uintptr_t>(arg.u));
+      break;
+    case kTagDouble:
+      stream << arg.d;
+      break;
+    case kTagBool:
+      stream << (arg.u != 0);
+      break;
+    default:
+      stream << arg.str;
+      break;
+  }
+}
+
+// Format a record the way LogLine does in text mode.
+void decode_text(const BinaryLogHeader& header, bool known,
+                 const LogSite& site, const std::vector<Argument>& args,
+                 bool corrupted, string* out) {
+  LogStream stream;
+  stream << (known ? site.type : "[?????] ");
+  LogLine::append_time(stream, Timestamp(header.micro_seconds_since_epoch));
+  if (known && site.func != NULL) {
+    stream << site.func << ": ";
+  }
+  for (const auto& arg : args) {
+    if (arg.key.size() > 0) {
+      stream << ' ' << arg.key << '=';
+    }
+    append_value(stream, arg);
+  }
+  if (corrupted) {
+    stream << "[CORRUPTED]";
+  }
+  if (header.saved_errno != 0) {
+    stream << " [ERRNO:" << header.saved_errno << "]"
+           << strerror_tl(header.saved_errno) << " ";
+  }
+  if (known) {
+    stream << " - " << StringPiece(site.file, site.file_size) << ':'
+           << site.line;
+  } else {
+    stream << " - site " << header.site_id;
+  }
+  stream << '\n';
+  out->append(stream.m_buffer.data(), stream.m_buffer.length());
+}
+
+// ISO 8601 in UTC, "2026-10-19T12:34:56.123456Z"
+void append_iso_time(int64_t micro_seconds_since_epoch, string* out) {
+  time_t seconds = static_cast<time_t>(micro_seconds_since_epoch /
+                                       Timestamp::kMicroSecondsPerSecond);
+  int microseconds = static_cast<int>(micro_seconds_since_epoch %
+                                      Timestamp::kMicroSecondsPerSecond);
+  struct tm tm_time;
+  ::gmtime_r(&seconds, &tm_time);
+  char buf[32];
+  size_t len = strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S.", &tm_time);
+  out->append(buf, len);
+  fixed_width_to_string(buf, static_cast<uint32_t>(microseconds), 6);
+  buf[6] = 'Z';
+  out->append(buf, 7);
+}
+
+// "INFO", "SERROR"
+StringPiece level_name(const char* type) {
+  StringPiece name(type);
+  while (name.size() > 0 && (name[0] == '[' || name[0] == ' ')) {
+    name.remove_prefix(1);
+  }
+  while (name.size() > 0 &&
+         (name[name.size() - 1] == ']' || name[name.size() - 1] == ' ')) {
+    name.remove_suffix(1);
+  }
+  return name;
+}
+
+void append_json_string(StringPiece str, string* out) {
+  static const char kHex[] = "0123456789abcdef";
+  out->push_back('"');
+  for (int i = 0; i < str.size(); ++i) {
+    unsigned char c = static_cast<unsigned char>(str[i]);
+    switch (c) {
+      case '"':
+        out->append("\\\"");
+        break;
+      case '\\':
+        out->append("\\\\");
+        break;
+      case '\n':
+        out->append("\\n");
+        break;
+      case '\r':
+        out->append("\\r");
+        break;
+      case '\t':
+        out->append("\\t");
+        break;
+      default:
+        if (c < 0x20) {
+          out->append("\\u00");
+          out->push_back(kHex[c >> 4]);
+          out->push_back(kHex[c & 0xF]);
+        } else {
+          out->push_back(static_cast<char>(c));
+        }
+        break;
+    }
+  }
+  out->push_back('"');
+}
+
+// a logfmt value, quoted if needed
+void append_logfmt_value(StringPiece str, string* out) {
+  bool quote = str.size() == 0;
+  for (int i = 0; i < str.size() && !quote; ++i) {
+    unsigned char c = static_cast<unsigned char>(str[i]);
+    quote = c <= ' ' || c == '=' || c == '"';
+  }
+  if (!quote) {
+    out->append(str.data(), str.size());
+    return;
+  }
+  out->push_back('"');
+  for (int i = 0; i < str.size(); ++i) {
+    char c = str[i];
+    if (c == '"' || c == '\\') {
+      out->push_back('\\');
+      out->push_back(c);
+    } else if (c == '\n') {
+      out->append("\\n");
+    } else {
+      out->push_back(c);
+    }
+  }
+  out->push_back('"');
+}
+
+StringPiece value_text(const Argument& arg, LogStream& stream) {
+  stream.m_buffer.reset_cur();
+  append_value(stream, arg);
+  return stream.m_buffer.to_string_piece();
+}
+
+bool is_json_number(const Argument& arg, StringPiece text) {
+  switch (arg.tag) {
+    case kTagInt64:
+    case kTagUInt64:
+      return true;
+    case kTagDouble:
+      // not nan nor inf
+      return text.size() > 0 && text[text.size() - 1] >= '0' &&
+             text[text.size() - 1] <= '9';
+    default:
+      return false;
+  }
+}
+
+// {"time":"...","level":"INFO","msg":"...","file":"x.cc","line":1,...}
+// or time=... level=INFO msg="..." file=x.cc line=1 ...
+void decode_structured(const BinaryLogHeader& header, bool known,
+                       const LogSite& site, const std::vector<Argument>& args,
+                       bool corrupted, LogFormat format, string* out) {
+  const bool json = format == kJsonLinesFormat;
+  LogStream message;
+  for (const auto& arg : args) {
+    if (arg.key.size() == 0) {
+      append_value(message, arg);
+    }
+  }
+  if (corrupted) {
+    message << "[CORRUPTED]";
+  }
+
+  bool first = true;
+  auto append_key = [&](StringPiece key) {
+    if (json) {
+      out->append(first ? "{" : ",");
+      append_json_string(key, out);
+      out->push_back(':');
+    } else {
+      if (!first) {
+        out->push_back(' ');
+      }
+      out->append(key.data(), key.size());
+      out->push_back('=');
+    }
+    first = false;
+  };
+  auto append_string = [&](StringPiece key, StringPiece value) {
+    append_key(key);
+    if (json) {
+      append_json_string(value, out);
+    } else {
+      append_logfmt_value(value, out);
+    }
+  };
+  auto append_number = [&](StringPiece key, long long value) {
+    append_key(key);
+    char buf[32];
+    out->append(buf, integer_to_string(buf, value));
+  };
+
+  string time;
+  append_iso_time(header.micro_seconds_since_epoch, &time);
+  append_string("time", time);
+  if (known) {
+    append_string("level", level_name(site.type));
+  }
+  append_string("msg", message.m_buffer.to_string_piece());
+  if (header.saved_errno != 0) {
+    append_number("errno", header.saved_errno);
+    append_string("error", strerror_tl(header.saved_errno));
+  }
+  if (known) {
+    append_string("file", StringPiece(site.file, site.file_size));
+    append_number("line", site.line);
+    if (site.func != NULL) {
+      append_string("func", site.func);
+    }
+  } else {
+    append_number("site", header.site_id);
+  }
+
+  LogStream value;
+  for (const auto& arg : args) {
+    if (arg.key.size() == 0) {
+      continue;
+    }
+    StringPiece text = value_text(arg, value);
+    if (json && (arg.tag == kTagBool || is_json_number(arg, text))) {
+      append_key(arg.key);
+      if (arg.tag == kTagBool) {
+        out->append(arg.u != 0 ? "true" : "false");
+      } else {
+        out->append(text.data(), text.size());
+      }
+    } else if (!json && arg.tag == kTagBool) {
+      append_string(arg.key, arg.u != 0 ? "true" : "false");
+    } else {
+      append_string(arg.key, text);
+    }
+  }
+  out->append(json ? "}\n" : "\n");
+}
+
+void decode_record(const BinaryLogHeader& header, const char* payload,
+                   LogFormat format, string* out) {
+  LogSite site;
+  bool known = find_log_site(header.site_id, &site);
+  std::vector<Argument> args;
+  bool corrupted = !parse_arguments(payload, payload + header.length, &args);
+  if (format == kTextFormat) {
+    decode_text(header, known, site, args, corrupted, out);
+  } else {
+    decode_structured(header, known, site, args, corrupted, format, out);
+  }
+}
+
+// A text line, from a LogLine in text mode or written directly.
+void decode_text_line(StringPiece line, LogFormat format, string* out) {
+  if (format == kTextFormat) {
+    out->append(line.data(), line.size());
+    return;
+  }
+  if (line.size() > 0 && line[line.size() - 1] == '\n') {
+    line.remove_suffix(1);
+  }
+  if (format == kJsonLinesFormat) {
+    out->append("{\"msg\":");
+    append_json_string(line, out);
+    out->append("}\n");
+  } else {
+    out->append("msg=");
+    append_logfmt_value(line, out);
+    out->push_back('\n');
+  }
+}
+
+// Never destroyed, lines may still be logged while exiting.
+LogSiteRegistry& log_site_registry() {
+  static LogSiteRegistry* registry = new LogSiteRegistry;
+  return *registry;
+}
+
+}  // namespace
+
+uint32_t register_log_site(const BaseName& file, int line, int level,
+                           const char* type, const char* func) {
+  LogSite site = {file.data(), file.size(), line, level, type, func};
+  return log_site_registry().add(site);
+}
+
+bool find_log_site(uint32_t site_id, LogSite* site) {
+  return log_site_registry().find(site_id, site);
+}
+
+void decode_binary_log(const char* data, size_t len, string* out,
+                       LogFormat format) {
+  const char* p = data;
+  const char* end = data + len;
+  while (p < end) {
+    BinaryLogHeader header;
+    if (end - p >= static_cast<ptrdiff_t>(sizeof(header))) {
+      memcpy(&header, p, sizeof(header));
+      if (header.magic == kBinaryLogMagic &&
+          static_cast<size_t>(end - p) - sizeof(header) >= header.length) {
+        decode_record(header, p + sizeof(header), format, out);
+        p += sizeof(header) + header.length;
+        continue;
+      }
+    }
+    // a text line
+    const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+    const char* next = eol != NULL ? eol + 1 : end;
+    decode_text_line(StringPiece(p, static_cast<int>(next - p)), format, out);
+    p = next;
+  }
+}
+
+}  // namespace flute
@@ -0,0 +1,86 @@
+#ifndef FLUTE_COMMON_BINARYLOG_H
+#define FLUTE_COMMON_BINARYLOG_H
+
+#include <flute/common/types.h>
+
+#include <stdint.h>
+
+namespace flute {
+
+class BaseName;
+
+///
+/// Binary log records, formatted into text later by the backend.
+///
+/// In binary mode a LOG_* statement records the ID of its call site, the raw
+/// timestamp and the raw bytes of its arguments. decode_binary_log() turns the
+/// records back into the very lines the text mode writes.
+///
+
+// A record is a BinaryLogHeader followed by length bytes of arguments, each of
+// which is a BinaryLogTag and its value.
+struct BinaryLogHeader {
+  uint16_t magic;
+  uint16_t length;
+  uint32_t site_id;
+  int64_t micro_seconds_since_epoch;
+  int32_t saved_errno;
+  uint32_t reserved;
+};
+
+// The first byte of the magic, 0xFF, never starts a text line.
+const uint16_t kBinaryLogMagic = 0xB1FF;
+
+enum BinaryLogTag {
+  kTagInt64 = 1,    // int64_t
+  kTagUInt64 = 2,   // uint64_t
+  kTagDouble = 3,   // double
+  kTagPointer = 4,  // uint64_t
+  kTagChar = 5,     // char
+  kTagString = 6,   // uint16_t length and the characters
+  kTagBool = 7,     // char
+  kTagKey = 8,      // like kTagString, the key of the next value
+};
+
+// Where a LOG_* statement is.
+struct LogSite {
+  const char* file;
+  int file_size;
+  int line;
+  int level;
+  const char* type;
+  const char* func;
+};
+
+// Return the ID of a call site, registering it on the first call. IDs start
+// from 1. Thread safe.
+uint32_t register_log_site(const BaseName& file, int line, int level,
+                           const char* type, const char* func);
+
+// Return false if the ID is unknown. Thread safe.
+bool find_log_site(uint32_t site_id, LogSite* site);
+
+enum LogFormat {
+  kTextFormat,       // the lines of LogLine in text mode
+  kJsonLinesFormat,  // a JSON object per line
+  kLogfmtFormat,     // key=value pairs per line
+};
+
+// Append the binary records and text lines in data to out in the format.
+// Fields of LOG_* << flute::kv(key, value) are written as keys of their own
+// in JSON lines and logfmt. Values are escaped here, never by the logging
+// threads.
+void decode_binary_log(const char* data, size_t len, string* out,
+                       LogFormat format = kTextFormat);
+
+}  // namespace flute
+
+// The ID of the call site, registered once by the static initialization.
+#define FLUTE_LOG_SITE(level, type, func)                                 \
+  [](const char* f) -> uint32_t {                                         \
+    static const uint32_t site_id =                                       \
+        flute::register_log_site(__FILE__, __LINE__, level, type, f);     \
+    return site_id;                                                       \
+  }(func)
+
+#endif  // FLUTE_COMMON_BINARYLOG_H
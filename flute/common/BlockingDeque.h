@@ -20,10 +20,10 @@ class BlockingDeque : noncopyable {
   T take_front() {
     MutexLockGuard lock(m_mutex);
     // always use a while-loop, due to spurious wakeup
-    while (m_deque.is_empty()) {
+    while (m_deque.empty()) {
       m_cond_not_empty.wait();
     }
-    assert(!m_deque.is_empty());
+    assert(!m_deque.empty());
     T front(std::move(m_deque.front()));
     m_deque.pop_front();
     return front;
@@ -46,8 +46,8 @@ class BlockingDeque : noncopyable {
     // http://www.domaigne.com/blog/computing/condvars-signal-with-mutex-locked-or-not/
   }
   mutable MutexLock m_mutex;
-  Condition m_cond_not_empty GUARDED_BY(mutex_);
-  std::deque<T> m_deque GUARDED_BY(mutex_);
+  Condition m_cond_not_empty GUARDED_BY(m_mutex);
+  std::deque<T> m_deque GUARDED_BY(m_mutex);
 };
 
 }  // namespace flute
@@ -0,0 +1,124 @@
+#ifndef FLUTE_COMMON_BLOCKINGMPMCQUEUE_H
+#define FLUTE_COMMON_BLOCKINGMPMCQUEUE_H
+
+#include <flute/common/BoundedMpmcQueue.h>
+#include <flute/common/Futex.h>
+
+#include <sched.h>
+
+namespace flute {
+
+///
+/// A BoundedMpmcQueue that waits when it is full or empty, in place of
+/// BoundedBlockingDeque where the front is never pushed.
+///
+/// A thread that has to wait retries for a while, then sleeps on a futex. The
+/// other side only makes a system call when someone sleeps.
+template <typename T>
+class BlockingMpmcQueue : noncopyable {
+ public:
+  static const int kSpinCount = 64;
+
+  explicit BlockingMpmcQueue(size_t capacity)
+      : m_queue(capacity),
+        m_not_empty(0),
+        m_num_takers_waiting(0),
+        m_not_full(0),
+        m_num_pushers_waiting(0) {}
+
+  void push_back(const T& x) {
+    for (int i = 0; !m_queue.try_push(x); ++i) {
+      wait(i, &m_not_full, &m_num_pushers_waiting,
+           [this]() { return !m_queue.is_full(); });
+    }
+    notify(&m_not_empty, &m_num_takers_waiting);
+  }
+
+  void push_back(T&& x) {
+    // try_push() moves from x only when it succeeds
+    for (int i = 0; !m_queue.try_push(std::move(x)); ++i) {
+      wait(i, &m_not_full, &m_num_pushers_waiting,
+           [this]() { return !m_queue.is_full(); });
+    }
+    notify(&m_not_empty, &m_num_takers_waiting);
+  }
+
+  T take_front() {
+    T x;
+    for (int i = 0; !m_queue.try_pop(&x); ++i) {
+      wait(i, &m_not_empty, &m_num_takers_waiting,
+           [this]() { return !m_queue.is_empty(); });
+    }
+    notify(&m_not_full, &m_num_pushers_waiting);
+    return x;
+  }
+
+  bool try_push(const T& x) {
+    bool ok = m_queue.try_push(x);
+    if (ok) {
+      notify(&m_not_empty, &m_num_takers_waiting);
+    }
+    return ok;
+  }
+
+  bool try_take_front(T* x) {
+    bool ok = m_queue.try_pop(x);
+    if (ok) {
+      notify(&m_not_full, &m_num_pushers_waiting);
+    }
+    return ok;
+  }
+
+  size_t size() const { return m_queue.size(); }
+  size_t capacity() const { return m_queue.capacity(); }
+  bool is_empty() const { return m_queue.is_empty(); }
+  bool is_full() const { return m_queue.is_full(); }
+
+ private:
+  // The attempt-th failure, spin or sleep until ready() may be true.
+  template <typename Ready>
+  static void wait(int attempt, std::atomic<uint32_t>* epoch,
+                   std::atomic<int>* num_waiting, Ready ready) {
+    if (attempt < kSpinCount) {
+#if defined(__x86_64__) || defined(__i386__)
+      __builtin_ia32_pause();
+#endif
+      if (attempt >= kSpinCount / 2) {
+        ::sched_yield();
+      }
+      return;
+    }
+    uint32_t e = epoch->load(std::memory_order_acquire);
+    num_waiting->fetch_add(1, std::memory_order_relaxed);
+    // pairs with the fence in notify()
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!ready()) {
+      futex_wait(epoch, e);
+    }
+    num_waiting->fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  static void notify(std::atomic<uint32_t>* epoch,
+                     std::atomic<int>* num_waiting) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (num_waiting->load(std::memory_order_relaxed) > 0) {
+      epoch->fetch_add(1, std::memory_order_release);
+      futex_wake(epoch, 1);
+    }
+  }
+
+  static const size_t kCacheLineSize = 64;
+
+  BoundedMpmcQueue<T> m_queue;
+  // futex words, each side on its own cache line
+  std::atomic<uint32_t> m_not_empty;
+  std::atomic<int> m_num_takers_waiting;
+  char m_pad0[kCacheLineSize - sizeof(uint32_t) - sizeof(int)];
+  std::atomic<uint32_t> m_not_full;
+  std::atomic<int> m_num_pushers_waiting;
+  char m_pad1[kCacheLineSize - sizeof(uint32_t) - sizeof(int)];
+};
+
+}  // namespace flute
+
+#endif  // FLUTE_COMMON_BLOCKINGMPMCQUEUE_H
@@ -2,6 +2,7 @@
 #define FLUTE_COMMON_BOUNDEDBLOCKINGDEQUE_H
 
 #include <flute/common/Condition.h>
+#include <flute/common/LogLine.h>
 #include <flute/common/Mutex.h>
 
 #include <deque>
@@ -45,12 +46,12 @@ class BoundedBlockingDeque : noncopyable {
 
   bool is_empty() const {
     MutexLockGuard lock(m_queue_mutex);
-    return m_deque.is_empty();
+    return m_deque.empty();
   }
 
   bool is_full() const {
     MutexLockGuard lock(m_queue_mutex);
-    return m_deque.size() == m_max_queue_size;
+    return m_deque.size() >= m_max_queue_size;
   }
 
   size_t size() const {
@@ -60,7 +61,7 @@ class BoundedBlockingDeque : noncopyable {
 
   size_t capacity() const {
     MutexLockGuard lock(m_queue_mutex);
-    return m_deque.capacity();
+    return m_max_queue_size;
   }
 
   void set_size(size_t size) {
@@ -71,7 +72,7 @@ class BoundedBlockingDeque : noncopyable {
  private:
   void push(const T& x, bool push_back) {
     MutexLockGuard lock(m_queue_mutex);
-    while (m_deque.size() == m_max_queue_size) {
+    while (m_deque.size() >= m_max_queue_size) {
       m_cond_not_full.wait();
     }
     assert(m_deque.size() < m_max_queue_size);
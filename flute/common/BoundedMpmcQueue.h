@@ -0,0 +1,146 @@
+#ifndef FLUTE_COMMON_BOUNDEDMPMCQUEUE_H
+#define FLUTE_COMMON_BOUNDEDMPMCQUEUE_H
+
+#include <flute/common/noncopyable.h>
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace flute {
+
+///
+/// A bounded multi-producer multi-consumer queue without locks, Dmitry
+/// Vyukov's ring of cells with sequence numbers.
+///
+/// A cell is free for the producer at position pos when its sequence is pos,
+/// and full for the consumer when its sequence is pos + 1. Producers and
+/// consumers only contend on their own index, each on its own cache line.
+/// try_push() and try_pop() never wait, see BlockingMpmcQueue for a queue
+/// that does.
+template <typename T>
+class BoundedMpmcQueue : noncopyable {
+ public:
+  // capacity is rounded up to a power of 2
+  explicit BoundedMpmcQueue(size_t capacity)
+      : m_mask(round_up(capacity) - 1),
+        m_cells(new Cell[m_mask + 1]),
+        m_push_index(0),
+        m_pop_index(0) {
+    for (size_t i = 0; i <= m_mask; ++i) {
+      m_cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  ~BoundedMpmcQueue() {
+    size_t push = m_push_index.load(std::memory_order_relaxed);
+    for (size_t pos = m_pop_index.load(std::memory_order_relaxed); pos != push;
+         ++pos) {
+      m_cells[pos & m_mask].item()->~T();
+    }
+  }
+
+  size_t capacity() const { return m_mask + 1; }
+  // an estimate while other threads push or pop
+  size_t size() const {
+    size_t push = m_push_index.load(std::memory_order_relaxed);
+    size_t pop = m_pop_index.load(std::memory_order_relaxed);
+    return push > pop ? push - pop : 0;
+  }
+  bool is_empty() const { return size() == 0; }
+  bool is_full() const { return size() >= capacity(); }
+
+  // Return false if it is full, x is left untouched then.
+  bool try_push(const T& x) { return emplace(x); }
+  bool try_push(T&& x) { return emplace(std::move(x)); }
+
+  // Return false if it is empty.
+  bool try_pop(T* x) {
+    size_t pos = m_pop_index.load(std::memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+      cell = &m_cells[pos & m_mask];
+      size_t seq = cell->sequence.load(std::memory_order_acquire);
+      intptr_t dif =
+          static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+      if (dif == 0) {
+        if (m_pop_index.compare_exchange_weak(pos, pos + 1,
+                                              std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (dif < 0) {
+        return false;
+      } else {
+        pos = m_pop_index.load(std::memory_order_relaxed);
+      }
+    }
+    T* item = cell->item();
+    *x = std::move(*item);
+    item->~T();
+    // free for the producer of the next lap
+    cell->sequence.store(pos + m_mask + 1, std::memory_order_release);
+    return true;
+  }
+
+ private:
+  struct Cell {
+    std::atomic<size_t> sequence;
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+
+    T* item() { return reinterpret_cast<T*>(&storage); }
+  };
+
+  template <typename U>
+  bool emplace(U&& x) {
+    size_t pos = m_push_index.load(std::memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+      cell = &m_cells[pos & m_mask];
+      size_t seq = cell->sequence.load(std::memory_order_acquire);
+      intptr_t dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+      if (dif == 0) {
+        if (m_push_index.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (dif < 0) {
+        return false;
+      } else {
+        pos = m_push_index.load(std::memory_order_relaxed);
+      }
+    }
+    new (&cell->storage) T(std::forward<U>(x));
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  static size_t round_up(size_t capacity) {
+    size_t n = 2;
+    while (n < capacity) {
+      n <<= 1;
+    }
+    return n;
+  }
+
+  static const size_t kCacheLineSize = 64;
+  typedef std::atomic<size_t> Index;
+
+  char m_pad0[kCacheLineSize];
+  const size_t m_mask;
+  const std::unique_ptr<Cell[]> m_cells;
+  char m_pad1[kCacheLineSize - sizeof(size_t) - sizeof(Cell*)];
+  Index m_push_index;
+  char m_pad2[kCacheLineSize - sizeof(Index)];
+  Index m_pop_index;
+  char m_pad3[kCacheLineSize - sizeof(Index)];
+};
+
+}  // namespace flute
+
+#endif  // FLUTE_COMMON_BOUNDEDMPMCQUEUE_H
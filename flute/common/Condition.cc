@@ -8,7 +8,7 @@ bool Condition::wait_for_seconds(double seconds) {
   int64_t nanoseconds =
       static_cast<int64_t>(seconds * flute::kNanoSecondsPerSecond);
   struct timespec abstime;
-  clock_gettime(CLOCK_MONOTONIC_RAW, &abstime);
+  clock_gettime(CLOCK_MONOTONIC, &abstime);
   abstime.tv_sec += static_cast<time_t>((abstime.tv_nsec + nanoseconds) /
                                         flute::kNanoSecondsPerSecond);
   abstime.tv_nsec = static_cast<long>((abstime.tv_nsec + nanoseconds) %
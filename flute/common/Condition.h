@@ -15,7 +15,12 @@ class Condition : noncopyable {
 
  public:
   explicit Condition(MutexLock& mutex) : m_mutexlock(mutex) {
-    MCHECK(pthread_cond_init(&m_pthread_cond, NULL));
+    // wait_for_seconds() counts on the monotonic clock
+    pthread_condattr_t attr;
+    MCHECK(pthread_condattr_init(&attr));
+    MCHECK(pthread_condattr_setclock(&attr, CLOCK_MONOTONIC));
+    MCHECK(pthread_cond_init(&m_pthread_cond, &attr));
+    MCHECK(pthread_condattr_destroy(&attr));
   }
   ~Condition() { MCHECK(pthread_cond_destroy(&m_pthread_cond)); };
 
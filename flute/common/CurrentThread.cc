@@ -17,17 +17,20 @@ __thread const char* t_thread_name = "unknown";
 static_assert(std::is_same<int, pid_t>::value, "pid_t should be int");
 
 string stacktrace(bool demangle) {
-  string stack;
   const int max_frames = 200;
   void* frame[max_frames];
   int nptrs = ::backtrace(frame, max_frames);
-  char** strings = ::backtrace_symbols(frame, nptrs);
+  // skipping the 0-th, which is this function
+  return stacktrace(frame + 1, nptrs - 1, demangle);
+}
+
+string stacktrace(void* const* frames, int num_frames, bool demangle) {
+  string stack;
+  char** strings = ::backtrace_symbols(frames, num_frames);
   if (strings) {
     size_t len = 256;
     char* demangled = demangle ? static_cast<char*>(::malloc(len)) : nullptr;
-    for (int i = 1; i < nptrs;
-         ++i)  // skipping the 0-th, which is this function
-    {
+    for (int i = 0; i < num_frames; ++i) {
       if (demangle) {
         // https://panthema.net/2008/0901-stacktrace-demangled/
         // bin/exception_test(_ZN3Bar4testEv+0x79) [0x401909]
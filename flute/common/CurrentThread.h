@@ -42,6 +42,8 @@ bool is_main_thread();
 void sleep_usec(int64_t usec);  // for testing
 
 string stacktrace(bool demangle);
+// The frames taken by ::backtrace(), as stacktrace(bool) formats them.
+string stacktrace(void* const* frames, int num_frames, bool demangle);
 }  // namespace CurrentThread
 }  // namespace flute
 
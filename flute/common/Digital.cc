@@ -0,0 +1,329 @@
+#include <flute/common/Digital.h>
+
+#include <math.h>
+
+// Grisu2 by Florian Loitsch, "Printing Floating-Point Numbers Quickly and
+// Accurately with Integers", PLDI 2010. It finds the shortest digits for
+// nearly all doubles, and the digits always read back to the same double.
+
+namespace flute {
+
+namespace {
+
+const uint64_t kSignificandMask = 0x000FFFFFFFFFFFFFULL;
+const uint64_t kHiddenBit = 0x0010000000000000ULL;
+const int kSignificandSize = 52;
+const int kExponentBias = 0x3FF + kSignificandSize;
+const int kMinExponent = -kExponentBias;
+
+// a floating point number f * 2^e with 64 bits of significand
+struct DiyFp {
+  DiyFp() : f(0), e(0) {}
+  DiyFp(uint64_t fp, int exp) : f(fp), e(exp) {}
+
+  explicit DiyFp(double d) {
+    uint64_t u;
+    memcpy(&u, &d, sizeof(u));
+    int biased_e = static_cast<int>((u >> kSignificandSize) & 0x7FF);
+    uint64_t significand = u & kSignificandMask;
+    if (biased_e != 0) {
+      f = significand + kHiddenBit;
+      e = biased_e - kExponentBias;
+    } else {
+      f = significand;
+      e = kMinExponent + 1;
+    }
+  }
+
+  DiyFp operator-(const DiyFp& rhs) const { return DiyFp(f - rhs.f, e); }
+
+  // the upper 64 bits of the product, rounded
+  DiyFp operator*(const DiyFp& rhs) const {
+    unsigned __int128 p = static_cast<unsigned __int128>(f) * rhs.f;
+    uint64_t h = static_cast<uint64_t>(p >> 64);
+    uint64_t l = static_cast<uint64_t>(p);
+    if (l & (uint64_t(1) << 63)) {
+      ++h;
+    }
+    return DiyFp(h, e + rhs.e + 64);
+  }
+
+  DiyFp normalize() const {
+    int s = __builtin_clzll(f);
+    return DiyFp(f << s, e - s);
+  }
+
+  DiyFp normalize_boundary() const {
+    DiyFp res = *this;
+    while (!(res.f & (kHiddenBit << 1))) {
+      res.f <<= 1;
+      res.e--;
+    }
+    res.f <<= (64 - kSignificandSize - 2);
+    res.e -= (64 - kSignificandSize - 2);
+    return res;
+  }
+
+  // the normalized boundaries m- and m+ halfway to the neighbor doubles
+  void normalized_boundaries(DiyFp* minus, DiyFp* plus) const {
+    DiyFp pl = DiyFp((f << 1) + 1, e - 1).normalize_boundary();
+    DiyFp mi = (f == kHiddenBit) ? DiyFp((f << 2) - 1, e - 2)
+                                 : DiyFp((f << 1) - 1, e - 1);
+    mi.f <<= mi.e - pl.e;
+    mi.e = pl.e;
+    *plus = pl;
+    *minus = mi;
+  }
+
+  uint64_t f;
+  int e;
+};
+
+// 10^k for k = -348, -340, ..., 340, normalized to 64 bits
+const uint64_t kCachedPowersF[] = {
+    0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL,
+    0xcf42894a5dce35eaULL, 0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL,
+    0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL, 0xbe5691ef416bd60cULL,
+    0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+    0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL,
+    0xc21094364dfb5637ULL, 0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL,
+    0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL, 0xb23867fb2a35b28eULL,
+    0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+    0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL,
+    0xb5b5ada8aaff80b8ULL, 0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL,
+    0x964e858c91ba2655ULL, 0xdff9772470297ebdULL, 0xa6dfbd9fb8e5b88fULL,
+    0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+    0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL,
+    0xaa242499697392d3ULL, 0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL,
+    0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL, 0x9c40000000000000ULL,
+    0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+    0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL,
+    0x9f4f2726179a2245ULL, 0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL,
+    0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL, 0x924d692ca61be758ULL,
+    0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+    0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL,
+    0x952ab45cfa97a0b3ULL, 0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL,
+    0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL, 0x88fcf317f22241e2ULL,
+    0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+    0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL,
+    0x8bab8eefb6409c1aULL, 0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL,
+    0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL, 0x80444b5e7aa7cf85ULL,
+    0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+    0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL,
+};
+
+const int16_t kCachedPowersE[] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+    -954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+    -688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+    -422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+    -157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+    109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+    375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+    641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+    907, 933, 960, 986, 1013, 1039, 1066,
+};
+
+static_assert(sizeof(kCachedPowersF) / sizeof(kCachedPowersF[0]) == 87,
+              "wrong number of cached powers");
+static_assert(sizeof(kCachedPowersE) / sizeof(kCachedPowersE[0]) == 87,
+              "wrong number of cached powers");
+
+// a cached power c = 10^-k, so that the exponent of w * c is in [-60, -32]
+DiyFp cached_power(int e, int* k) {
+  double dk = (-61 - e) * 0.30102999566398114 + 347;
+  int ik = static_cast<int>(dk);
+  if (dk - ik > 0.0) {
+    ik++;
+  }
+  unsigned index = static_cast<unsigned>((ik >> 3) + 1);
+  *k = -(-348 + static_cast<int>(index << 3));
+  return DiyFp(kCachedPowersF[index], kCachedPowersE[index]);
+}
+
+const uint64_t kPow10[] = {
+    1ULL,
+    10ULL,
+    100ULL,
+    1000ULL,
+    10000ULL,
+    100000ULL,
+    1000000ULL,
+    10000000ULL,
+    100000000ULL,
+    1000000000ULL,
+    10000000000ULL,
+    100000000000ULL,
+    1000000000000ULL,
+    10000000000000ULL,
+    100000000000000ULL,
+    1000000000000000ULL,
+    10000000000000000ULL,
+    100000000000000000ULL,
+    1000000000000000000ULL,
+    10000000000000000000ULL,
+};
+
+int count_decimal_digits(uint32_t n) {
+  int count = 1;
+  while (n >= 10) {
+    n /= 10;
+    ++count;
+  }
+  return count;
+}
+
+// Move the last digit closer to w while staying inside the boundaries.
+void grisu_round(char* buffer, int len, uint64_t delta, uint64_t rest,
+                 uint64_t ten_kappa, uint64_t wp_w) {
+  while (rest < wp_w && delta - rest >= ten_kappa &&
+         (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+    buffer[len - 1]--;
+    rest += ten_kappa;
+  }
+}
+
+void digit_gen(const DiyFp& w, const DiyFp& mp, uint64_t delta, char* buffer,
+               int* len, int* k) {
+  const DiyFp one(uint64_t(1) << -mp.e, mp.e);
+  const DiyFp wp_w = mp - w;
+  uint32_t p1 = static_cast<uint32_t>(mp.f >> -one.e);
+  uint64_t p2 = mp.f & (one.f - 1);
+  int kappa = count_decimal_digits(p1);
+  *len = 0;
+
+  // the integral part
+  while (kappa > 0) {
+    uint32_t pow10 = static_cast<uint32_t>(kPow10[kappa - 1]);
+    uint32_t d = p1 / pow10;
+    p1 %= pow10;
+    if (d || *len) {
+      buffer[(*len)++] = static_cast<char>('0' + d);
+    }
+    kappa--;
+    uint64_t tmp = (static_cast<uint64_t>(p1) << -one.e) + p2;
+    if (tmp <= delta) {
+      *k += kappa;
+      grisu_round(buffer, *len, delta, tmp, kPow10[kappa] << -one.e, wp_w.f);
+      return;
+    }
+  }
+
+  // the fractional part
+  while (true) {
+    p2 *= 10;
+    delta *= 10;
+    char d = static_cast<char>(p2 >> -one.e);
+    if (d || *len) {
+      buffer[(*len)++] = static_cast<char>('0' + d);
+    }
+    p2 &= one.f - 1;
+    kappa--;
+    if (p2 < delta) {
+      *k += kappa;
+      int index = -kappa;
+      grisu_round(buffer, *len, delta, p2, one.f,
+                  wp_w.f * (index < 20 ? kPow10[index] : 0));
+      return;
+    }
+  }
+}
+
+// The digits of a positive value, which is digits * 10^k.
+void grisu2(double value, char* buffer, int* len, int* k) {
+  const DiyFp v(value);
+  DiyFp w_m, w_p;
+  v.normalized_boundaries(&w_m, &w_p);
+
+  const DiyFp c_mk = cached_power(w_p.e, k);
+  const DiyFp w = v.normalize() * c_mk;
+  DiyFp wp = w_p * c_mk;
+  DiyFp wm = w_m * c_mk;
+  wm.f++;
+  wp.f--;
+  digit_gen(w, wp, wp.f - wm.f, buffer, len, k);
+}
+
+// Lay out len digits, which are digits * 10^k, like "%g" does.
+size_t format_digits(char* buf, const char* digits, int len, int k) {
+  // the position of the decimal point
+  const int point = len + k;
+  char* p = buf;
+  if (point > 0 && point <= 17) {
+    if (point >= len) {
+      // 1234000
+      memcpy(p, digits, len);
+      p += len;
+      memset(p, '0', point - len);
+      p += point - len;
+    } else {
+      // 1234.5678
+      memcpy(p, digits, point);
+      p += point;
+      *p++ = '.';
+      memcpy(p, digits + point, len - point);
+      p += len - point;
+    }
+  } else if (point <= 0 && point > -4) {
+    // 0.0001234
+    *p++ = '0';
+    *p++ = '.';
+    memset(p, '0', -point);
+    p += -point;
+    memcpy(p, digits, len);
+    p += len;
+  } else {
+    // 1.234e+30, 1e-07
+    *p++ = digits[0];
+    if (len > 1) {
+      *p++ = '.';
+      memcpy(p, digits + 1, len - 1);
+      p += len - 1;
+    }
+    int exponent = point - 1;
+    *p++ = 'e';
+    *p++ = exponent < 0 ? '-' : '+';
+    if (exponent < 0) {
+      exponent = -exponent;
+    }
+    if (exponent < 10) {
+      *p++ = '0';
+    }
+    char tmp[8];
+    char* end = tmp + sizeof(tmp);
+    char* first = unsigned_to_string_backward(end, static_cast<uint64_t>(exponent));
+    memcpy(p, first, end - first);
+    p += end - first;
+  }
+  *p = '\0';
+  return static_cast<size_t>(p - buf);
+}
+
+}  // namespace
+
+size_t double_to_string(char buf[], double value) {
+  if (isnan(value)) {
+    memcpy(buf, "nan", 4);
+    return 3;
+  }
+  char* p = buf;
+  if (signbit(value)) {
+    *p++ = '-';
+    value = -value;
+  }
+  if (isinf(value)) {
+    memcpy(p, "inf", 4);
+    return static_cast<size_t>(p - buf) + 3;
+  }
+  if (value == 0) {
+    memcpy(p, "0", 2);
+    return static_cast<size_t>(p - buf) + 1;
+  }
+  char digits[24];
+  int len = 0;
+  int k = 0;
+  grisu2(value, digits, &len, &k);
+  return static_cast<size_t>(p - buf) + format_digits(p, digits, len, k);
+}
+
+}  // namespace flute
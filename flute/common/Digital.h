@@ -1,54 +1,108 @@
 #ifndef FLUTE_COMMON_DIGITAL_H
 #define FLUTE_COMMON_DIGITAL_H
 
-#include <algorithm>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
 
-namespace flute {
+#include <type_traits>
 
-const char digits[] = "9876543210123456789";
-const char* zero = digits + 9;
-static_assert(sizeof(digits) == 20, "wrong number of digits");
+namespace flute {
 
 const char digits_hex[] = "0123456789ABCDEF";
 static_assert(sizeof(digits_hex) == 17, "wrong number of digitsHex");
 
-// Efficient Integer to String Conversions, by Matthew Wilson.
-template <typename T>
-size_t integer_to_string(char buf[], T value) {
-  T i = value;
-  char* p = buf;
+// "00" to "99", two digits are converted at a time.
+const char digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+static_assert(sizeof(digit_pairs) == 201, "wrong number of digit pairs");
 
-  do {
-    int lsd = static_cast<int>(i % 10);
-    i /= 10;
-    *p++ = zero[lsd];
-  } while (i != 0);
+// Write the decimal digits of value backwards, ending before end. Return the
+// first digit.
+inline char* unsigned_to_string_backward(char* end, uint64_t value) {
+  char* p = end;
+  while (value >= 100) {
+    const char* pair = digit_pairs + (value % 100) * 2;
+    value /= 100;
+    *--p = pair[1];
+    *--p = pair[0];
+  }
+  if (value < 10) {
+    *--p = static_cast<char>('0' + value);
+  } else {
+    const char* pair = digit_pairs + value * 2;
+    *--p = pair[1];
+    *--p = pair[0];
+  }
+  return p;
+}
 
+// Integer to string, returns the length without the ending '\0'.
+template <typename T>
+size_t integer_to_string(char buf[], T value) {
+  static_assert(std::is_integral<T>::value, "must be integral type");
+  typedef typename std::make_unsigned<T>::type U;
+  // the magnitude of the most negative value overflows T, but not U
+  U magnitude = value < 0 ? static_cast<U>(U(0) - static_cast<U>(value))
+                          : static_cast<U>(value);
+  char tmp[24];
+  char* end = tmp + sizeof(tmp);
+  char* p = unsigned_to_string_backward(end, magnitude);
   if (value < 0) {
-    *p++ = '-';
+    *--p = '-';
   }
-  *p = '\0';
-  std::reverse(buf, p);
-
-  return p - buf;
+  size_t len = static_cast<size_t>(end - p);
+  memcpy(buf, p, len);
+  buf[len] = '\0';
+  return len;
 }
 
-size_t hex_to_string(char buf[], uintptr_t value) {
-  uintptr_t i = value;
-  char* p = buf;
+// Write exactly width digits of value, padded with '0', without the ending
+// '\0'. value must be less than 10^width.
+inline void fixed_width_to_string(char buf[], uint32_t value, int width) {
+  char* p = buf + width;
+  while (p - buf >= 2) {
+    const char* pair = digit_pairs + (value % 100) * 2;
+    value /= 100;
+    *--p = pair[1];
+    *--p = pair[0];
+  }
+  if (p > buf) {
+    *--p = static_cast<char>('0' + value % 10);
+  }
+}
 
+inline size_t hex_to_string(char buf[], uintptr_t value) {
+  char tmp[2 * sizeof(uintptr_t)];
+  char* end = tmp + sizeof(tmp);
+  char* p = end;
   do {
-    int lsd = static_cast<int>(i % 16);
-    i /= 16;
-    *p++ = digits_hex[lsd];
-  } while (i != 0);
+    *--p = digits_hex[value % 16];
+    value /= 16;
+  } while (value != 0);
+  size_t len = static_cast<size_t>(end - p);
+  memcpy(buf, p, len);
+  buf[len] = '\0';
+  return len;
+}
 
-  *p = '\0';
-  std::reverse(buf, p);
+// The most characters double_to_string() writes, with the ending '\0'.
+const int kMaxDoubleStringSize = 32;
 
-  return p - buf;
-}
+// Write the shortest digits that read back to the same double, like "%g" with
+// the precision it needs: "0.1", "3.25", "1e+100". Returns the length without
+// the ending '\0'.
+size_t double_to_string(char buf[], double value);
 
 }  // namespace flute
 
-#endif  // FLUTE_COMMON_DIGITAL_H
\ No newline at end of file
+#endif  // FLUTE_COMMON_DIGITAL_H
@@ -1,23 +1,51 @@
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>  // IOV_MAX
 #include <flute/common/FileUtil.h>
 #include <flute/common/LogLine.h>  // strerror_tl
 #include <stdio.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <vector>
+
 namespace flute {
 
-FileUtil::AppendFile::AppendFile(StringArg filename)
+FileUtil::AppendFile::AppendFile(StringArg filename, off_t preallocate_bytes)
     : m_fp(::fopen(filename.c_str(), "ae")),  // 'e' for O_CLOEXEC
-      m_written_bytes(0) {
+      m_written_bytes(0),
+      m_preallocated(false) {
   assert(m_fp);
   ::setbuffer(m_fp, m_buffer, sizeof m_buffer);
   // posix_fadvise POSIX_FADV_DONTNEED ?
+  if (preallocate_bytes > 0) {
+    // Keep the size, so that O_APPEND writes still start at the end of data.
+    if (::fallocate(::fileno(m_fp), FALLOC_FL_KEEP_SIZE, 0,
+                    preallocate_bytes) == 0) {
+      m_preallocated = true;
+    } else {
+      fprintf(stderr, "AppendFile::AppendFile() fallocate failed %s\n",
+              strerror_tl(errno));
+      errno = 0;
+    }
+  }
 }
 
-FileUtil::AppendFile::~AppendFile() { ::fclose(m_fp); }
+FileUtil::AppendFile::~AppendFile() {
+  if (m_preallocated) {
+    // give back the reserved blocks past the end of data
+    ::fflush(m_fp);
+    struct stat stat_buf;
+    int fd = ::fileno(m_fp);
+    if (::fstat(fd, &stat_buf) == 0 && ::ftruncate(fd, stat_buf.st_size) != 0) {
+      fprintf(stderr, "AppendFile::~AppendFile() ftruncate failed %s\n",
+              strerror_tl(errno));
+    }
+  }
+  ::fclose(m_fp);
+}
 
 void FileUtil::AppendFile::append(const char* logline, const size_t len) {
   size_t n = write(logline, len);
@@ -38,6 +66,36 @@ void FileUtil::AppendFile::append(const char* logline, const size_t len) {
   m_written_bytes += len;
 }
 
+void FileUtil::AppendFile::append(const struct iovec* iov, int iovcnt) {
+  // keep the order with lines buffered by stdio
+  ::fflush(m_fp);
+  const int fd = ::fileno(m_fp);
+  // writev(2) may write partially, skip what has been written and go on.
+  std::vector<struct iovec> rest(iov, iov + iovcnt);
+  size_t first = 0;
+  while (first < rest.size()) {
+    int count = static_cast<int>(std::min<size_t>(rest.size() - first, IOV_MAX));
+    ssize_t n = ::writev(fd, &rest[first], count);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      fprintf(stderr, "AppendFile::append() failed %s\n", strerror_tl(errno));
+      break;
+    }
+    m_written_bytes += n;
+    size_t written = static_cast<size_t>(n);
+    while (first < rest.size() && written >= rest[first].iov_len) {
+      written -= rest[first].iov_len;
+      ++first;
+    }
+    if (written > 0) {
+      rest[first].iov_base = static_cast<char*>(rest[first].iov_base) + written;
+      rest[first].iov_len -= written;
+    }
+  }
+}
+
 void FileUtil::AppendFile::flush() { ::fflush(m_fp); }
 
 size_t FileUtil::AppendFile::write(const char* logline, size_t len) {
@@ -125,7 +183,7 @@ int FileUtil::ReadSmallFile::read_to_buffer(int* size) {
   return err;
 }
 
-template int FileUtil::readFile(StringArg filename, int maxSize,
+template int FileUtil::read_file(StringArg filename, int maxSize,
                                 string* content, int64_t*, int64_t*, int64_t*);
 
 template int FileUtil::ReadSmallFile::read_to_string(int maxSize,
@@ -11,6 +11,7 @@
 #include <flute/common/StringPiece.h>
 #include <flute/common/noncopyable.h>
 #include <sys/types.h>  // for off_t
+#include <sys/uio.h>    // for iovec
 
 namespace flute {
 namespace FileUtil {
@@ -53,12 +54,17 @@ int read_file(StringArg filename, int maxSize, String* content,
 // not thread safe
 class AppendFile : noncopyable {
  public:
-  explicit AppendFile(StringArg filename);
+  // Reserve preallocate_bytes of disk space if it is not zero, so appending
+  // does not allocate blocks. The unused space is released when closing.
+  explicit AppendFile(StringArg filename, off_t preallocate_bytes = 0);
 
   ~AppendFile();
 
   void append(const char* logline, size_t len);
 
+  // Write all the buffers with writev(2), bypassing the stdio buffer.
+  void append(const struct iovec* iov, int iovcnt);
+
   void flush();
 
   off_t written_bytes() const { return m_written_bytes; }
@@ -69,6 +75,7 @@ class AppendFile : noncopyable {
   FILE* m_fp;
   char m_buffer[64 * 1024];
   off_t m_written_bytes;
+  bool m_preallocated;
 };
 
 }  // namespace FileUtil
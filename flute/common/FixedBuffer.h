@@ -26,6 +26,7 @@ class FixedBuffer : noncopyable {
   }
 
   const char* data() const { return m_data; }
+  char* data() { return m_data; }
   int length() const { return static_cast<int>(m_cur - m_data); }
 
   char* cur_pos() { return m_cur; }
@@ -0,0 +1,32 @@
+#ifndef FLUTE_COMMON_FUTEX_H
+#define FLUTE_COMMON_FUTEX_H
+
+#include <linux/futex.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+
+namespace flute {
+
+// futex(2) on a 32-bit atomic word, private to the process.
+
+// Sleep while the word equals expected. Returns on a wakeup, on a signal, or
+// at once if the word has changed, so callers check their condition again.
+inline void futex_wait(std::atomic<uint32_t>* word, uint32_t expected) {
+  static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+                "futex word must be 32 bits");
+  ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT_PRIVATE,
+            expected, NULL, NULL, 0);
+}
+
+// Wake up at most count threads waiting on the word.
+inline void futex_wake(std::atomic<uint32_t>* word, int count) {
+  ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE_PRIVATE,
+            count, NULL, NULL, 0);
+}
+
+}  // namespace flute
+
+#endif  // FLUTE_COMMON_FUTEX_H
@@ -0,0 +1,181 @@
+#include <flute/common/HdrHistogram.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace flute {
+
+namespace {
+
+// The power of two range of index, 0 for the first two halves.
+int bucket_of_index(size_t index, int64_t* sub_bucket) {
+  int bucket =
+      static_cast<int>(index >> HdrHistogram::kSubBucketHalfCountMagnitude) - 1;
+  *sub_bucket = static_cast<int64_t>(index) %
+                    HdrHistogram::kSubBucketHalfCount +
+                HdrHistogram::kSubBucketHalfCount;
+  if (bucket < 0) {
+    *sub_bucket -= HdrHistogram::kSubBucketHalfCount;
+    bucket = 0;
+  }
+  return bucket;
+}
+
+}  // namespace
+
+const int HdrHistogram::kSubBucketHalfCountMagnitude;
+const int64_t HdrHistogram::kSubBucketHalfCount;
+const int HdrHistogram::kMaxValueBits;
+const int64_t HdrHistogram::kMaxValue;
+const size_t HdrHistogram::kNumCounts;
+
+HdrHistogram::HdrHistogram() : m_counts(kNumCounts, 0), m_total_count(0) {}
+
+size_t HdrHistogram::index_of(int64_t value) {
+  value = std::min(std::max(value, static_cast<int64_t>(0)), kMaxValue);
+  // the values below twice the half count are the first bucket, one by one
+  const uint64_t mask = 2 * kSubBucketHalfCount - 1;
+  int bucket = 64 - __builtin_clzll(static_cast<uint64_t>(value) | mask) -
+               (kSubBucketHalfCountMagnitude + 1);
+  int64_t sub_bucket = value >> bucket;
+  return static_cast<size_t>(
+      ((bucket + 1) << kSubBucketHalfCountMagnitude) +
+      (sub_bucket - kSubBucketHalfCount));
+}
+
+int64_t HdrHistogram::lowest_equivalent_value(size_t index) {
+  int64_t sub_bucket = 0;
+  int bucket = bucket_of_index(index, &sub_bucket);
+  return sub_bucket << bucket;
+}
+
+int64_t HdrHistogram::highest_equivalent_value(size_t index) {
+  int64_t sub_bucket = 0;
+  int bucket = bucket_of_index(index, &sub_bucket);
+  return (sub_bucket << bucket) + (static_cast<int64_t>(1) << bucket) - 1;
+}
+
+void HdrHistogram::record(int64_t value, int64_t count) {
+  m_counts[index_of(value)] += count;
+  m_total_count += count;
+}
+
+void HdrHistogram::record_corrected(int64_t value, int64_t expected_interval,
+                                    int64_t count) {
+  record(value, count);
+  if (expected_interval <= 0) {
+    return;
+  }
+  for (int64_t missed = value - expected_interval; missed >= expected_interval;
+       missed -= expected_interval) {
+    record(missed, count);
+  }
+}
+
+HdrHistogram HdrHistogram::corrected(int64_t expected_interval) const {
+  HdrHistogram copy;
+  for (size_t i = 0; i < kNumCounts; ++i) {
+    if (m_counts[i] != 0) {
+      copy.record_corrected(highest_equivalent_value(i), expected_interval,
+                            m_counts[i]);
+    }
+  }
+  return copy;
+}
+
+void HdrHistogram::add(const HdrHistogram& other) {
+  for (size_t i = 0; i < kNumCounts; ++i) {
+    m_counts[i] += other.m_counts[i];
+  }
+  m_total_count += other.m_total_count;
+}
+
+void HdrHistogram::reset() {
+  std::fill(m_counts.begin(), m_counts.end(), 0);
+  m_total_count = 0;
+}
+
+int64_t HdrHistogram::value_at_percentile(double percentile) const {
+  if (m_total_count == 0) {
+    return 0;
+  }
+  percentile = std::min(std::max(percentile, 0.0), 100.0);
+  int64_t wanted = static_cast<int64_t>(
+      std::ceil(percentile / 100.0 * static_cast<double>(m_total_count)));
+  wanted = std::max(wanted, static_cast<int64_t>(1));
+  int64_t cumulative = 0;
+  for (size_t i = 0; i < kNumCounts; ++i) {
+    cumulative += m_counts[i];
+    if (cumulative >= wanted) {
+      return highest_equivalent_value(i);
+    }
+  }
+  return kMaxValue;
+}
+
+// Written by the threads of one shard only, mostly. Padded as
+// Histogram::Shard.
+struct LatencyHistogram::Shard {
+  Shard() : counts(HdrHistogram::kNumCounts), sum(0) {}
+
+  char pad0[detail::kMetricCacheLineSize];
+  detail::MetricCounts counts;
+  std::atomic<int64_t> sum;
+  char pad1[detail::kMetricCacheLineSize];
+};
+
+LatencyHistogram::LatencyHistogram() {
+  for (std::atomic<Shard*>& shard : m_shards) {
+    shard.store(NULL, std::memory_order_relaxed);
+  }
+}
+
+LatencyHistogram::~LatencyHistogram() {
+  for (std::atomic<Shard*>& shard : m_shards) {
+    delete shard.load(std::memory_order_relaxed);
+  }
+}
+
+LatencyHistogram::Shard* LatencyHistogram::shard_of_this_thread() {
+  std::atomic<Shard*>& slot = m_shards[detail::metric_shard()];
+  Shard* shard = slot.load(std::memory_order_acquire);
+  if (LIKELY_FALSE(shard == NULL)) {
+    // another thread of the shard may get there first
+    Shard* fresh = new Shard;
+    if (slot.compare_exchange_strong(shard, fresh, std::memory_order_acq_rel)) {
+      shard = fresh;
+    } else {
+      delete fresh;
+    }
+  }
+  return shard;
+}
+
+void LatencyHistogram::record(int64_t micro_seconds) {
+  micro_seconds = std::max(micro_seconds, static_cast<int64_t>(0));
+  Shard* shard = shard_of_this_thread();
+  shard->counts[HdrHistogram::index_of(micro_seconds)].fetch_add(
+      1, std::memory_order_relaxed);
+  shard->sum.fetch_add(micro_seconds, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::snapshot(HdrHistogram* merged,
+                                int64_t* sum_micro_seconds) const {
+  merged->reset();
+  *sum_micro_seconds = 0;
+  for (const std::atomic<Shard*>& slot : m_shards) {
+    const Shard* shard = slot.load(std::memory_order_acquire);
+    if (shard == NULL) {
+      continue;
+    }
+    for (size_t i = 0; i < HdrHistogram::kNumCounts; ++i) {
+      int64_t count = shard->counts[i].load(std::memory_order_relaxed);
+      if (count != 0) {
+        merged->record(HdrHistogram::lowest_equivalent_value(i), count);
+      }
+    }
+    *sum_micro_seconds += shard->sum.load(std::memory_order_relaxed);
+  }
+}
+
+}  // namespace flute
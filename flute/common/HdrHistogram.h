@@ -0,0 +1,88 @@
+#ifndef FLUTE_COMMON_HDRHISTOGRAM_H
+#define FLUTE_COMMON_HDRHISTOGRAM_H
+
+#include <flute/common/Metrics.h>
+#include <flute/common/Timestamp.h>
+#include <flute/common/noncopyable.h>
+
+#include <stdint.h>
+
+#include <atomic>
+#include <vector>
+
+namespace flute {
+
+///
+/// Counts of integer values in log-linear buckets, after HdrHistogram.
+///
+/// Each power of two range is cut into 128 equal sub-buckets, so a value is
+/// known within 1/128 of itself whatever its magnitude. Values above
+/// kMaxValue count as kMaxValue. Not thread safe, see LatencyHistogram.
+class HdrHistogram {
+ public:
+  static const int kSubBucketHalfCountMagnitude = 7;
+  static const int64_t kSubBucketHalfCount = 1 << kSubBucketHalfCountMagnitude;
+  static const int kMaxValueBits = 32;
+  static const int64_t kMaxValue = (static_cast<int64_t>(1) << kMaxValueBits) - 1;
+  static const size_t kNumCounts =
+      (kMaxValueBits - kSubBucketHalfCountMagnitude + 1) * kSubBucketHalfCount;
+
+  HdrHistogram();
+
+  void record(int64_t value, int64_t count = 1);
+  /// Also records value - expected_interval, value - 2 * expected_interval
+  /// and so on down to expected_interval: what the requests a stalled client
+  /// did not send meanwhile would have waited. This corrects coordinated
+  /// omission, as of a closed loop.
+  void record_corrected(int64_t value, int64_t expected_interval,
+                        int64_t count = 1);
+  /// A copy with every value recorded again by record_corrected().
+  HdrHistogram corrected(int64_t expected_interval) const;
+  void add(const HdrHistogram& other);
+  void reset();
+
+  int64_t total_count() const { return m_total_count; }
+  int64_t count_at_index(size_t index) const { return m_counts[index]; }
+  /// The highest value equivalent to the one at percentile, 0 to 100, of the
+  /// recorded values. 0 if nothing was recorded.
+  int64_t value_at_percentile(double percentile) const;
+
+  static size_t index_of(int64_t value);
+  static int64_t lowest_equivalent_value(size_t index);
+  static int64_t highest_equivalent_value(size_t index);
+
+ private:
+  std::vector<int64_t> m_counts;
+  int64_t m_total_count;
+};
+
+///
+/// An HdrHistogram of durations in microseconds, recorded by many threads.
+///
+/// record() is a relaxed atomic add to the counts of the shard of the calling
+/// thread, allocated on its first record. snapshot() merges the shards while
+/// they are recorded into. Neither takes a lock.
+class LatencyHistogram : noncopyable {
+ public:
+  LatencyHistogram();
+  ~LatencyHistogram();
+
+  void record(int64_t micro_seconds);
+  void record_between(Timestamp start, Timestamp end) {
+    record(end.micro_seconds_since_epoch() - start.micro_seconds_since_epoch());
+  }
+
+  /// The merged counts and the sum of the recorded durations.
+  void snapshot(HdrHistogram* merged, int64_t* sum_micro_seconds) const;
+
+ private:
+  struct Shard;
+
+  Shard* shard_of_this_thread();
+
+  std::atomic<Shard*> m_shards[detail::kMetricShards];
+};
+
+}  // namespace flute
+
+#endif  // FLUTE_COMMON_HDRHISTOGRAM_H
@@ -0,0 +1,343 @@
+#include <flute/common/LogArchiver.h>
+#include <flute/common/CurrentThread.h>
+#include <flute/common/FileUtil.h>
+#include <flute/common/LogLine.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#ifdef FLUTE_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef FLUTE_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace flute {
+
+namespace {
+
+const size_t kChunkSize = 64 * 1024;
+
+// ioprio_set(2) has no glibc wrapper.
+const int kIoprioWhoProcess = 1;
+const int kIoprioClassIdle = 3;
+const int kIoprioClassShift = 13;
+
+bool ends_with(const string& str, const char* suffix) {
+  size_t len = strlen(suffix);
+  return str.size() >= len && str.compare(str.size() - len, len, suffix) == 0;
+}
+
+const char* extension(LogArchiver::Compression compression) {
+  switch (compression) {
+    case LogArchiver::kGzip:
+      return ".gz";
+    case LogArchiver::kZstd:
+      return ".zst";
+    default:
+      return "";
+  }
+}
+
+// Read the file chunk by chunk, return false on error.
+template <typename Func>
+bool for_each_chunk(int fd, Func func) {
+  std::vector<char> buf(kChunkSize);
+  while (true) {
+    ssize_t n = ::read(fd, buf.data(), buf.size());
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    if (n == 0 || !func(buf.data(), static_cast<size_t>(n))) {
+      return n == 0;
+    }
+  }
+}
+
+#ifdef FLUTE_HAVE_ZLIB
+bool gzip_file(int fd, const string& target) {
+  gzFile out = ::gzopen(target.c_str(), "wb6");
+  if (out == NULL) {
+    return false;
+  }
+  bool ok = for_each_chunk(fd, [out](const char* data, size_t len) {
+    return ::gzwrite(out, data, static_cast<unsigned>(len)) ==
+           static_cast<int>(len);
+  });
+  return ::gzclose(out) == Z_OK && ok;
+}
+#endif
+
+#ifdef FLUTE_HAVE_ZSTD
+bool zstd_file(int fd, const string& target) {
+  FILE* out = ::fopen(target.c_str(), "we");
+  if (out == NULL) {
+    return false;
+  }
+  ZSTD_CCtx* cctx = ::ZSTD_createCCtx();
+  ::ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, 3);
+  std::vector<char> out_buf(::ZSTD_CStreamOutSize());
+  auto compress_chunk = [&](const char* data, size_t len,
+                            ZSTD_EndDirective mode) {
+    ZSTD_inBuffer input = {data, len, 0};
+    bool done = false;
+    while (!done) {
+      ZSTD_outBuffer output = {out_buf.data(), out_buf.size(), 0};
+      size_t remaining = ::ZSTD_compressStream2(cctx, &output, &input, mode);
+      if (::ZSTD_isError(remaining) ||
+          ::fwrite(out_buf.data(), 1, output.pos, out) != output.pos) {
+        return false;
+      }
+      done = mode == ZSTD_e_end ? remaining == 0 : input.pos == input.size;
+    }
+    return true;
+  };
+  bool ok = for_each_chunk(fd, [&](const char* data, size_t len) {
+    return compress_chunk(data, len, ZSTD_e_continue);
+  });
+  ok = ok && compress_chunk(NULL, 0, ZSTD_e_end);
+  ::ZSTD_freeCCtx(cctx);
+  return ::fclose(out) == 0 && ok;
+}
+#endif
+
+bool compress_file(int fd, const string& target,
+                   LogArchiver::Compression compression) {
+  switch (compression) {
+#ifdef FLUTE_HAVE_ZLIB
+    case LogArchiver::kGzip:
+      return gzip_file(fd, target);
+#endif
+#ifdef FLUTE_HAVE_ZSTD
+    case LogArchiver::kZstd:
+      return zstd_file(fd, target);
+#endif
+    default:
+      return false;
+  }
+}
+
+struct LogFileEntry {
+  string name;
+  off_t size;
+
+  // newest first, the names start with the time
+  bool operator<(const LogFileEntry& rhs) const { return name > rhs.name; }
+};
+
+}  // namespace
+
+bool LogArchiver::is_supported(Compression compression) {
+  switch (compression) {
+    case kNoCompression:
+      return true;
+#ifdef FLUTE_HAVE_ZLIB
+    case kGzip:
+      return true;
+#endif
+#ifdef FLUTE_HAVE_ZSTD
+    case kZstd:
+      return true;
+#endif
+    default:
+      return false;
+  }
+}
+
+LogArchiver::LogArchiver(const string& basename)
+    : m_basename(basename),
+      m_mutex(),
+      m_cond(m_mutex),
+      m_idle(m_mutex),
+      m_busy(false),
+      m_running(true),
+      m_compression(kNoCompression),
+      m_max_files(0),
+      m_max_bytes(0),
+      m_thread(std::bind(&LogArchiver::thread_func, this), "LogArchiver") {
+  m_thread.start();
+}
+
+LogArchiver::~LogArchiver() {
+  {
+    MutexLockGuard lock(m_mutex);
+    m_running = false;
+    m_cond.notify();
+  }
+  m_thread.join();
+}
+
+void LogArchiver::set_compression(Compression compression) {
+  if (!is_supported(compression)) {
+    fprintf(stderr, "LogArchiver: compression %d is not built in\n",
+            static_cast<int>(compression));
+  }
+  MutexLockGuard lock(m_mutex);
+  m_compression = compression;
+}
+
+void LogArchiver::set_retention(int max_files, off_t max_bytes) {
+  MutexLockGuard lock(m_mutex);
+  m_max_files = max_files;
+  m_max_bytes = max_bytes;
+}
+
+void LogArchiver::retire(std::unique_ptr<FileUtil::AppendFile> file,
+                         const string& filename,
+                         const string& active_filename) {
+  Job job;
+  job.file = std::move(file);
+  job.filename = filename;
+  MutexLockGuard lock(m_mutex);
+  m_jobs.push_back(std::move(job));
+  m_active_filename = active_filename;
+  m_cond.notify();
+}
+
+void LogArchiver::wait_for_idle() {
+  MutexLockGuard lock(m_mutex);
+  while (!m_jobs.empty() || m_busy) {
+    m_idle.wait();
+  }
+}
+
+void LogArchiver::thread_func() {
+  // Best effort, the thread should only use the idle CPU and disk.
+  pid_t tid = CurrentThread::tid();
+  ::setpriority(PRIO_PROCESS, static_cast<id_t>(tid), 19);
+  ::syscall(SYS_ioprio_set, kIoprioWhoProcess, tid,
+            kIoprioClassIdle << kIoprioClassShift);
+
+  while (true) {
+    Job job;
+    Compression compression;
+    int max_files;
+    off_t max_bytes;
+    string active_filename;
+    {
+      MutexLockGuard lock(m_mutex);
+      while (m_jobs.empty() && m_running) {
+        m_cond.wait();
+      }
+      // finish the queue before exiting
+      if (m_jobs.empty()) {
+        break;
+      }
+      job = std::move(m_jobs.front());
+      m_jobs.pop_front();
+      m_busy = true;
+      compression = m_compression;
+      max_files = m_max_files;
+      max_bytes = m_max_bytes;
+    }
+
+    // flushes and closes the file
+    job.file.reset();
+    if (compression != kNoCompression && is_supported(compression)) {
+      compress(job.filename, compression);
+    }
+    if (max_files > 0 || max_bytes > 0) {
+      {
+        // the file may have rolled again since the job was queued
+        MutexLockGuard lock(m_mutex);
+        active_filename = m_active_filename;
+      }
+      prune(active_filename, max_files, max_bytes);
+    }
+
+    {
+      MutexLockGuard lock(m_mutex);
+      m_busy = false;
+      if (m_jobs.empty()) {
+        m_idle.notify_all();
+      }
+    }
+  }
+}
+
+void LogArchiver::compress(const string& filename, Compression compression) {
+  int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    // removed by retention already
+    return;
+  }
+  struct stat st;
+  bool ok = ::fstat(fd, &st) == 0;
+  const string target = filename + extension(compression);
+  // a crash leaves a .tmp, never a truncated archive
+  const string temp = target + ".tmp";
+  ok = ok && compress_file(fd, temp, compression);
+  ::close(fd);
+  if (ok) {
+    struct timespec times[2] = {st.st_atim, st.st_mtim};
+    ::utimensat(AT_FDCWD, temp.c_str(), times, 0);
+    ok = ::rename(temp.c_str(), target.c_str()) == 0;
+  }
+  if (ok) {
+    ::unlink(filename.c_str());
+  } else {
+    fprintf(stderr, "LogArchiver: failed to compress %s: %s\n",
+            filename.c_str(), strerror_tl(errno));
+    ::unlink(temp.c_str());
+  }
+}
+
+void LogArchiver::prune(const string& active_filename, int max_files,
+                        off_t max_bytes) {
+  DIR* dir = ::opendir(".");
+  if (dir == NULL) {
+    return;
+  }
+  const string prefix = m_basename + ".";
+  std::vector<LogFileEntry> entries;
+  off_t active_size = 0;
+  while (struct dirent* ent = ::readdir(dir)) {
+    string name = ent->d_name;
+    if (name.compare(0, prefix.size(), prefix) != 0 ||
+        !(ends_with(name, ".log") || ends_with(name, ".log.gz") ||
+          ends_with(name, ".log.zst"))) {
+      continue;
+    }
+    struct stat st;
+    if (::stat(name.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+      continue;
+    }
+    if (name == active_filename) {
+      active_size = st.st_size;
+      continue;
+    }
+    entries.push_back({name, st.st_size});
+  }
+  ::closedir(dir);
+
+  std::sort(entries.begin(), entries.end());
+  int files = 1;
+  off_t bytes = active_size;
+  bool full = false;
+  for (const auto& entry : entries) {
+    ++files;
+    bytes += entry.size;
+    // the older files go with the first one over a limit
+    full = full || (max_files > 0 && files > max_files) ||
+           (max_bytes > 0 && bytes > max_bytes);
+    if (full) {
+      ::unlink(entry.name.c_str());
+    }
+  }
+}
+
+}  // namespace flute
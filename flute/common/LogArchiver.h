@@ -0,0 +1,83 @@
+#ifndef FLUTE_COMMON_LOGARCHIVER_H
+#define FLUTE_COMMON_LOGARCHIVER_H
+
+#include <flute/common/Condition.h>
+#include <flute/common/Mutex.h>
+#include <flute/common/Thread.h>
+#include <flute/common/types.h>
+
+#include <sys/types.h>
+
+#include <deque>
+#include <memory>
+
+namespace flute {
+
+namespace FileUtil {
+class AppendFile;
+}
+
+///
+/// The rolled files of a LogFile are closed, compressed and pruned here, on a
+/// thread of the lowest CPU and I/O priority, so that a roll only costs the
+/// writer the creation of the new file.
+///
+/// The files of the basename are "basename.*.log", with ".gz" or ".zst" once
+/// compressed. Retention keeps the newest ones, by the time in the names,
+/// within both limits. The file being written counts but is never removed.
+class LogArchiver : noncopyable {
+ public:
+  enum Compression {
+    kNoCompression,
+    kGzip,
+    kZstd,
+  };
+
+  // false if the library was not found at build time
+  static bool is_supported(Compression compression);
+
+  explicit LogArchiver(const string& basename);
+  // Finishes the queued files.
+  ~LogArchiver();
+
+  // Settings, thread safe. An unsupported compression leaves files as is.
+  void set_compression(Compression compression);
+  // 0 for no limit
+  void set_retention(int max_files, off_t max_bytes);
+
+  // Close the rolled file, then compress and prune in the background.
+  void retire(std::unique_ptr<FileUtil::AppendFile> file,
+              const string& filename, const string& active_filename);
+
+  // Wait until the queued files are done.
+  void wait_for_idle();
+
+ private:
+  struct Job {
+    std::unique_ptr<FileUtil::AppendFile> file;
+    string filename;
+  };
+
+  void thread_func();
+  void compress(const string& filename, Compression compression);
+  void prune(const string& active_filename, int max_files, off_t max_bytes);
+
+  const string m_basename;
+  MutexLock m_mutex;
+  Condition m_cond GUARDED_BY(m_mutex);
+  // signaled when the queue is done
+  Condition m_idle GUARDED_BY(m_mutex);
+  std::deque<Job> m_jobs GUARDED_BY(m_mutex);
+  // the file being written, never removed
+  string m_active_filename GUARDED_BY(m_mutex);
+  bool m_busy GUARDED_BY(m_mutex);
+  bool m_running GUARDED_BY(m_mutex);
+  Compression m_compression GUARDED_BY(m_mutex);
+  int m_max_files GUARDED_BY(m_mutex);
+  off_t m_max_bytes GUARDED_BY(m_mutex);
+  Thread m_thread;
+};
+
+}  // namespace flute
+
+#endif  // FLUTE_COMMON_LOGARCHIVER_H
@@ -8,21 +8,27 @@
 namespace flute {
 
 LogFile::LogFile(const string& basename, off_t rollSize, bool threadSafe,
-                 int flushInterval, int checkEveryN)
+                 int flushInterval, int checkEveryN, bool preallocate)
     : m_basename(basename),
       m_rollsize(rollSize),
       m_flush_interval(flushInterval),
       m_check_every_n_appends(checkEveryN),
+      m_preallocate(preallocate),
       m_count(0),
       m_mutex(threadSafe ? new MutexLock : NULL),
       m_start_time(0),
       m_last_roll(0),
-      m_last_flush(0) {
+      m_last_flush(0),
+      m_roll_sequence(0) {
   assert(basename.find('/') == string::npos);
   roll_file();
 }
 
-LogFile::~LogFile() = default;
+LogFile::~LogFile() {
+  // close the file being written, then finish the rolled ones
+  m_file.reset();
+  m_archiver.reset();
+}
 
 void LogFile::append(const char* logline, int len) {
   if (m_mutex) {
@@ -33,6 +39,15 @@ void LogFile::append(const char* logline, int len) {
   }
 }
 
+void LogFile::append(const struct iovec* iov, int iovcnt) {
+  if (m_mutex) {
+    MutexLockGuard lock(*m_mutex);
+    append_unlocked(iov, iovcnt);
+  } else {
+    append_unlocked(iov, iovcnt);
+  }
+}
+
 void LogFile::flush() {
   if (m_mutex) {
     MutexLockGuard lock(*m_mutex);
@@ -51,44 +66,95 @@ void LogFile::append_unlocked(const char* logline, int len) {
     ++m_count;
     if (m_count >= m_check_every_n_appends) {
       m_count = 0;
-      time_t now = ::time(NULL);
-      time_t cur_period = now / kRollPerSeconds * kRollPerSeconds;
-      if (cur_period != m_start_time) {
-        roll_file();
-      } else if (now - m_last_flush > m_flush_interval) {
-        m_last_flush = now;
-        m_file->flush();
-      }
+      roll_or_flush_if_due();
     }
   }
 }
 
-bool LogFile::roll_file() {
-  time_t now = 0;
-  string filename = get_log_file_name(m_basename, &now);
-  time_t start = now / kRollPerSeconds * kRollPerSeconds;
+void LogFile::append_unlocked(const struct iovec* iov, int iovcnt) {
+  m_file->append(iov, iovcnt);
 
-  if (now > m_last_roll) {
-    m_last_roll = now;
+  if (m_file->written_bytes() > m_rollsize) {
+    roll_file();
+  } else {
+    // a batch of many lines, check the time every time
+    m_count = 0;
+    roll_or_flush_if_due();
+  }
+}
+
+void LogFile::roll_or_flush_if_due() {
+  time_t now = ::time(NULL);
+  time_t cur_period = now / kRollPerSeconds * kRollPerSeconds;
+  if (cur_period != m_start_time) {
+    roll_file();
+  } else if (now - m_last_flush > m_flush_interval) {
     m_last_flush = now;
-    m_start_time = start;
-    m_file.reset(new FileUtil::AppendFile(filename));
-    return true;
+    m_file->flush();
   }
-  return false;
 }
 
-string LogFile::get_log_file_name(const string& basename, time_t* now) {
+bool LogFile::roll_file() {
+  time_t now = ::time(NULL);
+  if (now < m_last_roll) {
+    // the clock went back
+    return false;
+  }
+  // Rolling by size may happen many times a second at high log rates.
+  m_roll_sequence = now == m_last_roll ? m_roll_sequence + 1 : 0;
+  m_last_roll = now;
+  m_last_flush = now;
+  m_start_time = now / kRollPerSeconds * kRollPerSeconds;
+
+  string filename = get_log_file_name(m_basename, now, m_roll_sequence);
+  std::unique_ptr<FileUtil::AppendFile> file(
+      new FileUtil::AppendFile(filename, m_preallocate ? m_rollsize : 0));
+  file.swap(m_file);
+  m_filename.swap(filename);
+  if (file && m_archiver) {
+    // closing flushes the tail of the file, leave it to the archiver
+    m_archiver->retire(std::move(file), filename, m_filename);
+  }
+  return true;
+}
+
+void LogFile::set_compression(LogArchiver::Compression compression) {
+  archiver().set_compression(compression);
+}
+
+void LogFile::set_retention(int max_files, off_t max_bytes) {
+  archiver().set_retention(max_files, max_bytes);
+}
+
+void LogFile::wait_for_archiver() {
+  if (m_archiver) {
+    m_archiver->wait_for_idle();
+  }
+}
+
+LogArchiver& LogFile::archiver() {
+  if (!m_archiver) {
+    m_archiver.reset(new LogArchiver(m_basename));
+  }
+  return *m_archiver;
+}
+
+string LogFile::get_log_file_name(const string& basename, time_t now,
+                                  int sequence) {
   string filename;
   filename.reserve(basename.size() + 64);
   filename = basename;
 
   char timebuf[32];
   struct tm tm;
-  *now = time(NULL);
-  gmtime_r(now, &tm);  // FIXME: localtime_r ?
-  strftime(timebuf, sizeof timebuf, ".%Y%m%d-%H%M%S.", &tm);
+  gmtime_r(&now, &tm);  // FIXME: localtime_r ?
+  size_t len = strftime(timebuf, sizeof timebuf, ".%Y%m%d-%H%M%S", &tm);
+  if (sequence > 0) {
+    // sorts after the first file of the second
+    snprintf(timebuf + len, sizeof timebuf - len, "_%04d", sequence);
+  }
   filename += timebuf;
+  filename += '.';
 
   filename += ProcessInfo::hostname();
 
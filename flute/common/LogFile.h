@@ -6,9 +6,12 @@
 #ifndef FLUTE_COMMON_LOGFILE_H
 #define FLUTE_COMMON_LOGFILE_H
 
+#include <flute/common/LogArchiver.h>
 #include <flute/common/Mutex.h>
 #include <flute/common/types.h>
 
+#include <sys/uio.h>
+
 #include <memory>
 
 namespace flute {
@@ -19,23 +22,43 @@ class AppendFile;
 
 class LogFile : noncopyable {
  public:
+  // With preallocate, every log file reserves rollSize bytes of disk space up
+  // front, so appending never waits for block allocation.
   LogFile(const string& basename, off_t rollSize, bool threadSafe = true,
-          int flushInterval = 3, int checkEveryN = 1024);
+          int flushInterval = 3, int checkEveryN = 1024,
+          bool preallocate = false);
   ~LogFile();
 
   void append(const char* logline, int len);
+  // Append many buffers with one system call.
+  void append(const struct iovec* iov, int iovcnt);
   void flush();
   bool roll_file();
 
+  // Compress the rolled files and keep at most max_files of them in
+  // max_bytes, 0 for no limit. Either starts a LogArchiver, which closes the
+  // rolled files in the background as well. Not thread safe, call them
+  // before appending.
+  void set_compression(LogArchiver::Compression compression);
+  void set_retention(int max_files, off_t max_bytes);
+  // Wait until the rolled files are archived.
+  void wait_for_archiver();
+
  private:
   void append_unlocked(const char* logline, int len);
+  void append_unlocked(const struct iovec* iov, int iovcnt);
+  void roll_or_flush_if_due();
+
+  LogArchiver& archiver();
 
-  static string get_log_file_name(const string& basename, time_t* now);
+  static string get_log_file_name(const string& basename, time_t now,
+                                  int sequence);
 
   const string m_basename;
   const off_t m_rollsize;
   const int m_flush_interval;
   const int m_check_every_n_appends;
+  const bool m_preallocate;
 
   int m_count;
 
@@ -43,7 +66,11 @@ class LogFile : noncopyable {
   time_t m_start_time;
   time_t m_last_roll;
   time_t m_last_flush;
+  // rolls in the same second as the last one
+  int m_roll_sequence;
+  string m_filename;
   std::unique_ptr<FileUtil::AppendFile> m_file;
+  std::unique_ptr<LogArchiver> m_archiver;
 
   static const int kRollPerSeconds = 60 * 60 * 24;
 };
@@ -0,0 +1,46 @@
+#include <flute/common/LogLimiter.h>
+#include <flute/common/Timestamp.h>
+
+namespace flute {
+
+namespace {
+
+std::atomic<int64_t> g_suppressed_log_lines(0);
+
+}  // namespace
+
+int64_t suppressed_log_lines() { return g_suppressed_log_lines.load(); }
+
+namespace detail {
+
+void count_suppressed_log_line() {
+  g_suppressed_log_lines.fetch_add(1, std::memory_order_relaxed);
+}
+
+int64_t LogTokenBucket::admit(double lines_per_second) {
+  if (lines_per_second <= 0) {
+    return reject();
+  }
+  const int64_t interval = static_cast<int64_t>(
+      static_cast<double>(Timestamp::kMicroSecondsPerSecond) /
+      lines_per_second);
+  // a full bucket holds one second of lines
+  const int64_t tolerance = Timestamp::kMicroSecondsPerSecond;
+  const int64_t now = Timestamp::now().micro_seconds_since_epoch();
+  int64_t arrival_time = m_theoretical_arrival_time.load();
+  while (true) {
+    int64_t next_arrival_time =
+        (arrival_time > now ? arrival_time : now) + interval;
+    if (next_arrival_time - now > tolerance) {
+      // the bucket is empty
+      return reject();
+    }
+    if (m_theoretical_arrival_time.compare_exchange_weak(arrival_time,
+                                                         next_arrival_time)) {
+      return accept();
+    }
+  }
+}
+
+}  // namespace detail
+}  // namespace flute
@@ -0,0 +1,92 @@
+#ifndef FLUTE_COMMON_LOGLIMITER_H
+#define FLUTE_COMMON_LOGLIMITER_H
+
+#include <flute/common/noncopyable.h>
+
+#include <stdint.h>
+
+#include <atomic>
+
+namespace flute {
+
+// number of lines suppressed by LOG_EVERY_N, LOG_FIRST_N and LOG_RATE_LIMITED
+int64_t suppressed_log_lines();
+
+// Written at the front of a line following suppressed ones.
+struct LogSuppressed {
+  explicit LogSuppressed(int64_t n) : count(n) {}
+  int64_t count;
+};
+
+namespace detail {
+
+void count_suppressed_log_line();
+
+///
+/// The limiters of a call site, one static object per LOG_* statement.
+///
+/// admit() returns 0 to suppress the line, or one plus the number of lines
+/// suppressed since the last admitted one. Thread safe and lock free.
+///
+class LogLimiter : noncopyable {
+ protected:
+  LogLimiter() : m_suppressed(0) {}
+
+  int64_t accept() { return m_suppressed.exchange(0) + 1; }
+  int64_t reject() {
+    ++m_suppressed;
+    count_suppressed_log_line();
+    return 0;
+  }
+
+ private:
+  std::atomic<int64_t> m_suppressed;
+};
+
+// the 1st, (n+1)th, (2n+1)th... lines
+class LogEveryN : public LogLimiter {
+ public:
+  LogEveryN() : m_count(0) {}
+  int64_t admit(int64_t n) {
+    int64_t count = m_count++;
+    return n <= 1 || count % n == 0 ? accept() : reject();
+  }
+
+ private:
+  std::atomic<int64_t> m_count;
+};
+
+// the first n lines
+class LogFirstN : public LogLimiter {
+ public:
+  LogFirstN() : m_count(0) {}
+  int64_t admit(int64_t n) { return m_count++ < n ? accept() : reject(); }
+
+ private:
+  std::atomic<int64_t> m_count;
+};
+
+// A token bucket of lines_per_second tokens per second, holding one second of
+// tokens at most.
+class LogTokenBucket : public LogLimiter {
+ public:
+  LogTokenBucket() : m_theoretical_arrival_time(0) {}
+  int64_t admit(double lines_per_second);
+
+ private:
+  // The bucket is kept as the generic cell rate algorithm: the time when the
+  // bucket would be full again, in microseconds.
+  std::atomic<int64_t> m_theoretical_arrival_time;
+};
+
+}  // namespace detail
+}  // namespace flute
+
+// admit() of the static limiter of the call site
+#define FLUTE_LOG_LIMIT(limiter, ...)  \
+  []() -> limiter& {                   \
+    static limiter call_site_limiter;  \
+    return call_site_limiter;          \
+  }().admit(__VA_ARGS__)
+
+#endif  // FLUTE_COMMON_LOGLIMITER_H
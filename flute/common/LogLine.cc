@@ -1,4 +1,5 @@
 #include <errno.h>
+#include <flute/common/Digital.h>
 #include <flute/common/LogLine.h>
 #include <flute/common/Timestamp.h>
 #include <flute/common/Timezone.h>
@@ -25,20 +26,34 @@ LogLine::OutputFuncPtr LogLine::g_output = LogLine::default_output;
 LogLine::FlushFuncPtr LogLine::g_flush = LogLine::default_flush;
 // UTC+8 Beijing
 Timezone LogLine::g_log_timezone(8 * 3600, "CST");
+bool LogLine::g_binary = false;
+bool LogLine::g_has_used_binary = false;
 
 // Implementations of the inner Data class
 
 LogLine::Data::Data(LogLevel level, int old_errno, const BaseName& file,
-                    int line, const char* type)
+                    int line, const char* type, const char* func)
     : m_level{level},
       m_line{line},
       m_basename(file),
       m_log_stream(),
-      m_timestamp(Timestamp::now()) {
+      m_timestamp(Timestamp::now()),
+      m_type(type),
+      m_func(func),
+      m_site_id(0) {
+  if (g_binary) {
+    // leave room for the header, the rest is up to finish_binary()
+    m_log_stream.set_binary(true);
+    m_log_stream.m_buffer.cur_add(sizeof(BinaryLogHeader));
+    return;
+  }
   if (type != NULL) {
     m_log_stream << type;
   }
   log_time();
+  if (func != NULL) {
+    m_log_stream << func << ": ";
+  }
 }
 
 LogLine::LogLine(BaseName file, int line, const char* type)
@@ -47,9 +62,7 @@ LogLine::LogLine(BaseName file, int line, LogLevel level, const char* type)
     : m_data(level, 0, file, line, type) {}
 LogLine::LogLine(BaseName file, int line, LogLevel level, const char* func,
                  const char* type)
-    : m_data(level, 0, file, line, type) {
-  m_data.m_log_stream << func << ": ";
-}
+    : m_data(level, 0, file, line, type, func) {}
 LogLine::LogLine(BaseName file, int line, bool to_abort, const char* type)
     : m_data(to_abort ? FATAL : ERROR, errno, file, line, type) {}
 
@@ -61,6 +74,10 @@ inline LogStream& operator<<(LogStream& s, const BaseName& v) {
 }
 
 LogLine::~LogLine() {
+  if (m_data.m_log_stream.is_binary()) {
+    finish_binary();
+    return;
+  }
   if (errno != 0) {
     m_data.m_log_stream << " [ERRNO:" << errno << "]" << strerror_tl(errno)
                         << " ";
@@ -75,8 +92,35 @@ LogLine::~LogLine() {
   }
 }
 
-void LogLine::Data::log_time() {
-  int64_t micro_seconds_since_epoch = m_timestamp.micro_seconds_since_epoch();
+void LogLine::finish_binary() {
+  if (m_data.m_site_id == 0) {
+    // not from a LOG_* macro
+    m_data.m_site_id =
+        register_log_site(m_data.m_basename, m_data.m_line, m_data.m_level,
+                          m_data.m_type, m_data.m_func);
+  }
+  LogBuffer& buf(stream().m_buffer);
+  BinaryLogHeader header;
+  header.magic = kBinaryLogMagic;
+  header.length =
+      static_cast<uint16_t>(buf.length() - sizeof(BinaryLogHeader));
+  header.site_id = m_data.m_site_id;
+  header.micro_seconds_since_epoch =
+      m_data.m_timestamp.micro_seconds_since_epoch();
+  header.saved_errno = errno;
+  header.reserved = 0;
+  memcpy(buf.data(), &header, sizeof(header));
+  g_output(buf.data(), buf.length());
+  if (m_data.m_level == FATAL) {
+    g_flush();
+    abort();
+  }
+}
+
+void LogLine::Data::log_time() { append_time(m_log_stream, m_timestamp); }
+
+void LogLine::append_time(LogStream& stream, Timestamp time) {
+  int64_t micro_seconds_since_epoch = time.micro_seconds_since_epoch();
   time_t seconds = static_cast<time_t>(micro_seconds_since_epoch /
                                        Timestamp::kMicroSecondsPerSecond);
   int microseconds = static_cast<int>(micro_seconds_since_epoch %
@@ -99,17 +143,16 @@ void LogLine::Data::log_time() {
     (void)len;
   }
 
-  // log time
-  if (g_log_timezone.valid()) {
-    // micro seconds
-    FormattedString us(".%06d ", microseconds);
-    assert(us.length_0() == 8);
-    m_log_stream << StringPiece(t_time, 17) << StringPiece(us.data(), 8);
-  } else {
-    FormattedString us(".%06dZ ", microseconds);
-    assert(us.length_0() == 9);
-    m_log_stream << StringPiece(t_time, 17) << StringPiece(us.data(), 9);
+  // log time, with the micro seconds like ".%06d "
+  char us[9];
+  us[0] = '.';
+  fixed_width_to_string(us + 1, static_cast<uint32_t>(microseconds), 6);
+  int us_len = 7;
+  if (!g_log_timezone.valid()) {
+    us[us_len++] = 'Z';
   }
+  us[us_len++] = ' ';
+  stream << StringPiece(t_time, 17) << StringPiece(us, us_len);
 }
 
 void LogLine::set_log_level(const LogLevel& level) { g_log_level = level; }
@@ -120,4 +163,11 @@ void LogLine::set_flush(const FlushFuncPtr& flush) { g_flush = flush; }
 
 void LogLine::set_timezone(const Timezone& tz) { g_log_timezone = tz; }
 
+void LogLine::set_binary(bool on) {
+  g_binary = on;
+  if (on) {
+    g_has_used_binary = true;
+  }
+}
+
 }  // namespace flute
@@ -1,6 +1,8 @@
 #ifndef FLUTE_COMMON_LOGLINE_H
 #define FLUTE_COMMON_LOGLINE_H
 
+#include <flute/common/BinaryLog.h>
+#include <flute/common/LogLimiter.h>
 #include <flute/common/LogStream.h>
 #include <flute/common/Timestamp.h>
 #include <flute/common/Timezone.h>
@@ -71,11 +73,26 @@ class LogLine {
   static void set_output(const OutputFuncPtr& out);
   static void set_flush(const FlushFuncPtr& flush);
   static void set_timezone(const Timezone& tz);
+  // In binary mode, lines are written as the records of BinaryLog.h, which
+  // AsyncLogging formats on its backend thread.
+  static void set_binary(bool on);
+  static bool is_binary() { return g_binary; }
+  // whether binary mode has ever been turned on
+  static bool has_used_binary() { return g_has_used_binary; }
   LogStream& stream() { return m_data.m_log_stream; }
+  // the stream of the statement at the call site of FLUTE_LOG_SITE
+  LogStream& stream(uint32_t site_id) {
+    m_data.m_site_id = site_id;
+    return m_data.m_log_stream;
+  }
+
+  // Append the time of a line, cached per second for each thread.
+  static void append_time(LogStream& stream, Timestamp time);
 
   static void default_output(const char* msg, int len) {
     size_t n_bytes = fwrite(msg, 1, len, stdout);
     assert(n_bytes > 0);
+    (void)n_bytes;
   }
   static void default_flush() { fflush(stdout); }
 
@@ -86,12 +103,14 @@ class LogLine {
   static OutputFuncPtr g_output;
   static FlushFuncPtr g_flush;
   static Timezone g_log_timezone;
+  static bool g_binary;
+  static bool g_has_used_binary;
 
  private:
   class Data {
    public:
     explicit Data(LogLevel level, int old_errno, const BaseName& file, int line,
-                  const char* type);
+                  const char* type, const char* func = NULL);
 
    public:
     Timestamp m_timestamp;
@@ -99,9 +118,14 @@ class LogLine {
     BaseName m_basename;
     LogLevel m_level;
     int m_line;
+    const char* m_type;
+    const char* m_func;
+    uint32_t m_site_id;
     void log_time();
   };
 
+  void finish_binary();
+
  private:
   Data m_data;
 };
@@ -110,6 +134,13 @@ static const char* const LogLevelNames[LogLine::NUM_LOG_LEVELS] = {
     "TRACE ", "DEBUG ", "INFO  ", "WARN  ", "ERROR ", "FATAL ",
 };
 
+inline LogStream& operator<<(LogStream& s, const LogSuppressed& v) {
+  if (v.count > 0) {
+    s << "(" << v.count << " suppressed) ";
+  }
+  return s;
+}
+
 // A small helper for CHECK_NOTNULL().
 template <typename T>
 T* CheckNotNull(BaseName file, int line, const char* names, T* ptr) {
@@ -127,32 +158,91 @@ T* CheckNotNull(BaseName file, int line, const char* names, T* ptr) {
 #define LOG_TYPE_STRING flute::LogLevelNames[flute::LogLine::get_log_level()]
 #endif
 
-#define LOG_TRACE                                                     \
-  if (flute::LogLine::get_log_level() <= flute::LogLine::TRACE)       \
+// Levels below FLUTE_MIN_LOG_LEVEL are compiled out, along with the
+// arguments of their statements. TRACE, DEBUG and INFO are also checked
+// against LogLine::get_log_level() at run time.
+#ifndef FLUTE_MIN_LOG_LEVEL
+#define FLUTE_MIN_LOG_LEVEL 0
+#endif
+
+#define FLUTE_LOG_ENABLED_TRACE                           \
+  (FLUTE_MIN_LOG_LEVEL <= flute::LogLine::TRACE &&        \
+   flute::LogLine::get_log_level() <= flute::LogLine::TRACE)
+#define FLUTE_LOG_ENABLED_DEBUG                           \
+  (FLUTE_MIN_LOG_LEVEL <= flute::LogLine::DEBUG &&        \
+   flute::LogLine::get_log_level() <= flute::LogLine::DEBUG)
+#define FLUTE_LOG_ENABLED_INFO                            \
+  (FLUTE_MIN_LOG_LEVEL <= flute::LogLine::INFO &&         \
+   flute::LogLine::get_log_level() <= flute::LogLine::INFO)
+#define FLUTE_LOG_ENABLED_WARN (FLUTE_MIN_LOG_LEVEL <= flute::LogLine::WARN)
+#define FLUTE_LOG_ENABLED_ERROR (FLUTE_MIN_LOG_LEVEL <= flute::LogLine::ERROR)
+#define FLUTE_LOG_ENABLED_FATAL true
+
+#define FLUTE_LOG_STREAM_TRACE                                        \
   flute::LogLine(__FILE__, __LINE__, flute::LogLine::TRACE, __func__, \
                  "[TRACE] ")                                          \
-      .stream()
-#define LOG_DEBUG                                                     \
-  if (flute::LogLine::get_log_level() <= flute::LogLine::DEBUG)       \
+      .stream(FLUTE_LOG_SITE(flute::LogLine::TRACE, "[TRACE] ", __func__))
+#define FLUTE_LOG_STREAM_DEBUG                                        \
   flute::LogLine(__FILE__, __LINE__, flute::LogLine::DEBUG, __func__, \
                  "[DEBUG] ")                                          \
-      .stream()
-#define LOG_INFO                                               \
-  if (flute::LogLine::get_log_level() <= flute::LogLine::INFO) \
-  flute::LogLine(__FILE__, __LINE__, "[INFO]  ").stream()
-#define LOG_WARN \
-  flute::LogLine(__FILE__, __LINE__, flute::LogLine::WARN, "[WARN]  ").stream()
-#define LOG_ERROR \
-  flute::LogLine(__FILE__, __LINE__, flute::LogLine::ERROR, "[ERROR] ").stream()
-#define LOG_IF_ERROR \
-  if (errno != 0)    \
-  flute::LogLine(__FILE__, __LINE__, flute::LogLine::ERROR, "[ERROR] ").stream()
-#define LOG_FATAL \
-  flute::LogLine(__FILE__, __LINE__, flute::LogLine::FATAL, "[FATAL] ").stream()
-#define LOG_SYSERR \
-  flute::LogLine(__FILE__, __LINE__, false, "[SERROR]").stream()
-#define LOG_SYSFATAL \
-  flute::LogLine(__FILE__, __LINE__, true, "[SFATAL]").stream()
+      .stream(FLUTE_LOG_SITE(flute::LogLine::DEBUG, "[DEBUG] ", __func__))
+#define FLUTE_LOG_STREAM_INFO                  \
+  flute::LogLine(__FILE__, __LINE__, "[INFO]  ") \
+      .stream(FLUTE_LOG_SITE(flute::LogLine::INFO, "[INFO]  ", NULL))
+#define FLUTE_LOG_STREAM_WARN                                         \
+  flute::LogLine(__FILE__, __LINE__, flute::LogLine::WARN, "[WARN]  ") \
+      .stream(FLUTE_LOG_SITE(flute::LogLine::WARN, "[WARN]  ", NULL))
+#define FLUTE_LOG_STREAM_ERROR                                         \
+  flute::LogLine(__FILE__, __LINE__, flute::LogLine::ERROR, "[ERROR] ") \
+      .stream(FLUTE_LOG_SITE(flute::LogLine::ERROR, "[ERROR] ", NULL))
+#define FLUTE_LOG_STREAM_FATAL                                         \
+  flute::LogLine(__FILE__, __LINE__, flute::LogLine::FATAL, "[FATAL] ") \
+      .stream(FLUTE_LOG_SITE(flute::LogLine::FATAL, "[FATAL] ", NULL))
+
+// "if (!(enabled)) {} else" rather than "if (enabled)", so that the else of
+// "if (x) LOG_WARN << a; else b();" still belongs to the caller's if.
+#define FLUTE_LOG_IF(condition) \
+  if (!(condition)) {           \
+  } else
+
+#define LOG_TRACE FLUTE_LOG_IF(FLUTE_LOG_ENABLED_TRACE) FLUTE_LOG_STREAM_TRACE
+#define LOG_DEBUG FLUTE_LOG_IF(FLUTE_LOG_ENABLED_DEBUG) FLUTE_LOG_STREAM_DEBUG
+#define LOG_INFO FLUTE_LOG_IF(FLUTE_LOG_ENABLED_INFO) FLUTE_LOG_STREAM_INFO
+#define LOG_WARN FLUTE_LOG_IF(FLUTE_LOG_ENABLED_WARN) FLUTE_LOG_STREAM_WARN
+#define LOG_ERROR FLUTE_LOG_IF(FLUTE_LOG_ENABLED_ERROR) FLUTE_LOG_STREAM_ERROR
+#define LOG_IF_ERROR                                  \
+  FLUTE_LOG_IF(FLUTE_LOG_ENABLED_ERROR && errno != 0) \
+  FLUTE_LOG_STREAM_ERROR
+#define LOG_FATAL FLUTE_LOG_STREAM_FATAL
+#define LOG_SYSERR                                       \
+  FLUTE_LOG_IF(FLUTE_LOG_ENABLED_ERROR)                  \
+  flute::LogLine(__FILE__, __LINE__, false, "[SERROR]") \
+      .stream(FLUTE_LOG_SITE(flute::LogLine::ERROR, "[SERROR]", NULL))
+#define LOG_SYSFATAL                                    \
+  flute::LogLine(__FILE__, __LINE__, true, "[SFATAL]") \
+      .stream(FLUTE_LOG_SITE(flute::LogLine::FATAL, "[SFATAL]", NULL))
+
+// Limited logging, for statements that may repeat in storms. Each statement
+// counts on its own, and a line tells how many lines were suppressed before
+// it. The level is one of TRACE, DEBUG, INFO, WARN, ERROR and FATAL.
+//
+//   LOG_EVERY_N(ERROR, 100) << "copy failed";   // the 1st, 101st, ...
+//   LOG_FIRST_N(WARN, 10) << "slow client";     // the first 10 only
+//   LOG_RATE_LIMITED(INFO, 5) << "retrying";    // 5 lines per second at most
+#define FLUTE_LOG_LIMITED(level, limit)                              \
+  if (int64_t flute_log_admitted = 0) {                              \
+  } else                                                             \
+    FLUTE_LOG_IF(FLUTE_LOG_ENABLED_##level &&                        \
+                 (flute_log_admitted = limit))                       \
+  FLUTE_LOG_STREAM_##level << flute::LogSuppressed(flute_log_admitted - 1)
+
+#define LOG_EVERY_N(level, n) \
+  FLUTE_LOG_LIMITED(level, FLUTE_LOG_LIMIT(flute::detail::LogEveryN, n))
+#define LOG_FIRST_N(level, n) \
+  FLUTE_LOG_LIMITED(level, FLUTE_LOG_LIMIT(flute::detail::LogFirstN, n))
+#define LOG_RATE_LIMITED(level, lines_per_second) \
+  FLUTE_LOG_LIMITED(                              \
+      level, FLUTE_LOG_LIMIT(flute::detail::LogTokenBucket, lines_per_second))
 
 // Taken from glog/logging.h
 //
@@ -0,0 +1,122 @@
+#include <flute/common/LogRing.h>
+
+#include <string.h>
+
+#include <algorithm>
+
+namespace flute {
+
+namespace {
+
+size_t round_up_to_power_of_2(size_t n) {
+  size_t power = 1;
+  while (power < n) {
+    power <<= 1;
+  }
+  return power;
+}
+
+}  // namespace
+
+const size_t LogRing::kHeaderSize;
+const size_t LogRing::kMinCapacity;
+
+size_t LogRing::rounded_capacity(size_t capacity) {
+  return round_up_to_power_of_2(std::max(capacity, kMinCapacity));
+}
+
+LogRing::LogRing(size_t capacity)
+    : m_capacity(rounded_capacity(capacity)),
+      m_mask(m_capacity - 1),
+      m_data(new char[m_capacity]),
+      m_write_index(0),
+      m_read_index(0) {}
+
+LogRing::~LogRing() { delete[] m_data; }
+
+size_t LogRing::try_append(const char* line, size_t len) {
+  const size_t record_size = kHeaderSize + len;
+  uint64_t write_index = m_write_index.load(std::memory_order_relaxed);
+  uint64_t read_index = m_read_index.load(std::memory_order_acquire);
+  size_t used = static_cast<size_t>(write_index - read_index);
+  if (record_size > m_capacity - used) {
+    return 0;
+  }
+  uint32_t header = static_cast<uint32_t>(len);
+  copy_in(write_index, reinterpret_cast<const char*>(&header), kHeaderSize);
+  copy_in(write_index + kHeaderSize, line, len);
+  m_write_index.store(write_index + record_size, std::memory_order_release);
+  return used + record_size;
+}
+
+size_t LogRing::drop_oldest(size_t len) {
+  if (!fits(len)) {
+    return 0;
+  }
+  const size_t record_size = kHeaderSize + len;
+  uint64_t write_index = m_write_index.load(std::memory_order_relaxed);
+  uint64_t read_index = m_read_index.load(std::memory_order_acquire);
+  size_t num_dropped = 0;
+  while (record_size > m_capacity - (write_index - read_index)) {
+    // Only this thread writes the ring, so the header is intact even if the
+    // consumer has drained it meanwhile. The CAS tells.
+    uint32_t header;
+    copy_out(read_index, reinterpret_cast<char*>(&header), kHeaderSize);
+    uint64_t next_index = read_index + kHeaderSize + header;
+    if (m_read_index.compare_exchange_weak(read_index, next_index,
+                                           std::memory_order_acq_rel,
+                                           std::memory_order_acquire)) {
+      read_index = next_index;
+      ++num_dropped;
+    }
+  }
+  return num_dropped;
+}
+
+size_t LogRing::drain(char* buf, size_t len) {
+  while (true) {
+    uint64_t read_index = m_read_index.load(std::memory_order_acquire);
+    uint64_t write_index = m_write_index.load(std::memory_order_acquire);
+    uint64_t index = read_index;
+    size_t num_bytes = 0;
+    while (index < write_index) {
+      uint32_t header;
+      copy_out(index, reinterpret_cast<char*>(&header), kHeaderSize);
+      if (header > write_index - index - kHeaderSize ||
+          header > len - num_bytes) {
+        // The line does not fit in buf, or was torn by drop_oldest() which
+        // makes the CAS below fail anyway.
+        break;
+      }
+      copy_out(index + kHeaderSize, buf + num_bytes, header);
+      num_bytes += header;
+      index += kHeaderSize + header;
+    }
+    if (index == read_index) {
+      return 0;
+    }
+    if (m_read_index.compare_exchange_strong(read_index, index,
+                                             std::memory_order_acq_rel,
+                                             std::memory_order_acquire)) {
+      return num_bytes;
+    }
+    // The producer dropped the oldest lines while we were copying, and may
+    // have overwritten them. Start over from the new read index.
+  }
+}
+
+void LogRing::copy_in(uint64_t index, const char* src, size_t len) {
+  size_t pos = static_cast<size_t>(index & m_mask);
+  size_t first = std::min(len, m_capacity - pos);
+  memcpy(m_data + pos, src, first);
+  memcpy(m_data, src + first, len - first);
+}
+
+void LogRing::copy_out(uint64_t index, char* dst, size_t len) const {
+  size_t pos = static_cast<size_t>(index & m_mask);
+  size_t first = std::min(len, m_capacity - pos);
+  memcpy(dst, m_data + pos, first);
+  memcpy(dst + first, m_data, len - first);
+}
+
+}  // namespace flute
@@ -0,0 +1,75 @@
+#ifndef FLUTE_COMMON_LOGRING_H
+#define FLUTE_COMMON_LOGRING_H
+
+#include <flute/common/noncopyable.h>
+#include <flute/common/types.h>
+
+#include <stdint.h>
+
+#include <atomic>
+
+namespace flute {
+
+///
+/// A single-producer single-consumer ring of log lines.
+///
+/// One thread appends lines, and the backend of AsyncLogging drains them,
+/// neither of them takes a lock. Every line is stored behind its length, so
+/// the producer is able to discard the oldest lines by itself when the ring is
+/// full.
+class LogRing : noncopyable {
+ public:
+  static const size_t kHeaderSize = sizeof(uint32_t);
+  static const size_t kMinCapacity = 4 * 1024;
+
+  // capacity is rounded up to a power of 2
+  explicit LogRing(size_t capacity);
+  ~LogRing();
+
+  // the capacity of a ring constructed with capacity
+  static size_t rounded_capacity(size_t capacity);
+
+  size_t capacity() const { return m_capacity; }
+  // whether a line of len bytes could ever be stored
+  bool fits(size_t len) const { return kHeaderSize + len <= m_capacity; }
+  size_t used_bytes() const {
+    return static_cast<size_t>(m_write_index.load(std::memory_order_acquire) -
+                               m_read_index.load(std::memory_order_acquire));
+  }
+  bool empty() const { return used_bytes() == 0; }
+
+  // Producer side.
+  // Append a line, return the bytes used after appending, or 0 if it is full.
+  size_t try_append(const char* line, size_t len);
+  // Discard the oldest lines until a line of len bytes fits, return the number
+  // of lines discarded.
+  size_t drop_oldest(size_t len);
+
+  // Consumer side.
+  // Move whole lines into buf of len bytes, return the bytes moved.
+  size_t drain(char* buf, size_t len);
+
+ private:
+  void copy_in(uint64_t index, const char* src, size_t len);
+  void copy_out(uint64_t index, char* dst, size_t len) const;
+
+  const size_t m_capacity;
+  const size_t m_mask;
+  char* m_data;
+  static const size_t kCacheLineSize = 64;
+  typedef std::atomic<uint64_t> Index;
+
+  // Both indexes grow forever, and are padded to their own cache lines. Only
+  // the producer moves m_write_index. The consumer moves m_read_index after
+  // draining, while the producer moves it only to drop the oldest lines, so
+  // both of them move it with compare-and-swap.
+  char m_pad0[kCacheLineSize];
+  Index m_write_index;
+  char m_pad1[kCacheLineSize - sizeof(Index)];
+  Index m_read_index;
+  char m_pad2[kCacheLineSize - sizeof(Index)];
+};
+
+}  // namespace flute
+
+#endif  // FLUTE_COMMON_LOGRING_H
@@ -1,12 +1,76 @@
 #include <flute/common/LogStream.h>
+#include <flute/common/BinaryLog.h>
 #include <flute/common/Digital.h>
 
+#include <type_traits>
+
 using namespace flute;
 
 // Any array
 
+// Binary values, a tag byte and the raw bytes. A value that does not fit is
+// dropped as a whole, so the record stays decodable.
+
+template <typename T>
+void LogStream::append_binary_value(int tag, T value) {
+  if (m_buffer.avail() > static_cast<int>(1 + sizeof(value))) {
+    char* buf = m_buffer.cur_pos();
+    buf[0] = static_cast<char>(tag);
+    memcpy(buf + 1, &value, sizeof(value));
+    m_buffer.cur_add(1 + sizeof(value));
+  }
+}
+
+void LogStream::append_binary_string(int tag, const char* data, int len) {
+  const int header_size = 1 + static_cast<int>(sizeof(uint16_t));
+  int avail = m_buffer.avail() - 1 - header_size;
+  if (avail <= 0 || len <= 0) {
+    return;
+  }
+  // truncated like the text mode
+  uint16_t n = static_cast<uint16_t>(len < avail ? len : avail);
+  char* buf = m_buffer.cur_pos();
+  buf[0] = static_cast<char>(tag);
+  memcpy(buf + 1, &n, sizeof(n));
+  memcpy(buf + header_size, data, n);
+  m_buffer.cur_add(header_size + n);
+}
+
+LogStream& LogStream::operator<<(bool v) {
+  if (m_binary) {
+    append_binary_value(kTagBool, static_cast<char>(v ? 1 : 0));
+  } else {
+    m_buffer.append(v ? "1" : "0", 1);
+  }
+  return *this;
+}
+
+void LogStream::append_key(const char* key) {
+  int len = static_cast<int>(strlen(key));
+  if (m_binary) {
+    append_binary_string(kTagKey, key, len);
+  } else {
+    m_buffer.append(" ", 1);
+    m_buffer.append(key, len);
+    m_buffer.append("=", 1);
+  }
+}
+
+LogStream& LogStream::operator<<(char v) {
+  if (m_binary) {
+    append_binary_value(kTagChar, v);
+  } else {
+    m_buffer.append(&v, 1);
+  }
+  return *this;
+}
+
 LogStream& LogStream::operator<<(const void* p) {
   uintptr_t v = reinterpret_cast<uintptr_t>(p);
+  if (m_binary) {
+    append_binary_value(kTagPointer, static_cast<uint64_t>(v));
+    return *this;
+  }
   if (m_buffer.avail() >= kMaxNumericCharNum) {
     char* buf = m_buffer.cur_pos();
     buf[0] = '0';
@@ -21,6 +85,14 @@ LogStream& LogStream::operator<<(const void* p) {
 
 template <typename T>
 void LogStream::log_integer(T v) {
+  if (m_binary) {
+    if (std::is_signed<T>::value) {
+      append_binary_value(kTagInt64, static_cast<int64_t>(v));
+    } else {
+      append_binary_value(kTagUInt64, static_cast<uint64_t>(v));
+    }
+    return;
+  }
   if (m_buffer.avail() >= kMaxNumericCharNum) {
     size_t len = integer_to_string(m_buffer.cur_pos(), v);
     m_buffer.cur_add(len);
@@ -69,8 +141,12 @@ LogStream& LogStream::operator<<(unsigned long long v) {
 
 // Double
 LogStream& LogStream::operator<<(double v) {
+  if (m_binary) {
+    append_binary_value(kTagDouble, v);
+    return *this;
+  }
   if (m_buffer.avail() >= kMaxNumericCharNum) {
-    int len = snprintf(m_buffer.cur_pos(), kMaxNumericCharNum, "%.12g", v);
+    size_t len = double_to_string(m_buffer.cur_pos(), v);
     m_buffer.cur_add(len);
   }
   return *this;
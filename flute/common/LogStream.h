@@ -1,6 +1,7 @@
 #ifndef FLUTE_COMMON_LOGSTREAM_H
 #define FLUTE_COMMON_LOGSTREAM_H
 
+#include <flute/common/BinaryLog.h>
 #include <flute/common/FixedBuffer.h>
 
 #include <string.h>
@@ -42,13 +43,23 @@ class FormattedString {
 
 class LogStream {
  public:
-  void append(const char* data, int len) { m_buffer.append(data, len); }
+  LogStream() : m_binary(false) {}
 
-  // Overload << for bool
-  LogStream& operator<<(bool v) {
-    m_buffer.append(v ? "1" : "0", 1);
-    return *this;
+  // In binary mode, values are appended as the tagged raw bytes of
+  // BinaryLog.h instead of text.
+  void set_binary(bool on) { m_binary = on; }
+  bool is_binary() const { return m_binary; }
+
+  void append(const char* data, int len) {
+    if (m_binary) {
+      append_binary_string(kTagString, data, len);
+    } else {
+      m_buffer.append(data, len);
+    }
   }
+
+  // Overload << for bool
+  LogStream& operator<<(bool v);
   // Overload << for void*
   LogStream& operator<<(const void*);
 
@@ -72,15 +83,12 @@ class LogStream {
   }
 
   // Overload << for strings
-  LogStream& operator<<(char v) {
-    m_buffer.append(&v, 1);
-    return *this;
-  }
+  LogStream& operator<<(char v);
   LogStream& operator<<(const char* str) {
     if (str) {
-      m_buffer.append(str, strlen(str));
+      append(str, static_cast<int>(strlen(str)));
     } else {
-      m_buffer.append("(null)", 6);
+      append("(null)", 6);
     }
     return *this;
   }
@@ -90,7 +98,7 @@ class LogStream {
   }
 
   LogStream& operator<<(const string& v) {
-    m_buffer.append(v.c_str(), v.size());
+    append(v.c_str(), static_cast<int>(v.size()));
     return *this;
   }
 
@@ -100,14 +108,46 @@ class LogStream {
   }
 
   LogStream& operator<<(const StringPiece& v) {
-    m_buffer.append(v.data(), v.size());
+    append(v.data(), v.size());
     return *this;
   }
 
+  // The key of the value appended next, " key=" in text mode.
+  void append_key(const char* key);
+
+ private:
+  template <typename T>
+  void append_binary_value(int tag, T value);
+  void append_binary_string(int tag, const char* data, int len);
+
  public:
   LogBuffer m_buffer;
+
+ private:
+  bool m_binary;
 };
 
+/// A typed key/value field of a log line, LOG_INFO << "login" <<
+/// flute::kv("user", name) << flute::kv("ms", cost). Only the pointer to the
+/// key and a reference to the value are kept, nothing is allocated. The key
+/// should be a literal and needs no escaping.
+template <typename T>
+struct LogField {
+  const char* key;
+  const T& value;
+};
+
+template <typename T>
+inline LogField<T> kv(const char* key, const T& value) {
+  return LogField<T>{key, value};
+}
+
+template <typename T>
+inline LogStream& operator<<(LogStream& stream, const LogField<T>& field) {
+  stream.append_key(field.key);
+  return stream << field.value;
+}
+
 }  // namespace flute
 
 #endif  // FLUTE_COMMON_LOGSTREAM_H
\ No newline at end of file
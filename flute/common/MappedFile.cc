@@ -0,0 +1,89 @@
+#include <flute/common/MappedFile.h>
+
+#include <flute/common/LogLine.h>
+#include <flute/common/Singleton.h>
+
+#include <errno.h>
+#include <sys/mman.h>
+
+namespace flute {
+
+MappedFile::MappedFile(int fd, size_t size)
+    : m_addr(NULL), m_size(size), m_valid(true) {
+  if (m_size == 0) {
+    // mmap() refuses zero length
+    return;
+  }
+  void* addr = ::mmap(NULL, m_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (addr == MAP_FAILED) {
+    LOG_SYSERR << "MappedFile::MappedFile mmap fd=" << fd;
+    m_valid = false;
+    return;
+  }
+  m_addr = addr;
+  // Pages are read once from the front to the back. Ask for aggressive
+  // read-ahead, and start reading now.
+  if (::madvise(m_addr, m_size, MADV_SEQUENTIAL) != 0 ||
+      ::madvise(m_addr, m_size, MADV_WILLNEED) != 0) {
+    LOG_SYSERR << "MappedFile::MappedFile madvise fd=" << fd;
+    errno = 0;
+  }
+}
+
+MappedFile::~MappedFile() {
+  if (m_addr != NULL && ::munmap(m_addr, m_size) != 0) {
+    LOG_SYSERR << "MappedFile::~MappedFile munmap";
+  }
+}
+
+MappedFileCache& MappedFileCache::instance() {
+  return Singleton<MappedFileCache>::instance();
+}
+
+MappedFilePtr MappedFileCache::get(const string& path, int fd, ino_t inode,
+                                   size_t size, Timestamp modify_time) {
+  MutexLockGuard lock(m_mutex);
+  EntryMap::iterator it = m_entries.find(path);
+  if (it != m_entries.end() && it->second.inode == inode &&
+      it->second.size == size && it->second.modify_time == modify_time) {
+    MappedFilePtr mapped_file = it->second.mapped_file.lock();
+    if (mapped_file) {
+      return mapped_file;
+    }
+  }
+
+  remove_expired_entries();
+  MappedFilePtr mapped_file(new MappedFile(fd, size));
+  if (mapped_file->valid()) {
+    Entry& entry = m_entries[path];
+    entry.inode = inode;
+    entry.size = size;
+    entry.modify_time = modify_time;
+    entry.mapped_file = mapped_file;
+  }
+  return mapped_file;
+}
+
+size_t MappedFileCache::size() const {
+  MutexLockGuard lock(m_mutex);
+  size_t n = 0;
+  for (const auto& item : m_entries) {
+    if (!item.second.mapped_file.expired()) {
+      ++n;
+    }
+  }
+  return n;
+}
+
+void MappedFileCache::remove_expired_entries() {
+  EntryMap::iterator it = m_entries.begin();
+  while (it != m_entries.end()) {
+    if (it->second.mapped_file.expired()) {
+      m_entries.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+}
+
+}  // namespace flute
@@ -0,0 +1,74 @@
+#ifndef FLUTE_COMMON_MAPPEDFILE_H
+#define FLUTE_COMMON_MAPPEDFILE_H
+
+#include <flute/common/Mutex.h>
+#include <flute/common/Timestamp.h>
+#include <flute/common/noncopyable.h>
+#include <flute/common/types.h>
+
+#include <sys/types.h>
+
+#include <map>
+#include <memory>
+
+namespace flute {
+
+///
+/// A read-only mapping of a whole file, unmapped when destructs.
+///
+class MappedFile : noncopyable {
+ public:
+  // Map size bytes of fd, which must be the whole file.
+  MappedFile(int fd, size_t size);
+  ~MappedFile();
+
+  // An empty file is valid without any mapping.
+  bool valid() const { return m_valid; }
+  const char* data() const { return static_cast<const char*>(m_addr); }
+  size_t size() const { return m_size; }
+
+ private:
+  void* m_addr;
+  size_t m_size;
+  bool m_valid;
+};
+
+typedef std::shared_ptr<MappedFile> MappedFilePtr;
+
+///
+/// Share one mapping of a file among all the copiers sending it.
+///
+/// The cache only holds weak references, so a file is unmapped as soon as the
+/// last transfer using it finishes. A file replaced or modified on disk gets a
+/// new mapping, while the old one lives on for its current holders.
+/// Thread safe.
+class MappedFileCache : noncopyable {
+ public:
+  static MappedFileCache& instance();
+
+  // Return the mapping of the opened file fd of the path, mapping it if nobody
+  // is using it.
+  MappedFilePtr get(const string& path, int fd, ino_t inode, size_t size,
+                    Timestamp modify_time);
+
+  // number of files currently mapped
+  size_t size() const;
+
+ private:
+  struct Entry {
+    ino_t inode;
+    size_t size;
+    Timestamp modify_time;
+    std::weak_ptr<MappedFile> mapped_file;
+  };
+  typedef std::map<string, Entry> EntryMap;
+
+  void remove_expired_entries() REQUIRES(m_mutex);
+
+  mutable MutexLock m_mutex;
+  EntryMap m_entries GUARDED_BY(m_mutex);
+};
+
+}  // namespace flute
+
+#endif  // FLUTE_COMMON_MAPPEDFILE_H
@@ -0,0 +1,315 @@
+#include <flute/common/Metrics.h>
+
+#include <flute/common/HdrHistogram.h>
+#include <flute/common/LogLine.h>
+#include <flute/common/ProcessInfo.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <cmath>
+#include <new>
+
+namespace flute {
+
+namespace detail {
+
+__thread int t_metric_shard = -1;
+
+int assign_metric_shard() {
+  static std::atomic<int> s_next_shard(0);
+  t_metric_shard = s_next_shard++ % kMetricShards;
+  return t_metric_shard;
+}
+
+}  // namespace detail
+
+namespace {
+
+// Prometheus wants +Inf, NaN and no exponent for integral values.
+void append_number(string* out, double value) {
+  char buf[64];
+  if (std::isnan(value)) {
+    out->append("NaN");
+  } else if (std::isinf(value)) {
+    out->append(value > 0 ? "+Inf" : "-Inf");
+  } else if (value == std::floor(value) && std::fabs(value) < 1e15) {
+    snprintf(buf, sizeof buf, "%.0f", value);
+    out->append(buf);
+  } else {
+    snprintf(buf, sizeof buf, "%.15g", value);
+    out->append(buf);
+  }
+}
+
+void append_sample(string* out, const string& name, const string& labels,
+                   double value) {
+  out->append(name);
+  if (!labels.empty()) {
+    out->append("{");
+    out->append(labels);
+    out->append("}");
+  }
+  out->append(" ");
+  append_number(out, value);
+  out->append("\n");
+}
+
+void register_process_metrics(MetricsRegistry* registry) {
+  registry->gauge_function(
+      "process_cpu_seconds_total", "User and system CPU time spent.", []() {
+        ProcessInfo::CpuTime cpu = ProcessInfo::cpuTime();
+        return cpu.userSeconds + cpu.systemSeconds;
+      });
+  registry->gauge_function("process_open_fds", "Open file descriptors.", []() {
+    return static_cast<double>(ProcessInfo::openedFiles());
+  });
+  registry->gauge_function(
+      "process_max_fds", "Maximum number of open file descriptors.",
+      []() { return static_cast<double>(ProcessInfo::maxOpenFiles()); });
+  registry->gauge_function("process_threads", "Threads of the process.", []() {
+    return static_cast<double>(ProcessInfo::numThreads());
+  });
+  registry->gauge_function(
+      "process_start_time_seconds", "Start time since the epoch.", []() {
+        return static_cast<double>(
+                   ProcessInfo::startTime().micro_seconds_since_epoch()) /
+               Timestamp::kMicroSecondsPerSecond;
+      });
+}
+
+}  // namespace
+
+namespace detail {
+
+MetricCounts::MetricCounts(size_t num) : m_counts(NULL) {
+  const size_t per_line = kMetricCacheLineSize / sizeof(std::atomic<int64_t>);
+  const size_t rounded = (num + per_line - 1) / per_line * per_line;
+  void* memory = NULL;
+  if (::posix_memalign(&memory, kMetricCacheLineSize,
+                       rounded * sizeof(std::atomic<int64_t>)) != 0) {
+    LOG_FATAL << "MetricCounts - posix_memalign of " << rounded << " counts";
+  }
+  m_counts = static_cast<std::atomic<int64_t>*>(memory);
+  for (size_t i = 0; i < rounded; ++i) {
+    new (&m_counts[i]) std::atomic<int64_t>(0);
+  }
+}
+
+// std::atomic<int64_t> is trivially destructible
+MetricCounts::~MetricCounts() { ::free(m_counts); }
+
+}  // namespace detail
+
+int64_t Counter::value() const {
+  int64_t sum = 0;
+  for (const detail::MetricCell& cell : m_cells) {
+    sum += cell.value.load(std::memory_order_relaxed);
+  }
+  return sum;
+}
+
+// Written by the threads of one shard. The counts are on cache lines of their
+// own, the sum is padded from the allocations around the shard.
+struct Histogram::Shard {
+  explicit Shard(size_t num_buckets) : counts(num_buckets), sum(0.0) {}
+
+  char pad0[detail::kMetricCacheLineSize];
+  detail::MetricCounts counts;
+  std::atomic<double> sum;
+  char pad1[detail::kMetricCacheLineSize];
+};
+
+Histogram::Histogram(const std::vector<double>& bounds) : m_bounds(bounds) {
+  assert(std::is_sorted(bounds.begin(), bounds.end()));
+  for (std::unique_ptr<Shard>& shard : m_shards) {
+    shard.reset(new Shard(bounds.size() + 1));
+  }
+}
+
+Histogram::~Histogram() = default;
+
+void Histogram::observe(double value) {
+  Shard* shard = m_shards[detail::metric_shard()].get();
+  size_t bucket = static_cast<size_t>(
+      std::lower_bound(m_bounds.begin(), m_bounds.end(), value) -
+      m_bounds.begin());
+  shard->counts[bucket].fetch_add(1, std::memory_order_relaxed);
+  // rarely contended, the shard is the thread's
+  double sum = shard->sum.load(std::memory_order_relaxed);
+  while (!shard->sum.compare_exchange_weak(sum, sum + value,
+                                           std::memory_order_relaxed)) {
+  }
+}
+
+void Histogram::snapshot(std::vector<int64_t>* counts, double* sum) const {
+  counts->assign(m_bounds.size() + 1, 0);
+  *sum = 0.0;
+  for (const std::unique_ptr<Shard>& shard : m_shards) {
+    for (size_t i = 0; i < counts->size(); ++i) {
+      (*counts)[i] += shard->counts[i].load(std::memory_order_relaxed);
+    }
+    *sum += shard->sum.load(std::memory_order_relaxed);
+  }
+}
+
+std::vector<double> Histogram::exponential_bounds(double start, double factor,
+                                                  int count) {
+  std::vector<double> bounds;
+  for (int i = 0; i < count; ++i) {
+    bounds.push_back(start);
+    start *= factor;
+  }
+  return bounds;
+}
+
+MetricsRegistry::MetricsRegistry() {}
+
+MetricsRegistry::~MetricsRegistry() {}
+
+MetricsRegistry& MetricsRegistry::instance() {
+  // never destroyed, threads may record until the process exits
+  static MetricsRegistry* s_registry = []() {
+    MetricsRegistry* registry = new MetricsRegistry;
+    register_process_metrics(registry);
+    return registry;
+  }();
+  return *s_registry;
+}
+
+MetricsRegistry::Family* MetricsRegistry::get_family(const string& name,
+                                                     const string& help,
+                                                     Type type) {
+  auto it = m_families.find(name);
+  if (it == m_families.end()) {
+    Family& family = m_families[name];
+    family.type = type;
+    family.help = help;
+    return &family;
+  }
+  if (it->second.type != type) {
+    LOG_FATAL << "MetricsRegistry - " << name << " is of another type";
+  }
+  return &it->second;
+}
+
+Counter* MetricsRegistry::counter(const string& name, const string& help,
+                                  const string& labels) {
+  MutexLockGuard lock(m_mutex);
+  std::unique_ptr<Counter>& metric =
+      get_family(name, help, kCounter)->counters[labels];
+  if (!metric) {
+    metric.reset(new Counter);
+  }
+  return metric.get();
+}
+
+Gauge* MetricsRegistry::gauge(const string& name, const string& help,
+                              const string& labels) {
+  MutexLockGuard lock(m_mutex);
+  std::unique_ptr<Gauge>& metric =
+      get_family(name, help, kGauge)->gauges[labels];
+  if (!metric) {
+    metric.reset(new Gauge);
+  }
+  return metric.get();
+}
+
+Histogram* MetricsRegistry::histogram(const string& name, const string& help,
+                                      const std::vector<double>& bounds,
+                                      const string& labels) {
+  MutexLockGuard lock(m_mutex);
+  std::unique_ptr<Histogram>& metric =
+      get_family(name, help, kHistogram)->histograms[labels];
+  if (!metric) {
+    metric.reset(new Histogram(bounds));
+  }
+  return metric.get();
+}
+
+LatencyHistogram* MetricsRegistry::latency(const string& name,
+                                           const string& help,
+                                           const string& labels) {
+  MutexLockGuard lock(m_mutex);
+  std::unique_ptr<LatencyHistogram>& metric =
+      get_family(name, help, kSummary)->latencies[labels];
+  if (!metric) {
+    metric.reset(new LatencyHistogram);
+  }
+  return metric.get();
+}
+
+void MetricsRegistry::gauge_function(const string& name, const string& help,
+                                     const std::function<double()>& fn) {
+  MutexLockGuard lock(m_mutex);
+  get_family(name, help, kGauge)->function = fn;
+}
+
+string MetricsRegistry::to_prometheus() const {
+  static const char* const kTypeNames[] = {"counter", "gauge", "histogram",
+                                             "summary"};
+  string out;
+  MutexLockGuard lock(m_mutex);
+  for (const auto& entry : m_families) {
+    const string& name = entry.first;
+    const Family& family = entry.second;
+    out += "# HELP " + name + " " + family.help + "\n";
+    out += "# TYPE " + name + " " + kTypeNames[family.type] + "\n";
+    for (const auto& counter : family.counters) {
+      append_sample(&out, name, counter.first,
+                    static_cast<double>(counter.second->value()));
+    }
+    for (const auto& gauge : family.gauges) {
+      append_sample(&out, name, gauge.first,
+                    static_cast<double>(gauge.second->value()));
+    }
+    if (family.function) {
+      append_sample(&out, name, string(), family.function());
+    }
+    for (const auto& histogram : family.histograms) {
+      const string& labels = histogram.first;
+      const string prefix = labels.empty() ? string() : labels + ",";
+      const std::vector<double>& bounds = histogram.second->bounds();
+      std::vector<int64_t> counts;
+      double sum = 0.0;
+      histogram.second->snapshot(&counts, &sum);
+      int64_t cumulative = 0;
+      for (size_t i = 0; i < counts.size(); ++i) {
+        cumulative += counts[i];
+        string le;
+        append_number(&le, i < bounds.size() ? bounds[i] : INFINITY);
+        append_sample(&out, name + "_bucket", prefix + "le=\"" + le + "\"",
+                      static_cast<double>(cumulative));
+      }
+      append_sample(&out, name + "_sum", labels, sum);
+      append_sample(&out, name + "_count", labels,
+                    static_cast<double>(cumulative));
+    }
+    for (const auto& latency : family.latencies) {
+      static const char* const kQuantiles[] = {"0.5", "0.99", "0.999"};
+      const string& labels = latency.first;
+      const string prefix = labels.empty() ? string() : labels + ",";
+      HdrHistogram merged;
+      int64_t sum = 0;
+      latency.second->snapshot(&merged, &sum);
+      for (const char* quantile : kQuantiles) {
+        double value =
+            merged.total_count() == 0
+                ? NAN
+                : static_cast<double>(merged.value_at_percentile(
+                      100.0 * atof(quantile))) /
+                      Timestamp::kMicroSecondsPerSecond;
+        append_sample(&out, name, prefix + "quantile=\"" + quantile + "\"",
+                      value);
+      }
+      append_sample(&out, name + "_sum", labels,
+                    static_cast<double>(sum) / Timestamp::kMicroSecondsPerSecond);
+      append_sample(&out, name + "_count", labels,
+                    static_cast<double>(merged.total_count()));
+    }
+  }
+  return out;
+}
+
+}  // namespace flute
@@ -0,0 +1,171 @@
+#ifndef FLUTE_COMMON_METRICS_H
+#define FLUTE_COMMON_METRICS_H
+
+#include <flute/common/Mutex.h>
+#include <flute/common/noncopyable.h>
+#include <flute/common/types.h>
+
+#include <stdint.h>
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace flute {
+
+class LatencyHistogram;
+
+namespace detail {
+
+const int kMetricShards = 16;
+const size_t kMetricCacheLineSize = 64;
+
+extern __thread int t_metric_shard;
+int assign_metric_shard();
+
+// The shard of the calling thread. Threads are spread over the shards as they
+// first record, so that each of them mostly writes cache lines of its own.
+inline int metric_shard() {
+  if (LIKELY_FALSE(t_metric_shard < 0)) {
+    return assign_metric_shard();
+  }
+  return t_metric_shard;
+}
+
+struct MetricCell {
+  MetricCell() : value(0) {}
+  std::atomic<int64_t> value;
+  char pad[kMetricCacheLineSize - sizeof(std::atomic<int64_t>)];
+};
+
+// Zeroed counts of one shard, aligned and rounded up to whole cache lines so
+// that no other allocation shares their lines.
+class MetricCounts : noncopyable {
+ public:
+  explicit MetricCounts(size_t num);
+  ~MetricCounts();
+
+  std::atomic<int64_t>& operator[](size_t i) { return m_counts[i]; }
+  const std::atomic<int64_t>& operator[](size_t i) const {
+    return m_counts[i];
+  }
+
+ private:
+  std::atomic<int64_t>* m_counts;
+};
+
+}  // namespace detail
+
+///
+/// A count that only goes up, sharded by thread.
+///
+/// add() is a relaxed atomic add to the cell of the calling thread, which no
+/// other thread is likely to write. value() sums the cells.
+class Counter : noncopyable {
+ public:
+  void add(int64_t n = 1) {
+    m_cells[detail::metric_shard()].value.fetch_add(n,
+                                                    std::memory_order_relaxed);
+  }
+  int64_t value() const;
+
+ private:
+  detail::MetricCell m_cells[detail::kMetricShards];
+};
+
+///
+/// A value that goes up and down.
+class Gauge : noncopyable {
+ public:
+  Gauge() : m_value(0) {}
+  void set(int64_t value) { m_value.store(value, std::memory_order_relaxed); }
+  void add(int64_t n) { m_value.fetch_add(n, std::memory_order_relaxed); }
+  int64_t value() const { return m_value.load(std::memory_order_relaxed); }
+
+ private:
+  std::atomic<int64_t> m_value;
+};
+
+///
+/// Counts of observed values by bucket, sharded by thread as Counter.
+class Histogram : noncopyable {
+ public:
+  /// bounds are the ascending upper bounds of the buckets, an unbounded one
+  /// follows them.
+  explicit Histogram(const std::vector<double>& bounds);
+  ~Histogram();
+
+  void observe(double value);
+
+  const std::vector<double>& bounds() const { return m_bounds; }
+  /// The merged counts of every bucket, not cumulative, and their sum.
+  void snapshot(std::vector<int64_t>* counts, double* sum) const;
+
+  /// count buckets from start, each factor times the one before.
+  static std::vector<double> exponential_bounds(double start, double factor,
+                                                int count);
+
+ private:
+  struct Shard;
+
+  const std::vector<double> m_bounds;
+  std::unique_ptr<Shard> m_shards[detail::kMetricShards];
+};
+
+///
+/// Named metrics of the process, exported in the Prometheus text format.
+///
+/// Metrics are made once, usually into a static pointer, and never freed.
+/// Recording into them takes no lock; making and exporting them does.
+class MetricsRegistry : noncopyable {
+ public:
+  MetricsRegistry();
+  ~MetricsRegistry();
+
+  /// The registry of the process, which also exports the process_* metrics.
+  static MetricsRegistry& instance();
+
+  /// labels is the inside of the braces, as code="200", or empty. The same
+  /// name and labels give the same metric. Thread safe.
+  Counter* counter(const string& name, const string& help,
+                   const string& labels = string());
+  Gauge* gauge(const string& name, const string& help,
+               const string& labels = string());
+  Histogram* histogram(const string& name, const string& help,
+                       const std::vector<double>& bounds,
+                       const string& labels = string());
+  /// Exported as a summary in seconds, with the 0.5, 0.99 and 0.999
+  /// quantiles. See LatencyHistogram in HdrHistogram.h.
+  LatencyHistogram* latency(const string& name, const string& help,
+                            const string& labels = string());
+  /// A gauge read by calling fn when exported.
+  void gauge_function(const string& name, const string& help,
+                      const std::function<double()>& fn);
+
+  /// The text exposition format, version 0.0.4.
+  string to_prometheus() const;
+
+ private:
+  enum Type { kCounter, kGauge, kHistogram, kSummary };
+  struct Family {
+    Type type;
+    string help;
+    std::map<string, std::unique_ptr<Counter>> counters;
+    std::map<string, std::unique_ptr<Gauge>> gauges;
+    std::map<string, std::unique_ptr<Histogram>> histograms;
+    std::map<string, std::unique_ptr<LatencyHistogram>> latencies;
+    std::function<double()> function;
+  };
+
+  Family* get_family(const string& name, const string& help, Type type)
+      REQUIRES(m_mutex);
+
+  mutable MutexLock m_mutex;
+  std::map<string, Family> m_families GUARDED_BY(m_mutex);
+};
+
+}  // namespace flute
+
+#endif  // FLUTE_COMMON_METRICS_H
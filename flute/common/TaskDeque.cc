@@ -13,11 +13,12 @@
 namespace flute {
 
 TaskDeque::TaskDeque(const string& name_arg)
-    : m_task_deque(kMaxTaskDequeSize),
-      m_name(name_arg),
+    : m_name(name_arg),
+      m_max_queue_size(0),
       m_is_running(false),
       m_cond_not_empty(m_deque_mutex),
-      m_cond_not_full(m_deque_mutex) {}
+      m_cond_not_full(m_deque_mutex),
+      m_cond_stopped(m_deque_mutex) {}
 
 TaskDeque::~TaskDeque() {
   LOG_TRACE << "TaskDeque dtor";
@@ -47,12 +48,20 @@ void TaskDeque::stop() {
     MutexLockGuard lock(m_deque_mutex);
     m_is_running = false;
     m_cond_not_empty.notify_all();
+    m_cond_stopped.notify_all();
   }
   for (auto& thr : m_threads) {
     thr->join();
   }
 }
 
+void TaskDeque::wait() const {
+  MutexLockGuard lock(m_deque_mutex);
+  while (m_is_running) {
+    m_cond_stopped.wait();
+  }
+}
+
 size_t TaskDeque::size() const {
   MutexLockGuard lock(m_deque_mutex);
   return m_task_deque.size();
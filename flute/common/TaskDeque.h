@@ -7,6 +7,7 @@
 #include <flute/common/types.h>
 #include <flute/common/BoundedBlockingDeque.h>
 
+#include <atomic>
 #include <deque>
 #include <vector>
 
@@ -28,7 +29,8 @@ class TaskDeque : noncopyable {
 
   void start(int num_threads);
   void stop();
-  void wait() const {while (m_is_running);}
+  // Block until stop() is called.
+  void wait() const;
 
   const string& name() const { return m_name; }
 
@@ -40,19 +42,20 @@ class TaskDeque : noncopyable {
  private:
   // Could block if maxQueueSize > 0
   void push_task(Task f, bool push_back);
-  bool is_full() const REQUIRES(m_queue_mutex);
+  bool is_full() const REQUIRES(m_deque_mutex);
   void worker_loop();
   Task take_one();
 
   mutable MutexLock m_deque_mutex;
   Condition m_cond_not_empty GUARDED_BY(m_deque_mutex);
   Condition m_cond_not_full GUARDED_BY(m_deque_mutex);
+  mutable Condition m_cond_stopped GUARDED_BY(m_deque_mutex);
   string m_name;
   Task m_thread_init_callback;
   std::vector<std::unique_ptr<flute::Thread>> m_threads;
   std::deque<Task> m_task_deque GUARDED_BY(m_deque_mutex);
   size_t m_max_queue_size;
-  bool m_is_running;
+  std::atomic<bool> m_is_running;
 };
 
 }  // namespace flute
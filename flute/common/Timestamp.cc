@@ -2,6 +2,7 @@
 
 #include <stdio.h>
 #include <sys/time.h>
+#include <time.h>
 
 #ifndef __STDC_FORMAT_MACROS
 #define __STDC_FORMAT_MACROS
@@ -0,0 +1,143 @@
+#ifndef FLUTE_COMMON_WORKSTEALINGDEQUE_H
+#define FLUTE_COMMON_WORKSTEALINGDEQUE_H
+
+#include <flute/common/noncopyable.h>
+
+#include <assert.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace flute {
+
+///
+/// The Chase-Lev deque of pointers, with the memory orders of "Correct and
+/// Efficient Work-Stealing for Weak Memory Models" (Le et al., PPoPP 2013).
+///
+/// The owner thread pushes and pops at the bottom, any other thread steals at
+/// the top, none of them takes a lock. The array grows when it is full, and
+/// the old arrays are kept until the deque is destroyed, since a thief may
+/// still be reading one.
+template <typename T>
+class WorkStealingDeque : noncopyable {
+ public:
+  explicit WorkStealingDeque(size_t capacity = 256)
+      : m_top(0), m_bottom(0), m_array(NULL) {
+    size_t n = 1;
+    while (n < capacity) {
+      n <<= 1;
+    }
+    m_arrays.emplace_back(new Array(n));
+    m_array.store(m_arrays.back().get(), std::memory_order_relaxed);
+  }
+
+  // an estimate when called by a thief
+  bool empty() const {
+    int64_t b = m_bottom.load(std::memory_order_relaxed);
+    int64_t t = m_top.load(std::memory_order_relaxed);
+    return b <= t;
+  }
+
+  // Owner only.
+  void push(T* item) {
+    int64_t b = m_bottom.load(std::memory_order_relaxed);
+    int64_t t = m_top.load(std::memory_order_acquire);
+    Array* a = m_array.load(std::memory_order_relaxed);
+    if (b - t > static_cast<int64_t>(a->mask)) {
+      a = grow(a, t, b);
+    }
+    a->put(b, item);
+    std::atomic_thread_fence(std::memory_order_release);
+    m_bottom.store(b + 1, std::memory_order_relaxed);
+  }
+
+  // Owner only, the last pushed item or NULL.
+  T* pop() {
+    int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+    Array* a = m_array.load(std::memory_order_relaxed);
+    m_bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = m_top.load(std::memory_order_relaxed);
+    if (t > b) {
+      // empty
+      m_bottom.store(b + 1, std::memory_order_relaxed);
+      return NULL;
+    }
+    T* item = a->get(b);
+    if (t == b) {
+      // the last one, race the thieves for it
+      if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                         std::memory_order_relaxed)) {
+        item = NULL;
+      }
+      m_bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return item;
+  }
+
+  // Any thread, the first pushed item, or NULL if it is empty or another
+  // thread won the race.
+  T* steal() {
+    int64_t t = m_top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = m_bottom.load(std::memory_order_acquire);
+    if (t >= b) {
+      return NULL;
+    }
+    Array* a = m_array.load(std::memory_order_acquire);
+    T* item = a->get(t);
+    if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                       std::memory_order_relaxed)) {
+      return NULL;
+    }
+    return item;
+  }
+
+ private:
+  struct Array {
+    explicit Array(size_t capacity)
+        : mask(capacity - 1), items(new std::atomic<T*>[capacity]) {}
+
+    T* get(int64_t i) const {
+      return items[static_cast<size_t>(i) & mask].load(
+          std::memory_order_relaxed);
+    }
+    void put(int64_t i, T* item) {
+      items[static_cast<size_t>(i) & mask].store(item,
+                                                 std::memory_order_relaxed);
+    }
+
+    const size_t mask;
+    std::unique_ptr<std::atomic<T*>[]> items;
+  };
+
+  Array* grow(Array* old, int64_t top, int64_t bottom) {
+    m_arrays.emplace_back(new Array((old->mask + 1) * 2));
+    Array* a = m_arrays.back().get();
+    for (int64_t i = top; i < bottom; ++i) {
+      a->put(i, old->get(i));
+    }
+    m_array.store(a, std::memory_order_release);
+    return a;
+  }
+
+  static const size_t kCacheLineSize = 64;
+  typedef std::atomic<int64_t> Index;
+
+  // The thieves share m_top, the owner mostly touches m_bottom, keep them on
+  // their own cache lines.
+  char m_pad0[kCacheLineSize];
+  Index m_top;
+  char m_pad1[kCacheLineSize - sizeof(Index)];
+  Index m_bottom;
+  char m_pad2[kCacheLineSize - sizeof(Index)];
+  std::atomic<Array*> m_array;
+  // owner only
+  std::vector<std::unique_ptr<Array>> m_arrays;
+};
+
+}  // namespace flute
+
+#endif  // FLUTE_COMMON_WORKSTEALINGDEQUE_H
@@ -0,0 +1,272 @@
+#include <flute/common/WorkStealingPool.h>
+
+#include <flute/common/Exception.h>
+#include <flute/common/Futex.h>
+
+#include <assert.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdio.h>
+
+#include <algorithm>
+
+namespace flute {
+
+namespace {
+
+// the Worker of the current thread, if it is a worker of a pool
+__thread void* t_worker = NULL;
+
+// A parking worker looks at the queues this many times, yielding in between,
+// before it sleeps.
+const int kSpinsBeforeParking = 16;
+// At most this many tasks move from the injection queue to a worker at once.
+const size_t kMaxInjectedBatch = 32;
+
+}  // namespace
+
+struct WorkStealingPool::Worker {
+  Worker(WorkStealingPool* owner, int index)
+      : pool(owner), random_state(2654435761u * (index + 1)) {}
+
+  // xorshift32
+  uint32_t next_random() {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+  }
+
+  WorkStealingDeque<Task> deque;
+  WorkStealingPool* const pool;
+  uint32_t random_state;
+};
+
+WorkStealingPool::WorkStealingPool(const string& name_arg)
+    : m_name(name_arg),
+      m_is_running(false),
+      m_injection_size(0),
+      m_wakeup_epoch(0),
+      m_num_parked(0) {}
+
+WorkStealingPool::~WorkStealingPool() {
+  if (m_is_running) {
+    stop();
+  }
+  // pushed after stop()
+  MutexLockGuard lock(m_injection_mutex);
+  for (Task* task : m_injection) {
+    delete task;
+  }
+}
+
+void WorkStealingPool::start(int num_threads) {
+  assert(m_threads.empty());
+  m_is_running = true;
+  // all the workers exist before any of them steals
+  m_workers.reserve(num_threads);
+  for (int i = 0; i < num_threads; ++i) {
+    m_workers.emplace_back(new Worker(this, i));
+  }
+  m_threads.reserve(num_threads);
+  for (int i = 0; i < num_threads; ++i) {
+    char id[32];
+    snprintf(id, sizeof id, "%d", i + 1);
+    m_threads.emplace_back(new Thread(
+        std::bind(&WorkStealingPool::worker_loop, this, m_workers[i].get()),
+        m_name + id));
+    m_threads[i]->start();
+  }
+  if (num_threads == 0 && m_thread_init_callback) {
+    m_thread_init_callback();
+  }
+}
+
+void WorkStealingPool::stop() {
+  m_is_running = false;
+  m_wakeup_epoch.fetch_add(1, std::memory_order_release);
+  futex_wake(&m_wakeup_epoch, INT_MAX);
+  for (auto& thr : m_threads) {
+    thr->join();
+  }
+}
+
+void WorkStealingPool::push_task(Task task) {
+  if (m_workers.empty()) {
+    // call the task in current thread.
+    task();
+    return;
+  }
+  Task* item = new Task(std::move(task));
+  Worker* worker = static_cast<Worker*>(t_worker);
+  if (worker != NULL && worker->pool == this) {
+    worker->deque.push(item);
+  } else {
+    MutexLockGuard lock(m_injection_mutex);
+    m_injection.push_back(item);
+    m_injection_size.store(m_injection.size(), std::memory_order_relaxed);
+  }
+  wake_up(1);
+}
+
+void WorkStealingPool::push_tasks(std::vector<Task>&& tasks) {
+  if (m_workers.empty()) {
+    for (auto& task : tasks) {
+      task();
+    }
+    tasks.clear();
+    return;
+  }
+  std::vector<Task*> items;
+  items.reserve(tasks.size());
+  for (auto& task : tasks) {
+    items.push_back(new Task(std::move(task)));
+  }
+  tasks.clear();
+  {
+    MutexLockGuard lock(m_injection_mutex);
+    m_injection.insert(m_injection.end(), items.begin(), items.end());
+    m_injection_size.store(m_injection.size(), std::memory_order_relaxed);
+  }
+  wake_up(static_cast<int>(std::min(items.size(), m_workers.size())));
+}
+
+void WorkStealingPool::wake_up(int count) {
+  // pairs with the fence in park(), either the parking worker sees the task
+  // or this thread sees the worker
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (count > 0 && m_num_parked.load(std::memory_order_relaxed) > 0) {
+    m_wakeup_epoch.fetch_add(1, std::memory_order_release);
+    futex_wake(&m_wakeup_epoch, count);
+  }
+}
+
+bool WorkStealingPool::has_task() {
+  if (m_injection_size.load(std::memory_order_relaxed) > 0) {
+    return true;
+  }
+  for (const auto& worker : m_workers) {
+    if (!worker->deque.empty()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void WorkStealingPool::park() {
+  for (int i = 0; i < kSpinsBeforeParking; ++i) {
+    if (has_task() || !m_is_running) {
+      return;
+    }
+    ::sched_yield();
+  }
+  uint32_t epoch = m_wakeup_epoch.load(std::memory_order_acquire);
+  m_num_parked.fetch_add(1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (!has_task() && m_is_running) {
+    futex_wait(&m_wakeup_epoch, epoch);
+  }
+  m_num_parked.fetch_sub(1, std::memory_order_relaxed);
+}
+
+WorkStealingPool::Task* WorkStealingPool::find_task(Worker* worker) {
+  Task* task = worker->deque.pop();
+  if (task == NULL) {
+    task = take_injected(worker);
+  }
+  if (task == NULL) {
+    task = steal(worker);
+  }
+  return task;
+}
+
+WorkStealingPool::Task* WorkStealingPool::take_injected(Worker* worker) {
+  if (m_injection_size.load(std::memory_order_relaxed) == 0) {
+    return NULL;
+  }
+  size_t moved = 0;
+  Task* task = NULL;
+  {
+    MutexLockGuard lock(m_injection_mutex);
+    if (m_injection.empty()) {
+      return NULL;
+    }
+    task = m_injection.front();
+    m_injection.pop_front();
+    // take a fair share, the others steal it if they are idle
+    size_t share =
+        std::min(m_injection.size() / m_workers.size(), kMaxInjectedBatch);
+    for (; moved < share; ++moved) {
+      worker->deque.push(m_injection.front());
+      m_injection.pop_front();
+    }
+    m_injection_size.store(m_injection.size(), std::memory_order_relaxed);
+  }
+  if (moved > 0) {
+    wake_up(1);
+  }
+  return task;
+}
+
+WorkStealingPool::Task* WorkStealingPool::steal(Worker* worker) {
+  const size_t n = m_workers.size();
+  if (n < 2) {
+    return NULL;
+  }
+  size_t start = worker->next_random() % n;
+  for (size_t i = 0; i < n; ++i) {
+    Worker* victim = m_workers[(start + i) % n].get();
+    if (victim == worker) {
+      continue;
+    }
+    Task* task = victim->deque.steal();
+    if (task != NULL) {
+      return task;
+    }
+  }
+  return NULL;
+}
+
+void WorkStealingPool::run(Task* task) {
+  std::unique_ptr<Task> holder(task);
+  (*task)();
+}
+
+void WorkStealingPool::worker_loop(Worker* worker) {
+  try {
+    t_worker = worker;
+    if (m_thread_init_callback) {
+      m_thread_init_callback();
+    }
+    while (true) {
+      Task* task = find_task(worker);
+      if (task != NULL) {
+        run(task);
+      } else if (m_is_running) {
+        park();
+      } else if (!has_task()) {
+        // stopped, and the tasks left have run
+        break;
+      }
+    }
+    t_worker = NULL;
+  } catch (const Exception& ex) {
+    fprintf(stderr, "exception caught in WorkStealingPool %s\n",
+            m_name.c_str());
+    fprintf(stderr, "reason: %s\n", ex.what());
+    fprintf(stderr, "stack trace: %s\n", ex.stackTrace());
+    abort();
+  } catch (const std::exception& ex) {
+    fprintf(stderr, "exception caught in WorkStealingPool %s\n",
+            m_name.c_str());
+    fprintf(stderr, "reason: %s\n", ex.what());
+    abort();
+  } catch (...) {
+    fprintf(stderr, "unknown exception caught in WorkStealingPool %s\n",
+            m_name.c_str());
+    throw;  // rethrow
+  }
+}
+
+}  // namespace flute
@@ -0,0 +1,95 @@
+#ifndef FLUTE_COMMON_WORKSTEALINGPOOL_H
+#define FLUTE_COMMON_WORKSTEALINGPOOL_H
+
+#include <flute/common/Mutex.h>
+#include <flute/common/Thread.h>
+#include <flute/common/WorkStealingDeque.h>
+#include <flute/common/types.h>
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace flute {
+
+///
+/// A pool of threads that steal work from each other.
+///
+/// A task pushed by one of the workers goes to the bottom of its own
+/// WorkStealingDeque, and it runs the newest of them first. Tasks from other
+/// threads go to one injection queue. An idle worker takes its own tasks, then
+/// a share of the injection queue, then steals the oldest tasks of a random
+/// worker, and at last parks on a futex until new tasks come.
+///
+/// Unlike TaskDeque there is no bound and no push to the front, and stop()
+/// runs the remaining tasks before it returns.
+class WorkStealingPool : noncopyable {
+ public:
+  typedef std::function<void()> Task;
+
+  explicit WorkStealingPool(const string& name_arg = string("WorkStealingPool"));
+  ~WorkStealingPool();
+
+  // Must be called before start().
+  void set_thread_init_callback(const Task& cb) { m_thread_init_callback = cb; }
+
+  // With no threads, tasks run in the pushing thread.
+  void start(int num_threads);
+  void stop();
+
+  const string& name() const { return m_name; }
+  size_t num_threads() const { return m_workers.size(); }
+
+  // thread safe
+  void push_task(Task task);
+  // With one lock of the injection queue and the wakeups the tasks need.
+  void push_tasks(std::vector<Task>&& tasks);
+
+  // Run func in the pool, the future holds its result or exception.
+  template <typename Func>
+  std::future<typename std::result_of<Func()>::type> submit(Func func) {
+    typedef typename std::result_of<Func()>::type Result;
+    // std::function needs a copyable task
+    std::shared_ptr<std::packaged_task<Result()>> task(
+        new std::packaged_task<Result()>(std::move(func)));
+    std::future<Result> result = task->get_future();
+    push_task([task]() { (*task)(); });
+    return result;
+  }
+
+ private:
+  struct Worker;
+
+  void worker_loop(Worker* worker);
+  Task* find_task(Worker* worker);
+  Task* take_injected(Worker* worker);
+  Task* steal(Worker* worker);
+  bool has_task();
+  void park();
+  void wake_up(int count);
+  void run(Task* task);
+
+  const string m_name;
+  Task m_thread_init_callback;
+  std::vector<std::unique_ptr<Worker>> m_workers;
+  std::vector<std::unique_ptr<Thread>> m_threads;
+  std::atomic<bool> m_is_running;
+
+  MutexLock m_injection_mutex;
+  std::deque<Task*> m_injection GUARDED_BY(m_injection_mutex);
+  std::atomic<size_t> m_injection_size;
+
+  // Parking: a worker reads m_wakeup_epoch, counts itself in m_num_parked,
+  // checks the queues once more and sleeps on the epoch. A pusher bumps the
+  // epoch if anyone is parked, so no wakeup is lost.
+  std::atomic<uint32_t> m_wakeup_epoch;
+  std::atomic<int> m_num_parked;
+};
+
+}  // namespace flute
+
+#endif  // FLUTE_COMMON_WORKSTEALINGPOOL_H
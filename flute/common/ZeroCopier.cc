@@ -1,8 +1,13 @@
+#include <errno.h>
 #include <fcntl.h>
 #include <flute/common/LogLine.h>
+#include <flute/common/MappedFile.h>
+#include <flute/common/Metrics.h>
+#include <flute/common/ThreadLocal.h>
 #include <flute/common/ZeroCopier.h>
 #include <flute/common/types.h>
-#include <sys/mman.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <sys/sendfile.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
@@ -12,23 +17,69 @@
 #include <algorithm>
 #include <fstream>
 #include <string>
+#include <vector>
 
 #include "stdio.h"
 
 namespace flute {
 
-size_t ZeroCopier::g_chunk_size = 1024;
+namespace {
+
+// read buffer of kReadWrite, one per sending thread
+ThreadLocal<std::vector<char>> t_read_buffer;
+
+Counter* copied_bytes_counter(const char* mode) {
+  return MetricsRegistry::instance().counter(
+      "flute_zerocopier_sent_bytes_total",
+      "File body bytes sent by ZeroCopier, by copy mode.",
+      string("mode=\"") + mode + "\"");
+}
+
+// by CopyMode
+Counter* const g_copied_bytes[] = {copied_bytes_counter("sendfile"),
+                                   copied_bytes_counter("mmap"),
+                                   copied_bytes_counter("readwrite")};
+
+}  // namespace
+
+size_t ZeroCopier::g_chunk_size = 64 * 1024;
+size_t ZeroCopier::g_bytes_per_event = 1024 * 1024;
+const size_t ZeroCopier::kMinChunkSize;
+const size_t ZeroCopier::kMaxChunkSize;
 ZeroCopier::CopyMode ZeroCopier::g_copy_mode = kZeroCopy;
 string ZeroCopier::g_copy_mode_names[] = {"ZeroCopy", "MMap", "ReadWrite"};
 
 ZeroCopier::ZeroCopier(const string& path)
-    : m_failure_counter{0}, m_started{false} {
+    : m_source_fd{-1},
+      m_target_fd{-1},
+      m_failure_counter{0},
+      m_source_available{false},
+      m_source_size{0},
+      m_source_inode{0},
+      m_begin{0},
+      m_total_bytes{0},
+      m_offset{0},
+      m_chunk_size{g_chunk_size},
+      m_started{false},
+      m_pending_begin{0} {
+  open_source(path);
+}
+
+ZeroCopier::ZeroCopier(const string& path, off_t offset, size_t length)
+    : ZeroCopier(path) {
+  if (m_source_available && !set_window(offset, length)) {
+    LOG_ERROR << "Invalid window [" << offset << ", +" << length << ") of "
+              << path << " with " << m_source_size << " bytes";
+    m_source_available = false;
+  }
+}
+
+void ZeroCopier::open_source(const string& path) {
   // open the file
-  m_source_available = false;
-  int source_fd = ::open(path.c_str(), O_RDONLY);
+  int source_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
   if (source_fd == -1) {
     char buf[100];
-    sprintf(buf, "Cannot open file: %s!", path.c_str());
+    snprintf(buf, sizeof buf, "Cannot open file: %s!", path.c_str());
     perror(buf);
     return;
   }
@@ -36,55 +87,128 @@ ZeroCopier::ZeroCopier(const string& path)
   // get the file status
   if (fstat64(source_fd, &filestat) < 0) {
     perror("Invalid File!");
+    ::close(source_fd);
     return;
   }
   m_source_available = true;
   m_source_path = path;
 
   m_source_fd = source_fd;
-  m_target_fd = -1;
-  m_total_bytes = filestat.st_size;
-  m_offset = 0;
+  m_source_size = filestat.st_size;
+  m_source_modify_time = Timestamp::from_unix_time(
+      filestat.st_mtim.tv_sec,
+      static_cast<int>(filestat.st_mtim.tv_nsec / 1000));
+  m_source_inode = filestat.st_ino;
+  m_total_bytes = m_source_size;
+}
+
+bool ZeroCopier::set_window(off_t offset, size_t length) {
+  assert(!m_started);
+  if (offset < 0 || static_cast<size_t>(offset) > m_source_size ||
+      length > m_source_size - static_cast<size_t>(offset)) {
+    return false;
+  }
+  m_begin = offset;
+  m_total_bytes = length;
+  m_offset = offset;
+  return true;
 }
 
-// Can auto-adjust the chunk size.
+void ZeroCopier::start() {
+  m_started = true;
+  init_chunk_size();
+}
+
+// Start with what the socket can hold at once: the larger of the free send
+// buffer and the congestion window.
+void ZeroCopier::init_chunk_size() {
+  size_t chunk_size = g_chunk_size;
+  if (m_target_fd != -1) {
+    int sndbuf = 0;
+    socklen_t len = sizeof sndbuf;
+    if (::getsockopt(m_target_fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, &len) == 0 &&
+        sndbuf > 0) {
+      // the kernel doubles SO_SNDBUF for bookkeeping overhead
+      chunk_size = std::max(chunk_size, static_cast<size_t>(sndbuf) / 2);
+    }
+    struct tcp_info tcpi;
+    len = sizeof tcpi;
+    mem_zero(&tcpi, sizeof tcpi);
+    if (::getsockopt(m_target_fd, SOL_TCP, TCP_INFO, &tcpi, &len) == 0) {
+      chunk_size =
+          std::max(chunk_size, static_cast<size_t>(tcpi.tcpi_snd_cwnd) *
+                                   tcpi.tcpi_snd_mss);
+    }
+  }
+  m_chunk_size = std::min(std::max(chunk_size, kMinChunkSize), kMaxChunkSize);
+}
+
+// A full chunk taken by the socket means there is room for more, a short one
+// tells how much the socket buffer actually holds.
+void ZeroCopier::adapt_chunk_size(size_t bytes_asked, size_t bytes_sent) {
+  if (bytes_sent == bytes_asked) {
+    m_chunk_size = std::min(m_chunk_size * 2, kMaxChunkSize);
+  } else {
+    m_chunk_size = std::max(bytes_sent, kMinChunkSize);
+  }
+}
+
+// Keep copying until the socket is full, the window is done, or this transfer
+// has used up its share of the current writable event.
 size_t ZeroCopier::send_one_chunk() {
   if (!is_valid() || !has_started()) {
     return -1;
   }
   if (remaining_bytes() <= 0) return 0;
-  ssize_t bytes_to_send =
-      std::min(g_chunk_size, static_cast<size_t>(remaining_bytes()));
-  ssize_t num_bytes_sent;
-  errno = 0;
-  switch (g_copy_mode) {
-    case kZeroCopy:
-      num_bytes_sent = send_one_chunk_zerocopy(bytes_to_send);
-      break;
-    case kMMap:
-      num_bytes_sent = send_one_chunk_mmap(bytes_to_send);
-      break;
-    case kReadWrite:
-      num_bytes_sent = send_one_chunk_rw(bytes_to_send);
-      break;
-    default:
-      assert(false);
-  }
-  if (num_bytes_sent < 0) {
-    m_failure_counter++;
-    // HACK: ZeroCopier will try continously for kMaxTrial times.
-    LOG_ERROR << "copy failed. trial= " << m_failure_counter;
-    if (m_failure_counter >= kMaxTrial) {
-      // The copier need to terminate itself, instead of sending that over and
-      // over again
-      mark_abort();
-      LOG_ERROR << m_source_path << " send_one_chunk failed";
-      return -1;
+  size_t bytes_sent_in_event = 0;
+  while (remaining_bytes() > 0 && bytes_sent_in_event < g_bytes_per_event) {
+    size_t budget = g_bytes_per_event - bytes_sent_in_event;
+    size_t bytes_to_send = std::min(std::min(m_chunk_size, budget),
+                                    static_cast<size_t>(remaining_bytes()));
+    ssize_t num_bytes_sent;
+    switch (g_copy_mode) {
+      case kZeroCopy:
+        num_bytes_sent = send_one_chunk_zerocopy(bytes_to_send);
+        break;
+      case kMMap:
+        num_bytes_sent = send_one_chunk_mmap(bytes_to_send);
+        break;
+      case kReadWrite:
+        num_bytes_sent = send_one_chunk_rw(bytes_to_send);
+        break;
+      default:
+        assert(false);
+        num_bytes_sent = -1;
+        break;
+    }
+    if (num_bytes_sent < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+        // socket buffer is full, wait for the next writable event.
+        break;
+      }
+      m_failure_counter++;
+      // HACK: ZeroCopier will try continously for kMaxTrial times.
+      LOG_EVERY_N(ERROR, 10) << "copy failed. trial= " << m_failure_counter;
+      if (m_failure_counter >= kMaxTrial) {
+        // The copier need to terminate itself, instead of sending that over
+        // and over again
+        mark_abort();
+        LOG_ERROR << m_source_path << " send_one_chunk failed";
+        return -1;
+      }
+      return bytes_sent_in_event > 0 ? bytes_sent_in_event : -1;
     }
-  } else {
     m_failure_counter = 0;
+    g_copied_bytes[g_copy_mode]->add(num_bytes_sent);
+    bytes_sent_in_event += num_bytes_sent;
+    adapt_chunk_size(bytes_to_send, num_bytes_sent);
+    if (static_cast<size_t>(num_bytes_sent) < bytes_to_send) {
+      // A short write means the socket buffer is full. Trying again now would
+      // only return EAGAIN.
+      break;
+    }
   }
-  return num_bytes_sent;
+  return bytes_sent_in_event;
 }
 
 ssize_t ZeroCopier::send_one_chunk_zerocopy(size_t bytes_to_send) {
@@ -94,63 +218,94 @@ ssize_t ZeroCopier::send_one_chunk_zerocopy(size_t bytes_to_send) {
 }
 
 ssize_t ZeroCopier::send_one_chunk_mmap(size_t bytes_to_send) {
-  // HACK: offset must be a multiple of the page size as returned by
-  // sysconf(_SC_PAGE_SIZE). https://man7.org/linux/man-pages/man2/mmap.2.html
-  g_chunk_size = 1 * 1024;
-  static size_t PAGESIZE = 4096;
-  // HACK: Assume 4096 is the pagesize.
-  off_t page_offset = (m_offset / PAGESIZE) * PAGESIZE;
-  off_t gap = m_offset - page_offset;
-  size_t len = gap + bytes_to_send;
-  errno = 0;
-  void* portion_ptr =
-      mmap(NULL, len, PROT_READ, MAP_PRIVATE, m_source_fd, page_offset);
-  if (errno != 0) {
-    LOG_ERROR << "mmap";
-    munmap(portion_ptr, len);
-    return -1;
+  if (!m_mapped_file) {
+    // Map the whole file once, and share it with every copier sending the
+    // same file.
+    m_mapped_file = MappedFileCache::instance().get(
+        m_source_path, m_source_fd, m_source_inode, m_source_size,
+        m_source_modify_time);
   }
-  void* start = static_cast<void*>(static_cast<char*>(portion_ptr) + gap);
-  errno = 0;
-  ssize_t bytes_sent = send(m_target_fd, start, bytes_to_send, 0);
+  if (!m_mapped_file->valid() ||
+      static_cast<size_t>(window_end()) > m_mapped_file->size()) {
+    // The file can not be mapped, fall back to sendfile()
+    return send_one_chunk_zerocopy(bytes_to_send);
+  }
+  ssize_t bytes_sent = ::send(m_target_fd, m_mapped_file->data() + m_offset,
+                              bytes_to_send, MSG_NOSIGNAL);
   if (bytes_sent > 0) {
     m_offset += bytes_sent;
-  } else {
-    LOG_ERROR << "send";
-    return -1;
-  }
-  errno = 0;
-  munmap(portion_ptr, bytes_to_send);
-  if (errno != 0) {
-    LOG_ERROR << "munmap";
-    return -1;
   }
   return bytes_sent;
 }
 
 ssize_t ZeroCopier::send_one_chunk_rw(size_t bytes_to_send) {
-  static char* buffer = static_cast<char*>(std::malloc(g_chunk_size));
-  // create a shared pointer that manages the buffer
-  static std::shared_ptr<char> buffer_ptr(buffer, std::free);
-  ssize_t bytes_read = ::read(m_source_fd, buffer, bytes_to_send);
-  if (errno != 0) {
-    LOG_ERROR << "read error";
-    return -1;
+  ssize_t total_sent = 0;
+  if (m_pending_begin < m_pending.size()) {
+    // bytes read for an earlier short write go first, and are never read again
+    size_t n = std::min(bytes_to_send, m_pending.size() - m_pending_begin);
+    ssize_t bytes_sent =
+        ::write(m_target_fd, m_pending.data() + m_pending_begin, n);
+    if (bytes_sent < 0) {
+      return -1;
+    }
+    m_pending_begin += bytes_sent;
+    m_offset += bytes_sent;
+    if (m_pending_begin < m_pending.size()) {
+      return bytes_sent;
+    }
+    m_pending.clear();
+    m_pending_begin = 0;
+    total_sent = bytes_sent;
+    bytes_to_send -= bytes_sent;
+    if (bytes_to_send == 0) {
+      return total_sent;
+    }
   }
-  if (bytes_read == -1)
-    return -1;
-  else {
-    ssize_t bytes_sent = write(m_target_fd, buffer, bytes_read);
-    if (bytes_sent > 0) {
-      m_offset += bytes_sent;
+
+  // Every reactor thread reads into its own buffer, grown to the largest chunk
+  // it has sent.
+  std::vector<char>& buffer = t_read_buffer.value();
+  if (buffer.size() < bytes_to_send) {
+    buffer.resize(bytes_to_send);
+  }
+  // pread() leaves the file position alone, so no state is kept in the fd.
+  ssize_t bytes_read = ::pread(m_source_fd, buffer.data(), bytes_to_send,
+                               m_offset);
+  if (bytes_read <= 0) {
+    if (bytes_read == 0) {
+      // the file was truncated under us
+      errno = EIO;
     }
-    return bytes_sent;
+    LOG_SYSERR << "ZeroCopier::send_one_chunk_rw pread " << m_source_path;
+    return total_sent > 0 ? total_sent : -1;
   }
+  ssize_t bytes_sent = ::write(m_target_fd, buffer.data(), bytes_read);
+  if (bytes_sent < 0) {
+    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+      return total_sent > 0 ? total_sent : -1;
+    }
+    bytes_sent = 0;
+  }
+  if (bytes_sent < bytes_read) {
+    // keep the unsent tail for the next writable event
+    m_pending.assign(buffer.data() + bytes_sent,
+                     static_cast<size_t>(bytes_read - bytes_sent));
+    m_pending_begin = 0;
+  }
+  m_offset += bytes_sent;
+  total_sent += bytes_sent;
+  if (total_sent == 0) {
+    errno = EAGAIN;
+    return -1;
+  }
+  return total_sent;
 }
 
 ZeroCopier::~ZeroCopier() {
   LOG_TRACE << "Zero Copier for " << m_source_path << " Deconstructed.";
-  ::close(m_source_fd);
+  if (m_source_fd >= 0) {
+    ::close(m_source_fd);
+  }
 }
 
 }  // namespace flute
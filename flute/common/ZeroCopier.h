@@ -1,5 +1,8 @@
 #ifndef FLUTE_COMMON_ZEROCOPIER_H
 #define FLUTE_COMMON_ZEROCOPIER_H
+#include <assert.h>
+#include <flute/common/MappedFile.h>
+#include <flute/common/Timestamp.h>
 #include <flute/common/types.h>
 #include <flute/net/Channel.h>
 #include <sys/sendfile.h>
@@ -18,11 +21,20 @@ class ZeroCopier {
   enum CopyMode { kZeroCopy, kMMap, kReadWrite };
   static string g_copy_mode_names[];
   static const int kMaxTrial = 100;
+  static const size_t kMinChunkSize = 4 * 1024;
+  static const size_t kMaxChunkSize = 4 * 1024 * 1024;
 
+  // the first chunk of a transfer, later chunks adapt to the socket
   static size_t g_chunk_size;
+  // fairness budget, so that one big file does not starve other connections
+  // of the same reactor
+  static size_t g_bytes_per_event;
   static CopyMode g_copy_mode;
   ZeroCopier() = delete;
+  // Copy the whole file.
   ZeroCopier(const string& path);
+  // Copy the window [offset, offset + length) of the file.
+  ZeroCopier(const string& path, off_t offset, size_t length);
   ~ZeroCopier();
 
   bool has_finished() const {
@@ -32,30 +44,51 @@ class ZeroCopier {
       return true;
     } else {
       assert(m_source_available);
-      return (static_cast<size_t>(m_offset) == m_total_bytes);
+      return m_offset == window_end();
     }
   }
-  size_t source_size() const { return m_total_bytes; }
+  // size of the whole source file
+  size_t source_size() const { return m_source_size; }
+  // metadata of the source file when it was opened, for HTTP validators
+  Timestamp source_modify_time() const { return m_source_modify_time; }
+  ino_t source_inode() const { return m_source_inode; }
+  // bytes of the window to be copied
+  size_t window_size() const { return m_total_bytes; }
+  off_t window_begin() const { return m_begin; }
 
   bool is_valid() const { return m_source_available && (m_target_fd != -1); }
+  bool is_source_available() const { return m_source_available; }
 
-  // send with best effort
+  // send with best effort, until the socket is full or g_bytes_per_event bytes
+  // have been sent. Return the bytes sent.
   // size_t not ssize_t because it may return -1 as err
   size_t send_one_chunk();
-  ssize_t remaining_bytes() const { return m_total_bytes - m_offset; }
+  ssize_t remaining_bytes() const { return window_end() - m_offset; }
+
+  // Narrow the copy down to [offset, offset + length) of the source file.
+  // Must be called before start(). Return false if the window is out of range.
+  bool set_window(off_t offset, size_t length);
 
   void set_target_fd(int target_fd) { m_target_fd = target_fd; }
   static void set_chunk_size(size_t chunk_size) { g_chunk_size = chunk_size; }
+  static void set_bytes_per_event(size_t bytes) { g_bytes_per_event = bytes; }
+  size_t chunk_size() const { return m_chunk_size; }
   static void set_g_copy_mode(CopyMode on) { g_copy_mode = on; }
 
   // HACK: Lie to the caller that it has finished.
   void mark_abort() {
+    m_begin = 0;
     m_total_bytes = 0;
     m_offset = 0;
+    m_pending.clear();
+    m_pending_begin = 0;
   }
 
-  bool to_abort() { return m_total_bytes == 0 && m_offset == 0; }
-  void start() { m_started = true; }
+  bool to_abort() {
+    return m_begin == 0 && m_total_bytes == 0 && m_offset == 0;
+  }
+  // Must be called after set_target_fd().
+  void start();
   bool has_started() const { return m_started; }
 
   string& copymode_to_string() const {
@@ -65,6 +98,13 @@ class ZeroCopier {
   const string& source_path() { return m_source_path; }
 
  private:
+  void open_source(const string& path);
+  void init_chunk_size();
+  void adapt_chunk_size(size_t bytes_asked, size_t bytes_sent);
+  off_t window_end() const {
+    return m_begin + static_cast<off_t>(m_total_bytes);
+  }
+
   ssize_t send_one_chunk_zerocopy(size_t bytes_to_send);
   ssize_t send_one_chunk_mmap(size_t bytes_to_send);
   ssize_t send_one_chunk_rw(size_t bytes_to_send);
@@ -76,9 +116,23 @@ class ZeroCopier {
   int m_failure_counter;
   // If any file error occurs, it will become false;
   bool m_source_available;
+  size_t m_source_size;
+  Timestamp m_source_modify_time;
+  ino_t m_source_inode;
+  // the window [m_begin, m_begin + m_total_bytes) is to be copied, m_offset is
+  // the next byte to send.
+  off_t m_begin;
   size_t m_total_bytes;
   off_t m_offset;
+  // chunk size of this transfer
+  size_t m_chunk_size;
   bool m_started;
+  // the shared mapping of the whole source file, used by kMMap
+  MappedFilePtr m_mapped_file;
+  // bytes read but not written yet by kReadWrite, the unsent ones start at
+  // m_pending_begin and continue from m_offset of the source.
+  string m_pending;
+  size_t m_pending_begin;
 };
 
 }  // namespace flute
@@ -0,0 +1,104 @@
+#include <flute/common/AsyncLogging.h>
+#include <flute/common/LogLine.h>
+#include <flute/common/Thread.h>
+#include <flute/common/Timestamp.h>
+
+#include <glob.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <memory>
+#include <vector>
+
+// Usage: AsyncLogging_bench [threads] [lines_per_thread] [preallocate]
+//                           [overflow_policy] [binary]
+// Logs through LOG_INFO into a temporary directory, and reports the rate from
+// the first line to the last byte written by the backend.
+
+namespace {
+
+flute::AsyncLogging* g_async_logging = NULL;
+
+void async_output(const char* msg, int len) {
+  g_async_logging->append(msg, len);
+}
+
+void produce(int num_lines) {
+  for (int i = 0; i < num_lines; ++i) {
+    LOG_INFO << "AsyncLogging_bench line " << i << " of " << num_lines
+             << " abcdefghijklmnopqrstuvwxyz " << 3.14159;
+  }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  int num_threads = argc > 1 ? atoi(argv[1]) : 4;
+  int num_lines = argc > 2 ? atoi(argv[2]) : 1000 * 1000;
+  bool preallocate = argc > 3 ? atoi(argv[3]) != 0 : false;
+  flute::AsyncLogging::OverflowPolicy policy =
+      argc > 4 ? static_cast<flute::AsyncLogging::OverflowPolicy>(atoi(argv[4]))
+               : flute::AsyncLogging::kBlock;
+  bool binary = argc > 5 ? atoi(argv[5]) != 0 : false;
+
+  char dir[] = "/tmp/AsyncLogging_bench.XXXXXX";
+  if (::mkdtemp(dir) == NULL || ::chdir(dir) != 0) {
+    perror("temporary directory");
+    return 1;
+  }
+
+  int64_t dropped_lines = 0;
+  flute::Timestamp start;
+  {
+    flute::AsyncLogging logging("AsyncLogging_bench", 1024 * 1024 * 1024);
+    logging.set_preallocate(preallocate);
+    logging.set_overflow_policy(policy);
+    logging.start();
+    g_async_logging = &logging;
+    flute::LogLine::set_output(async_output);
+    flute::LogLine::set_binary(binary);
+
+    start = flute::Timestamp::now();
+    std::vector<std::unique_ptr<flute::Thread>> threads;
+    for (int i = 0; i < num_threads; ++i) {
+      threads.emplace_back(
+          new flute::Thread(std::bind(&produce, num_lines), "producer"));
+      threads.back()->start();
+    }
+    for (auto& thread : threads) {
+      thread->join();
+    }
+    logging.stop();
+    flute::LogLine::set_binary(false);
+    flute::LogLine::set_output(flute::LogLine::default_output);
+    dropped_lines = logging.dropped_lines();
+  }
+  double seconds = flute::second_difference(flute::Timestamp::now(), start);
+
+  int64_t total_bytes = 0;
+  glob_t files;
+  if (::glob("AsyncLogging_bench.*.log", 0, NULL, &files) == 0) {
+    for (size_t i = 0; i < files.gl_pathc; ++i) {
+      struct stat stat_buf;
+      if (::stat(files.gl_pathv[i], &stat_buf) == 0) {
+        total_bytes += stat_buf.st_size;
+      }
+      ::unlink(files.gl_pathv[i]);
+    }
+    ::globfree(&files);
+  }
+  ::chdir("/tmp");
+  ::rmdir(dir);
+
+  int64_t total_lines = static_cast<int64_t>(num_threads) * num_lines;
+  printf("%d threads x %d lines, preallocate %d, policy %d, binary %d\n",
+         num_threads, num_lines, preallocate ? 1 : 0, static_cast<int>(policy),
+         binary ? 1 : 0);
+  printf("%.3f s %10.1f MB/s %12.0f lines/s %lld dropped\n", seconds,
+         static_cast<double>(total_bytes) / seconds / 1024 / 1024,
+         static_cast<double>(total_lines - dropped_lines) / seconds,
+         static_cast<long long>(dropped_lines));
+  return 0;
+}
@@ -0,0 +1,185 @@
+#include <flute/common/AsyncLogging.h>
+#include <flute/common/Thread.h>
+#include <flute/common/tests/TestUtil.h>
+
+#include <glob.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+using flute::test::expect;
+
+const int kNumThreads = 4;
+const int kLinesPerThread = 100 * 1000;
+
+void produce(flute::AsyncLogging* logging, int id) {
+  char line[128];
+  for (int i = 0; i < kLinesPerThread; ++i) {
+    int len = snprintf(line, sizeof line,
+                       "thread %d line %d padding padding padding\n", id, i);
+    logging->append(line, len);
+  }
+}
+
+// Read the lines of the log files of the current directory, then remove
+// them.
+std::vector<std::string> read_log_lines() {
+  std::vector<std::string> lines;
+  glob_t files;
+  if (::glob("AsyncLogging_test.*.log", 0, NULL, &files) == 0) {
+    for (size_t i = 0; i < files.gl_pathc; ++i) {
+      std::ifstream in(files.gl_pathv[i]);
+      std::string line;
+      while (std::getline(in, line)) {
+        lines.push_back(line);
+      }
+      ::unlink(files.gl_pathv[i]);
+    }
+    ::globfree(&files);
+  }
+  return lines;
+}
+
+// Run test in a temporary directory.
+void in_temporary_directory(const char* name, const std::function<void()>& test) {
+  char dir[] = "/tmp/AsyncLogging_test.XXXXXX";
+  if (::mkdtemp(dir) == NULL || ::chdir(dir) != 0) {
+    expect(false, std::string(name) + " temporary directory");
+    return;
+  }
+  test();
+  ::chdir("/tmp");
+  ::rmdir(dir);
+}
+
+// Log from kNumThreads threads, then check the lines in the log files.
+void run(const char* name, flute::AsyncLogging::OverflowPolicy policy) {
+  int64_t dropped_lines = 0;
+  {
+    flute::AsyncLogging logging("AsyncLogging_test", 1024 * 1024 * 1024);
+    logging.set_overflow_policy(policy);
+    // small rings to overflow them
+    logging.set_staging_size(64 * 1024);
+    logging.start();
+    std::vector<std::unique_ptr<flute::Thread>> threads;
+    for (int i = 0; i < kNumThreads; ++i) {
+      threads.emplace_back(
+          new flute::Thread(std::bind(&produce, &logging, i), "producer"));
+      threads.back()->start();
+    }
+    for (auto& thread : threads) {
+      thread->join();
+    }
+    logging.stop();
+    dropped_lines = logging.dropped_lines();
+  }
+
+  int64_t num_lines = 0;
+  bool in_order = true;
+  std::vector<int> last_line(kNumThreads, -1);
+  for (const std::string& line : read_log_lines()) {
+    int id = 0;
+    int seq = 0;
+    if (sscanf(line.c_str(), "thread %d line %d", &id, &seq) != 2) {
+      continue;
+    }
+    ++num_lines;
+    if (id < 0 || id >= kNumThreads || seq <= last_line[id]) {
+      in_order = false;
+    } else {
+      last_line[id] = seq;
+    }
+  }
+
+  const int64_t total = kNumThreads * kLinesPerThread;
+  printf("%s: %lld written, %lld dropped\n", name,
+         static_cast<long long>(num_lines),
+         static_cast<long long>(dropped_lines));
+  expect(num_lines + dropped_lines == total,
+         std::string(name) + " every line is written or dropped");
+  expect(in_order, std::string(name) + " lines of a thread keep their order");
+  if (policy == flute::AsyncLogging::kBlock) {
+    expect(dropped_lines == 0, std::string(name) + " drops nothing");
+  }
+}
+
+void produce_a_few(flute::AsyncLogging* logging, int id) {
+  char line[128];
+  for (int i = 0; i < 100; ++i) {
+    int len = snprintf(line, sizeof line, "late thread %d line %d\n", id, i);
+    logging->append(line, len);
+  }
+}
+
+// Threads come and go while the backend drains and forgets the rings of the
+// exited ones. The rings of the new threads must not be forgotten with them.
+void test_late_threads() {
+  const int kWaves = 50;
+  int64_t dropped_lines = 0;
+  {
+    flute::AsyncLogging logging("AsyncLogging_test", 1024 * 1024 * 1024, 1);
+    logging.set_staging_size(4 * 1024);
+    logging.start();
+    for (int wave = 0; wave < kWaves; ++wave) {
+      std::vector<std::unique_ptr<flute::Thread>> threads;
+      for (int i = 0; i < kNumThreads; ++i) {
+        threads.emplace_back(new flute::Thread(
+            std::bind(&produce_a_few, &logging, wave * kNumThreads + i),
+            "late"));
+        threads.back()->start();
+      }
+      for (auto& thread : threads) {
+        thread->join();
+      }
+    }
+    logging.stop();
+    dropped_lines = logging.dropped_lines();
+  }
+  size_t num_lines = read_log_lines().size();
+  expect(dropped_lines == 0 && num_lines == kWaves * kNumThreads * 100,
+         "lines of threads started after the backend are all written");
+}
+
+// The ring of 5000 bytes is 8192, its lines longer than 5000 bytes must still
+// be drained.
+void test_long_lines() {
+  const std::string line(6000, 'x');
+  int64_t dropped_lines = 0;
+  {
+    flute::AsyncLogging logging("AsyncLogging_test", 1024 * 1024 * 1024);
+    logging.set_staging_size(5000);
+    logging.start();
+    for (int i = 0; i < 10; ++i) {
+      logging.append((line + "\n").c_str(), static_cast<int>(line.size() + 1));
+    }
+    logging.stop();
+    dropped_lines = logging.dropped_lines();
+  }
+  std::vector<std::string> lines = read_log_lines();
+  expect(dropped_lines == 0 && lines.size() == 10 && lines[0] == line,
+         "lines longer than the staging size drained");
+}
+
+}  // namespace
+
+int main() {
+  in_temporary_directory("kBlock",
+                         std::bind(run, "kBlock", flute::AsyncLogging::kBlock));
+  in_temporary_directory(
+      "kDropOldest",
+      std::bind(run, "kDropOldest", flute::AsyncLogging::kDropOldest));
+  in_temporary_directory(
+      "kDropNewest",
+      std::bind(run, "kDropNewest", flute::AsyncLogging::kDropNewest));
+  in_temporary_directory("late threads", test_late_threads);
+  in_temporary_directory("long lines", test_long_lines);
+  return flute::test::exit_code();
+}
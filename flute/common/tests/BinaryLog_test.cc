@@ -0,0 +1,90 @@
+#include <flute/common/BinaryLog.h>
+#include <flute/common/LogLine.h>
+#include <flute/common/tests/TestUtil.h>
+
+#include <errno.h>
+#include <stdio.h>
+
+#include <string>
+
+namespace {
+
+using flute::test::expect;
+
+std::string g_output;
+void capture_output(const char* msg, int len) { g_output.append(msg, len); }
+
+void log_lines() {
+  int i = -42;
+  unsigned long ul = 1234567890123UL;
+  double d = 3.25;
+  std::string s = "a string";
+  LOG_INFO << "int " << i << " ulong " << ul << " double " << d << " char "
+           << 'c' << " bool " << true << " string " << s << " pointer "
+           << reinterpret_cast<const void*>(0x1234);
+  LOG_TRACE << "trace with the function name";
+  LOG_WARN << flute::StringPiece("a piece");
+  errno = EAGAIN;
+  LOG_SYSERR << "with errno";
+  errno = 0;
+  // not from a LOG_* macro
+  flute::LogLine(__FILE__, __LINE__, flute::LogLine::INFO, "[INFO]  ")
+          .stream()
+      << "direct " << 7;
+}
+
+// Remove the times, which differ between runs.
+std::string strip_times(const std::string& text) {
+  std::string result;
+  size_t begin = 0;
+  while (begin < text.size()) {
+    size_t end = text.find('\n', begin);
+    end = end == std::string::npos ? text.size() : end + 1;
+    std::string line = text.substr(begin, end - begin);
+    // "[INFO]  " and "20261019 12:00:00.123456 "
+    if (line.size() > 8 + 25) {
+      line.erase(8, 25);
+    }
+    result += line;
+    begin = end;
+  }
+  return result;
+}
+
+}  // namespace
+
+int main() {
+  flute::LogLine::set_log_level(flute::LogLine::TRACE);
+  flute::LogLine::set_output(capture_output);
+
+  log_lines();
+  std::string text = g_output;
+  g_output.clear();
+
+  flute::LogLine::set_binary(true);
+  log_lines();
+  flute::LogLine::set_binary(false);
+  std::string binary = g_output;
+  g_output.clear();
+  flute::LogLine::set_output(flute::LogLine::default_output);
+
+  std::string decoded;
+  flute::decode_binary_log(binary.data(), binary.size(), &decoded);
+  printf("%s", decoded.c_str());
+
+  expect(binary.find("a string") != std::string::npos,
+         "binary records carry raw strings");
+  expect(binary.find("-42") == std::string::npos,
+         "binary records carry raw integers");
+  expect(strip_times(decoded) == strip_times(text),
+         "decoded lines equal the text lines");
+
+  // text lines pass through
+  std::string mixed = "a text line\n" + binary + "another text line\n";
+  std::string decoded_mixed;
+  flute::decode_binary_log(mixed.data(), mixed.size(), &decoded_mixed);
+  expect(decoded_mixed == "a text line\n" + decoded + "another text line\n",
+         "text lines and binary records mix");
+
+  return flute::test::exit_code();
+}
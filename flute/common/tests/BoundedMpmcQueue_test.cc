@@ -0,0 +1,108 @@
+#include <flute/common/BlockingMpmcQueue.h>
+#include <flute/common/BoundedMpmcQueue.h>
+#include <flute/common/Thread.h>
+#include <flute/common/tests/TestUtil.h>
+
+#include <stdio.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+using flute::test::expect;
+
+void test_single_thread() {
+  flute::BoundedMpmcQueue<std::string> queue(5);
+  expect(queue.capacity() == 8, "capacity rounded up");
+  bool pushed = true;
+  for (int i = 0; i < 8; ++i) {
+    pushed = pushed && queue.try_push(std::to_string(i));
+  }
+  expect(pushed && queue.is_full(), "fills up");
+  std::string extra = "extra";
+  expect(!queue.try_push(std::move(extra)) && extra == "extra",
+         "push to a full queue fails and keeps the value");
+  std::string x;
+  bool in_order = true;
+  for (int i = 0; i < 8; ++i) {
+    in_order = in_order && queue.try_pop(&x) && x == std::to_string(i);
+  }
+  expect(in_order, "pops in order");
+  expect(!queue.try_pop(&x) && queue.is_empty(), "pop from an empty queue");
+
+  // wrap around many times, and leave some to the destructor
+  std::unique_ptr<flute::BoundedMpmcQueue<std::shared_ptr<int>>> owners(
+      new flute::BoundedMpmcQueue<std::shared_ptr<int>>(4));
+  std::shared_ptr<int> value(new int(1));
+  for (int i = 0; i < 100; ++i) {
+    owners->try_push(value);
+    std::shared_ptr<int> out;
+    owners->try_pop(&out);
+  }
+  owners->try_push(value);
+  owners->try_push(value);
+  expect(value.use_count() == 3, "queued copies alive");
+  owners.reset();
+  expect(value.use_count() == 1, "destructor destroys the queued items");
+}
+
+// kProducers push 1..kItems each, kConsumers take them all.
+void test_blocking_threads() {
+  const int kProducers = 4;
+  const int kConsumers = 3;
+  const int kItems = 200 * 1000;
+  flute::BlockingMpmcQueue<int64_t> queue(64);
+  std::atomic<int64_t> sum(0);
+  std::atomic<int> taken(0);
+  std::vector<std::unique_ptr<flute::Thread>> threads;
+  for (int i = 0; i < kProducers; ++i) {
+    threads.emplace_back(new flute::Thread(
+        [&queue]() {
+          for (int j = 1; j <= kItems; ++j) {
+            queue.push_back(j);
+          }
+        },
+        "producer"));
+  }
+  for (int i = 0; i < kConsumers; ++i) {
+    threads.emplace_back(new flute::Thread(
+        [&queue, &sum, &taken]() {
+          // a negative item stops a consumer
+          while (true) {
+            int64_t x = queue.take_front();
+            if (x < 0) {
+              break;
+            }
+            sum += x;
+            ++taken;
+          }
+        },
+        "consumer"));
+  }
+  for (auto& thread : threads) {
+    thread->start();
+  }
+  for (int i = 0; i < kProducers; ++i) {
+    threads[i]->join();
+  }
+  for (int i = 0; i < kConsumers; ++i) {
+    queue.push_back(-1);
+  }
+  for (int i = kProducers; i < kProducers + kConsumers; ++i) {
+    threads[i]->join();
+  }
+  expect(taken == kProducers * kItems, "every item taken once");
+  expect(sum == int64_t(kProducers) * kItems * (kItems + 1) / 2,
+         "sum of the items");
+}
+
+}  // namespace
+
+int main() {
+  test_single_thread();
+  test_blocking_threads();
+  return flute::test::exit_code();
+}
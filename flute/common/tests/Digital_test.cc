@@ -0,0 +1,155 @@
+#include <flute/common/Digital.h>
+#include <flute/common/tests/TestUtil.h>
+
+#include <float.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <limits>
+#include <random>
+#include <string>
+
+namespace {
+
+// Only the failures are printed, there are many checks.
+void expect(bool ok, const std::string& what) {
+  if (!ok) {
+    flute::test::expect(false, what);
+  }
+}
+
+std::string dtoa(double v) {
+  char buf[flute::kMaxDoubleStringSize];
+  size_t len = flute::double_to_string(buf, v);
+  return std::string(buf, len);
+}
+
+template <typename T>
+void check_integer(T v, const char* fmt) {
+  char expected[32];
+  snprintf(expected, sizeof expected, fmt, v);
+  char buf[32];
+  size_t len = flute::integer_to_string(buf, v);
+  expect(std::string(buf, len) == expected,
+         std::string("integer ") + expected + " got " + buf);
+}
+
+// the fewest significant digits that read back to v
+int shortest_digits(double v) {
+  char buf[40];
+  for (int precision = 1; precision <= 17; ++precision) {
+    snprintf(buf, sizeof buf, "%.*e", precision - 1, v);
+    if (strtod(buf, NULL) == v) {
+      return precision;
+    }
+  }
+  return 17;
+}
+
+int significant_digits(const std::string& s) {
+  int n = 0;
+  bool leading = true;
+  for (char c : s) {
+    if (c == 'e') {
+      break;
+    }
+    if (c >= '1' && c <= '9') {
+      leading = false;
+    }
+    if (c >= '0' && c <= '9' && !leading) {
+      ++n;
+    }
+  }
+  // trailing zeros of an integer are not significant
+  std::string digits = s.substr(0, s.find('e'));
+  if (digits.find('.') == std::string::npos) {
+    for (size_t i = digits.size(); i > 0 && digits[i - 1] == '0' && n > 1;
+         --i) {
+      --n;
+    }
+  }
+  return n;
+}
+
+}  // namespace
+
+int main() {
+  check_integer(0, "%d");
+  check_integer(7, "%d");
+  check_integer(10, "%d");
+  check_integer(99, "%d");
+  check_integer(100, "%d");
+  check_integer(-1, "%d");
+  check_integer(-100, "%d");
+  check_integer(INT_MIN, "%d");
+  check_integer(INT_MAX, "%d");
+  check_integer(static_cast<long long>(LLONG_MIN), "%lld");
+  check_integer(static_cast<unsigned long long>(ULLONG_MAX), "%llu");
+  check_integer(static_cast<short>(-32768), "%hd");
+
+  char fixed[8] = {0};
+  flute::fixed_width_to_string(fixed, 42, 6);
+  expect(std::string(fixed) == "000042", "fixed width 000042");
+  flute::fixed_width_to_string(fixed, 999999, 6);
+  expect(std::string(fixed) == "999999", "fixed width 999999");
+  flute::fixed_width_to_string(fixed, 5, 3);
+  expect(std::string(fixed, 3) == "005", "fixed width 005");
+
+  char hex[32];
+  flute::hex_to_string(hex, 0x1234ABCD);
+  expect(std::string(hex) == "1234ABCD", "hex");
+
+  expect(dtoa(0.0) == "0", "0");
+  expect(dtoa(-0.0) == "-0", "-0");
+  expect(dtoa(1.0) == "1", "1");
+  expect(dtoa(0.1) == "0.1", "0.1");
+  expect(dtoa(3.25) == "3.25", "3.25");
+  expect(dtoa(-2.5) == "-2.5", "-2.5");
+  expect(dtoa(1234567.0) == "1234567", "1234567");
+  expect(dtoa(0.0001) == "0.0001", "0.0001");
+  expect(dtoa(0.00001) == "1e-05", "1e-05 got " + dtoa(0.00001));
+  expect(dtoa(1e100) == "1e+100", "1e+100 got " + dtoa(1e100));
+  expect(dtoa(1.5e300) == "1.5e+300", "1.5e+300");
+  expect(dtoa(1e17) == "1e+17", "1e+17 got " + dtoa(1e17));
+  expect(dtoa(1e16) == "10000000000000000", "1e16 got " + dtoa(1e16));
+  expect(dtoa(NAN) == "nan", "nan");
+  expect(dtoa(INFINITY) == "inf", "inf");
+  expect(dtoa(-INFINITY) == "-inf", "-inf");
+  expect(strtod(dtoa(DBL_MAX).c_str(), NULL) == DBL_MAX, "DBL_MAX");
+  expect(strtod(dtoa(DBL_MIN).c_str(), NULL) == DBL_MIN, "DBL_MIN");
+  expect(strtod(dtoa(4.9e-324).c_str(), NULL) == 4.9e-324, "denormal min");
+
+  // random bit patterns, and random values of common magnitudes
+  std::mt19937_64 rng(20261019);
+  std::uniform_real_distribution<double> common(-1e6, 1e6);
+  int num_longer = 0;
+  const int kNumRandom = 1000 * 1000;
+  for (int i = 0; i < kNumRandom; ++i) {
+    double v;
+    if (i % 2 == 0) {
+      uint64_t bits = rng();
+      memcpy(&v, &bits, sizeof v);
+      if (isnan(v) || isinf(v)) {
+        continue;
+      }
+    } else {
+      v = common(rng);
+    }
+    std::string s = dtoa(v);
+    if (strtod(s.c_str(), NULL) != v) {
+      expect(false, "round trip " + s);
+    }
+    if (i % 16 == 0 && significant_digits(s) > shortest_digits(v)) {
+      ++num_longer;
+    }
+  }
+  printf("%d of %d sampled doubles are not the shortest\n", num_longer,
+         kNumRandom / 16);
+  // Grisu2 misses the shortest digits for a tiny fraction only
+  expect(num_longer * 1000 < kNumRandom / 16, "nearly always the shortest");
+
+  printf("%d failure(s)\n", flute::test::failures());
+  return flute::test::exit_code();
+}
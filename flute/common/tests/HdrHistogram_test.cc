@@ -0,0 +1,148 @@
+#include <flute/common/HdrHistogram.h>
+#include <flute/common/Metrics.h>
+#include <flute/common/Thread.h>
+#include <flute/common/tests/TestUtil.h>
+
+#include <stdio.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+using flute::test::expect;
+
+bool contains(const std::string& s, const std::string& part) {
+  return s.find(part) != std::string::npos;
+}
+
+bool within(int64_t value, int64_t expected, double ratio) {
+  double diff = static_cast<double>(value - expected);
+  return diff >= 0 && diff <= ratio * static_cast<double>(expected);
+}
+
+void test_buckets() {
+  bool exact = true;
+  for (int64_t v = 0; v < 2 * flute::HdrHistogram::kSubBucketHalfCount; ++v) {
+    size_t index = flute::HdrHistogram::index_of(v);
+    exact = exact && flute::HdrHistogram::lowest_equivalent_value(index) == v &&
+            flute::HdrHistogram::highest_equivalent_value(index) == v;
+  }
+  expect(exact, "small values counted one by one");
+
+  bool precise = true;
+  for (int64_t v = 256; v < flute::HdrHistogram::kMaxValue; v = v * 3 / 2) {
+    size_t index = flute::HdrHistogram::index_of(v);
+    int64_t low = flute::HdrHistogram::lowest_equivalent_value(index);
+    int64_t high = flute::HdrHistogram::highest_equivalent_value(index);
+    precise = precise && low <= v && v <= high &&
+              static_cast<double>(high - low) <= static_cast<double>(v) / 128;
+  }
+  expect(precise, "large values within 1/128");
+  expect(flute::HdrHistogram::index_of(flute::HdrHistogram::kMaxValue) ==
+                 flute::HdrHistogram::kNumCounts - 1 &&
+             flute::HdrHistogram::index_of(int64_t(1) << 40) ==
+                 flute::HdrHistogram::kNumCounts - 1,
+         "values above the maximum clamped");
+}
+
+void test_percentiles() {
+  flute::HdrHistogram histogram;
+  expect(histogram.value_at_percentile(50) == 0, "empty is 0");
+  for (int64_t v = 1; v <= 100000; ++v) {
+    histogram.record(v);
+  }
+  expect(histogram.total_count() == 100000, "total count");
+  expect(within(histogram.value_at_percentile(50), 50000, 0.01), "p50");
+  expect(within(histogram.value_at_percentile(99), 99000, 0.01), "p99");
+  expect(within(histogram.value_at_percentile(99.9), 99900, 0.01), "p999");
+  expect(within(histogram.value_at_percentile(100), 100000, 0.01), "max");
+  histogram.record(1000000, 100000);
+  expect(within(histogram.value_at_percentile(50), 100000, 0.01) &&
+             within(histogram.value_at_percentile(51), 1000000, 0.01),
+         "recorded with a count");
+}
+
+void test_coordinated_omission() {
+  // 99 quick responses and a stall of 100 intervals
+  flute::HdrHistogram histogram;
+  for (int i = 0; i < 99; ++i) {
+    histogram.record_corrected(10, 10);
+  }
+  histogram.record_corrected(1000, 10);
+  expect(histogram.total_count() == 199, "stalled requests added");
+  expect(within(histogram.value_at_percentile(75), 510, 0.01),
+         "stall seen by the requests behind it");
+
+  flute::HdrHistogram raw;
+  for (int i = 0; i < 99; ++i) {
+    raw.record(10);
+  }
+  raw.record(1000);
+  flute::HdrHistogram copy = raw.corrected(10);
+  expect(copy.total_count() == 199 &&
+             within(copy.value_at_percentile(75), 510, 0.01),
+         "corrected copy");
+}
+
+const int kThreads = 8;
+const int kRecordsPerThread = 100000;
+
+void test_concurrent() {
+  flute::LatencyHistogram latency;
+  std::vector<std::unique_ptr<flute::Thread>> threads;
+  for (int i = 0; i < kThreads; ++i) {
+    threads.emplace_back(new flute::Thread([&latency, i]() {
+      for (int j = 0; j < kRecordsPerThread; ++j) {
+        latency.record(i < kThreads / 2 ? 100 : 10000);
+      }
+    }));
+    threads.back()->start();
+  }
+  flute::HdrHistogram merged;
+  int64_t sum = 0;
+  // merging while the threads record
+  latency.snapshot(&merged, &sum);
+  for (auto& thread : threads) {
+    thread->join();
+  }
+  latency.snapshot(&merged, &sum);
+  expect(merged.total_count() == kThreads * kRecordsPerThread,
+         "records of every thread merged");
+  expect(sum == int64_t(kThreads / 2) * kRecordsPerThread * (100 + 10000),
+         "sum of the records");
+  expect(merged.value_at_percentile(50) == 100 &&
+             within(merged.value_at_percentile(99), 10000, 0.01),
+         "merged percentiles");
+}
+
+void test_exposition() {
+  flute::MetricsRegistry registry;
+  flute::LatencyHistogram* latency = registry.latency("stage_seconds", "A stage.");
+  expect(contains(registry.to_prometheus(),
+                  "stage_seconds{quantile=\"0.5\"} NaN\n"),
+         "no quantiles before a record");
+  for (int i = 0; i < 1000; ++i) {
+    latency->record(i < 990 ? 100 : 5000);
+  }
+  expect(contains(registry.to_prometheus(),
+                  "# TYPE stage_seconds summary\n"
+                  "stage_seconds{quantile=\"0.5\"} 0.0001\n"
+                  "stage_seconds{quantile=\"0.99\"} 0.0001\n"
+                  "stage_seconds{quantile=\"0.999\"} 0.005023\n"
+                  "stage_seconds_sum 0.149\n"
+                  "stage_seconds_count 1000\n"),
+         "summary with p50, p99 and p999");
+}
+
+}  // namespace
+
+int main() {
+  test_buckets();
+  test_percentiles();
+  test_coordinated_omission();
+  test_concurrent();
+  test_exposition();
+  return flute::test::exit_code();
+}
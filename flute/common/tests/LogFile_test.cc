@@ -0,0 +1,126 @@
+#include <flute/common/LogFile.h>
+#include <flute/common/tests/TestUtil.h>
+
+#include <glob.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+using flute::test::expect;
+
+const off_t kRollSize = 64 * 1024;
+const int kNumLines = 20 * 1000;
+
+std::vector<std::string> list_files(const char* pattern) {
+  std::vector<std::string> names;
+  glob_t files;
+  if (::glob(pattern, 0, NULL, &files) == 0) {
+    for (size_t i = 0; i < files.gl_pathc; ++i) {
+      names.push_back(files.gl_pathv[i]);
+    }
+    ::globfree(&files);
+  }
+  return names;
+}
+
+off_t file_size(const std::string& name) {
+  struct stat st;
+  return ::stat(name.c_str(), &st) == 0 ? st.st_size : 0;
+}
+
+bool enter_temporary_directory(const char* name) {
+  char dir[] = "/tmp/LogFile_test.XXXXXX";
+  bool ok = ::mkdtemp(dir) != NULL && ::chdir(dir) == 0;
+  expect(ok, std::string(name) + " temporary directory");
+  return ok;
+}
+
+// About 1.5MB of lines, many rolls in the same second.
+void write_lines(flute::LogFile* file) {
+  char line[128];
+  for (int i = 0; i < kNumLines; ++i) {
+    int len = snprintf(line, sizeof line,
+                       "line %d padding padding padding padding padding\n", i);
+    file->append(line, len);
+  }
+  file->flush();
+}
+
+void test_compression_and_count() {
+  if (!enter_temporary_directory("count")) {
+    return;
+  }
+  const bool gzip = flute::LogArchiver::is_supported(flute::LogArchiver::kGzip);
+  {
+    flute::LogFile file("LogFile_test", kRollSize, false);
+    if (gzip) {
+      file.set_compression(flute::LogArchiver::kGzip);
+    }
+    file.set_retention(4, 0);
+    write_lines(&file);
+    file.wait_for_archiver();
+
+    std::vector<std::string> logs = list_files("LogFile_test.*.log");
+    std::vector<std::string> archives = list_files("LogFile_test.*.log.gz");
+    expect(logs.size() + archives.size() == 4, "keep 4 files");
+    expect(!gzip || logs.size() == 1, "only the active file uncompressed");
+    bool is_gzip = true;
+    for (const auto& name : archives) {
+      std::ifstream in(name.c_str(), std::ios::binary);
+      is_gzip = is_gzip && in.get() == 0x1f && in.get() == 0x8b;
+    }
+    expect(is_gzip, "archives are gzip");
+    expect(list_files("*.tmp").empty(), "no temporary file left");
+  }
+  // the last file is closed, not archived
+  expect(list_files("LogFile_test.*.log").size() == 1,
+         "last file kept on exit");
+}
+
+void test_total_bytes() {
+  if (!enter_temporary_directory("bytes")) {
+    return;
+  }
+  const off_t max_bytes = 4 * kRollSize;
+  flute::LogFile file("LogFile_test", kRollSize, false);
+  file.set_retention(0, max_bytes);
+  write_lines(&file);
+  file.wait_for_archiver();
+
+  std::vector<std::string> logs = list_files("LogFile_test.*.log");
+  off_t total = 0;
+  for (const auto& name : logs) {
+    total += file_size(name);
+  }
+  expect(total <= max_bytes, "within the total bytes");
+  expect(total > max_bytes - 2 * kRollSize, "newest files kept");
+
+  // the newest lines survive
+  bool has_last_line = false;
+  for (const auto& name : logs) {
+    std::ifstream in(name.c_str());
+    std::string line;
+    while (std::getline(in, line)) {
+      has_last_line = has_last_line ||
+                      line.compare(0, 11, "line " +
+                                              std::to_string(kNumLines - 1) +
+                                              " ") == 0;
+    }
+  }
+  expect(has_last_line, "last line kept");
+}
+
+}  // namespace
+
+int main() {
+  test_compression_and_count();
+  test_total_bytes();
+  return flute::test::exit_code();
+}
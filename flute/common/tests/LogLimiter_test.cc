@@ -0,0 +1,99 @@
+// TRACE is compiled out of this file.
+#undef FLUTE_MIN_LOG_LEVEL
+#define FLUTE_MIN_LOG_LEVEL 1
+
+#include <flute/common/LogLine.h>
+#include <flute/common/tests/TestUtil.h>
+
+#include <stdio.h>
+
+#include <string>
+
+namespace {
+
+using flute::test::expect;
+
+int g_num_lines = 0;
+int g_num_evaluated = 0;
+std::string g_last_line;
+
+void count_output(const char* msg, int len) {
+  ++g_num_lines;
+  g_last_line.assign(msg, len);
+}
+
+int evaluated() { return ++g_num_evaluated; }
+
+}  // namespace
+
+int main() {
+  flute::LogLine::set_log_level(flute::LogLine::TRACE);
+  flute::LogLine::set_output(count_output);
+
+  LOG_TRACE << "compiled out " << evaluated();
+  expect(g_num_lines == 0 && g_num_evaluated == 0,
+         "levels below FLUTE_MIN_LOG_LEVEL are compiled out");
+  LOG_DEBUG << "compiled in " << evaluated();
+  expect(g_num_lines == 1 && g_num_evaluated == 1,
+         "levels from FLUTE_MIN_LOG_LEVEL are logged");
+
+  g_num_lines = 0;
+  for (int i = 0; i < 100; ++i) {
+    LOG_EVERY_N(INFO, 10) << "every 10th " << i;
+  }
+  expect(g_num_lines == 10, "LOG_EVERY_N logs 1 of n");
+  expect(g_last_line.find("(9 suppressed) every 10th 90") != std::string::npos,
+         "LOG_EVERY_N tells the suppressed lines");
+
+  g_num_lines = 0;
+  for (int i = 0; i < 100; ++i) {
+    LOG_FIRST_N(WARN, 5) << "first 5 " << i;
+  }
+  expect(g_num_lines == 5, "LOG_FIRST_N logs the first n");
+
+  g_num_lines = 0;
+  for (int i = 0; i < 1000; ++i) {
+    LOG_RATE_LIMITED(ERROR, 100) << "rate limited " << i;
+  }
+  // a second of tokens, and a few refilled during the loop
+  expect(g_num_lines >= 100 && g_num_lines < 120,
+         "LOG_RATE_LIMITED bursts a second of lines");
+  const int rate_limited_lines = g_num_lines;
+
+  g_num_lines = 0;
+  flute::LogLine::set_log_level(flute::LogLine::WARN);
+  for (int i = 0; i < 100; ++i) {
+    LOG_EVERY_N(INFO, 10) << "disabled " << evaluated();
+  }
+  expect(g_num_lines == 0 && g_num_evaluated == 1,
+         "disabled levels do not count");
+
+  // the else belongs to the if of the caller, whether the level is enabled
+  // or not
+  g_num_lines = 0;
+  int num_else = 0;
+  bool log = true;
+  if (log) LOG_TRACE << "compiled out"; else ++num_else;
+  if (log) LOG_INFO << "disabled"; else ++num_else;
+  if (log) LOG_WARN << "enabled"; else ++num_else;
+  if (log) LOG_SYSERR << "enabled"; else ++num_else;
+  if (log) LOG_FIRST_N(INFO, 1) << "disabled"; else ++num_else;
+  for (int i = 0; i < 2; ++i) {
+    // logged, then limited
+    if (log) LOG_FIRST_N(ERROR, 1) << "once"; else ++num_else;
+  }
+  log = false;
+  if (log) LOG_WARN << "not reached"; else ++num_else;
+  if (log) LOG_EVERY_N(WARN, 1) << "not reached"; else ++num_else;
+  expect(num_else == 2 && g_num_lines == 3,
+         "an else after a log statement binds to the if before it");
+
+  printf("%lld lines suppressed\n",
+         static_cast<long long>(flute::suppressed_log_lines()));
+  expect(flute::suppressed_log_lines() ==
+             90 + 95 + 1000 - rate_limited_lines + 1,
+         "suppressed lines are counted");
+
+  flute::LogLine::set_output(flute::LogLine::default_output);
+  return flute::test::exit_code();
+}
@@ -0,0 +1,64 @@
+#include <flute/common/Digital.h>
+#include <flute/common/LogLine.h>
+#include <flute/common/Timestamp.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Usage: LogStream_bench [iterations]
+// Reports nanoseconds per formatted value and per log line, the line being
+// formatted by LOG_INFO into an output function that drops it.
+
+namespace {
+
+volatile size_t g_sink = 0;
+
+void null_output(const char* msg, int len) { g_sink += len; }
+
+template <typename Func>
+void run(const char* name, int iterations, Func func) {
+  flute::Timestamp start = flute::Timestamp::now();
+  for (int i = 0; i < iterations; ++i) {
+    func(i);
+  }
+  double seconds = flute::second_difference(flute::Timestamp::now(), start);
+  printf("%-28s %8.1f ns\n", name, seconds * 1e9 / iterations);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const int iterations = argc > 1 ? atoi(argv[1]) : 2000 * 1000;
+  char buf[64];
+
+  run("integer snprintf", iterations, [&](int i) {
+    g_sink += snprintf(buf, sizeof buf, "%lld", 1000000007LL * i);
+  });
+  run("integer_to_string", iterations, [&](int i) {
+    g_sink += flute::integer_to_string(buf, 1000000007LL * i);
+  });
+  run("double snprintf %.12g", iterations, [&](int i) {
+    g_sink += snprintf(buf, sizeof buf, "%.12g", i * 1.0001);
+  });
+  run("double snprintf %.17g", iterations, [&](int i) {
+    g_sink += snprintf(buf, sizeof buf, "%.17g", i * 1.0001);
+  });
+  run("double_to_string", iterations, [&](int i) {
+    g_sink += flute::double_to_string(buf, i * 1.0001);
+  });
+  run("micro seconds snprintf", iterations, [&](int i) {
+    g_sink += snprintf(buf, sizeof buf, ".%06d ", i % 1000000);
+  });
+  run("micro seconds fixed width", iterations, [&](int i) {
+    flute::fixed_width_to_string(buf, static_cast<uint32_t>(i % 1000000), 6);
+    g_sink += buf[0];
+  });
+
+  flute::LogLine::set_output(null_output);
+  run("LOG_INFO line", iterations, [&](int i) {
+    LOG_INFO << "request " << i << " took " << i * 0.001 << " ms, "
+             << 1000000007LL * i << " bytes";
+  });
+  flute::LogLine::set_output(flute::LogLine::default_output);
+  return 0;
+}
@@ -0,0 +1,107 @@
+#include <flute/common/Metrics.h>
+#include <flute/common/Thread.h>
+#include <flute/common/tests/TestUtil.h>
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+using flute::test::expect;
+
+bool contains(const std::string& s, const std::string& part) {
+  return s.find(part) != std::string::npos;
+}
+
+const int kThreads = 8;
+const int kAddsPerThread = 100000;
+
+void test_counter() {
+  flute::MetricsRegistry registry;
+  flute::Counter* counter = registry.counter("test_total", "A counter.");
+  expect(registry.counter("test_total", "A counter.") == counter,
+         "same name, same counter");
+  std::vector<std::unique_ptr<flute::Thread>> threads;
+  for (int i = 0; i < kThreads; ++i) {
+    threads.emplace_back(new flute::Thread([counter]() {
+      for (int j = 0; j < kAddsPerThread; ++j) {
+        counter->add();
+      }
+    }));
+    threads.back()->start();
+  }
+  for (auto& thread : threads) {
+    thread->join();
+  }
+  expect(counter->value() == kThreads * kAddsPerThread,
+         "adds of every thread summed");
+}
+
+void test_exposition() {
+  flute::MetricsRegistry registry;
+  registry.counter("requests_total", "Requests.", "code=\"200\"")->add(3);
+  registry.counter("requests_total", "Requests.", "code=\"404\"")->add();
+  registry.gauge("open", "Open things.")->set(-2);
+  registry.gauge_function("answer", "The answer.", []() { return 42.0; });
+  flute::Histogram* histogram =
+      registry.histogram("latency_seconds", "Latency.", {0.1, 1.0});
+  histogram->observe(0.05);
+  histogram->observe(0.5);
+  histogram->observe(5.0);
+
+  std::string text = registry.to_prometheus();
+  expect(contains(text, "# HELP requests_total Requests.\n"
+                        "# TYPE requests_total counter\n"
+                        "requests_total{code=\"200\"} 3\n"
+                        "requests_total{code=\"404\"} 1\n"),
+         "counters with labels");
+  expect(contains(text, "# TYPE open gauge\nopen -2\n"), "gauge");
+  expect(contains(text, "answer 42\n"), "gauge function");
+  expect(contains(text, "# TYPE latency_seconds histogram\n"
+                        "latency_seconds_bucket{le=\"0.1\"} 1\n"
+                        "latency_seconds_bucket{le=\"1\"} 2\n"
+                        "latency_seconds_bucket{le=\"+Inf\"} 3\n"
+                        "latency_seconds_sum 5.55\n"
+                        "latency_seconds_count 3\n"),
+         "cumulative histogram buckets");
+}
+
+// The counts of a shard start and end on cache line boundaries.
+void test_metric_counts() {
+  bool aligned = true;
+  bool zeroed = true;
+  std::vector<std::unique_ptr<flute::detail::MetricCounts>> shards;
+  for (size_t num = 1; num <= 20; ++num) {
+    shards.emplace_back(new flute::detail::MetricCounts(num));
+    const flute::detail::MetricCounts& counts = *shards.back();
+    aligned = aligned && reinterpret_cast<uintptr_t>(&counts[0]) %
+                                 flute::detail::kMetricCacheLineSize ==
+                             0;
+    for (size_t i = 0; i < num; ++i) {
+      zeroed = zeroed && counts[i].load() == 0;
+    }
+  }
+  expect(aligned, "shard counts aligned to cache lines");
+  expect(zeroed, "shard counts zeroed");
+}
+
+void test_process_metrics() {
+  std::string text = flute::MetricsRegistry::instance().to_prometheus();
+  expect(contains(text, "process_open_fds ") &&
+             contains(text, "process_cpu_seconds_total "),
+         "process metrics in the global registry");
+}
+
+}  // namespace
+
+int main() {
+  test_counter();
+  test_exposition();
+  test_metric_counts();
+  test_process_metrics();
+  return flute::test::exit_code();
+}
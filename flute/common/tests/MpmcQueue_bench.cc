@@ -0,0 +1,90 @@
+#include <flute/common/BlockingDeque.h>
+#include <flute/common/BlockingMpmcQueue.h>
+#include <flute/common/BoundedBlockingDeque.h>
+#include <flute/common/Thread.h>
+#include <flute/common/Timestamp.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <memory>
+#include <vector>
+
+// Usage: MpmcQueue_bench [producers] [consumers] [items_per_producer]
+//                        [capacity]
+// Passes integers from the producers to the consumers through
+// BoundedBlockingDeque, BlockingDeque and BlockingMpmcQueue, and reports the
+// items per second.
+
+namespace {
+
+template <typename Queue>
+double run(Queue* queue, int num_producers, int num_consumers, int num_items) {
+  flute::Timestamp start = flute::Timestamp::now();
+  std::vector<std::unique_ptr<flute::Thread>> threads;
+  for (int i = 0; i < num_producers; ++i) {
+    threads.emplace_back(new flute::Thread(
+        [queue, num_items]() {
+          for (int j = 0; j < num_items; ++j) {
+            queue->push_back(j);
+          }
+        },
+        "producer"));
+  }
+  for (int i = 0; i < num_consumers; ++i) {
+    threads.emplace_back(new flute::Thread(
+        [queue]() {
+          while (queue->take_front() >= 0) {
+          }
+        },
+        "consumer"));
+  }
+  for (auto& thread : threads) {
+    thread->start();
+  }
+  for (int i = 0; i < num_producers; ++i) {
+    threads[i]->join();
+  }
+  for (int i = 0; i < num_consumers; ++i) {
+    queue->push_back(-1);
+  }
+  for (auto& thread : threads) {
+    if (!thread->is_joined()) {
+      thread->join();
+    }
+  }
+  return flute::second_difference(flute::Timestamp::now(), start);
+}
+
+void report(const char* name, int64_t items, double seconds) {
+  printf("%-20s %10lld items %8.3f s %12.0f items/s\n", name,
+         static_cast<long long>(items), seconds,
+         static_cast<double>(items) / seconds);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  int num_producers = argc > 1 ? atoi(argv[1]) : 4;
+  int num_consumers = argc > 2 ? atoi(argv[2]) : 4;
+  int num_items = argc > 3 ? atoi(argv[3]) : 1000 * 1000;
+  size_t capacity = argc > 4 ? static_cast<size_t>(atoi(argv[4])) : 1024;
+  const int64_t total = static_cast<int64_t>(num_producers) * num_items;
+
+  {
+    flute::BoundedBlockingDeque<int> queue(capacity);
+    report("BoundedBlockingDeque", total,
+           run(&queue, num_producers, num_consumers, num_items));
+  }
+  {
+    flute::BlockingDeque<int> queue;
+    report("BlockingDeque", total,
+           run(&queue, num_producers, num_consumers, num_items));
+  }
+  {
+    flute::BlockingMpmcQueue<int> queue(capacity);
+    report("BlockingMpmcQueue", total,
+           run(&queue, num_producers, num_consumers, num_items));
+  }
+  return 0;
+}
@@ -0,0 +1,97 @@
+#include <flute/common/BinaryLog.h>
+#include <flute/common/LogLine.h>
+#include <flute/common/tests/TestUtil.h>
+
+#include <errno.h>
+#include <stdio.h>
+
+#include <string>
+
+namespace {
+
+using flute::test::expect;
+
+std::string g_output;
+void capture_output(const char* msg, int len) { g_output.append(msg, len); }
+
+bool contains(const std::string& text, const std::string& part) {
+  return text.find(part) != std::string::npos;
+}
+
+std::string log_line() {
+  g_output.clear();
+  std::string user = "quote\" back\\slash\nnew line";
+  LOG_INFO << "request done" << flute::kv("user", user)
+           << flute::kv("status", 200) << flute::kv("ms", 1.5)
+           << flute::kv("cached", true) << flute::kv("bytes", -7L);
+  return g_output;
+}
+
+std::string decode(const std::string& data, flute::LogFormat format) {
+  std::string out;
+  flute::decode_binary_log(data.data(), data.size(), &out, format);
+  return out;
+}
+
+}  // namespace
+
+int main() {
+  flute::LogLine::set_output(capture_output);
+
+  std::string text = log_line();
+  printf("%s", text.c_str());
+  expect(contains(text, "request done user=quote\" back\\slash\nnew line "
+                        "status=200 ms=1.5 cached=1 bytes=-7 - "),
+         "fields in text mode");
+
+  flute::LogLine::set_binary(true);
+  std::string binary = log_line();
+  g_output.clear();
+  errno = ENOENT;
+  LOG_SYSERR << "open failed" << flute::kv("path", "/tmp/x y");
+  errno = 0;
+  binary += g_output;
+  g_output.clear();
+  flute::LogLine::set_binary(false);
+  flute::LogLine::set_output(flute::LogLine::default_output);
+  binary += "a text line \"quoted\"\n";
+
+  std::string decoded = decode(binary, flute::kTextFormat);
+  // without "[INFO]  20261019 12:00:00.123456 "
+  expect(decoded.compare(33, text.size() - 33, text, 33) == 0,
+         "binary decodes to the text line");
+
+  std::string json = decode(binary, flute::kJsonLinesFormat);
+  printf("%s", json.c_str());
+  expect(json.compare(0, 9, "{\"time\":\"") == 0, "json starts with time");
+  expect(contains(json, "Z\",\"level\":\"INFO\",\"msg\":\"request done\","),
+         "json level and msg");
+  expect(contains(json, "\"user\":\"quote\\\" back\\\\slash\\nnew line\""),
+         "json string escaped");
+  expect(contains(json, "\"status\":200,\"ms\":1.5,\"cached\":true,"
+                        "\"bytes\":-7}\n"),
+         "json typed fields");
+  expect(contains(json, "\"level\":\"SERROR\",\"msg\":\"open failed\","
+                        "\"errno\":2,\"error\":\"No such file or directory\""),
+         "json errno");
+  expect(contains(json, "\"path\":\"/tmp/x y\"}\n"), "json string field");
+  expect(contains(json, "{\"msg\":\"a text line \\\"quoted\\\"\"}\n"),
+         "json text line");
+  expect(json.find("\"file\":\"StructuredLog_test.cc\",\"line\":") !=
+             std::string::npos,
+         "json file and line");
+
+  std::string logfmt = decode(binary, flute::kLogfmtFormat);
+  printf("%s", logfmt.c_str());
+  expect(logfmt.compare(0, 5, "time=") == 0, "logfmt starts with time");
+  expect(contains(logfmt, "Z level=INFO msg=\"request done\" "),
+         "logfmt level and msg");
+  expect(contains(logfmt, "user=\"quote\\\" back\\\\slash\\nnew line\" "
+                          "status=200 ms=1.5 cached=true bytes=-7\n"),
+         "logfmt fields");
+  expect(contains(logfmt, "path=\"/tmp/x y\"\n"), "logfmt quoted value");
+  expect(contains(logfmt, "msg=\"a text line \\\"quoted\\\"\"\n"),
+         "logfmt text line");
+
+  return flute::test::exit_code();
+}
@@ -0,0 +1,31 @@
+#ifndef FLUTE_COMMON_TESTS_TESTUTIL_H
+#define FLUTE_COMMON_TESTS_TESTUTIL_H
+
+#include <stdio.h>
+
+#include <string>
+
+namespace flute {
+namespace test {
+
+/// The number of failed checks of the test program so far.
+inline int& failures() {
+  static int s_failures = 0;
+  return s_failures;
+}
+
+/// Print a check as OK or FAIL, and count it if it failed.
+inline void expect(bool ok, const std::string& what) {
+  printf("%s %s\n", ok ? "OK  " : "FAIL", what.c_str());
+  if (!ok) {
+    ++failures();
+  }
+}
+
+/// What main() returns, nonzero once a check has failed.
+inline int exit_code() { return failures() == 0 ? 0 : 1; }
+
+}  // namespace test
+}  // namespace flute
+
+#endif  // FLUTE_COMMON_TESTS_TESTUTIL_H
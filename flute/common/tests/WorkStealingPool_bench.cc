@@ -0,0 +1,113 @@
+#include <flute/common/TaskDeque.h>
+#include <flute/common/Thread.h>
+#include <flute/common/Timestamp.h>
+#include <flute/common/WorkStealingPool.h>
+
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// Usage: WorkStealingPool_bench [producers] [workers] [tasks_per_producer]
+// Pushes tiny tasks from many producer threads into a TaskDeque and into a
+// WorkStealingPool, then runs a tree of tasks spawned by the tasks themselves,
+// and reports the tasks per second from the first push to the last task.
+
+namespace {
+
+std::atomic<int64_t> g_done(0);
+
+void tiny_task() { g_done.fetch_add(1, std::memory_order_relaxed); }
+
+void wait_for(int64_t total) {
+  while (g_done.load(std::memory_order_relaxed) < total) {
+    ::sched_yield();
+  }
+}
+
+template <typename Push>
+double produce(int num_producers, int num_tasks, Push push) {
+  g_done = 0;
+  flute::Timestamp start = flute::Timestamp::now();
+  std::vector<std::unique_ptr<flute::Thread>> producers;
+  for (int i = 0; i < num_producers; ++i) {
+    producers.emplace_back(new flute::Thread(
+        [num_tasks, &push]() {
+          for (int j = 0; j < num_tasks; ++j) {
+            push(tiny_task);
+          }
+        },
+        "producer"));
+    producers.back()->start();
+  }
+  for (auto& producer : producers) {
+    producer->join();
+  }
+  wait_for(static_cast<int64_t>(num_producers) * num_tasks);
+  return flute::second_difference(flute::Timestamp::now(), start);
+}
+
+template <typename Push>
+void spawn(Push* push, int depth) {
+  if (depth == 0) {
+    tiny_task();
+    return;
+  }
+  for (int i = 0; i < 2; ++i) {
+    (*push)(std::bind(&spawn<Push>, push, depth - 1));
+  }
+}
+
+template <typename Push>
+double spawn_tree(int depth, Push push) {
+  g_done = 0;
+  flute::Timestamp start = flute::Timestamp::now();
+  push(std::bind(&spawn<Push>, &push, depth));
+  wait_for(int64_t(1) << depth);
+  return flute::second_difference(flute::Timestamp::now(), start);
+}
+
+void report(const char* name, const char* workload, int64_t tasks,
+            double seconds) {
+  printf("%-16s %-10s %10lld tasks %8.3f s %12.0f tasks/s\n", name, workload,
+         static_cast<long long>(tasks), seconds,
+         static_cast<double>(tasks) / seconds);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  int num_producers = argc > 1 ? atoi(argv[1]) : 8;
+  int num_workers = argc > 2 ? atoi(argv[2]) : 4;
+  int num_tasks = argc > 3 ? atoi(argv[3]) : 200 * 1000;
+  const int64_t total = static_cast<int64_t>(num_producers) * num_tasks;
+  const int depth = 18;
+
+  {
+    flute::TaskDeque deque;
+    deque.start(num_workers);
+    auto push = [&deque](const flute::TaskDeque::Task& task) {
+      deque.push_task_back(task);
+    };
+    report("TaskDeque", "producers", total,
+           produce(num_producers, num_tasks, push));
+    report("TaskDeque", "tree", int64_t(1) << depth, spawn_tree(depth, push));
+    deque.stop();
+  }
+  {
+    flute::WorkStealingPool pool;
+    pool.start(num_workers);
+    auto push = [&pool](const flute::WorkStealingPool::Task& task) {
+      pool.push_task(task);
+    };
+    report("WorkStealingPool", "producers", total,
+           produce(num_producers, num_tasks, push));
+    report("WorkStealingPool", "tree", int64_t(1) << depth,
+           spawn_tree(depth, push));
+    pool.stop();
+  }
+  return 0;
+}
@@ -0,0 +1,116 @@
+#include <flute/common/WorkStealingPool.h>
+#include <flute/common/Thread.h>
+#include <flute/common/tests/TestUtil.h>
+
+#include <stdio.h>
+
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+using flute::test::expect;
+
+void test_many_producers() {
+  const int kProducers = 4;
+  const int kTasksPerProducer = 100 * 1000;
+  std::atomic<int> count(0);
+  flute::WorkStealingPool pool;
+  pool.start(4);
+  std::vector<std::unique_ptr<flute::Thread>> producers;
+  for (int i = 0; i < kProducers; ++i) {
+    producers.emplace_back(new flute::Thread(
+        [&pool, &count]() {
+          for (int j = 0; j < kTasksPerProducer; ++j) {
+            pool.push_task([&count]() { ++count; });
+          }
+        },
+        "producer"));
+    producers.back()->start();
+  }
+  for (auto& producer : producers) {
+    producer->join();
+  }
+  pool.stop();
+  expect(count == kProducers * kTasksPerProducer, "every task runs once");
+}
+
+// Every task spawns two more down to the leaves, from the workers.
+void spawn(flute::WorkStealingPool* pool, std::atomic<int>* leaves,
+           int depth) {
+  if (depth == 0) {
+    ++*leaves;
+    return;
+  }
+  for (int i = 0; i < 2; ++i) {
+    pool->push_task(std::bind(&spawn, pool, leaves, depth - 1));
+  }
+}
+
+void test_nested_tasks() {
+  std::atomic<int> leaves(0);
+  flute::WorkStealingPool pool;
+  pool.start(3);
+  pool.push_task(std::bind(&spawn, &pool, &leaves, 16));
+  pool.stop();
+  expect(leaves == 1 << 16, "nested tasks all run before stop returns");
+}
+
+void test_batch_and_futures() {
+  flute::WorkStealingPool pool;
+  pool.start(2);
+
+  std::atomic<int> count(0);
+  std::vector<flute::WorkStealingPool::Task> tasks;
+  for (int i = 0; i < 1000; ++i) {
+    tasks.push_back([&count]() { ++count; });
+  }
+  pool.push_tasks(std::move(tasks));
+
+  std::vector<std::future<int>> squares;
+  for (int i = 0; i < 100; ++i) {
+    squares.push_back(pool.submit([i]() { return i * i; }));
+  }
+  bool right = true;
+  for (int i = 0; i < 100; ++i) {
+    right = right && squares[i].get() == i * i;
+  }
+  expect(right, "futures hold the results");
+
+  std::future<void> failed =
+      pool.submit([]() { throw std::runtime_error("failed"); });
+  bool thrown = false;
+  try {
+    failed.get();
+  } catch (const std::runtime_error&) {
+    thrown = true;
+  }
+  expect(thrown, "future rethrows the exception");
+
+  pool.stop();
+  expect(count == 1000, "every task of the batch runs");
+}
+
+void test_no_threads() {
+  flute::WorkStealingPool pool;
+  pool.start(0);
+  int value = 0;
+  pool.push_task([&value]() { value = 1; });
+  expect(value == 1, "no threads, runs in the caller");
+  expect(pool.submit([]() { return 2; }).get() == 2,
+         "no threads, future is ready");
+  pool.stop();
+}
+
+}  // namespace
+
+int main() {
+  test_many_producers();
+  test_nested_tasks();
+  test_batch_and_futures();
+  test_no_threads();
+  return flute::test::exit_code();
+}
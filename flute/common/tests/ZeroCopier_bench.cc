@@ -0,0 +1,117 @@
+#include <flute/common/LogLine.h>
+#include <flute/common/Thread.h>
+#include <flute/common/Timestamp.h>
+#include <flute/common/ZeroCopier.h>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <vector>
+
+// Copy a file through a loopback TCP connection with each CopyMode.
+// usage: ZeroCopier_bench [file_MB] [first_chunk_KB] [bytes_per_event_KB]
+// e.g. "ZeroCopier_bench 64 1 1" mimics the former 1KB per writable event.
+
+using namespace flute;
+
+const char* kPath = "/tmp/flute_zerocopier_bench.dat";
+
+void make_file(size_t bytes) {
+  FILE* fp = fopen(kPath, "w");
+  std::vector<char> block(1024 * 1024, 'x');
+  for (size_t written = 0; written < bytes; written += block.size()) {
+    fwrite(block.data(), 1, std::min(block.size(), bytes - written), fp);
+  }
+  fclose(fp);
+}
+
+// return the connected pair {writer, reader} over 127.0.0.1
+void make_connection(int* writer, int* reader) {
+  int listen_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  mem_zero(&addr, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t len = sizeof addr;
+  ::bind(listen_fd, reinterpret_cast<struct sockaddr*>(&addr), len);
+  ::listen(listen_fd, 1);
+  ::getsockname(listen_fd, reinterpret_cast<struct sockaddr*>(&addr), &len);
+  *reader = ::socket(AF_INET, SOCK_STREAM, 0);
+  ::connect(*reader, reinterpret_cast<struct sockaddr*>(&addr), len);
+  *writer = ::accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK);
+  ::close(listen_fd);
+}
+
+void drain(int fd, size_t bytes) {
+  std::vector<char> buf(256 * 1024);
+  size_t received = 0;
+  while (received < bytes) {
+    ssize_t n = ::read(fd, buf.data(), buf.size());
+    if (n <= 0) {
+      break;
+    }
+    received += n;
+  }
+}
+
+void bench(ZeroCopier::CopyMode mode, size_t bytes) {
+  ZeroCopier::set_g_copy_mode(mode);
+  int writer = -1;
+  int reader = -1;
+  make_connection(&writer, &reader);
+  Thread drainer(std::bind(&drain, reader, bytes), "drainer");
+  drainer.start();
+
+  ZeroCopier copier(kPath);
+  copier.set_target_fd(writer);
+  Timestamp start(Timestamp::now());
+  copier.start();
+  int64_t events = 0;
+  struct pollfd pfd;
+  pfd.fd = writer;
+  pfd.events = POLLOUT;
+  while (!copier.has_finished()) {
+    ::poll(&pfd, 1, -1);
+    copier.send_one_chunk();
+    ++events;
+  }
+  drainer.join();
+  double seconds = second_difference(Timestamp::now(), start);
+  printf("%-10s %10.1f MB/s %10lld events %10.1f KB/event  last chunk %zu KB\n",
+         copier.copymode_to_string().c_str(),
+         static_cast<double>(bytes) / (1024 * 1024) / seconds,
+         static_cast<long long>(events),
+         static_cast<double>(bytes) / 1024 / static_cast<double>(events),
+         copier.chunk_size() / 1024);
+  ::close(writer);
+  ::close(reader);
+}
+
+int main(int argc, char* argv[]) {
+  LogLine::set_log_level(LogLine::WARN);
+  size_t bytes = 64 * 1024 * 1024;
+  if (argc > 1) {
+    bytes = static_cast<size_t>(atoi(argv[1])) * 1024 * 1024;
+  }
+  if (argc > 2) {
+    ZeroCopier::set_chunk_size(1024 * atoi(argv[2]));
+  }
+  if (argc > 3) {
+    ZeroCopier::set_bytes_per_event(1024 * atoi(argv[3]));
+  }
+  make_file(bytes);
+  printf("file %zu MB, first chunk %zu KB, %zu KB per event at most\n",
+         bytes / (1024 * 1024), ZeroCopier::g_chunk_size / 1024,
+         ZeroCopier::g_bytes_per_event / 1024);
+  bench(ZeroCopier::kZeroCopy, bytes);
+  bench(ZeroCopier::kMMap, bytes);
+  bench(ZeroCopier::kReadWrite, bytes);
+  ::unlink(kPath);
+  return 0;
+}
@@ -0,0 +1,222 @@
+#include <flute/common/LogLine.h>
+#include <flute/common/MappedFile.h>
+#include <flute/common/ZeroCopier.h>
+#include <flute/common/tests/TestUtil.h>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+
+using flute::ZeroCopier;
+
+namespace {
+
+using flute::test::expect;
+
+const size_t kFileSize = 1024 * 1024 + 123;
+// the kernel raises it to its minimum, writes come up short all the time
+const int kSmallSendBuffer = 4096;
+
+std::string g_path;
+std::string g_content;
+
+// Random bytes, a byte sent from a wrong offset does not go unnoticed.
+bool make_file() {
+  char path[] = "/tmp/ZeroCopier_test.XXXXXX";
+  int fd = ::mkstemp(path);
+  g_path = path;
+  unsigned int seed = 2024;
+  g_content.resize(kFileSize);
+  for (size_t i = 0; i < kFileSize; ++i) {
+    g_content[i] = static_cast<char>(rand_r(&seed));
+  }
+  bool written = fd >= 0 && ::write(fd, g_content.data(), kFileSize) ==
+                                static_cast<ssize_t>(kFileSize);
+  ::close(fd);
+  return written;
+}
+
+// A connected loopback pair, the sender non-blocking as in TcpConnection.
+struct SocketPair {
+  explicit SocketPair(int send_buffer) {
+    int listener = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof addr;
+    ::bind(listener, reinterpret_cast<struct sockaddr*>(&addr), sizeof addr);
+    ::listen(listener, 1);
+    ::getsockname(listener, reinterpret_cast<struct sockaddr*>(&addr), &len);
+    sender = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (send_buffer > 0) {
+      ::setsockopt(sender, SOL_SOCKET, SO_SNDBUF, &send_buffer,
+                   sizeof send_buffer);
+    }
+    ::connect(sender, reinterpret_cast<struct sockaddr*>(&addr), sizeof addr);
+    receiver = ::accept(listener, NULL, NULL);
+    ::close(listener);
+    ::fcntl(sender, F_SETFL, ::fcntl(sender, F_GETFL) | O_NONBLOCK);
+  }
+  ~SocketPair() {
+    ::close(sender);
+    ::close(receiver);
+  }
+
+  int sender;
+  int receiver;
+};
+
+struct Transfer {
+  Transfer()
+      : failed(false),
+        max_bytes_per_call(0),
+        first_chunk(0),
+        min_chunk(0),
+        max_chunk(0) {}
+
+  std::string received;
+  bool failed;
+  size_t max_bytes_per_call;
+  // chunk sizes of the copier
+  size_t first_chunk;
+  size_t min_chunk;
+  size_t max_chunk;
+};
+
+// Send the window of copier over loopback as TcpConnection does, on every
+// writable event, reading the other end between the events.
+Transfer transfer(ZeroCopier* copier, int send_buffer) {
+  Transfer result;
+  SocketPair pair(send_buffer);
+  copier->set_target_fd(pair.sender);
+  copier->start();
+  result.first_chunk = result.min_chunk = result.max_chunk =
+      copier->chunk_size();
+  char buf[64 * 1024];
+  int stalls = 0;
+  while (!copier->has_finished()) {
+    size_t n = copier->send_one_chunk();
+    if (n == static_cast<size_t>(-1) || (n == 0 && ++stalls > 100)) {
+      result.failed = true;
+      break;
+    }
+    if (n > 0) {
+      stalls = 0;
+    }
+    result.max_bytes_per_call = std::max(result.max_bytes_per_call, n);
+    result.min_chunk = std::min(result.min_chunk, copier->chunk_size());
+    result.max_chunk = std::max(result.max_chunk, copier->chunk_size());
+    ssize_t nr;
+    while ((nr = ::recv(pair.receiver, buf, sizeof buf, MSG_DONTWAIT)) > 0) {
+      result.received.append(buf, static_cast<size_t>(nr));
+    }
+    // the next writable event
+    struct pollfd pfd = {pair.sender, POLLOUT, 0};
+    ::poll(&pfd, 1, 10);
+  }
+  ::shutdown(pair.sender, SHUT_WR);
+  ssize_t nr;
+  while ((nr = ::recv(pair.receiver, buf, sizeof buf, 0)) > 0) {
+    result.received.append(buf, static_cast<size_t>(nr));
+  }
+  return result;
+}
+
+std::string describe(ZeroCopier::CopyMode mode, size_t offset, size_t length,
+                     int send_buffer) {
+  return ZeroCopier::g_copy_mode_names[mode] + " [" + std::to_string(offset) +
+         ", +" + std::to_string(length) + ")" +
+         (send_buffer > 0 ? " small SO_SNDBUF" : "");
+}
+
+// Every byte of every window arrives, in order, whatever the socket takes.
+void test_windows(ZeroCopier::CopyMode mode) {
+  ZeroCopier::set_g_copy_mode(mode);
+  const size_t windows[][2] = {
+      {0, kFileSize},
+      {0, 1},
+      // across a page boundary
+      {4095, 4097},
+      {300 * 1000, 500 * 1000},
+      {kFileSize - 1, 1},
+      {kFileSize / 2, 0},
+  };
+  const int send_buffers[] = {0, kSmallSendBuffer};
+  for (const auto& window : windows) {
+    for (int send_buffer : send_buffers) {
+      ZeroCopier copier(g_path, static_cast<off_t>(window[0]), window[1]);
+      Transfer result = transfer(&copier, send_buffer);
+      expect(!result.failed &&
+                 result.received == g_content.substr(window[0], window[1]),
+             describe(mode, window[0], window[1], send_buffer));
+    }
+  }
+}
+
+// Chunks start at what the socket holds, shrink to what a short write took
+// and stay within the limits. The bytes of an event keep to the budget.
+void test_adaptive_chunks(ZeroCopier::CopyMode mode) {
+  ZeroCopier::set_g_copy_mode(mode);
+  const std::string name = ZeroCopier::g_copy_mode_names[mode];
+  ZeroCopier copier(g_path);
+  Transfer result = transfer(&copier, kSmallSendBuffer);
+  expect(result.min_chunk < result.first_chunk,
+         name + " chunk shrinks after a short write");
+  expect(result.min_chunk >= ZeroCopier::kMinChunkSize &&
+             result.max_chunk <= ZeroCopier::kMaxChunkSize,
+         name + " chunk within its limits");
+
+  const size_t kBudget = 64 * 1024;
+  ZeroCopier::set_bytes_per_event(kBudget);
+  ZeroCopier budgeted(g_path);
+  result = transfer(&budgeted, 0);
+  ZeroCopier::set_bytes_per_event(1024 * 1024);
+  expect(!result.failed && result.received == g_content &&
+             result.max_bytes_per_call <= kBudget,
+         name + " bytes of an event within the budget");
+}
+
+// The copiers of a file share one mapping, unmapped after the last of them.
+void test_mapped_file_cache() {
+  ZeroCopier::set_g_copy_mode(ZeroCopier::kMMap);
+  flute::MappedFileCache& cache = flute::MappedFileCache::instance();
+  expect(cache.size() == 0, "nothing mapped before");
+  std::unique_ptr<ZeroCopier> first(new ZeroCopier(g_path, 0, 1000));
+  Transfer result = transfer(first.get(), 0);
+  expect(result.received == g_content.substr(0, 1000) && cache.size() == 1,
+         "the file mapped once sent");
+  std::unique_ptr<ZeroCopier> second(new ZeroCopier(g_path, 5000, 1000));
+  result = transfer(second.get(), kSmallSendBuffer);
+  expect(result.received == g_content.substr(5000, 1000),
+         "a window of the mapped file sent");
+  second.reset();
+  expect(cache.size() == 1, "the mapping is shared, kept for the first copier");
+  first.reset();
+  expect(cache.size() == 0, "unmapped after the last copier");
+}
+
+}  // namespace
+
+int main() {
+  flute::LogLine::set_log_level(flute::LogLine::ERROR);
+  expect(make_file(), "file written");
+  const ZeroCopier::CopyMode modes[] = {
+      ZeroCopier::kZeroCopy, ZeroCopier::kMMap, ZeroCopier::kReadWrite};
+  for (ZeroCopier::CopyMode mode : modes) {
+    test_windows(mode);
+    test_adaptive_chunks(mode);
+  }
+  test_mapped_file_cache();
+  ::unlink(g_path.c_str());
+  return flute::test::exit_code();
+}
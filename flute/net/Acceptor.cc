@@ -59,7 +59,8 @@ void Acceptor::handle_conn_arrival() {
       socket_ops::close(connfd);
     }
   } else {
-    LOG_SYSERR << "in Acceptor::handleRead";
+    // EMFILE storms repeat on every poll, keep them from flooding the log
+    LOG_RATE_LIMITED(ERROR, 10) << "in Acceptor::handleRead";
     // Read the section named "The special problem of
     // accept()ing when you can't" in libev's doc.
     // By Marc Lehmann, author of libev.
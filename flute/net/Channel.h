@@ -6,6 +6,7 @@
 
 #include <functional>
 #include <memory>
+#include <typeinfo>
 
 #include "poll.h"
 
@@ -46,7 +47,7 @@ class Channel : noncopyable {
   int fd() const { return m_fd; }
   int concerned_events() const { return m_concerned_events; }
   void set_revents(int revt) { m_recv_events = revt; }  // used by pollers
-  // int revents() const { return m_recv_events; }
+  int revents() const { return m_recv_events; }
   bool is_none_event() const { return m_concerned_events == kNoneEvent; }
 
   void wang_to_read() {
@@ -79,6 +80,13 @@ class Channel : noncopyable {
   // for debug
   string recv_events_to_string() const;
   string concerned_events_to_string() const;
+  static string events_to_string(int fd, int ev);
+  const std::type_info& read_callback_type() const {
+    return m_read_callback.target_type();
+  }
+  const std::type_info& write_callback_type() const {
+    return m_write_callback.target_type();
+  }
 
   void disable_loghup() { m_loghup_enabled = false; }
 
@@ -86,8 +94,6 @@ class Channel : noncopyable {
   void remove_self_from_reactor();
 
  private:
-  static string events_to_string(int fd, int ev);
-
   void update_self_in_reactor();
   void handle_event_with_guard(Timestamp receiveTime);
 
@@ -5,7 +5,9 @@
 
 #include <flute/common/LogLine.h>
 #include <flute/net/Channel.h>
+#include <flute/net/Endian.h>
 #include <flute/net/Reactor.h>
+#include <flute/net/Resolver.h>
 #include <flute/net/SocketsOps.h>
 
 #include <errno.h>
@@ -15,20 +17,54 @@ using namespace flute;
 
 const int Connector::kMaxRetryDelayMs;
 
+namespace
+{
+
+// sin_port and sin6_port are at the same offset, see InetAddress.cc
+InetAddress with_port(const InetAddress& addr, uint16_t port)
+{
+  struct sockaddr_in6 addr6 = *socket_ops::sockaddr_in6_cast(addr.get_sock_addr());
+  addr6.sin6_port = socket_ops::host_to_net16(port);
+  return InetAddress(addr6);
+}
+
+}  // namespace
+
 Connector::Connector(Reactor* reactor, const InetAddress& serverAddr)
   : m_reactor(reactor),
     serverAddr_(serverAddr),
+    m_resolver(NULL),
+    m_port(serverAddr.to_port()),
     m_is_connected(false),
     m_state(kDisconnected),
+    m_next_candidate(0),
+    m_retryable(false),
+    m_race_timer_pending(false),
     m_retry_delay_ms(kInitRetryDelayMs)
 {
   LOG_DEBUG << "ctor[" << CurrentThread::name() << "]";
 }
 
+Connector::Connector(Reactor* reactor, Resolver* resolver,
+                     const string& hostname, uint16_t port)
+  : m_reactor(reactor),
+    m_resolver(resolver),
+    m_hostname(hostname),
+    m_port(port),
+    m_is_connected(false),
+    m_state(kDisconnected),
+    m_next_candidate(0),
+    m_retryable(false),
+    m_race_timer_pending(false),
+    m_retry_delay_ms(kInitRetryDelayMs)
+{
+  LOG_DEBUG << "ctor[" << CurrentThread::name() << "] " << hostname;
+}
+
 Connector::~Connector()
 {
   LOG_DEBUG << "dtor[" << CurrentThread::name() << "]";
-  assert(!m_channel);
+  assert(m_attempts.empty());
 }
 
 void Connector::start()
@@ -41,13 +77,20 @@ void Connector::start_in_reactor()
 {
   m_reactor->assert_in_reactor_thread();
   assert(m_state == kDisconnected);
-  if (m_is_connected)
+  if (!m_is_connected)
+  {
+    LOG_DEBUG << "do not connect";
+  }
+  else if (m_resolver)
   {
-    connect();
+    set_state(kResolving);
+    m_resolver->resolve(m_hostname, std::bind(&Connector::on_resolved,
+                                              shared_from_this(),
+                                              std::placeholders::_1));
   }
   else
   {
-    LOG_DEBUG << "do not connect";
+    start_race(std::vector<InetAddress>(1, serverAddr_));
   }
 }
 
@@ -63,50 +106,117 @@ void Connector::stop_in_reactor()
   m_reactor->assert_in_reactor_thread();
   if (m_state == kConnecting)
   {
+    // not a failure, neither retried nor reported
+    cancel_race_timer();
+    abort_attempts();
     set_state(kDisconnected);
-    int sockfd = remove_and_reset_channel();
-    retry(sockfd);
-  }
-}
-
-void Connector::connect()
-{
-  int sockfd = socket_ops::create_sockfd_nonblocking_or_abort(serverAddr_.family());
-  int ret = socket_ops::connect(sockfd, serverAddr_.get_sock_addr());
-  int savedErrno = (ret == 0) ? 0 : errno;
-  switch (savedErrno)
-  {
-    case 0:
-    case EINPROGRESS:
-    case EINTR:
-    case EISCONN:
-      connecting(sockfd);
-      break;
-
-    case EAGAIN:
-    case EADDRINUSE:
-    case EADDRNOTAVAIL:
-    case ECONNREFUSED:
-    case ENETUNREACH:
-      retry(sockfd);
-      break;
-
-    case EACCES:
-    case EPERM:
-    case EAFNOSUPPORT:
-    case EALREADY:
-    case EBADF:
-    case EFAULT:
-    case ENOTSOCK:
-      LOG_SYSERR << "connect error in Connector::start_in_reactor " << savedErrno;
-      socket_ops::close(sockfd);
-      break;
+  }
+  else if (m_state == kResolving)
+  {
+    // on_resolved() does nothing
+    set_state(kDisconnected);
+  }
+}
 
-    default:
-      LOG_SYSERR << "Unexpected error in Connector::start_in_reactor " << savedErrno;
-      socket_ops::close(sockfd);
-      // connectErrorCallback_();
-      break;
+void Connector::on_resolved(const std::vector<InetAddress>& addresses)
+{
+  if (m_state != kResolving)
+  {
+    return;
+  }
+  if (addresses.empty())
+  {
+    LOG_WARN << "Connector - cannot resolve " << m_hostname;
+    retry();
+    return;
+  }
+  // alternate the families, IPv6 first
+  std::vector<InetAddress> ipv6, ipv4;
+  for (const InetAddress& addr : addresses)
+  {
+    (addr.family() == AF_INET6 ? ipv6 : ipv4).push_back(with_port(addr, m_port));
+  }
+  std::vector<InetAddress> candidates;
+  for (size_t i = 0; i < std::max(ipv6.size(), ipv4.size()); ++i)
+  {
+    if (i < ipv6.size())
+    {
+      candidates.push_back(ipv6[i]);
+    }
+    if (i < ipv4.size())
+    {
+      candidates.push_back(ipv4[i]);
+    }
+  }
+  start_race(candidates);
+}
+
+void Connector::start_race(const std::vector<InetAddress>& candidates)
+{
+  set_state(kConnecting);
+  m_candidates = candidates;
+  m_next_candidate = 0;
+  m_retryable = false;
+  connect_next();
+}
+
+// Start connecting the next candidate. A connect that fails at once goes on
+// with the one after it.
+void Connector::connect_next()
+{
+  while (m_next_candidate < m_candidates.size())
+  {
+    const InetAddress& addr = m_candidates[m_next_candidate++];
+    int sockfd = socket_ops::create_sockfd_nonblocking_or_abort(addr.family());
+    int ret = socket_ops::connect(sockfd, addr.get_sock_addr());
+    int savedErrno = (ret == 0) ? 0 : errno;
+    switch (savedErrno)
+    {
+      case 0:
+      case EINPROGRESS:
+      case EINTR:
+      case EISCONN:
+        connecting(sockfd, addr);
+        if (m_next_candidate < m_candidates.size())
+        {
+          m_race_timer_pending = true;
+          m_race_timer = m_reactor->run_after(
+              kRaceDelayMs / 1000.0,
+              std::bind(&Connector::on_race_timer, shared_from_this()));
+        }
+        return;
+
+      case EAGAIN:
+      case EADDRINUSE:
+      case EADDRNOTAVAIL:
+      case ECONNREFUSED:
+      case ENETUNREACH:
+        LOG_DEBUG << "Connector - " << addr.to_ip_port() << " "
+                  << flute::strerror_tl(savedErrno);
+        socket_ops::close(sockfd);
+        m_retryable = true;
+        break;
+
+      case EACCES:
+      case EPERM:
+      case EAFNOSUPPORT:
+      case EALREADY:
+      case EBADF:
+      case EFAULT:
+      case ENOTSOCK:
+        LOG_SYSERR << "connect error in Connector::start_in_reactor " << savedErrno;
+        socket_ops::close(sockfd);
+        break;
+
+      default:
+        LOG_SYSERR << "Unexpected error in Connector::start_in_reactor " << savedErrno;
+        socket_ops::close(sockfd);
+        break;
+    }
+  }
+  if (m_attempts.empty())
+  {
+    connect_failed();
   }
 }
 
@@ -119,57 +229,86 @@ void Connector::restart()
   start_in_reactor();
 }
 
-void Connector::connecting(int sockfd)
+void Connector::connecting(int sockfd, const InetAddress& addr)
 {
-  set_state(kConnecting);
-  assert(!m_channel);
-  m_channel.reset(new Channel(m_reactor, sockfd));
-  m_channel->set_write_callback(
-      std::bind(&Connector::handle_write, this)); // FIXME: unsafe
-  m_channel->set_error_callback(
-      std::bind(&Connector::handle_error, this)); // FIXME: unsafe
+  Attempt attempt;
+  attempt.addr = addr;
+  attempt.channel.reset(new Channel(m_reactor, sockfd));
+  Channel* channel = attempt.channel.get();
+  channel->set_write_callback(
+      std::bind(&Connector::handle_write, this, channel)); // FIXME: unsafe
+  channel->set_error_callback(
+      std::bind(&Connector::handle_error, this, channel)); // FIXME: unsafe
 
   // channel_->tie(shared_from_this()); is not working,
   // as channel_ is not managed by shared_ptr
-  m_channel->want_to_write();
+  channel->want_to_write();
+  m_attempts.push_back(std::move(attempt));
 }
 
-int Connector::remove_and_reset_channel()
+bool Connector::has_attempt(Channel* channel) const
 {
-  m_channel->end_all();
-  m_channel->remove_self_from_reactor();
-  int sockfd = m_channel->fd();
+  for (const Attempt& attempt : m_attempts)
+  {
+    if (attempt.channel.get() == channel)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+int Connector::remove_and_reset_channel(Channel* channel, InetAddress* addr)
+{
+  std::vector<Attempt>::iterator it = m_attempts.begin();
+  while (it->channel.get() != channel)
+  {
+    ++it;
+  }
+  *addr = it->addr;
+  channel->end_all();
+  channel->remove_self_from_reactor();
+  int sockfd = channel->fd();
   // Can't reset channel_ here, because we are inside Channel::handleEvent
+  m_removed_channels.push_back(std::move(it->channel));
+  m_attempts.erase(it);
   m_reactor->queue_in_reactor(std::bind(&Connector::reset_channel, this)); // FIXME: unsafe
   return sockfd;
 }
 
 void Connector::reset_channel()
 {
-  m_channel.reset();
+  m_removed_channels.clear();
 }
 
-void Connector::handle_write()
+void Connector::handle_write(Channel* channel)
 {
   LOG_TRACE << "Connector::handle_write " << m_state;
 
-  if (m_state == kConnecting)
+  if (m_state == kConnecting && has_attempt(channel))
   {
-    int sockfd = remove_and_reset_channel();
+    InetAddress addr;
+    int sockfd = remove_and_reset_channel(channel, &addr);
     int err = socket_ops::getSocketError(sockfd);
     if (err)
     {
-      LOG_WARN << "Connector::handle_write - SO_ERROR = "
-               << err << " " << flute::strerror_tl(err);
-      retry(sockfd);
+      LOG_WARN << "Connector::handle_write - " << addr.to_ip_port()
+               << " SO_ERROR = " << err << " " << flute::strerror_tl(err);
+      socket_ops::close(sockfd);
+      attempt_failed();
     }
     else if (socket_ops::isSelfConnect(sockfd))
     {
       LOG_WARN << "Connector::handle_write - Self connect";
-      retry(sockfd);
+      socket_ops::close(sockfd);
+      attempt_failed();
     }
     else
     {
+      // the others lost the race
+      cancel_race_timer();
+      abort_attempts();
+      serverAddr_ = addr;
       set_state(kConnected);
       if (m_is_connected)
       {
@@ -183,30 +322,89 @@ void Connector::handle_write()
   }
   else
   {
-    // what happened?
-    assert(m_state == kDisconnected);
+    // what happened? or the error callback of channel has ended its attempt
+    assert(m_state == kDisconnected || !has_attempt(channel));
   }
 }
 
-void Connector::handle_error()
+void Connector::handle_error(Channel* channel)
 {
   LOG_ERROR << "Connector::handle_error state=" << m_state;
-  if (m_state == kConnecting)
+  if (m_state == kConnecting && has_attempt(channel))
   {
-    int sockfd = remove_and_reset_channel();
+    InetAddress addr;
+    int sockfd = remove_and_reset_channel(channel, &addr);
     int err = socket_ops::getSocketError(sockfd);
     LOG_TRACE << "SO_ERROR = " << err << " " << flute::strerror_tl(err);
-    retry(sockfd);
+    socket_ops::close(sockfd);
+    attempt_failed();
   }
 }
 
-void Connector::retry(int sockfd)
+// The next candidate does not wait for the race timer.
+void Connector::attempt_failed()
+{
+  m_retryable = true;
+  cancel_race_timer();
+  connect_next();
+}
+
+// Every candidate of this round has failed.
+void Connector::connect_failed()
+{
+  if (m_retryable)
+  {
+    retry();
+  }
+  else
+  {
+    set_state(kDisconnected);
+    if (m_connect_failed_callback)
+    {
+      m_connect_failed_callback();
+    }
+  }
+}
+
+void Connector::on_race_timer()
+{
+  m_race_timer_pending = false;
+  if (m_state == kConnecting)
+  {
+    connect_next();
+  }
+}
+
+void Connector::cancel_race_timer()
+{
+  if (m_race_timer_pending)
+  {
+    m_race_timer_pending = false;
+    m_reactor->remove(m_race_timer);
+  }
+}
+
+void Connector::abort_attempts()
+{
+  while (!m_attempts.empty())
+  {
+    InetAddress addr;
+    socket_ops::close(
+        remove_and_reset_channel(m_attempts.back().channel.get(), &addr));
+  }
+}
+
+void Connector::retry()
 {
-  socket_ops::close(sockfd);
   set_state(kDisconnected);
+  if (m_connect_failed_callback)
+  {
+    m_connect_failed_callback();
+  }
   if (m_is_connected)
   {
-    LOG_INFO << "Connector::retry - Retry connecting to " << serverAddr_.to_ip_port()
+    LOG_INFO << "Connector::retry - Retry connecting to "
+             << (m_resolver ? m_hostname : serverAddr_.to_ip_port())
              << " in " << m_retry_delay_ms << " milliseconds. ";
     m_reactor->run_after(m_retry_delay_ms/1000.0,
                     std::bind(&Connector::start_in_reactor, shared_from_this()));
@@ -217,4 +415,3 @@ void Connector::retry(int sockfd)
     LOG_DEBUG << "do not connect";
   }
 }
-
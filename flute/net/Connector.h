@@ -2,55 +2,101 @@
 #define FLUTE_NET_CONNECTOR_H
 
 #include <flute/common/noncopyable.h>
+#include <flute/common/types.h>
 #include <flute/net/InetAddress.h>
+#include <flute/net/TimerId.h>
 
 #include <functional>
 #include <memory>
+#include <vector>
 
 namespace flute {
 
 class Channel;
 class Reactor;
+class Resolver;
 
 class Connector : noncopyable, public std::enable_shared_from_this<Connector> {
  public:
   typedef std::function<void(int sockfd)> NewConnectionCallback;
+  typedef std::function<void()> ConnectFailedCallback;
 
   Connector(Reactor* reactor, const InetAddress& serverAddr);
+  // Looks hostname up with resolver before every attempt, which races its
+  // IPv6 and IPv4 addresses: the next address is tried when the one before
+  // fails, or has not connected in kRaceDelayMs, and the first to connect
+  // wins (happy eyeballs, RFC 8305). resolver must outlive the Connector.
+  Connector(Reactor* reactor, Resolver* resolver, const string& hostname,
+            uint16_t port);
   ~Connector();
 
   void set_new_conn_callback(const NewConnectionCallback& cb) {
     m_new_conn_callback = cb;
   }
 
+  // Called in loop thread on every failed attempt, before the retry. Calling
+  // stop() in it gives up.
+  void set_connect_failed_callback(const ConnectFailedCallback& cb) {
+    m_connect_failed_callback = cb;
+  }
+
   void start();    // can be called in any thread
   void restart();  // must be called in loop thread
   void stop();     // can be called in any thread
 
+  // With a hostname, the address connected to last.
   const InetAddress& serverAddress() const { return serverAddr_; }
 
  private:
-  enum ConnectStates { kDisconnected, kConnecting, kConnected };
+  enum ConnectStates { kDisconnected, kResolving, kConnecting, kConnected };
   static const int kMaxRetryDelayMs = 30 * 1000;
   static const int kInitRetryDelayMs = 500;
+  static const int kRaceDelayMs = 250;
+
+  // A connect in progress.
+  struct Attempt {
+    InetAddress addr;
+    std::unique_ptr<Channel> channel;
+  };
 
   void set_state(ConnectStates s) { m_state = s; }
   void start_in_reactor();
   void stop_in_reactor();
-  void connect();
-  void connecting(int sockfd);
-  void handle_write();
-  void handle_error();
-  void retry(int sockfd);
-  int remove_and_reset_channel();
+  void on_resolved(const std::vector<InetAddress>& addresses);
+  void start_race(const std::vector<InetAddress>& candidates);
+  void connect_next();
+  void connecting(int sockfd, const InetAddress& addr);
+  void handle_write(Channel* channel);
+  void handle_error(Channel* channel);
+  void attempt_failed();
+  void connect_failed();
+  void on_race_timer();
+  void cancel_race_timer();
+  void abort_attempts();
+  void retry();
+  bool has_attempt(Channel* channel) const;
+  int remove_and_reset_channel(Channel* channel, InetAddress* addr);
   void reset_channel();
 
   Reactor* m_reactor;
   InetAddress serverAddr_;
+  Resolver* m_resolver;  // null if serverAddr_ is given
+  const string m_hostname;
+  const uint16_t m_port;
   bool m_is_connected;    // atomic
   ConnectStates m_state;  // FIXME: use atomic variable
-  std::unique_ptr<Channel> m_channel;
+  // the addresses of this round, in the order they are tried
+  std::vector<InetAddress> m_candidates;
+  size_t m_next_candidate;
+  // whether a failure of this round is worth a retry
+  bool m_retryable;
+  std::vector<Attempt> m_attempts;
+  // removed from the reactor, reset in a queued task
+  std::vector<std::unique_ptr<Channel>> m_removed_channels;
+  TimerId m_race_timer;
+  bool m_race_timer_pending;
   NewConnectionCallback m_new_conn_callback;
+  ConnectFailedCallback m_connect_failed_callback;
   int m_retry_delay_ms;
 };
 
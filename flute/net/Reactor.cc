@@ -2,10 +2,13 @@
 
 #include <flute/net/Reactor.h>
 
+#include <flute/common/HdrHistogram.h>
 #include <flute/common/LogLine.h>
+#include <flute/common/Metrics.h>
 #include <flute/common/Mutex.h>
 #include <flute/net/Channel.h>
 #include <flute/net/Poller.h>
+#include <flute/net/SlowCallbackDetector.h>
 #include <flute/net/SocketsOps.h>
 #include <flute/net/TimerQueue.h>
 
@@ -42,6 +45,24 @@ class IgnoreSigPipe {
 #pragma GCC diagnostic error "-Wold-style-cast"
 
 IgnoreSigPipe initObj;
+
+// From the return of poll() to the end of the queued tasks, 1us to 1s.
+Histogram* const g_loop_iteration_seconds =
+    MetricsRegistry::instance().histogram(
+        "flute_reactor_loop_iteration_seconds",
+        "Busy time of a reactor loop iteration, the wait in poll excluded.",
+        Histogram::exponential_bounds(1e-6, 4, 11));
+
+// Where the time of an iteration goes.
+LatencyHistogram* const g_poll_wait = MetricsRegistry::instance().latency(
+    "flute_reactor_poll_wait_seconds",
+    "Wait of a reactor loop iteration in poll.");
+LatencyHistogram* const g_event_handling = MetricsRegistry::instance().latency(
+    "flute_reactor_event_handling_seconds",
+    "Channel callbacks of a reactor loop iteration, the timers included.");
+LatencyHistogram* const g_queued_tasks = MetricsRegistry::instance().latency(
+    "flute_reactor_queued_tasks_seconds",
+    "Queued tasks of a reactor loop iteration.");
 }  // namespace
 
 static const int kPollTimeMs = 10000;
@@ -95,6 +116,7 @@ void Reactor::loop() {
       false;  // FIXME: what if someone calls quit() before loop() ?
   LOG_TRACE << "Reactor " << CurrentThread::name() << " start looping";
 
+  Timestamp iteration_end = Timestamp::now();
   while (!m_going_to_quit) {
     m_active_channels.clear();
     m_poll_return_time = m_poller->poll(m_timeout_ms, &m_active_channels);
@@ -104,13 +126,25 @@ void Reactor::loop() {
     }
     // TODO sort channel by priority
     m_is_handling_event = true;
-    for (Channel* channel : m_active_channels) {
-      m_current_active_channel = channel;
-      m_current_active_channel->handle_event(m_poll_return_time);
+    if (m_slow_callback_detector) {
+      handle_events_checked(m_poll_return_time);
+    } else {
+      for (Channel* channel : m_active_channels) {
+        m_current_active_channel = channel;
+        m_current_active_channel->handle_event(m_poll_return_time);
+      }
     }
     m_current_active_channel = NULL;
     m_is_handling_event = false;
+    Timestamp events_end = Timestamp::now();
     do_queueing_tasks();
+    Timestamp tasks_end = Timestamp::now();
+    g_poll_wait->record_between(iteration_end, m_poll_return_time);
+    g_event_handling->record_between(m_poll_return_time, events_end);
+    g_queued_tasks->record_between(events_end, tasks_end);
+    g_loop_iteration_seconds->observe(
+        second_difference(tasks_end, m_poll_return_time));
+    iteration_end = tasks_end;
   }
 
   LOG_TRACE << "Reactor " << CurrentThread::name() << " stop looping";
@@ -156,6 +190,23 @@ size_t Reactor::num_pending_tasks() const {
   return m_pending_tasks.size();
 }
 
+void Reactor::set_slow_callback_threshold(double seconds) {
+  assert_in_reactor_thread();
+  // the detector of the thread goes before another one comes
+  m_slow_callback_detector.reset();
+  if (seconds > 0) {
+    m_slow_callback_detector.reset(
+        new SlowCallbackDetector(seconds, m_slow_callback_handler));
+  }
+}
+
+void Reactor::set_slow_callback_handler(const SlowCallbackHandler& handler) {
+  m_slow_callback_handler = handler;
+  if (m_slow_callback_detector) {
+    m_slow_callback_detector->set_handler(handler);
+  }
+}
+
 TimerId Reactor::run_at(Timestamp time, TimerCallback cb) {
   return m_timerqueue->add_timer(std::move(cb), time, 0.0);
 }
@@ -228,12 +279,51 @@ void Reactor::do_queueing_tasks() {
     tasks.swap(m_pending_tasks);
   }
 
-  for (const Task& functor : tasks) {
-    functor();
+  SlowCallbackDetector* detector = m_slow_callback_detector.get();
+  if (detector) {
+    Timestamp start = Timestamp::now();
+    for (const Task& functor : tasks) {
+      SlowCallbackDetector::Scope scope = detector->begin(start);
+      functor();
+      Timestamp end = Timestamp::now();
+      detector->end(scope, end, [&functor]() {
+        return "task " + SlowCallbackDetector::callback_name(functor);
+      });
+      start = end;
+    }
+  } else {
+    for (const Task& functor : tasks) {
+      functor();
+    }
   }
   m_is_calling_pending_tasks = false;
 }
 
+// The callbacks of a channel may free it, what names them is taken before.
+void Reactor::handle_events_checked(Timestamp start) {
+  SlowCallbackDetector* detector = m_slow_callback_detector.get();
+  for (Channel* channel : m_active_channels) {
+    m_current_active_channel = channel;
+    const int fd = channel->fd();
+    const int revents = channel->revents();
+    const std::type_info* read_type = &channel->read_callback_type();
+    const std::type_info* write_type = &channel->write_callback_type();
+    SlowCallbackDetector::Scope scope = detector->begin(start);
+    channel->handle_event(m_poll_return_time);
+    Timestamp end = Timestamp::now();
+    detector->end(scope, end, [=]() {
+      string name = "channel " + Channel::events_to_string(fd, revents);
+      if (revents & kReadEvent) {
+        name += "read " + SlowCallbackDetector::type_name(*read_type);
+      } else if (revents & kWriteEvent) {
+        name += "write " + SlowCallbackDetector::type_name(*write_type);
+      }
+      return name;
+    });
+    start = end;
+  }
+}
+
 void Reactor::print_active_channels() const {
   for (const Channel* channel : m_active_channels) {
     LOG_TRACE << "{" << channel->recv_events_to_string() << "} ";
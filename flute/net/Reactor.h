@@ -20,6 +20,7 @@ namespace flute {
 
 class Channel;
 class Poller;
+class SlowCallbackDetector;
 class TimerQueue;
 
 ///
@@ -30,6 +31,11 @@ class TimerQueue;
 class Reactor : noncopyable {
  public:
   typedef std::function<void()> Task;
+  /// What a slow callback was, e.g. "task std::_Bind<...>", how long it ran
+  /// and the stack of the loop thread sampled meanwhile, empty if none.
+  typedef std::function<void(const string& callback, double seconds,
+                             const string& stack)>
+      SlowCallbackHandler;
 
   Reactor();
   Reactor(int timeout_ms);
@@ -67,6 +73,14 @@ class Reactor : noncopyable {
 
   size_t num_pending_tasks() const;
 
+  /// Flag the channel callbacks, timers and queued tasks running longer than
+  /// seconds, 0 turns it off, the default. The stack of a callback past the
+  /// threshold is sampled while it runs, by a watchdog thread signaling the
+  /// loop thread. Flagged callbacks are logged as warnings, or given to
+  /// handler if set. Must be called in the loop thread.
+  void set_slow_callback_threshold(double seconds);
+  void set_slow_callback_handler(const SlowCallbackHandler& handler);
+
   // timers
 
   ///
@@ -95,6 +109,9 @@ class Reactor : noncopyable {
   void update_channel(Channel* channel);
   void remove_channel(Channel* channel);
   bool has_channel(Channel* channel);
+  SlowCallbackDetector* slow_callback_detector() const {
+    return m_slow_callback_detector.get();
+  }
 
   // pid_t threadId() const { return threadId_; }
   void assert_in_reactor_thread() {
@@ -118,6 +135,7 @@ class Reactor : noncopyable {
   void abort_not_in_reactor_thread();
   void handle_wakeup();  // waked up
   void do_queueing_tasks();
+  void handle_events_checked(Timestamp start);
 
   void print_active_channels() const;  // DEBUG
 
@@ -138,6 +156,8 @@ class Reactor : noncopyable {
   // a standalone channel responsible for the waking up events
   std::unique_ptr<Channel> m_wakeup_channel;
   const void* m_context;
+  SlowCallbackHandler m_slow_callback_handler;
+  std::unique_ptr<SlowCallbackDetector> m_slow_callback_detector;
 
   // scratch variables
   ChannelPtrList m_active_channels;
@@ -0,0 +1,415 @@
+#include <flute/net/Resolver.h>
+
+#include <flute/common/LogLine.h>
+#include <flute/net/Channel.h>
+#include <flute/net/Reactor.h>
+#include <flute/net/SocketsOps.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>  // strncasecmp
+#include <sys/random.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <limits>
+
+namespace flute {
+
+namespace {
+
+const uint16_t kDnsPort = 53;
+const uint16_t kTypeA = 1;
+const uint16_t kTypeAAAA = 28;
+const uint16_t kClassIN = 1;
+// a UDP answer is 512 bytes unless EDNS is asked for
+const size_t kMaxAnswerSize = 4096;
+
+// The first "nameserver" line of /etc/resolv.conf, or the loopback.
+InetAddress default_name_server() {
+  FILE* fp = ::fopen("/etc/resolv.conf", "re");
+  if (fp != NULL) {
+    char line[256];
+    char ip[64];
+    while (::fgets(line, sizeof line, fp) != NULL) {
+      if (::sscanf(line, " nameserver %63s", ip) == 1) {
+        ::fclose(fp);
+        return InetAddress(ip, kDnsPort, strchr(ip, ':') != NULL);
+      }
+    }
+    ::fclose(fp);
+  }
+  return InetAddress("127.0.0.1", kDnsPort);
+}
+
+// IP literals need no lookup.
+bool parse_ip(const string& hostname, InetAddress* out) {
+  struct sockaddr_in addr;
+  mem_zero(&addr, sizeof addr);
+  if (::inet_pton(AF_INET, hostname.c_str(), &addr.sin_addr) == 1) {
+    addr.sin_family = AF_INET;
+    *out = InetAddress(addr);
+    return true;
+  }
+  struct sockaddr_in6 addr6;
+  mem_zero(&addr6, sizeof addr6);
+  if (::inet_pton(AF_INET6, hostname.c_str(), &addr6.sin6_addr) == 1) {
+    addr6.sin6_family = AF_INET6;
+    *out = InetAddress(addr6);
+    return true;
+  }
+  return false;
+}
+
+void put16(string* packet, uint16_t value) {
+  packet->push_back(static_cast<char>(value >> 8));
+  packet->push_back(static_cast<char>(value & 0xff));
+}
+
+uint16_t get16(const unsigned char* p) {
+  return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+uint32_t get32(const unsigned char* p) {
+  return static_cast<uint32_t>(get16(p)) << 16 | get16(p + 2);
+}
+
+// A question for the records of type of hostname, false if hostname is not a
+// valid domain name.
+bool make_question(uint16_t id, const string& hostname, uint16_t type,
+                   string* packet) {
+  packet->clear();
+  put16(packet, id);
+  put16(packet, 0x0100);  // recursion desired
+  put16(packet, 1);       // one question
+  put16(packet, 0);
+  put16(packet, 0);
+  put16(packet, 0);
+  size_t begin = 0;
+  while (begin < hostname.size()) {
+    size_t end = hostname.find('.', begin);
+    if (end == string::npos) {
+      end = hostname.size();
+    }
+    size_t label = end - begin;
+    if (label == 0 || label > 63) {
+      return false;
+    }
+    packet->push_back(static_cast<char>(label));
+    packet->append(hostname, begin, label);
+    begin = end + 1;
+  }
+  packet->push_back('\0');
+  if (packet->size() - 12 > 255) {
+    return false;
+  }
+  put16(packet, type);
+  put16(packet, kClassIN);
+  return true;
+}
+
+// An id an off-path attacker cannot guess, as a sequence would be.
+uint16_t random_id() {
+  uint16_t id = 0;
+  if (::getrandom(&id, sizeof id, 0) != static_cast<ssize_t>(sizeof id)) {
+    LOG_SYSERR << "Resolver - getrandom";
+    id = static_cast<uint16_t>(Timestamp::now().micro_seconds_since_epoch());
+  }
+  return id;
+}
+
+// Whether the uncompressed domain name at *pos is hostname, moving *pos past
+// it. Names are compared regardless of case.
+bool match_name(const unsigned char* data, size_t len, size_t* pos,
+                const string& hostname) {
+  size_t begin = 0;
+  while (*pos < len) {
+    size_t label = data[*pos];
+    ++*pos;
+    if (label == 0) {
+      return begin >= hostname.size();
+    }
+    if ((label & 0xc0) != 0 || *pos + label > len ||
+        begin + label > hostname.size() ||
+        strncasecmp(reinterpret_cast<const char*>(data + *pos),
+                    hostname.data() + begin, label) != 0) {
+      return false;
+    }
+    *pos += label;
+    begin += label;
+    if (begin < hostname.size()) {
+      if (hostname[begin] != '.') {
+        return false;
+      }
+      ++begin;
+    }
+  }
+  return false;
+}
+
+// Skip a possibly compressed domain name at *pos.
+bool skip_name(const unsigned char* data, size_t len, size_t* pos) {
+  while (*pos < len) {
+    unsigned char label = data[*pos];
+    if ((label & 0xc0) == 0xc0) {
+      *pos += 2;
+      return *pos <= len;
+    }
+    *pos += 1 + label;
+    if (label == 0) {
+      return *pos <= len;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+struct Resolver::Lookup {
+  Lookup(const string& name)
+      : hostname(name),
+        min_ttl(std::numeric_limits<uint32_t>::max()),
+        tries(0) {
+    for (int i = 0; i < 2; ++i) {
+      ids[i] = 0;
+      answered[i] = false;
+    }
+  }
+
+  const string hostname;
+  std::vector<Callback> callbacks;
+  // [0] is the AAAA question, [1] the A one
+  uint16_t ids[2];
+  bool answered[2];
+  std::vector<InetAddress> addresses[2];
+  // of the records so far, the maximum before any
+  uint32_t min_ttl;
+  int tries;
+  TimerId timer;
+};
+
+Resolver::Resolver(Reactor* reactor)
+    : Resolver(reactor, default_name_server()) {}
+
+Resolver::Resolver(Reactor* reactor, const InetAddress& name_server)
+    : m_reactor(reactor),
+      m_name_server(name_server),
+      m_timeout(1.0),
+      m_max_tries(3),
+      m_min_ttl(1.0),
+      m_max_ttl(3600.0),
+      m_sockfd(::socket(name_server.family(),
+                        SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) {
+  if (m_sockfd < 0) {
+    LOG_SYSFATAL << "Resolver::Resolver";
+  }
+  // the kernel drops datagrams of any other peer
+  if (socket_ops::connect(m_sockfd, name_server.get_sock_addr()) < 0) {
+    LOG_SYSERR << "Resolver::Resolver connect " << name_server.to_ip_port();
+  }
+  m_channel.reset(new Channel(reactor, m_sockfd));
+  m_channel->set_read_callback(std::bind(&Resolver::handle_read, this));
+  m_channel->wang_to_read();
+}
+
+Resolver::~Resolver() {
+  m_reactor->assert_in_reactor_thread();
+  for (const auto& entry : m_lookups) {
+    m_reactor->remove(entry.second->timer);
+  }
+  m_channel->end_all();
+  m_channel->remove_self_from_reactor();
+  ::close(m_sockfd);
+}
+
+void Resolver::resolve(const string& hostname, const Callback& cb) {
+  m_reactor->assert_in_reactor_thread();
+  InetAddress literal;
+  if (parse_ip(hostname, &literal)) {
+    cb(std::vector<InetAddress>(1, literal));
+    return;
+  }
+  auto cached = m_cache.find(hostname);
+  if (cached != m_cache.end()) {
+    if (Timestamp::now() < cached->second.expiration) {
+      LOG_TRACE << "Resolver - " << hostname << " cached";
+      std::vector<InetAddress> addresses(cached->second.addresses);
+      cb(addresses);
+      return;
+    }
+    m_cache.erase(cached);
+  }
+  auto it = m_lookups.find(hostname);
+  if (it != m_lookups.end()) {
+    it->second->callbacks.push_back(cb);
+    return;
+  }
+
+  std::unique_ptr<Lookup> owner(new Lookup(hostname));
+  Lookup* lookup = owner.get();
+  lookup->callbacks.push_back(cb);
+  string packet;
+  if (!make_question(0, hostname, kTypeA, &packet)) {
+    LOG_ERROR << "Resolver - bad hostname " << hostname;
+    cb(std::vector<InetAddress>());
+    return;
+  }
+  m_lookups[hostname] = std::move(owner);
+  for (int i = 0; i < 2; ++i) {
+    do {
+      lookup->ids[i] = random_id();
+    } while (m_questions.count(lookup->ids[i]) != 0);
+    m_questions[lookup->ids[i]] = hostname;
+    send_question(lookup, i);
+  }
+  lookup->tries = 1;
+  lookup->timer = m_reactor->run_after(
+      m_timeout, std::bind(&Resolver::on_timeout, this, hostname));
+}
+
+void Resolver::send_question(Lookup* lookup, int index) {
+  string packet;
+  make_question(lookup->ids[index], lookup->hostname,
+                index == 0 ? kTypeAAAA : kTypeA, &packet);
+  ssize_t n = ::send(m_sockfd, packet.data(), packet.size(), 0);
+  if (n < 0) {
+    LOG_SYSERR << "Resolver::send_question " << lookup->hostname;
+  }
+}
+
+void Resolver::handle_read() {
+  char buf[kMaxAnswerSize];
+  while (true) {
+    ssize_t n = ::recv(m_sockfd, buf, sizeof buf, 0);
+    if (n < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        // e.g. ECONNREFUSED, nothing listens at the name server
+        LOG_SYSERR << "Resolver::handle_read";
+      }
+      break;
+    }
+    handle_answer(buf, static_cast<size_t>(n));
+  }
+}
+
+void Resolver::handle_answer(const char* answer, size_t len) {
+  const unsigned char* data = reinterpret_cast<const unsigned char*>(answer);
+  if (len < 12 || (data[2] & 0x80) == 0) {
+    return;
+  }
+  uint16_t id = get16(data);
+  auto question = m_questions.find(id);
+  if (question == m_questions.end()) {
+    LOG_DEBUG << "Resolver - stale answer " << id;
+    return;
+  }
+  string hostname = question->second;
+  Lookup* lookup = m_lookups[hostname].get();
+  int index = lookup->ids[0] == id ? 0 : 1;
+  // the question is echoed, a forged answer guessing the id alone is dropped
+  size_t pos = 12;
+  if (get16(data + 4) != 1 || !match_name(data, len, &pos, hostname) ||
+      pos + 4 > len ||
+      get16(data + pos) != (index == 0 ? kTypeAAAA : kTypeA) ||
+      get16(data + pos + 2) != kClassIN) {
+    LOG_WARN << "Resolver - answer " << id << " not of the question for "
+             << hostname;
+    return;
+  }
+  pos += 4;
+  m_questions.erase(question);
+  lookup->answered[index] = true;
+
+  int rcode = data[3] & 0x0f;
+  if (rcode != 0) {
+    LOG_DEBUG << "Resolver - " << hostname << " rcode " << rcode;
+  }
+  uint16_t num_answers = get16(data + 6);
+  for (int i = 0; i < num_answers; ++i) {
+    if (!skip_name(data, len, &pos) || pos + 10 > len) {
+      break;
+    }
+    uint16_t type = get16(data + pos);
+    uint16_t klass = get16(data + pos + 2);
+    uint32_t ttl = get32(data + pos + 4);
+    uint16_t rdlength = get16(data + pos + 8);
+    pos += 10;
+    if (pos + rdlength > len) {
+      break;
+    }
+    // CNAMEs are followed by the records of their target
+    if (klass == kClassIN && type == kTypeA && rdlength == 4) {
+      struct sockaddr_in addr;
+      mem_zero(&addr, sizeof addr);
+      addr.sin_family = AF_INET;
+      memcpy(&addr.sin_addr, data + pos, 4);
+      lookup->addresses[index].push_back(InetAddress(addr));
+    } else if (klass == kClassIN && type == kTypeAAAA && rdlength == 16) {
+      struct sockaddr_in6 addr6;
+      mem_zero(&addr6, sizeof addr6);
+      addr6.sin6_family = AF_INET6;
+      memcpy(&addr6.sin6_addr, data + pos, 16);
+      lookup->addresses[index].push_back(InetAddress(addr6));
+    } else {
+      pos += rdlength;
+      continue;
+    }
+    lookup->min_ttl = std::min(lookup->min_ttl, ttl);
+    pos += rdlength;
+  }
+
+  if (lookup->answered[0] && lookup->answered[1]) {
+    m_reactor->remove(lookup->timer);
+    finish(hostname);
+  }
+}
+
+void Resolver::on_timeout(const string& hostname) {
+  auto it = m_lookups.find(hostname);
+  assert(it != m_lookups.end());
+  Lookup* lookup = it->second.get();
+  if (lookup->tries >= m_max_tries) {
+    LOG_WARN << "Resolver - " << hostname << " timed out";
+    finish(hostname);
+    return;
+  }
+  ++lookup->tries;
+  for (int i = 0; i < 2; ++i) {
+    if (!lookup->answered[i]) {
+      send_question(lookup, i);
+    }
+  }
+  lookup->timer = m_reactor->run_after(
+      m_timeout, std::bind(&Resolver::on_timeout, this, hostname));
+}
+
+void Resolver::finish(const string& hostname) {
+  auto it = m_lookups.find(hostname);
+  std::unique_ptr<Lookup> lookup(std::move(it->second));
+  m_lookups.erase(it);
+  std::vector<InetAddress> addresses(lookup->addresses[0]);
+  for (int i = 0; i < 2; ++i) {
+    if (!lookup->answered[i]) {
+      m_questions.erase(lookup->ids[i]);
+    }
+  }
+  addresses.insert(addresses.end(), lookup->addresses[1].begin(),
+                   lookup->addresses[1].end());
+  if (!addresses.empty()) {
+    double ttl = std::min(std::max(static_cast<double>(lookup->min_ttl),
+                                   m_min_ttl),
+                          m_max_ttl);
+    CacheEntry& entry = m_cache[hostname];
+    entry.addresses = addresses;
+    entry.expiration = add_second(Timestamp::now(), ttl);
+  }
+  LOG_DEBUG << "Resolver - " << hostname << " has " << addresses.size()
+            << " addresses";
+  for (const Callback& cb : lookup->callbacks) {
+    cb(addresses);
+  }
+}
+
+}  // namespace flute
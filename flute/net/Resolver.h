@@ -0,0 +1,89 @@
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef FLUTE_NET_RESOLVER_H
+#define FLUTE_NET_RESOLVER_H
+
+#include <flute/common/Timestamp.h>
+#include <flute/common/noncopyable.h>
+#include <flute/common/types.h>
+#include <flute/net/InetAddress.h>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace flute {
+
+class Channel;
+class Reactor;
+
+///
+/// Non-blocking DNS resolver of one Reactor.
+///
+/// A and AAAA questions go to one name server over UDP, from a socket watched
+/// by a Channel, so a lookup never blocks the reactor thread as
+/// InetAddress::resolve() does. Answers are cached for their TTL, and lookups
+/// of a hostname already being looked up wait for the same answers.
+///
+/// Used in its reactor thread only, it takes no lock.
+class Resolver : noncopyable {
+ public:
+  /// Called with the addresses of the hostname, port 0, IPv6 ones first.
+  /// Empty if the lookup failed.
+  typedef std::function<void(const std::vector<InetAddress>&)> Callback;
+
+  /// The first name server of /etc/resolv.conf.
+  explicit Resolver(Reactor* reactor);
+  Resolver(Reactor* reactor, const InetAddress& name_server);
+  ~Resolver();  // force out-line dtor, for std::unique_ptr members.
+
+  /// Settings. Every question is sent max_tries times at most, timeout
+  /// seconds apart.
+  void set_timeout(double seconds) { m_timeout = seconds; }
+  void set_max_tries(int num) { m_max_tries = num; }
+  /// TTLs are clamped to these, in seconds.
+  void set_ttl_range(double min_ttl, double max_ttl) {
+    m_min_ttl = min_ttl;
+    m_max_ttl = max_ttl;
+  }
+
+  /// Look up hostname in the reactor thread. IP literals and cached answers
+  /// call cb before resolve() returns.
+  void resolve(const string& hostname, const Callback& cb);
+
+  size_t num_cached() const { return m_cache.size(); }
+  const InetAddress& name_server() const { return m_name_server; }
+
+ private:
+  struct Lookup;
+  struct CacheEntry {
+    std::vector<InetAddress> addresses;
+    Timestamp expiration;
+  };
+
+  void send_question(Lookup* lookup, int index);
+  void handle_read();
+  void handle_answer(const char* data, size_t len);
+  void on_timeout(const string& hostname);
+  void finish(const string& hostname);
+
+  Reactor* m_reactor;
+  const InetAddress m_name_server;
+  double m_timeout;
+  int m_max_tries;
+  double m_min_ttl;
+  double m_max_ttl;
+  int m_sockfd;
+  std::unique_ptr<Channel> m_channel;
+  // by hostname
+  std::map<string, std::unique_ptr<Lookup>> m_lookups;
+  // question id to hostname
+  std::map<uint16_t, string> m_questions;
+  std::map<string, CacheEntry> m_cache;
+};
+
+}  // namespace flute
+
+#endif  // FLUTE_NET_RESOLVER_H
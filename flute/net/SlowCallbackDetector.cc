@@ -0,0 +1,215 @@
+#include <flute/net/SlowCallbackDetector.h>
+
+#include <flute/common/CurrentThread.h>
+#include <flute/common/LogLine.h>
+#include <flute/common/Metrics.h>
+#include <flute/common/Mutex.h>
+#include <flute/common/Thread.h>
+
+#include <assert.h>
+#include <cxxabi.h>
+#include <errno.h>
+#include <execinfo.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+
+namespace flute {
+
+namespace {
+
+__thread SlowCallbackDetector* t_detector_of_this_thread = NULL;
+
+Counter* const g_slow_callbacks = MetricsRegistry::instance().counter(
+    "flute_reactor_slow_callbacks_total",
+    "Reactor callbacks which ran past the slow callback threshold.");
+
+// the sampling handler and the trampoline of the kernel
+const int kSignalFrames = 3;
+
+int sample_signal() { return SIGRTMIN + 2; }
+
+void handle_sample_signal(int) {
+  int saved_errno = errno;
+  if (t_detector_of_this_thread) {
+    t_detector_of_this_thread->sample_stack_in_signal_handler();
+  }
+  errno = saved_errno;
+}
+
+// Looks at the detectors of the process a few times per threshold.
+class SlowCallbackWatchdog : noncopyable {
+ public:
+  static SlowCallbackWatchdog& instance() {
+    // never destroyed, its thread runs until the process exits
+    static SlowCallbackWatchdog* s_watchdog = new SlowCallbackWatchdog;
+    return *s_watchdog;
+  }
+
+  void add(SlowCallbackDetector* detector, int64_t threshold_us) {
+    MutexLockGuard lock(m_mutex);
+    m_detectors[detector] = threshold_us;
+  }
+
+  void remove(SlowCallbackDetector* detector) {
+    MutexLockGuard lock(m_mutex);
+    m_detectors.erase(detector);
+  }
+
+ private:
+  SlowCallbackWatchdog()
+      : m_thread(std::bind(&SlowCallbackWatchdog::run, this),
+                 "SlowCallbackWatchdog") {
+    // the first backtrace() loads libgcc, which must not happen in a handler
+    void* frame = NULL;
+    ::backtrace(&frame, 1);
+    struct sigaction action;
+    memset(&action, 0, sizeof action);
+    action.sa_handler = handle_sample_signal;
+    action.sa_flags = SA_RESTART;
+    ::sigemptyset(&action.sa_mask);
+    if (::sigaction(sample_signal(), &action, NULL) < 0) {
+      LOG_SYSERR << "SlowCallbackWatchdog - sigaction";
+    }
+    m_thread.start();
+  }
+
+  void run() {
+    while (true) {
+      int64_t period_us = kMaxPeriodUs;
+      {
+        MutexLockGuard lock(m_mutex);
+        int64_t now_us = Timestamp::now().micro_seconds_since_epoch();
+        for (const auto& entry : m_detectors) {
+          entry.first->check(now_us);
+          period_us = std::min(period_us, entry.second / 4);
+        }
+      }
+      CurrentThread::sleep_usec(std::max(period_us, kMinPeriodUs));
+    }
+  }
+
+  static const int64_t kMinPeriodUs = 1000;
+  static const int64_t kMaxPeriodUs = 100 * 1000;
+
+  MutexLock m_mutex;
+  std::map<SlowCallbackDetector*, int64_t> m_detectors GUARDED_BY(m_mutex);
+  Thread m_thread;
+};
+
+const int64_t SlowCallbackWatchdog::kMinPeriodUs;
+const int64_t SlowCallbackWatchdog::kMaxPeriodUs;
+
+}  // namespace
+
+SlowCallbackDetector::SlowCallbackDetector(
+    double threshold_seconds, const Reactor::SlowCallbackHandler& handler)
+    : m_threshold_us(static_cast<int64_t>(threshold_seconds *
+                                          Timestamp::kMicroSecondsPerSecond)),
+      m_thread(::pthread_self()),
+      m_handler(handler),
+      m_next_id(0),
+      m_reported_start_us(0),
+      m_current_id(0),
+      m_current_start_us(0),
+      m_requested_id(0),
+      m_sampled_id(0),
+      m_num_sampled_frames(0) {
+  assert(t_detector_of_this_thread == NULL);
+  t_detector_of_this_thread = this;
+  SlowCallbackWatchdog::instance().add(this, m_threshold_us);
+}
+
+SlowCallbackDetector::~SlowCallbackDetector() {
+  // no signal is sent once removed, one in flight finds no detector
+  SlowCallbackWatchdog::instance().remove(this);
+  t_detector_of_this_thread = NULL;
+}
+
+SlowCallbackDetector::Scope SlowCallbackDetector::begin(Timestamp start) {
+  Scope scope;
+  scope.id = ++m_next_id;
+  scope.start_us = start.micro_seconds_since_epoch();
+  scope.enclosing_id = m_current_id.load(std::memory_order_relaxed);
+  scope.enclosing_start_us =
+      m_current_start_us.load(std::memory_order_relaxed);
+  m_current_id.store(scope.id, std::memory_order_relaxed);
+  m_current_start_us.store(scope.start_us, std::memory_order_release);
+  return scope;
+}
+
+bool SlowCallbackDetector::finish(const Scope& scope, Timestamp end) {
+  m_current_id.store(scope.enclosing_id, std::memory_order_relaxed);
+  m_current_start_us.store(scope.enclosing_start_us,
+                           std::memory_order_release);
+  return end.micro_seconds_since_epoch() - scope.start_us > m_threshold_us &&
+         m_reported_start_us < scope.start_us;
+}
+
+void SlowCallbackDetector::report(const string& callback, const Scope& scope,
+                                  Timestamp end) {
+  m_reported_start_us = scope.start_us;
+  g_slow_callbacks->add();
+  double seconds =
+      static_cast<double>(end.micro_seconds_since_epoch() - scope.start_us) /
+      Timestamp::kMicroSecondsPerSecond;
+  string stack;
+  std::atomic_signal_fence(std::memory_order_acquire);
+  // sampled in this callback or in one nested in it
+  if (m_sampled_id.load(std::memory_order_relaxed) >= scope.id &&
+      m_num_sampled_frames > kSignalFrames) {
+    stack = CurrentThread::stacktrace(m_sampled_frames + kSignalFrames,
+                                      m_num_sampled_frames - kSignalFrames,
+                                      true);
+    m_sampled_id.store(0, std::memory_order_relaxed);
+  }
+  if (m_handler) {
+    m_handler(callback, seconds, stack);
+  } else {
+    LOG_WARN << "Reactor - slow callback " << callback << " ran " << seconds
+             << "s" << (stack.empty() ? "" : ", sampled stack:\n") << stack;
+  }
+}
+
+string SlowCallbackDetector::type_name(const std::type_info& type) {
+  int status = 0;
+  char* demangled = abi::__cxa_demangle(type.name(), NULL, NULL, &status);
+  string name(status == 0 ? demangled : type.name());
+  free(demangled);
+  return name;
+}
+
+string SlowCallbackDetector::symbol_name(void* address) {
+  string symbol = CurrentThread::stacktrace(&address, 1, true);
+  if (!symbol.empty() && symbol.back() == '\n') {
+    symbol.pop_back();
+  }
+  return symbol;
+}
+
+// In the watchdog thread.
+void SlowCallbackDetector::check(int64_t now_us) {
+  int64_t start_us = m_current_start_us.load(std::memory_order_acquire);
+  uint64_t id = m_current_id.load(std::memory_order_relaxed);
+  if (start_us != 0 && now_us - start_us > m_threshold_us &&
+      m_requested_id.load(std::memory_order_relaxed) != id) {
+    m_requested_id.store(id, std::memory_order_relaxed);
+    ::pthread_kill(m_thread, sample_signal());
+  }
+}
+
+// In the loop thread, interrupted in a callback.
+void SlowCallbackDetector::sample_stack_in_signal_handler() {
+  uint64_t id = m_current_id.load(std::memory_order_relaxed);
+  if (id != 0 && id == m_requested_id.load(std::memory_order_relaxed) &&
+      id != m_sampled_id.load(std::memory_order_relaxed)) {
+    m_num_sampled_frames = ::backtrace(m_sampled_frames, kMaxFrames);
+    std::atomic_signal_fence(std::memory_order_release);
+    m_sampled_id.store(id, std::memory_order_relaxed);
+  }
+}
+
+}  // namespace flute
@@ -0,0 +1,99 @@
+#ifndef FLUTE_NET_SLOWCALLBACKDETECTOR_H
+#define FLUTE_NET_SLOWCALLBACKDETECTOR_H
+
+#include <flute/common/Timestamp.h>
+#include <flute/common/noncopyable.h>
+#include <flute/common/types.h>
+#include <flute/net/Reactor.h>
+
+#include <pthread.h>
+
+#include <atomic>
+#include <functional>
+#include <typeinfo>
+
+namespace flute {
+
+///
+/// Internal class timing the callbacks of a loop thread, see
+/// Reactor::set_slow_callback_threshold().
+///
+/// A watchdog thread, one for the process, looks at the callback each loop
+/// thread is in. Once one runs past the threshold, the watchdog signals the
+/// thread and the handler samples its stack, so that the stack shows where
+/// the callback is stuck rather than where it was timed.
+class SlowCallbackDetector : noncopyable {
+ public:
+  struct Scope {
+    uint64_t id;
+    int64_t start_us;
+    uint64_t enclosing_id;
+    int64_t enclosing_start_us;
+  };
+
+  /// In the loop thread.
+  SlowCallbackDetector(double threshold_seconds,
+                       const Reactor::SlowCallbackHandler& handler);
+  ~SlowCallbackDetector();
+
+  void set_handler(const Reactor::SlowCallbackHandler& handler) {
+    m_handler = handler;
+  }
+
+  /// A callback starts, nested in the current one if any.
+  Scope begin(Timestamp start);
+  /// The callback of scope ends. If it was slow, describe() names it for the
+  /// handler, unless a callback nested in it was reported already.
+  template <typename Describe>
+  void end(const Scope& scope, Timestamp end, Describe describe) {
+    if (LIKELY_FALSE(finish(scope, end))) {
+      report(describe(), scope, end);
+    }
+  }
+
+  /// The demangled name of a callback type, as of std::function::target_type().
+  static string type_name(const std::type_info& type);
+  /// The type of the target of callback, and the symbol of the function if it
+  /// is a plain function pointer, whose type says little.
+  template <typename Signature>
+  static string callback_name(const std::function<Signature>& callback) {
+    string name = type_name(callback.target_type());
+    typedef Signature* FunctionPointer;
+    const FunctionPointer* function =
+        callback.template target<FunctionPointer>();
+    if (function) {
+      name += " " + symbol_name(reinterpret_cast<void*>(*function));
+    }
+    return name;
+  }
+
+  // for the watchdog and the signal handler
+  void check(int64_t now_us);
+  void sample_stack_in_signal_handler();
+
+ private:
+  static string symbol_name(void* address);
+  bool finish(const Scope& scope, Timestamp end);
+  void report(const string& callback, const Scope& scope, Timestamp end);
+
+  static const int kMaxFrames = 64;
+
+  const int64_t m_threshold_us;
+  const pthread_t m_thread;
+  Reactor::SlowCallbackHandler m_handler;
+  uint64_t m_next_id;
+  // the start of the last reported callback
+  int64_t m_reported_start_us;
+  // the callback running, 0 outside of callbacks
+  std::atomic<uint64_t> m_current_id;
+  std::atomic<int64_t> m_current_start_us;
+  // set by the watchdog, then by the signal handler once sampled
+  std::atomic<uint64_t> m_requested_id;
+  std::atomic<uint64_t> m_sampled_id;
+  void* m_sampled_frames[kMaxFrames];
+  int m_num_sampled_frames;
+};
+
+}  // namespace flute
+
+#endif  // FLUTE_NET_SLOWCALLBACKDETECTOR_H
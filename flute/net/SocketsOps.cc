@@ -109,7 +109,7 @@ int socket_ops::accept(int sockfd, struct sockaddr_in6* addr) {
 #endif
   if (connfd < 0) {
     int savedErrno = errno;
-    LOG_SYSERR << "Socket::accept";
+    LOG_RATE_LIMITED(ERROR, 10) << "Socket::accept";
     switch (savedErrno) {
       case EAGAIN:
       case ECONNABORTED:
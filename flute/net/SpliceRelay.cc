@@ -0,0 +1,188 @@
+#include <flute/net/SpliceRelay.h>
+
+#include <flute/common/LogLine.h>
+#include <flute/net/Channel.h>
+#include <flute/net/Reactor.h>
+#include <flute/net/TcpConnection.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace flute {
+
+namespace {
+
+// Asked of the kernel for every pipe, it may give less.
+const int kPipeSize = 1024 * 1024;
+const unsigned int kSpliceFlags = SPLICE_F_MOVE | SPLICE_F_NONBLOCK;
+
+}  // namespace
+
+SpliceRelayPtr SpliceRelay::start(const TcpConnectionPtr& a,
+                                  const TcpConnectionPtr& b) {
+  a->get_reactor()->assert_in_reactor_thread();
+  assert(a->get_reactor() == b->get_reactor());
+  SpliceRelayPtr relay(new SpliceRelay(a, b));
+  if (!relay->open_pipe(&relay->m_directions[0]) ||
+      !relay->open_pipe(&relay->m_directions[1])) {
+    return SpliceRelayPtr();
+  }
+  // read before the relay started
+  b->send_buffer(a->input_buffer());
+  a->send_buffer(b->input_buffer());
+  a->set_splice_relay(relay);
+  b->set_splice_relay(relay);
+  a->start_read();
+  b->start_read();
+  return relay;
+}
+
+SpliceRelay::SpliceRelay(const TcpConnectionPtr& a, const TcpConnectionPtr& b)
+    : m_closed(false) {
+  for (int i = 0; i < 2; ++i) {
+    Direction& direction = m_directions[i];
+    direction.source = i == 0 ? a : b;
+    direction.sink = i == 0 ? b : a;
+    direction.pipe_fds[0] = -1;
+    direction.pipe_fds[1] = -1;
+    direction.pipe_capacity = 0;
+    direction.bytes_in_pipe = 0;
+    direction.bytes_relayed = 0;
+    direction.source_ended = false;
+    direction.sink_shut_down = false;
+  }
+}
+
+SpliceRelay::~SpliceRelay() {
+  for (Direction& direction : m_directions) {
+    for (int fd : direction.pipe_fds) {
+      if (fd >= 0) {
+        ::close(fd);
+      }
+    }
+  }
+}
+
+bool SpliceRelay::open_pipe(Direction* direction) {
+  if (::pipe2(direction->pipe_fds, O_NONBLOCK | O_CLOEXEC) < 0) {
+    LOG_SYSERR << "SpliceRelay::open_pipe";
+    return false;
+  }
+  // a bigger pipe moves more in one splice, the default is 64 KiB
+  ::fcntl(direction->pipe_fds[1], F_SETPIPE_SZ, kPipeSize);
+  int capacity = ::fcntl(direction->pipe_fds[1], F_GETPIPE_SZ);
+  direction->pipe_capacity =
+      capacity > 0 ? static_cast<size_t>(capacity) : 64 * 1024;
+  return true;
+}
+
+uint64_t SpliceRelay::bytes_relayed_from(const TcpConnectionPtr& conn) const {
+  return m_directions[0].source == conn ? m_directions[0].bytes_relayed
+                                        : m_directions[1].bytes_relayed;
+}
+
+SpliceRelay::Direction* SpliceRelay::by_source(TcpConnection* conn) {
+  return m_directions[0].source.get() == conn ? &m_directions[0]
+                                              : &m_directions[1];
+}
+
+SpliceRelay::Direction* SpliceRelay::by_sink(TcpConnection* conn) {
+  return m_directions[0].sink.get() == conn ? &m_directions[0]
+                                            : &m_directions[1];
+}
+
+void SpliceRelay::handle_readable(TcpConnection* conn) {
+  Direction* direction = by_source(conn);
+  size_t room = direction->pipe_capacity - direction->bytes_in_pipe;
+  if (room == 0) {
+    direction->source->stop_read();
+    return;
+  }
+  int source_fd = direction->source->get_channel_ptr()->fd();
+  ssize_t n = ::splice(source_fd, NULL, direction->pipe_fds[1], NULL, room,
+                       kSpliceFlags);
+  if (n > 0) {
+    direction->bytes_in_pipe += static_cast<size_t>(n);
+    direction->bytes_relayed += static_cast<uint64_t>(n);
+    // else the sink is writing its own output, the pipe waits behind it
+    if (!direction->sink->get_channel_ptr()->is_writing()) {
+      drain(direction);
+    }
+    if (!m_closed && direction->bytes_in_pipe == direction->pipe_capacity) {
+      // backpressure, resumed in drain()
+      direction->source->stop_read();
+    }
+  } else if (n == 0) {
+    LOG_TRACE << conn->name() << " ended, relayed "
+              << direction->bytes_relayed << " bytes";
+    direction->source_ended = true;
+    direction->source->stop_read();
+    drain(direction);
+  } else if (errno != EAGAIN) {
+    LOG_SYSERR << "SpliceRelay::handle_readable " << conn->name();
+    close();
+  }
+}
+
+bool SpliceRelay::handle_writable(TcpConnection* conn) {
+  Direction* direction = by_sink(conn);
+  drain(direction);
+  return direction->bytes_in_pipe == 0;
+}
+
+// Move the pipe into the sink, and go on reading the source if there is room.
+void SpliceRelay::drain(Direction* direction) {
+  if (direction->bytes_in_pipe > 0) {
+    int sink_fd = direction->sink->get_channel_ptr()->fd();
+    ssize_t n = ::splice(direction->pipe_fds[0], NULL, sink_fd, NULL,
+                         direction->bytes_in_pipe, kSpliceFlags);
+    if (n > 0) {
+      direction->bytes_in_pipe -= static_cast<size_t>(n);
+    } else if (n < 0 && errno != EAGAIN) {
+      LOG_SYSERR << "SpliceRelay::drain " << direction->sink->name();
+      close();
+      return;
+    }
+  }
+  Channel* sink_channel = direction->sink->get_channel_ptr();
+  if (direction->bytes_in_pipe > 0) {
+    if (!sink_channel->is_writing()) {
+      sink_channel->want_to_write();
+    }
+  } else if (direction->source_ended) {
+    if (!direction->sink_shut_down) {
+      direction->sink_shut_down = true;
+      direction->sink->shutdown();
+      if (m_directions[0].sink_shut_down && m_directions[1].sink_shut_down) {
+        close();
+      }
+    }
+    return;
+  }
+  if (!direction->source_ended &&
+      direction->bytes_in_pipe < direction->pipe_capacity &&
+      !direction->source->is_reading()) {
+    direction->source->start_read();
+  }
+}
+
+void SpliceRelay::handle_close(TcpConnection* conn) {
+  LOG_TRACE << conn->name() << " closed while relaying";
+  close();
+}
+
+void SpliceRelay::close() {
+  if (m_closed) {
+    return;
+  }
+  m_closed = true;
+  for (Direction& direction : m_directions) {
+    // the bytes coming before the close are not for the message callback
+    direction.source->stop_read();
+    direction.source->set_splice_relay(SpliceRelayPtr());
+    direction.source->force_close();
+  }
+}
+
+}  // namespace flute
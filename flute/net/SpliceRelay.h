@@ -0,0 +1,77 @@
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef FLUTE_NET_SPLICERELAY_H
+#define FLUTE_NET_SPLICERELAY_H
+
+#include <flute/common/noncopyable.h>
+#include <flute/net/Callbacks.h>
+
+#include <stdint.h>
+
+#include <memory>
+
+namespace flute {
+
+class SpliceRelay;
+typedef std::shared_ptr<SpliceRelay> SpliceRelayPtr;
+
+///
+/// Joins two connections of one reactor, as a tunnel does: the bytes each of
+/// them receives are sent by the other.
+///
+/// Every direction has a pipe. splice(2) moves the bytes from the source
+/// socket into the pipe and from the pipe into the sink socket, so they never
+/// enter user space. A source is read only while its pipe has room, and the
+/// sink waits to be writable while the pipe is not empty.
+///
+/// When a source ends, the writing of the sink is shut down once the pipe has
+/// been drained. When both sources have ended, or on an error, both
+/// connections are closed.
+class SpliceRelay : noncopyable {
+ public:
+  /// Start relaying, in the reactor thread of both connections. The bytes
+  /// already in their input buffers are sent first. The message callbacks are
+  /// not called any more. Return null if no pipe could be made.
+  static SpliceRelayPtr start(const TcpConnectionPtr& a,
+                              const TcpConnectionPtr& b);
+  ~SpliceRelay();
+
+  /// Bytes received from conn and moved into the pipe to the other.
+  uint64_t bytes_relayed_from(const TcpConnectionPtr& conn) const;
+
+  /// Called by TcpConnection in place of its reading.
+  void handle_readable(TcpConnection* conn);
+  /// Called by TcpConnection once its own output is sent. Return true if the
+  /// pipe to conn is empty.
+  bool handle_writable(TcpConnection* conn);
+  /// conn has closed, the other one is closed too.
+  void handle_close(TcpConnection* conn);
+
+ private:
+  struct Direction {
+    TcpConnectionPtr source;
+    TcpConnectionPtr sink;
+    int pipe_fds[2];
+    size_t pipe_capacity;
+    size_t bytes_in_pipe;
+    uint64_t bytes_relayed;
+    bool source_ended;
+    bool sink_shut_down;
+  };
+
+  SpliceRelay(const TcpConnectionPtr& a, const TcpConnectionPtr& b);
+
+  bool open_pipe(Direction* direction);
+  Direction* by_source(TcpConnection* conn);
+  Direction* by_sink(TcpConnection* conn);
+  void drain(Direction* direction);
+  void close();
+
+  Direction m_directions[2];
+  bool m_closed;
+};
+
+}  // namespace flute
+
+#endif  // FLUTE_NET_SPLICERELAY_H
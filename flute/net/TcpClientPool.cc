@@ -0,0 +1,305 @@
+#include <flute/net/TcpClientPool.h>
+
+#include <flute/common/LogLine.h>
+#include <flute/net/Connector.h>
+#include <flute/net/Reactor.h>
+#include <flute/net/SocketsOps.h>
+
+#include <stdio.h>  // snprintf
+
+#include <algorithm>
+#include <deque>
+#include <set>
+
+namespace flute {
+
+namespace detail {
+
+void destroy_conn(Reactor* reactor, const TcpConnectionPtr& conn) {
+  reactor->queue_in_reactor(std::bind(&TcpConnection::connect_destroyed, conn));
+}
+
+void hold_connector(const ConnectorPtr&) {}
+
+// A Connector resets its channel in a task queued by itself, keep it alive
+// until the round of tasks after that.
+void release_connector_later(Reactor* reactor, const ConnectorPtr& connector) {
+  reactor->queue_in_reactor([reactor, connector]() {
+    reactor->queue_in_reactor(std::bind(&hold_connector, connector));
+  });
+}
+
+// Bytes on an idle connection mean the protocol is out of step.
+void on_idle_message(const TcpConnectionPtr& conn, Buffer* buf, Timestamp) {
+  LOG_WARN << "TcpClientPool - " << conn->name() << " got "
+           << buf->content_bytes_len() << " bytes while idle, closing";
+  buf->retrieve_all();
+  conn->force_close();
+}
+
+}  // namespace detail
+
+struct TcpClientPool::Upstream {
+  explicit Upstream(const InetAddress& addr)
+      : server_addr(addr),
+        num_failures(0),
+        healthy(true),
+        retry_pending(false) {}
+
+  int num_connections() const {
+    return static_cast<int>(connections.size() + connectors.size());
+  }
+
+  const InetAddress server_addr;
+  // idle and leased
+  std::set<TcpConnectionPtr> connections;
+  // the most recently used at the back
+  std::vector<TcpConnectionPtr> idle;
+  std::set<ConnectorPtr> connectors;
+  std::deque<LeaseCallback> waiting_leases;
+  // consecutive failed connects
+  int num_failures;
+  bool healthy;
+  bool retry_pending;
+  TimerId retry_timer;
+};
+
+TcpClientPool::TcpClientPool(Reactor* reactor, const string& name)
+    : m_reactor(CHECK_NOTNULL(reactor)),
+      m_name(name),
+      m_warm_connections(2),
+      m_max_connections(16),
+      m_max_waiting_leases(64),
+      m_max_failures(3),
+      m_retry_delay(1.0),
+      m_conn_counter(1) {}
+
+TcpClientPool::~TcpClientPool() {
+  m_reactor->assert_in_reactor_thread();
+  for (auto& upstream : m_upstreams) {
+    if (upstream->retry_pending) {
+      m_reactor->remove(upstream->retry_timer);
+    }
+    for (const ConnectorPtr& connector : upstream->connectors) {
+      connector->set_connect_failed_callback(Connector::ConnectFailedCallback());
+      connector->stop();
+      detail::release_connector_later(m_reactor, connector);
+    }
+    for (const TcpConnectionPtr& conn : upstream->connections) {
+      conn->set_close_callback(std::bind(&detail::destroy_conn, m_reactor, _1));
+      conn->force_close();
+    }
+    std::deque<LeaseCallback> leases;
+    leases.swap(upstream->waiting_leases);
+    for (const LeaseCallback& cb : leases) {
+      cb(TcpConnectionPtr());
+    }
+  }
+}
+
+int TcpClientPool::add_upstream(const InetAddress& server_addr) {
+  m_reactor->assert_in_reactor_thread();
+  m_upstreams.emplace_back(new Upstream(server_addr));
+  int upstream = static_cast<int>(m_upstreams.size()) - 1;
+  fill(upstream);
+  return upstream;
+}
+
+void TcpClientPool::lease(int upstream_index, const LeaseCallback& cb) {
+  m_reactor->assert_in_reactor_thread();
+  Upstream& upstream = *m_upstreams[upstream_index];
+  if (!upstream.idle.empty()) {
+    TcpConnectionPtr conn = upstream.idle.back();
+    upstream.idle.pop_back();
+    cb(conn);
+    return;
+  }
+  if (!upstream.healthy ||
+      static_cast<int>(upstream.waiting_leases.size()) >= m_max_waiting_leases) {
+    cb(TcpConnectionPtr());
+    return;
+  }
+  upstream.waiting_leases.push_back(cb);
+  fill(upstream_index);
+}
+
+void TcpClientPool::give_back(const TcpConnectionPtr& conn, bool reusable) {
+  m_reactor->assert_in_reactor_thread();
+  int upstream = find_upstream(conn);
+  if (upstream < 0) {
+    // closed already
+    return;
+  }
+  conn->set_conn_callback(dummy_conn_callback);
+  conn->set_message_callback(detail::on_idle_message);
+  if (!reusable || !conn->connected() ||
+      conn->input_buffer()->content_bytes_len() > 0) {
+    conn->force_close();
+    return;
+  }
+  hand_out(upstream, conn);
+}
+
+bool TcpClientPool::is_healthy(int upstream) const {
+  return m_upstreams[upstream]->healthy;
+}
+
+int TcpClientPool::num_idle(int upstream) const {
+  return static_cast<int>(m_upstreams[upstream]->idle.size());
+}
+
+int TcpClientPool::num_leased(int upstream) const {
+  const Upstream& u = *m_upstreams[upstream];
+  return static_cast<int>(u.connections.size() - u.idle.size());
+}
+
+int TcpClientPool::num_connecting(int upstream) const {
+  return static_cast<int>(m_upstreams[upstream]->connectors.size());
+}
+
+// Connect until there are the warm connections, and a connect for every
+// waiting lease, within the limit.
+void TcpClientPool::fill(int upstream_index) {
+  Upstream& upstream = *m_upstreams[upstream_index];
+  while (upstream.healthy &&
+         upstream.num_connections() < m_max_connections &&
+         (upstream.num_connections() < m_warm_connections ||
+          upstream.connectors.size() < upstream.waiting_leases.size())) {
+    connect(upstream_index);
+  }
+}
+
+void TcpClientPool::connect(int upstream_index) {
+  Upstream& upstream = *m_upstreams[upstream_index];
+  ConnectorPtr connector(new Connector(m_reactor, upstream.server_addr));
+  // The connector is owned by the upstream, the callbacks hold it weakly.
+  Connector* raw = connector.get();
+  connector->set_new_conn_callback([this, upstream_index, raw](int sockfd) {
+    on_new_conn(upstream_index, raw->shared_from_this(), sockfd);
+  });
+  connector->set_connect_failed_callback([this, upstream_index, raw]() {
+    on_connect_failed(upstream_index, raw->shared_from_this());
+  });
+  upstream.connectors.insert(connector);
+  connector->start();
+}
+
+void TcpClientPool::on_new_conn(int upstream_index,
+                                const ConnectorPtr& connector, int sockfd) {
+  Upstream& upstream = *m_upstreams[upstream_index];
+  upstream.connectors.erase(connector);
+  detail::release_connector_later(m_reactor, connector);
+  upstream.num_failures = 0;
+  upstream.healthy = true;
+
+  InetAddress peer_addr(socket_ops::get_peer_addr(sockfd));
+  InetAddress local_addr(socket_ops::get_local_addr(sockfd));
+  char buf[64];
+  snprintf(buf, sizeof buf, ":%s#%d", peer_addr.to_ip_port().c_str(),
+           m_conn_counter);
+  ++m_conn_counter;
+  TcpConnectionPtr conn(
+      new TcpConnection(m_reactor, m_name + buf, sockfd, local_addr, peer_addr));
+  conn->set_conn_callback(dummy_conn_callback);
+  conn->set_message_callback(detail::on_idle_message);
+  conn->set_close_callback(
+      std::bind(&TcpClientPool::on_close, this, upstream_index, _1));
+  upstream.connections.insert(conn);
+  conn->connect_established();
+  hand_out(upstream_index, conn);
+  fill(upstream_index);
+}
+
+void TcpClientPool::on_connect_failed(int upstream_index,
+                                      const ConnectorPtr& connector) {
+  Upstream& upstream = *m_upstreams[upstream_index];
+  // the pool does the retrying
+  connector->set_connect_failed_callback(Connector::ConnectFailedCallback());
+  connector->stop();
+  upstream.connectors.erase(connector);
+  detail::release_connector_later(m_reactor, connector);
+
+  ++upstream.num_failures;
+  LOG_WARN << "TcpClientPool[" << m_name << "] - failed to connect to "
+           << upstream.server_addr.to_ip_port() << ", "
+           << upstream.num_failures << " times in a row";
+  if (upstream.num_failures < m_max_failures) {
+    fill(upstream_index);
+    return;
+  }
+  if (upstream.healthy) {
+    LOG_ERROR << "TcpClientPool[" << m_name << "] - "
+              << upstream.server_addr.to_ip_port() << " is unhealthy";
+    upstream.healthy = false;
+  }
+  if (!upstream.retry_pending) {
+    upstream.retry_pending = true;
+    upstream.retry_timer = m_reactor->run_after(
+        m_retry_delay,
+        std::bind(&TcpClientPool::on_retry_time, this, upstream_index));
+  }
+  std::deque<LeaseCallback> leases;
+  leases.swap(upstream.waiting_leases);
+  for (const LeaseCallback& cb : leases) {
+    cb(TcpConnectionPtr());
+  }
+}
+
+// Probe an unhealthy upstream with one connect.
+void TcpClientPool::on_retry_time(int upstream_index) {
+  Upstream& upstream = *m_upstreams[upstream_index];
+  upstream.retry_pending = false;
+  if (upstream.healthy || !upstream.connectors.empty()) {
+    return;
+  }
+  // a success makes it healthy and fills it, a failure waits again
+  connect(upstream_index);
+}
+
+void TcpClientPool::on_close(int upstream_index,
+                             const TcpConnectionPtr& conn) {
+  Upstream& upstream = *m_upstreams[upstream_index];
+  upstream.connections.erase(conn);
+  auto it = std::find(upstream.idle.begin(), upstream.idle.end(), conn);
+  if (it != upstream.idle.end()) {
+    upstream.idle.erase(it);
+  }
+  m_reactor->queue_in_reactor(
+      std::bind(&TcpConnection::connect_destroyed, conn));
+  fill(upstream_index);
+}
+
+// A new or given back connection, to the first waiting lease or idle.
+void TcpClientPool::hand_out(int upstream_index, const TcpConnectionPtr& conn) {
+  Upstream& upstream = *m_upstreams[upstream_index];
+  if (upstream.waiting_leases.empty()) {
+    make_idle(upstream_index, conn);
+    return;
+  }
+  LeaseCallback cb = upstream.waiting_leases.front();
+  upstream.waiting_leases.pop_front();
+  cb(conn);
+}
+
+void TcpClientPool::make_idle(int upstream_index,
+                              const TcpConnectionPtr& conn) {
+  Upstream& upstream = *m_upstreams[upstream_index];
+  upstream.idle.push_back(conn);
+  // more idle than the warm ones, close the least recently used
+  if (static_cast<int>(upstream.idle.size()) > m_warm_connections) {
+    TcpConnectionPtr oldest = upstream.idle.front();
+    upstream.idle.erase(upstream.idle.begin());
+    oldest->force_close();
+  }
+}
+
+int TcpClientPool::find_upstream(const TcpConnectionPtr& conn) const {
+  for (size_t i = 0; i < m_upstreams.size(); ++i) {
+    if (m_upstreams[i]->connections.count(conn) > 0) {
+      return static_cast<int>(i);
+    }
+  }
+  return -1;
+}
+
+}  // namespace flute
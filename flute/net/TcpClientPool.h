@@ -0,0 +1,91 @@
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef FLUTE_NET_TCPCLIENTPOOL_H
+#define FLUTE_NET_TCPCLIENTPOOL_H
+
+#include <flute/net/TcpConnection.h>
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace flute {
+
+class Connector;
+typedef std::shared_ptr<Connector> ConnectorPtr;
+
+///
+/// Warm client connections to a few upstreams, for one Reactor.
+///
+/// Every upstream keeps warm_connections open, leased or idle. lease() hands
+/// out an idle one at once, or one that is connecting, and give_back() makes
+/// it idle again. Idle connections above warm_connections are closed.
+/// The pool is used in its reactor thread only, so it takes no lock; create a
+/// pool in each reactor thread.
+///
+/// An upstream whose connects fail max_failures times in a row is unhealthy:
+/// leases fail at once, and a new connect is tried after retry_delay seconds.
+class TcpClientPool : noncopyable {
+ public:
+  /// Called with the leased connection, or a null one if the upstream is
+  /// unhealthy or has too many leases waiting.
+  typedef std::function<void(const TcpConnectionPtr&)> LeaseCallback;
+
+  TcpClientPool(Reactor* reactor, const string& name);
+  ~TcpClientPool();  // force out-line dtor, for std::unique_ptr members.
+
+  /// Settings, call them before add_upstream().
+  void set_warm_connections(int num) { m_warm_connections = num; }
+  void set_max_connections(int num) { m_max_connections = num; }
+  void set_max_waiting_leases(int num) { m_max_waiting_leases = num; }
+  void set_max_failures(int num) { m_max_failures = num; }
+  void set_retry_delay(double seconds) { m_retry_delay = seconds; }
+
+  /// Return the index of the upstream, which starts connecting.
+  int add_upstream(const InetAddress& server_addr);
+  size_t num_upstreams() const { return m_upstreams.size(); }
+
+  /// While leased, the message and connection callbacks of the connection
+  /// are the lessee's, the latter tells when it closes. cb may be called
+  /// before lease() returns.
+  void lease(int upstream, const LeaseCallback& cb);
+  /// Give back a leased connection. Unless reusable, or if it has unread
+  /// bytes, it is closed instead.
+  void give_back(const TcpConnectionPtr& conn, bool reusable = true);
+
+  bool is_healthy(int upstream) const;
+  int num_idle(int upstream) const;
+  int num_leased(int upstream) const;
+  int num_connecting(int upstream) const;
+
+  Reactor* get_reactor() const { return m_reactor; }
+  const string& name() const { return m_name; }
+
+ private:
+  struct Upstream;
+
+  void fill(int upstream);
+  void connect(int upstream);
+  void on_new_conn(int upstream, const ConnectorPtr& connector, int sockfd);
+  void on_connect_failed(int upstream, const ConnectorPtr& connector);
+  void on_retry_time(int upstream);
+  void on_close(int upstream, const TcpConnectionPtr& conn);
+  void hand_out(int upstream, const TcpConnectionPtr& conn);
+  void make_idle(int upstream, const TcpConnectionPtr& conn);
+  int find_upstream(const TcpConnectionPtr& conn) const;
+
+  Reactor* m_reactor;
+  const string m_name;
+  int m_warm_connections;
+  int m_max_connections;
+  int m_max_waiting_leases;
+  int m_max_failures;
+  double m_retry_delay;
+  int m_conn_counter;
+  std::vector<std::unique_ptr<Upstream>> m_upstreams;
+};
+
+}  // namespace flute
+
+#endif  // FLUTE_NET_TCPCLIENTPOOL_H
@@ -1,14 +1,30 @@
 #include <errno.h>
+#include <flute/common/HdrHistogram.h>
 #include <flute/common/LogLine.h>
+#include <flute/common/Metrics.h>
 #include <flute/common/WeakCallback.h>
 #include <flute/net/Channel.h>
 #include <flute/net/Reactor.h>
 #include <flute/net/Socket.h>
 #include <flute/net/SocketsOps.h>
+#include <flute/net/SpliceRelay.h>
 #include <flute/net/TcpConnection.h>
 
 namespace flute {
 
+namespace {
+
+Counter* const g_bytes_received = MetricsRegistry::instance().counter(
+    "flute_tcp_received_bytes_total", "Bytes read by TCP connections.");
+Counter* const g_bytes_sent = MetricsRegistry::instance().counter(
+    "flute_tcp_sent_bytes_total",
+    "Bytes written by TCP connections, file bodies included.");
+LatencyHistogram* const g_poll_to_read = MetricsRegistry::instance().latency(
+    "flute_tcp_poll_to_read_seconds",
+    "From the return of poll to the read of a readable connection.");
+
+}  // namespace
+
 // do nothing but set the conn state.
 void dummy_conn_callback(const TcpConnectionPtr& conn) {
   LOG_TRACE << conn->local_address().to_ip_port() << " -> "
@@ -36,7 +52,11 @@ TcpConnection::TcpConnection(Reactor* reactor, const string& name_arg,
       m_channel(new Channel(reactor, sockfd)),
       m_local_addr(local_addr),
       m_peer_addr(peer_addr),
-      m_highwater_mark(64 * 1024 * 1024) {
+      m_highwater_mark(64 * 1024 * 1024),
+      m_creation_time(Timestamp::now()),
+      m_bytes_received(0),
+      m_bytes_sent(0),
+      m_bytes_queued(0) {
   m_channel->set_read_callback(
       std::bind(&TcpConnection::handle_socket_readable, this, _1));
   m_channel->set_write_callback(
@@ -163,8 +183,9 @@ void TcpConnection::send_bytes_in_reactor(const void* data,
     }
     LOG_TRACE << m_name << " has " << remaining_num_bytes
               << " remaining bytes to write";
-    m_output_buffer.append(static_cast<const char*>(data) + nwrote,
-                           remaining_num_bytes);
+    tail_output_buffer()->append(static_cast<const char*>(data) + nwrote,
+                                 remaining_num_bytes);
+    m_bytes_queued += remaining_num_bytes;
     if (!m_channel->is_writing()) {
       // NOTE: notify the reactor and the poller that the channel still has sth
       // to write. Thus the remaining bytes in m_output_buffer is going to be
@@ -180,10 +201,31 @@ void TcpConnection::send_bytes_in_reactor(const void* data,
 // CAUTION: You should not write anything into the socket other than this, to
 // maintain the sequentiality of the file data.
 void TcpConnection::enable_zero_copy(const ZeroCopierPtr& zero_copier_ptr) {
-  m_zero_copier_ptr = zero_copier_ptr;
-  m_zero_copier_ptr->set_target_fd(m_channel->fd());
-  m_zero_copier_ptr->start();
-  m_channel->want_to_write();
+  m_reactor->assert_in_reactor_thread();
+  zero_copier_ptr->set_target_fd(m_channel->fd());
+  zero_copier_ptr->start();
+  m_file_segments.push_back(FileSegment());
+  m_file_segments.back().zero_copier_ptr = zero_copier_ptr;
+  m_bytes_queued += zero_copier_ptr->remaining_bytes();
+  if (!m_channel->is_writing()) {
+    m_channel->want_to_write();
+  }
+}
+
+// Bytes must not overtake a queued file, so they go behind the last one.
+Buffer* TcpConnection::tail_output_buffer() {
+  if (m_file_segments.empty()) {
+    return &m_output_buffer;
+  }
+  return &m_file_segments.back().trailing_buffer;
+}
+
+// The bytes following the finished file become the next ones to write.
+void TcpConnection::finish_current_file() {
+  assert(!m_file_segments.empty());
+  assert(m_output_buffer.content_bytes_len() == 0);
+  m_output_buffer.swap(m_file_segments.front().trailing_buffer);
+  m_file_segments.pop_front();
 }
 
 void TcpConnection::shutdown() {
@@ -320,10 +362,22 @@ void TcpConnection::connect_destroyed() {
 
 void TcpConnection::handle_socket_readable(Timestamp receiveTime) {
   m_reactor->assert_in_reactor_thread();
+  // the channels handled before this one in the same round
+  g_poll_to_read->record_between(m_reactor->poll_return_time(),
+                                 Timestamp::now());
+  if (m_splice_relay) {
+    // the relay may let go of itself
+    std::shared_ptr<SpliceRelay> relay(m_splice_relay);
+    relay->handle_readable(this);
+    return;
+  }
   int saved_errno = 0;
   ssize_t n = m_input_buffer.read_all_from(m_channel->fd(), &saved_errno);
   // QUESTION: what if n < bytes received.
   if (n > 0) {
+    m_last_receive_time = receiveTime;
+    m_bytes_received += static_cast<uint64_t>(n);
+    g_bytes_received->add(n);
     m_message_callback(shared_from_this(), &m_input_buffer, receiveTime);
   } else if (n == 0) {
     LOG_INFO << m_name << " READ 0 bytes: FIN received";
@@ -364,19 +418,35 @@ void TcpConnection::handle_socket_writable() {
       transfer_sending_state();
     }
     // if the buffer has nothing to write, we do copy works
-    if (m_output_buffer.content_bytes_len() == 0 &&
-        m_zero_copier_ptr != nullptr &&
+    if (m_output_buffer.content_bytes_len() == 0 && !m_file_segments.empty() &&
         (m_sending_state == kNotSending || m_sending_state == kSendingFile)) {
       m_sending_state = kSendingFile;
-      m_zero_copier_ptr->send_one_chunk();
+      const ZeroCopierPtr& copier = m_file_segments.front().zero_copier_ptr;
+      size_t n = copier->send_one_chunk();
+      // -1 on failure
+      if (n != static_cast<size_t>(-1)) {
+        m_bytes_sent += n;
+        g_bytes_sent->add(static_cast<int64_t>(n));
+      }
+      if (copier->has_finished()) {
+        finish_current_file();
+      }
       transfer_sending_state();
-      if (m_zero_copier_ptr->has_finished()) {
-        m_zero_copier_ptr.reset();
+    }
+    if (m_sending_state == kNotSending && m_splice_relay) {
+      std::shared_ptr<SpliceRelay> relay(m_splice_relay);
+      if (!relay->handle_writable(this)) {
+        // the pipe of the relay is not drained yet
+        return;
       }
     }
+    record_last_bytes_written(m_bytes_sent);
     if (m_sending_state == kNotSending) {
       LOG_INFO << "TCPConn" << m_name << " writing finished.";
       m_channel->end_writing();
+      // everything queued is written, but the rest of an aborted file
+      record_last_bytes_written(m_bytes_queued);
+      m_bytes_queued = m_bytes_sent;
       if (m_write_complete_callback) {
         m_reactor->queue_in_reactor(
             std::bind(m_write_complete_callback, shared_from_this()));
@@ -392,20 +462,45 @@ void TcpConnection::handle_socket_writable() {
   }
 }
 
+void TcpConnection::record_time_to_last_byte(Timestamp start,
+                                             LatencyHistogram* histogram) {
+  m_reactor->assert_in_reactor_thread();
+  LastByte last_byte = {m_bytes_queued, start, histogram};
+  m_last_bytes.push_back(last_byte);
+  record_last_bytes_written(m_bytes_sent);
+}
+
+// Record the entries whose last byte is within the first written bytes.
+void TcpConnection::record_last_bytes_written(uint64_t written) {
+  if (m_last_bytes.empty() || m_last_bytes.front().end_offset > written) {
+    return;
+  }
+  Timestamp now = Timestamp::now();
+  while (!m_last_bytes.empty() &&
+         m_last_bytes.front().end_offset <= written) {
+    m_last_bytes.front().histogram->record_between(m_last_bytes.front().start,
+                                                   now);
+    m_last_bytes.pop_front();
+  }
+}
+
 void TcpConnection::transfer_sending_state() {
   if (m_sending_state == kNotSending) {
     if (m_output_buffer.content_bytes_len() != 0) {
       m_sending_state = kSendingBuffer;
-    } else if (m_zero_copier_ptr != nullptr &&
-               !m_zero_copier_ptr->has_finished()) {
+    } else if (!m_file_segments.empty()) {
       m_sending_state = kSendingFile;
     }
   } else if (m_sending_state == kSendingBuffer) {
     if (m_output_buffer.content_bytes_len() == 0) {
-      m_sending_state = kNotSending;
+      m_sending_state =
+          m_file_segments.empty() ? kNotSending : kSendingFile;
     }
   } else if (m_sending_state == kSendingFile) {
-    if (m_zero_copier_ptr->has_finished()) {
+    // the current file is popped once finished, see handle_socket_writable()
+    if (m_output_buffer.content_bytes_len() != 0) {
+      m_sending_state = kSendingBuffer;
+    } else if (m_file_segments.empty()) {
       m_sending_state = kNotSending;
     }
   }
@@ -421,6 +516,8 @@ void TcpConnection::write_socket_from_buffer() {
     LOG_SYSERR << m_name << "TcpConnection::handle_write";
   } else {
     m_output_buffer.retrieve(n);
+    m_bytes_sent += static_cast<uint64_t>(n);
+    g_bytes_sent->add(n);
   }
 }
 
@@ -433,6 +530,11 @@ void TcpConnection::handle_close() {
   m_channel->end_all();
 
   TcpConnectionPtr guard_this(shared_from_this());
+  if (m_splice_relay) {
+    std::shared_ptr<SpliceRelay> relay;
+    relay.swap(m_splice_relay);
+    relay->handle_close(this);
+  }
   m_conn_callback(guard_this);
   // must be the last line
   // ONGOING: When will server close a conn?
@@ -6,6 +6,7 @@
 #define FLUTE_NET_TCPCONNECTION_H
 
 #include <flute/common/StringPiece.h>
+#include <flute/common/Timestamp.h>
 #include <flute/common/ZeroCopier.h>
 #include <flute/common/noncopyable.h>
 #include <flute/common/types.h>
@@ -14,6 +15,7 @@
 #include <flute/net/InetAddress.h>
 
 #include <any>
+#include <deque>
 #include <memory>
 
 // struct tcp_info is in <netinet/tcp.h>
@@ -22,8 +24,10 @@ struct tcp_info;
 namespace flute {
 
 class Channel;
+class LatencyHistogram;
 class Reactor;
 class Socket;
+class SpliceRelay;
 
 ///
 /// TCP connection, for both client and server usage.
@@ -55,6 +59,9 @@ class TcpConnection : noncopyable,
   // void send(Buffer&& message); // C++11
   void send_buffer(Buffer* message);  // this one will swap data
 
+  // Queue a file body behind everything sent so far. Bytes sent afterwards are
+  // held back until the file has been copied. Must be called in reactor
+  // thread.
   void enable_zero_copy(const ZeroCopierPtr& zero_copier_ptr);
 
   void shutdown();  // NOT thread safe, no simultaneous calling
@@ -99,6 +106,10 @@ class TcpConnection : noncopyable,
 
   /// Internal use only.
   void set_close_callback(const CloseCallback& cb) { m_close_callback = cb; }
+  /// Internal use only, see SpliceRelay::start().
+  void set_splice_relay(const std::shared_ptr<SpliceRelay>& relay) {
+    m_splice_relay = relay;
+  }
 
   // called when TcpServer accepts a new connection
   void connect_established();  // should be called only once
@@ -107,6 +118,18 @@ class TcpConnection : noncopyable,
 
   Channel* get_channel_ptr() { return m_channel.get(); }
 
+  /// Record the time from start until everything sent so far has been
+  /// written to the socket into histogram. Every call is recorded when its
+  /// own last byte is written, pipelined responses included. Must be called
+  /// in reactor thread.
+  void record_time_to_last_byte(Timestamp start, LatencyHistogram* histogram);
+
+  /// Statistics, read them in the reactor thread.
+  Timestamp creation_time() const { return m_creation_time; }
+  Timestamp last_receive_time() const { return m_last_receive_time; }
+  uint64_t bytes_received() const { return m_bytes_received; }
+  uint64_t bytes_sent() const { return m_bytes_sent; }
+
  private:
   enum TCPConnectionState {
     kDisconnected,
@@ -121,6 +144,9 @@ class TcpConnection : noncopyable,
   void handle_close();
   void handle_error();
   void write_socket_from_buffer();
+  void finish_current_file();
+  Buffer* tail_output_buffer();
+  void record_last_bytes_written(uint64_t written);
   void handle_socket_readable(Timestamp receiveTime);
   // void send_in_reactor(string&& message);
   void send_in_reactor(const StringPiece& message);
@@ -151,9 +177,32 @@ class TcpConnection : noncopyable,
   Buffer m_input_buffer;
   Buffer m_output_buffer;  // FIXME: use list<Buffer> as output buffer.
   void* m_context_ptr;
-  ZeroCopierPtr m_zero_copier_ptr;
-  // FIXME: creation_time, last_receive_time
-  //        bytes_received, bytes_sent
+  // A queued file body, followed by the bytes sent after it.
+  struct FileSegment {
+    ZeroCopierPtr zero_copier_ptr;
+    Buffer trailing_buffer;
+  };
+  // m_output_buffer is always written first, then the files in order. The
+  // front copier is the one in progress.
+  std::deque<FileSegment> m_file_segments;
+  // Reads and writes the socket in place of the buffers while set.
+  std::shared_ptr<SpliceRelay> m_splice_relay;
+  const Timestamp m_creation_time;
+  Timestamp m_last_receive_time;
+  // through the buffers and the file bodies, not a SpliceRelay
+  uint64_t m_bytes_received;
+  uint64_t m_bytes_sent;
+  // bytes given to the sends and enable_zero_copy(), m_bytes_sent once all
+  // written
+  uint64_t m_bytes_queued;
+  // see record_time_to_last_byte()
+  struct LastByte {
+    // recorded once m_bytes_sent reaches it
+    uint64_t end_offset;
+    Timestamp start;
+    LatencyHistogram* histogram;
+  };
+  std::deque<LastByte> m_last_bytes;
 };
 
 typedef std::shared_ptr<TcpConnection> TcpConnectionPtr;
@@ -3,6 +3,7 @@
 #include <flute/net/TcpServer.h>
 
 #include <flute/common/LogLine.h>
+#include <flute/common/Metrics.h>
 #include <flute/net/Acceptor.h>
 #include <flute/net/Reactor.h>
 #include <flute/net/ReactorThreadPool.h>
@@ -12,6 +13,17 @@
 
 namespace flute {
 
+namespace {
+
+Counter* const g_conns_accepted = MetricsRegistry::instance().counter(
+    "flute_tcp_connections_accepted_total",
+    "Connections accepted by the TCP servers.");
+Counter* const g_conns_closed = MetricsRegistry::instance().counter(
+    "flute_tcp_connections_closed_total",
+    "Connections of the TCP servers closed.");
+
+}  // namespace
+
 TcpServer::TcpServer(Reactor* reactor, const InetAddress& listen_addr,
                      const string& name_arg, Option option)
     : m_acceptor_reactor(CHECK_NOTNULL(reactor)),
@@ -55,6 +67,7 @@ void TcpServer::start() {
 
 void TcpServer::new_conn_callback(int sockfd, const InetAddress& peer_addr) {
   m_acceptor_reactor->assert_in_reactor_thread();
+  g_conns_accepted->add();
   // select a reactor from the pool to be responsible for this sockfd.
   Reactor* sockfd_reactor = m_reactor_thread_poll->get_next_reactor();
   char buf[64];
@@ -96,6 +109,7 @@ void TcpServer::remove_connection_in_reactor(const TcpConnectionPtr& conn) {
   size_t n = m_conn_map.erase(conn->name());
   (void)n;
   assert(n == 1);
+  g_conns_closed->add();
   Reactor* sockfd_reactor = conn->get_reactor();
   sockfd_reactor->queue_in_reactor(
       std::bind(&TcpConnection::connect_destroyed, conn));
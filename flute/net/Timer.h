@@ -20,6 +20,7 @@ class Timer : noncopyable {
         m_global_timer_id(g_global_timer_id.increment_and_get()) {}
 
   void alarm() const { m_callback(); }
+  const TimerCallback& callback() const { return m_callback; }
 
   Timestamp expiration() const { return m_time_expire; }
   bool is_repeat() const { return m_is_repeated; }
@@ -6,6 +6,7 @@
 
 #include <flute/common/LogLine.h>
 #include <flute/net/Reactor.h>
+#include <flute/net/SlowCallbackDetector.h>
 #include <flute/net/Timer.h>
 #include <flute/net/TimerId.h>
 
@@ -138,8 +139,22 @@ void TimerQueue::handle_timerfd_read() {
   m_is_calling_expired_timers = true;
   m_canceling_timers.clear();
   // safe to callback outside critical section
+  SlowCallbackDetector* detector = m_reactor->slow_callback_detector();
+  Timestamp start = now;
   for (const Entry& it : expired) {
-    it.second->alarm();
+    if (detector) {
+      // nested in the callback of m_timer_fd_channel
+      SlowCallbackDetector::Scope scope = detector->begin(start);
+      it.second->alarm();
+      Timestamp end = Timestamp::now();
+      const Timer* timer = it.second;
+      detector->end(scope, end, [timer]() {
+        return "timer " + SlowCallbackDetector::callback_name(timer->callback());
+      });
+      start = end;
+    } else {
+      it.second->alarm();
+    }
   }
   m_is_calling_expired_timers = false;
 
@@ -36,29 +36,35 @@ bool HttpContext::process_request_line(const char* begin, const char* end) {
 
 // This will consume the content in buffer and try to modify the state of
 // HttpContext. return false if any error
-// Note that this function will change the state of the buffer, hence it could
-// not be called twice on the same buffer
+// The request may come over several calls, each consuming the complete lines
+// of buf. It stops after the request, the bytes of the next one pipelined
+// behind it are left in buf. A head longer than kMaxHeadSize is an error, be
+// it a line without its CRLF or endless header fields.
 bool HttpContext::parse_request(Buffer* buf, Timestamp receiveTime) {
-  bool ok = false;
+  bool ok = true;
   bool has_more = true;
   while (has_more) {
-    if (m_state == kExpectRequestLine) {
+    if (m_state == kExpectRequestLine || m_state == kExpectHeaders) {
       const char* crlf = buf->find_CRLF();
-      if (crlf) {
+      size_t line_len = crlf ? static_cast<size_t>(crlf + 2 - buf->peek_base())
+                             : buf->content_bytes_len();
+      if (m_head_bytes + line_len > kMaxHeadSize) {
+        m_head_too_large = true;
+        return false;
+      }
+      if (!crlf) {
+        has_more = false;
+      } else if (m_state == kExpectRequestLine) {
         ok = process_request_line(buf->peek_base(), crlf);
         if (ok) {
           m_request.set_receive_time(receiveTime);
           buf->retrieve_until(crlf + 2);
+          m_head_bytes += line_len;
           m_state = kExpectHeaders;
         } else {
           has_more = false;
         }
       } else {
-        has_more = false;
-      }
-    } else if (m_state == kExpectHeaders) {
-      const char* crlf = buf->find_CRLF();
-      if (crlf) {
         const char* colon = std::find(buf->peek_base(), crlf, ':');
         if (colon != crlf) {
           m_request.add_header(buf->peek_base(), colon, crlf);
@@ -69,8 +75,7 @@ bool HttpContext::parse_request(Buffer* buf, Timestamp receiveTime) {
           has_more = false;
         }
         buf->retrieve_until(crlf + 2);
-      } else {
-        has_more = false;
+        m_head_bytes += line_len;
       }
     } else if (m_state == kExpectBody) {
       // TODO: expect body. kExpectBody unused now.
@@ -15,8 +15,11 @@ class HttpContext {
     kExpectBody,
     kGotAll,
   };
+  // of the request line and the header fields, with their CRLFs
+  static const size_t kMaxHeadSize = 64 * 1024;
 
-  HttpContext() : m_state(kExpectRequestLine) {}
+  HttpContext()
+      : m_state(kExpectRequestLine), m_head_bytes(0), m_head_too_large(false) {}
 
   // default copy-ctor, dtor and assignment are fine
 
@@ -24,9 +27,13 @@ class HttpContext {
   bool parse_request(Buffer* buf, Timestamp receiveTime);
 
   bool got_all() const { return m_state == kGotAll; }
+  // parse_request() failed as the head has grown over kMaxHeadSize
+  bool head_too_large() const { return m_head_too_large; }
 
   void reset() {
     m_state = kExpectRequestLine;
+    m_head_bytes = 0;
+    m_head_too_large = false;
     HttpRequest dummy;
     // FIXME: ugly
     m_request.swap(dummy);
@@ -40,6 +47,9 @@ class HttpContext {
   bool process_request_line(const char* begin, const char* end);
 
   HttpRequestParseState m_state;
+  // consumed from the buffer for the request so far
+  size_t m_head_bytes;
+  bool m_head_too_large;
   HttpRequest m_request;
 };
 
@@ -0,0 +1,618 @@
+#include <flute/net/http/HttpProxy.h>
+
+#include <flute/common/CountdownLatch.h>
+#include <flute/common/LogLine.h>
+#include <flute/net/Reactor.h>
+#include <flute/net/TcpClientPool.h>
+#include <flute/net/http/HttpRequest.h>
+#include <flute/net/http/HttpResponse.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>  // strncasecmp
+
+#include <algorithm>
+#include <set>
+
+namespace flute {
+
+namespace {
+
+// a backend whose response head is longer is taken as broken
+const size_t kMaxResponseHeadSize = 64 * 1024;
+
+bool field_equals(const char* begin, const char* end, const char* name) {
+  size_t len = strlen(name);
+  return static_cast<size_t>(end - begin) == len &&
+         strncasecmp(begin, name, len) == 0;
+}
+
+// Connection-level headers, not forwarded by a proxy (RFC 7230, 6.1).
+bool is_hop_by_hop(const char* begin, const char* end) {
+  return field_equals(begin, end, "Connection") ||
+         field_equals(begin, end, "Keep-Alive") ||
+         field_equals(begin, end, "Proxy-Connection") ||
+         field_equals(begin, end, "TE") ||
+         field_equals(begin, end, "Upgrade");
+}
+
+// Whether req announces a body, which HttpContext has not read.
+bool has_body(const HttpRequest& req) {
+  for (const auto& header : req.headers()) {
+    const char* begin = header.first.data();
+    const char* end = begin + header.first.size();
+    if (field_equals(begin, end, "Transfer-Encoding") ||
+        (field_equals(begin, end, "Content-Length") &&
+         header.second.find_first_not_of('0') != string::npos)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void send_status(const TcpConnectionPtr& conn,
+                 HttpResponse::HttpStatusCode code, const char* message,
+                 bool close) {
+  HttpResponse response(close);
+  response.set_status_code(code);
+  response.set_status_message(message);
+  response.set_content_type("text/plain");
+  response.set_body(string(message) + "\n");
+  Buffer buf;
+  response.append_to_buffer(&buf);
+  conn->send_buffer(&buf);
+  detail::count_http_response(code);
+}
+
+}  // namespace
+
+struct HttpProxy::Exchange {
+  enum Stage {
+    kLeasing,
+    kExpectHead,
+    kRelayLength,
+    kRelayChunks,
+    kRelayUntilClose,
+    kDone,
+  };
+  enum ChunkStage { kChunkSize, kChunkData, kChunkTrailer };
+
+  Exchange()
+      : reactor_state(NULL),
+        backend(-1),
+        attempts(0),
+        client_close(false),
+        client_http10(false),
+        head_only(false),
+        idempotent(false),
+        stage(kLeasing),
+        chunk_stage(kChunkSize),
+        remaining(0),
+        upstream_close(false),
+        relayed(false),
+        paused(false) {}
+
+  // Walk the chunked framing of data, return how many bytes of it belong to
+  // the response. A chunk-size line is taken only when it is complete.
+  size_t scan_chunks(const char* data, size_t len, bool* complete) {
+    size_t pos = 0;
+    *complete = false;
+    while (pos < len) {
+      if (chunk_stage == kChunkData) {
+        size_t n = std::min(remaining, len - pos);
+        pos += n;
+        remaining -= n;
+        if (remaining == 0) {
+          chunk_stage = kChunkSize;
+        }
+        continue;
+      }
+      const char* crlf = std::search(data + pos, data + len, kCRLF, kCRLF + 2);
+      if (crlf == data + len) {
+        break;
+      }
+      const char* line = data + pos;
+      pos = crlf + 2 - data;
+      if (chunk_stage == kChunkSize) {
+        // "1a;ext=1\r\n", strtoul stops at the ';' or the '\r'
+        size_t size = strtoul(line, NULL, 16);
+        if (size == 0) {
+          chunk_stage = kChunkTrailer;
+        } else {
+          // the data and its CRLF
+          remaining = size + 2;
+          chunk_stage = kChunkData;
+        }
+      } else if (line == crlf) {
+        // the empty line after the trailer fields
+        *complete = true;
+        break;
+      }
+    }
+    return pos;
+  }
+
+  ReactorState* reactor_state;
+  // until the response head comes
+  TimerId response_timer;
+  TcpConnectionPtr client;
+  TcpConnectionPtr upstream;
+  HttpProxy::DoneCallback done;
+  // the request head for the backend, kept for a second attempt
+  string request;
+  int backend;
+  int attempts;
+  bool client_close;
+  // gets no 1xx responses (RFC 7231, 6.2)
+  bool client_http10;
+  bool head_only;
+  bool idempotent;
+
+  Stage stage;
+  ChunkStage chunk_stage;
+  // of the body or the current chunk
+  size_t remaining;
+  bool upstream_close;
+  // some of the response has gone to the client
+  bool relayed;
+  // the backend is not read until the client catches up
+  bool paused;
+};
+
+// What the proxy keeps for one reactor, used in its thread only.
+struct HttpProxy::ReactorState {
+  std::unique_ptr<TcpClientPool> pool;
+  // requests in flight, by backend
+  std::vector<int> outstanding;
+  // the next round-robin position, by route
+  std::vector<size_t> next_backend;
+  std::set<ExchangePtr> exchanges;
+};
+
+HttpProxy::HttpProxy(const string& name)
+    : m_name(name),
+      m_balancing(kRoundRobin),
+      m_keep_alive_connections(2),
+      m_max_connections(64),
+      m_high_water_mark(1024 * 1024),
+      m_response_timeout(30.0),
+      m_stopped(false) {}
+
+HttpProxy::~HttpProxy() { stop(); }
+
+void HttpProxy::add_route(const string& path_prefix,
+                          const std::vector<InetAddress>& backends) {
+  assert(!backends.empty());
+  Route route;
+  route.path_prefix = path_prefix;
+  for (const InetAddress& addr : backends) {
+    route.backends.push_back(static_cast<int>(m_backends.size()));
+    m_backends.push_back(addr);
+  }
+  m_routes.push_back(route);
+}
+
+int HttpProxy::find_route(const HttpRequest& req) const {
+  int found = -1;
+  size_t longest = 0;
+  for (size_t i = 0; i < m_routes.size(); ++i) {
+    const string& prefix = m_routes[i].path_prefix;
+    if (req.path().compare(0, prefix.size(), prefix) == 0 &&
+        (found < 0 || prefix.size() > longest)) {
+      found = static_cast<int>(i);
+      longest = prefix.size();
+    }
+  }
+  return found;
+}
+
+bool HttpProxy::has_route(const HttpRequest& req) const {
+  return find_route(req) >= 0;
+}
+
+HttpProxy::ReactorState* HttpProxy::get_state(Reactor* reactor) {
+  reactor->assert_in_reactor_thread();
+  MutexLockGuard lock(m_mutex);
+  if (m_stopped) {
+    return NULL;
+  }
+  std::unique_ptr<ReactorState>& state = m_states[reactor];
+  if (!state) {
+    state.reset(new ReactorState);
+    state->pool.reset(new TcpClientPool(reactor, m_name));
+    state->pool->set_warm_connections(m_keep_alive_connections);
+    state->pool->set_max_connections(m_max_connections);
+    for (const InetAddress& addr : m_backends) {
+      state->pool->add_upstream(addr);
+    }
+    state->outstanding.resize(m_backends.size());
+    state->next_backend.resize(m_routes.size());
+  }
+  return state.get();
+}
+
+void HttpProxy::start_in_reactor(Reactor* reactor) { get_state(reactor); }
+
+void HttpProxy::stop() {
+  std::map<Reactor*, std::unique_ptr<ReactorState>> states;
+  {
+    MutexLockGuard lock(m_mutex);
+    m_stopped = true;
+    states.swap(m_states);
+  }
+  for (auto& item : states) {
+    Reactor* reactor = item.first;
+    ReactorState* state = item.second.get();
+    auto release = [this, state]() {
+      std::set<ExchangePtr> exchanges(state->exchanges);
+      for (const ExchangePtr& exchange : exchanges) {
+        cancel(exchange);
+      }
+      state->pool.reset();
+    };
+    if (reactor->is_in_reactor_thread()) {
+      release();
+    } else {
+      CountdownLatch latch(1);
+      reactor->run_asap_in_reactor([&release, &latch]() {
+        release();
+        latch.countdown();
+      });
+      latch.wait();
+    }
+  }
+}
+
+int HttpProxy::choose_backend(ReactorState* state, int route_index) {
+  const std::vector<int>& backends = m_routes[route_index].backends;
+  const size_t n = backends.size();
+  size_t start = state->next_backend[route_index]++ % n;
+  int chosen = -1;
+  for (size_t i = 0; i < n; ++i) {
+    int backend = backends[(start + i) % n];
+    if (!state->pool->is_healthy(backend)) {
+      continue;
+    }
+    if (m_balancing == kRoundRobin) {
+      return backend;
+    }
+    if (chosen < 0 ||
+        state->outstanding[backend] < state->outstanding[chosen]) {
+      chosen = backend;
+    }
+  }
+  // all unhealthy, the lease fails with a 502
+  return chosen >= 0 ? chosen : backends[start];
+}
+
+HttpProxy::ExchangePtr HttpProxy::forward(const TcpConnectionPtr& client,
+                                          const HttpRequest& req, bool close,
+                                          const DoneCallback& done) {
+  int route = find_route(req);
+  assert(route >= 0);
+  if (has_body(req)) {
+    // the body would be read as the next request
+    send_status(client, HttpResponse::k501NotImplemented, "Not Implemented",
+                true);
+    client->get_reactor()->queue_in_reactor(std::bind(done, false));
+    return ExchangePtr();
+  }
+  ReactorState* state = get_state(client->get_reactor());
+  if (state == NULL) {
+    // stopped, the server is going away
+    client->get_reactor()->queue_in_reactor(std::bind(done, false));
+    return ExchangePtr();
+  }
+  ExchangePtr exchange(new Exchange);
+  exchange->reactor_state = state;
+  exchange->client = client;
+  exchange->done = done;
+  exchange->client_close = close;
+  exchange->client_http10 = req.get_version() == HttpRequest::kHttp10;
+  exchange->head_only = req.method() == HttpRequest::kHead;
+  exchange->idempotent = req.method() != HttpRequest::kPost;
+  exchange->backend = choose_backend(state, route);
+
+  string& head = exchange->request;
+  head.reserve(256);
+  head += req.method_string();
+  head += ' ';
+  head += req.path();
+  // with its '?'
+  head += req.query();
+  // the version of the client, a backend then sends no chunked body to an
+  // HTTP/1.0 client, which could not read it
+  head += req.get_version() == HttpRequest::kHttp10 ? " HTTP/1.0\r\n"
+                                                    : " HTTP/1.1\r\n";
+  bool has_host = false;
+  string forwarded_for;
+  for (const auto& header : req.headers()) {
+    const string& field = header.first;
+    const char* begin = field.data();
+    const char* end = begin + field.size();
+    if (is_hop_by_hop(begin, end)) {
+      continue;
+    }
+    if (field_equals(begin, end, "X-Forwarded-For")) {
+      forwarded_for = header.second + ", ";
+      continue;
+    }
+    has_host = has_host || field_equals(begin, end, "Host");
+    head += field;
+    head += ": ";
+    head += header.second;
+    head += kCRLF;
+  }
+  if (!has_host) {
+    head += "Host: ";
+    head += m_backends[exchange->backend].to_ip_port();
+    head += kCRLF;
+  }
+  head += "X-Forwarded-For: ";
+  head += forwarded_for;
+  head += client->peer_address().to_ip();
+  head += "\r\nConnection: keep-alive\r\n\r\n";
+
+  ++state->outstanding[exchange->backend];
+  state->exchanges.insert(exchange);
+  exchange->response_timer = client->get_reactor()->run_after(
+      m_response_timeout,
+      std::bind(&HttpProxy::on_response_timeout, this, exchange));
+  lease(exchange);
+  return exchange;
+}
+
+void HttpProxy::cancel(const ExchangePtr& exchange) {
+  if (exchange->stage == Exchange::kDone) {
+    return;
+  }
+  exchange->done = DoneCallback();
+  finish(exchange, false);
+}
+
+void HttpProxy::lease(const ExchangePtr& exchange) {
+  ++exchange->attempts;
+  exchange->stage = Exchange::kLeasing;
+  exchange->reactor_state->pool->lease(
+      exchange->backend, std::bind(&HttpProxy::on_leased, this, exchange, _1));
+}
+
+void HttpProxy::on_leased(const ExchangePtr& exchange,
+                          const TcpConnectionPtr& upstream) {
+  if (exchange->stage == Exchange::kDone) {
+    // cancelled while waiting
+    if (upstream) {
+      exchange->reactor_state->pool->give_back(upstream);
+    }
+    return;
+  }
+  if (!upstream) {
+    send_bad_gateway(exchange);
+    return;
+  }
+  exchange->upstream = upstream;
+  exchange->stage = Exchange::kExpectHead;
+  upstream->set_conn_callback(
+      std::bind(&HttpProxy::on_upstream_conn, this, exchange, _1));
+  upstream->set_message_callback(
+      std::bind(&HttpProxy::on_upstream_message, this, exchange, _1, _2));
+  upstream->send_string_piece(exchange->request);
+}
+
+void HttpProxy::on_upstream_conn(const ExchangePtr& exchange,
+                                 const TcpConnectionPtr& upstream) {
+  if (upstream->connected() || exchange->stage == Exchange::kDone) {
+    return;
+  }
+  // the backend has closed
+  if (exchange->stage == Exchange::kRelayUntilClose) {
+    finish(exchange, false);
+  } else if (!exchange->relayed) {
+    if (exchange->idempotent && exchange->attempts < 2) {
+      // a keep-alive connection the backend closed while idle, once more
+      exchange->upstream.reset();
+      lease(exchange);
+    } else {
+      send_bad_gateway(exchange);
+    }
+  } else {
+    LOG_WARN << "HttpProxy[" << m_name << "] - " << upstream->name()
+             << " closed in the middle of a response";
+    // the client sees a short response
+    exchange->client_close = true;
+    finish(exchange, false);
+  }
+}
+
+void HttpProxy::on_upstream_message(const ExchangePtr& exchange,
+                                    const TcpConnectionPtr&, Buffer* buf) {
+  // interim 1xx heads come before the final one
+  while (exchange->stage == Exchange::kExpectHead) {
+    if (!parse_response_head(exchange, buf)) {
+      return;
+    }
+  }
+  relay_body(exchange, buf);
+}
+
+// Send the response head to the client, with the hop-by-hop headers of this
+// hop. An interim 1xx head leaves the exchange expecting the final one.
+// Return false if it is incomplete, or bad.
+bool HttpProxy::parse_response_head(const ExchangePtr& exchange, Buffer* buf) {
+  const char* begin = buf->peek_base();
+  const char* end = buf->write_base();
+  static const char kEndOfHead[] = "\r\n\r\n";
+  const char* head_end = std::search(begin, end, kEndOfHead, kEndOfHead + 4);
+  if (head_end == end) {
+    if (buf->content_bytes_len() > kMaxResponseHeadSize) {
+      send_bad_gateway(exchange);
+      return false;
+    }
+    return false;
+  }
+  const char* crlf = std::search(begin, head_end + 2, kCRLF, kCRLF + 2);
+  // "HTTP/1.1 200 OK"
+  if (crlf - begin < 12 || !std::equal(begin, begin + 7, "HTTP/1.")) {
+    LOG_WARN << "HttpProxy[" << m_name << "] - bad status line from "
+             << m_backends[exchange->backend].to_ip_port();
+    send_bad_gateway(exchange);
+    return false;
+  }
+  int status = atoi(begin + 9);
+  bool keep_alive = begin[7] == '1';
+
+  string head(begin, crlf + 2);
+  bool chunked = false;
+  bool has_length = false;
+  size_t length = 0;
+  for (const char* line = crlf + 2; line < head_end + 2; line = crlf + 2) {
+    crlf = std::search(line, head_end + 2, kCRLF, kCRLF + 2);
+    const char* colon = std::find(line, crlf, ':');
+    const char* value = colon + 1;
+    while (value < crlf && *value == ' ') {
+      ++value;
+    }
+    if (field_equals(line, colon, "Connection")) {
+      if (static_cast<size_t>(crlf - value) >= 5) {
+        if (strncasecmp(value, "close", 5) == 0) {
+          keep_alive = false;
+        } else if (strncasecmp(value, "keep-alive", 10) == 0) {
+          keep_alive = true;
+        }
+      }
+    } else if (field_equals(line, colon, "Content-Length")) {
+      has_length = true;
+      length = strtoul(value, NULL, 10);
+    } else if (field_equals(line, colon, "Transfer-Encoding")) {
+      chunked = std::search(value, crlf, "chunked", "chunked" + 7) != crlf;
+    }
+    if (!is_hop_by_hop(line, colon)) {
+      head.append(line, crlf + 2);
+    }
+  }
+  if (status / 100 == 1) {
+    // 103 Early Hints and the like, no 101 since Upgrade is not forwarded
+    buf->retrieve_until(head_end + 4);
+    if (!exchange->client_http10) {
+      head += kCRLF;
+      exchange->client->send_string_piece(head);
+      exchange->relayed = true;
+    }
+    return true;
+  }
+  detail::count_http_response(status);
+  exchange->upstream_close = !keep_alive;
+  exchange->client->get_reactor()->remove(exchange->response_timer);
+
+  if (exchange->head_only || status == 204 || status == 304) {
+    exchange->stage = Exchange::kRelayLength;
+    exchange->remaining = 0;
+  } else if (chunked) {
+    exchange->stage = Exchange::kRelayChunks;
+    exchange->chunk_stage = Exchange::kChunkSize;
+  } else if (has_length) {
+    exchange->stage = Exchange::kRelayLength;
+    exchange->remaining = length;
+  } else {
+    // the body ends when the backend closes, so does the client connection
+    exchange->stage = Exchange::kRelayUntilClose;
+    exchange->upstream_close = true;
+    exchange->client_close = true;
+  }
+  head += exchange->client_close ? "Connection: close\r\n\r\n"
+                                 : "Connection: Keep-Alive\r\n\r\n";
+  buf->retrieve_until(head_end + 4);
+  exchange->client->send_string_piece(head);
+  exchange->relayed = true;
+  return true;
+}
+
+void HttpProxy::relay_body(const ExchangePtr& exchange, Buffer* buf) {
+  size_t len = buf->content_bytes_len();
+  size_t n = len;
+  bool complete = false;
+  if (exchange->stage == Exchange::kRelayLength) {
+    n = std::min(exchange->remaining, len);
+    exchange->remaining -= n;
+    complete = exchange->remaining == 0;
+  } else if (exchange->stage == Exchange::kRelayChunks) {
+    n = exchange->scan_chunks(buf->peek_base(), len, &complete);
+  }
+  const TcpConnectionPtr& client = exchange->client;
+  if (n == len) {
+    client->send_buffer(buf);
+  } else if (n > 0) {
+    client->send(buf->peek_base(), static_cast<int>(n));
+    buf->retrieve(n);
+  }
+  if (complete) {
+    // bytes after the response mean the backend is out of step
+    finish(exchange,
+           !exchange->upstream_close && buf->content_bytes_len() == 0);
+    return;
+  }
+  if (!exchange->paused &&
+      client->output_buffer()->content_bytes_len() > m_high_water_mark) {
+    exchange->paused = true;
+    exchange->upstream->stop_read();
+    client->set_write_complete_callback(
+        std::bind(&HttpProxy::on_client_write_complete, this, exchange));
+  }
+}
+
+void HttpProxy::on_client_write_complete(const ExchangePtr& exchange) {
+  if (!exchange->paused) {
+    return;
+  }
+  exchange->paused = false;
+  exchange->upstream->start_read();
+  exchange->client->set_write_complete_callback(WriteCompleteCallback());
+}
+
+void HttpProxy::on_response_timeout(const ExchangePtr& exchange) {
+  if (exchange->stage != Exchange::kLeasing &&
+      exchange->stage != Exchange::kExpectHead) {
+    return;
+  }
+  LOG_WARN << "HttpProxy[" << m_name << "] - no response from "
+           << m_backends[exchange->backend].to_ip_port() << " in "
+           << m_response_timeout << " seconds";
+  // the upstream connection is closed, a late response must not be taken
+  send_bad_gateway(exchange);
+}
+
+void HttpProxy::send_bad_gateway(const ExchangePtr& exchange) {
+  send_status(exchange->client, HttpResponse::k502BadGateway, "Bad Gateway",
+              exchange->client_close);
+  finish(exchange, false);
+}
+
+// It resets the callbacks holding the exchange, keep it alive meanwhile.
+void HttpProxy::finish(ExchangePtr exchange, bool reusable) {
+  exchange->stage = Exchange::kDone;
+  // it holds the exchange
+  exchange->client->get_reactor()->remove(exchange->response_timer);
+  ReactorState* state = exchange->reactor_state;
+  --state->outstanding[exchange->backend];
+  if (exchange->paused) {
+    exchange->paused = false;
+    exchange->client->set_write_complete_callback(WriteCompleteCallback());
+    exchange->upstream->start_read();
+  }
+  if (exchange->upstream) {
+    // resets its callbacks, or closes it
+    state->pool->give_back(exchange->upstream, reusable);
+    exchange->upstream.reset();
+  }
+  state->exchanges.erase(exchange);
+  DoneCallback done;
+  done.swap(exchange->done);
+  if (done) {
+    // never within forward(), a lease may fail at once
+    exchange->client->get_reactor()->queue_in_reactor(
+        std::bind(done, !exchange->client_close));
+  }
+  exchange->client.reset();
+}
+
+}  // namespace flute
@@ -0,0 +1,129 @@
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef FLUTE_NET_HTTP_HTTPPROXY_H
+#define FLUTE_NET_HTTP_HTTPPROXY_H
+
+#include <flute/common/Mutex.h>
+#include <flute/net/TcpConnection.h>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace flute {
+
+class HttpRequest;
+
+///
+/// Forwards the requests of matched routes to upstream backends, for
+/// HttpServer::set_proxy().
+///
+/// The request head is written again for the backend, in the HTTP version of
+/// the client, the response head is
+/// looked at for its framing, and the body bytes are relayed between the
+/// Buffers of the two connections as they come, without parsing them. Every
+/// reactor of the server keeps its own TcpClientPool of keep-alive
+/// connections to the backends.
+///
+/// Request bodies are not forwarded, HttpContext does not read them yet. A
+/// request announcing one is answered with 501 Not Implemented, and its
+/// connection closed.
+class HttpProxy : noncopyable {
+ public:
+  enum Balancing {
+    kRoundRobin,
+    // the backend with the fewest requests in flight from this reactor
+    kLeastOutstanding,
+  };
+  /// Called in the reactor thread of the client once the response has been
+  /// relayed, keep_alive tells whether the client connection may go on. It
+  /// is queued in the reactor, never called before forward() returns.
+  typedef std::function<void(bool keep_alive)> DoneCallback;
+
+  struct Exchange;
+  typedef std::shared_ptr<Exchange> ExchangePtr;
+
+  explicit HttpProxy(const string& name = string("HttpProxy"));
+  ~HttpProxy();
+
+  /// Settings, call them before the server starts.
+  /// Requests whose path starts with path_prefix go to one of the backends,
+  /// the longest prefix wins.
+  void add_route(const string& path_prefix,
+                 const std::vector<InetAddress>& backends);
+  void set_balancing(Balancing balancing) { m_balancing = balancing; }
+  /// Idle connections kept to every backend, by each reactor.
+  void set_keep_alive_connections(int num) { m_keep_alive_connections = num; }
+  void set_max_connections(int num) { m_max_connections = num; }
+  /// The relay stops reading the backend while this many bytes wait to be
+  /// sent to the client.
+  void set_relay_high_water_mark(size_t bytes) { m_high_water_mark = bytes; }
+  /// The head of the response must come within seconds of forwarding the
+  /// request, or the client gets a 502.
+  void set_response_timeout(double seconds) { m_response_timeout = seconds; }
+
+  const string& name() const { return m_name; }
+
+  bool has_route(const HttpRequest& req) const;
+
+  /// Forward req of client to a backend of its route, in the reactor thread
+  /// of client. close is the keep-alive decision for the client.
+  ExchangePtr forward(const TcpConnectionPtr& client, const HttpRequest& req,
+                      bool close, const DoneCallback& done);
+  /// The client has gone, done is not called.
+  void cancel(const ExchangePtr& exchange);
+
+  /// Connect the backends early, in a reactor thread of the server.
+  void start_in_reactor(Reactor* reactor);
+  /// Close the backend connections in the reactor threads, which must still
+  /// be looping. Called when the server is destroyed, requests forwarded
+  /// later close their client connection.
+  void stop();
+
+ private:
+  struct Route {
+    string path_prefix;
+    // indices of m_backends, the upstreams of every pool
+    std::vector<int> backends;
+  };
+  struct ReactorState;
+
+  // null once stopped
+  ReactorState* get_state(Reactor* reactor);
+  // the index of the route, or -1
+  int find_route(const HttpRequest& req) const;
+  int choose_backend(ReactorState* state, int route);
+
+  void lease(const ExchangePtr& exchange);
+  void on_leased(const ExchangePtr& exchange, const TcpConnectionPtr& upstream);
+  void on_upstream_conn(const ExchangePtr& exchange,
+                        const TcpConnectionPtr& upstream);
+  void on_upstream_message(const ExchangePtr& exchange,
+                           const TcpConnectionPtr& upstream, Buffer* buf);
+  void on_client_write_complete(const ExchangePtr& exchange);
+  bool parse_response_head(const ExchangePtr& exchange, Buffer* buf);
+  void relay_body(const ExchangePtr& exchange, Buffer* buf);
+  void on_response_timeout(const ExchangePtr& exchange);
+  void send_bad_gateway(const ExchangePtr& exchange);
+  void finish(ExchangePtr exchange, bool reusable);
+
+  const string m_name;
+  Balancing m_balancing;
+  int m_keep_alive_connections;
+  int m_max_connections;
+  size_t m_high_water_mark;
+  double m_response_timeout;
+  std::vector<InetAddress> m_backends;
+  std::vector<Route> m_routes;
+
+  MutexLock m_mutex;
+  std::map<Reactor*, std::unique_ptr<ReactorState>> m_states
+      GUARDED_BY(m_mutex);
+  bool m_stopped GUARDED_BY(m_mutex);
+};
+
+}  // namespace flute
+
+#endif  // FLUTE_NET_HTTP_HTTPPROXY_H
@@ -0,0 +1,128 @@
+#include <flute/net/http/HttpRange.h>
+
+#include <assert.h>
+#include <ctype.h>
+#include <stdio.h>
+
+#include <algorithm>
+
+namespace flute {
+
+namespace {
+
+const char* skip_spaces(const char* p, const char* end) {
+  while (p < end && isspace(*p)) {
+    ++p;
+  }
+  return p;
+}
+
+// Parse a non-negative decimal number in [p, end). Return false on overflow or
+// when no digit is found.
+bool parse_number(const char* p, const char* end, off_t* out) {
+  if (p == end) {
+    return false;
+  }
+  off_t value = 0;
+  for (; p < end; ++p) {
+    if (!isdigit(*p)) {
+      return false;
+    }
+    off_t digit = *p - '0';
+    if (value > (INT64_MAX - digit) / 10) {
+      return false;
+    }
+    value = value * 10 + digit;
+  }
+  *out = value;
+  return true;
+}
+
+}  // namespace
+
+RangeParseResult parse_byte_ranges(const string& value, size_t total_size,
+                                   std::vector<ByteRange>* ranges) {
+  assert(ranges != NULL);
+  ranges->clear();
+  static const char kUnit[] = "bytes=";
+  const char* p = skip_spaces(value.data(), value.data() + value.size());
+  const char* end = value.data() + value.size();
+  if (static_cast<size_t>(end - p) < sizeof(kUnit) - 1 ||
+      !std::equal(kUnit, kUnit + sizeof(kUnit) - 1, p)) {
+    return kRangeNone;
+  }
+  p += sizeof(kUnit) - 1;
+
+  const off_t size = static_cast<off_t>(total_size);
+  size_t num_specs = 0;
+  while (p < end) {
+    const char* comma = std::find(p, end, ',');
+    const char* spec_begin = skip_spaces(p, comma);
+    const char* spec_end = comma;
+    while (spec_end > spec_begin && isspace(*(spec_end - 1))) {
+      --spec_end;
+    }
+    p = comma == end ? end : comma + 1;
+    // empty elements are allowed in a list, e.g. "bytes=0-1,,5-6"
+    if (spec_begin == spec_end) {
+      continue;
+    }
+    if (++num_specs > kMaxByteRanges) {
+      ranges->clear();
+      return kRangeNone;
+    }
+
+    const char* dash = std::find(spec_begin, spec_end, '-');
+    if (dash == spec_end) {
+      ranges->clear();
+      return kRangeNone;
+    }
+    ByteRange range;
+    if (dash == spec_begin) {
+      // suffix range "-n": the last n bytes
+      off_t suffix = 0;
+      if (!parse_number(dash + 1, spec_end, &suffix)) {
+        ranges->clear();
+        return kRangeNone;
+      }
+      if (suffix == 0 || size == 0) {
+        continue;
+      }
+      range.first = suffix >= size ? 0 : size - suffix;
+      range.last = size - 1;
+    } else {
+      if (!parse_number(spec_begin, dash, &range.first)) {
+        ranges->clear();
+        return kRangeNone;
+      }
+      if (dash + 1 == spec_end) {
+        // "first-": till the end
+        range.last = size - 1;
+      } else if (!parse_number(dash + 1, spec_end, &range.last) ||
+                 range.last < range.first) {
+        ranges->clear();
+        return kRangeNone;
+      }
+      if (range.first >= size) {
+        continue;
+      }
+      range.last = std::min(range.last, size - 1);
+    }
+    ranges->push_back(range);
+  }
+
+  if (num_specs == 0) {
+    return kRangeNone;
+  }
+  return ranges->empty() ? kRangeNotSatisfiable : kRangeSatisfiable;
+}
+
+string content_range_of(const ByteRange& range, size_t total_size) {
+  char buf[80];
+  snprintf(buf, sizeof buf, "bytes %lld-%lld/%zu",
+           static_cast<long long>(range.first),
+           static_cast<long long>(range.last), total_size);
+  return buf;
+}
+
+}  // namespace flute
@@ -0,0 +1,45 @@
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef FLUTE_NET_HTTP_HTTPRANGE_H
+#define FLUTE_NET_HTTP_HTTPRANGE_H
+
+#include <flute/common/types.h>
+
+#include <sys/types.h>  // for off_t
+#include <vector>
+
+namespace flute {
+
+/// An inclusive byte range [first, last] of a representation, RFC 7233.
+struct ByteRange {
+  off_t first;
+  off_t last;
+
+  size_t length() const { return static_cast<size_t>(last - first + 1); }
+};
+
+enum RangeParseResult {
+  // no usable "Range:" header, send the whole representation
+  kRangeNone,
+  kRangeSatisfiable,
+  // none of the ranges overlaps the representation, send 416
+  kRangeNotSatisfiable,
+};
+
+// Too many ranges are more likely an attack than a real client.
+static const size_t kMaxByteRanges = 16;
+
+/// Parse the value of a "Range:" header such as "bytes=0-499,-500" against a
+/// representation of @c total_size bytes. Satisfiable ranges are clamped into
+/// the representation and stored into @c ranges in the order of the header.
+/// A malformed header is ignored as if it was absent.
+RangeParseResult parse_byte_ranges(const string& value, size_t total_size,
+                                   std::vector<ByteRange>* ranges);
+
+/// "bytes first-last/total"
+string content_range_of(const ByteRange& range, size_t total_size);
+
+}  // namespace flute
+
+#endif  // FLUTE_NET_HTTP_HTTPRANGE_H
@@ -1,12 +1,39 @@
 #include <flute/net/http/HttpResponse.h>
 #include <flute/net/Buffer.h>
 #include <flute/common/LogLine.h>
+#include <flute/common/Metrics.h>
+#include <flute/common/Timestamp.h>
+#include <flute/net/http/HttpValidator.h>
 
 #include <stdio.h>
+#include <atomic>
 #include <memory>
 
 namespace flute {
 
+namespace detail {
+
+void count_http_response(int status) {
+  static const int kMaxStatus = 600;
+  // made as the statuses are first seen, zero initialized
+  static std::atomic<Counter*> s_counters[kMaxStatus];
+  if (status < 0 || status >= kMaxStatus) {
+    status = 0;
+  }
+  Counter* counter = s_counters[status].load(std::memory_order_acquire);
+  if (counter == NULL) {
+    char labels[32];
+    snprintf(labels, sizeof labels, "code=\"%d\"", status);
+    counter = MetricsRegistry::instance().counter(
+        "flute_http_requests_total", "HTTP requests answered, by status.",
+        labels);
+    s_counters[status].store(counter, std::memory_order_release);
+  }
+  counter->add();
+}
+
+}  // namespace detail
+
 void HttpResponse::append_to_buffer(Buffer* out_buf) const {
   char buf[32];
   snprintf(buf, sizeof buf, "HTTP/1.1 %d ", m_status_code);
@@ -16,6 +43,9 @@ void HttpResponse::append_to_buffer(Buffer* out_buf) const {
 
   if (m_will_close) {
     out_buf->append("Connection: close\r\n");
+  } else if (m_status_code == k304NotModified) {
+    // 304 never has a body, Content-Length would describe the full file.
+    out_buf->append("Connection: Keep-Alive\r\n");
   } else {
     snprintf(buf, sizeof buf, "Content-Length: %zd\r\n", content_length());
     out_buf->append(buf);
@@ -43,13 +73,99 @@ size_t HttpResponse::content_length() const {
     }
     return size;
   } else if (m_response_body_type == kJPEG) {
-    return m_zero_copier_ptr->source_size();
+    size = m_file_trailer.size();
+    for (const FilePart& part : m_file_parts) {
+      size += part.preamble.size() + part.zero_copier_ptr->window_size();
+    }
+    return size;
   } else {
     // FIXME: Unsupported types
     return 0;
   }
 }
 
+const string& HttpResponse::get_header(const string& key) const {
+  static const string kEmpty;
+  std::map<string, string>::const_iterator it = m_headers.find(key);
+  return it == m_headers.end() ? kEmpty : it->second;
+}
+
+void HttpResponse::set_partial_content(const std::vector<ByteRange>& ranges) {
+  assert(m_response_body_type == kJPEG && m_file_parts.size() == 1);
+  assert(!ranges.empty());
+  const string path = m_file_parts.front().zero_copier_ptr->source_path();
+  const size_t total_size = m_file_parts.front().zero_copier_ptr->source_size();
+  set_status_code(k206PartialContent);
+  set_status_message("Partial Content");
+
+  if (ranges.size() == 1) {
+    // the opened file is reused for a single range
+    m_file_parts.front().zero_copier_ptr->set_window(ranges[0].first,
+                                                     ranges[0].length());
+    add_header("Content-Range", content_range_of(ranges[0], total_size));
+    return;
+  }
+
+  char boundary[48];
+  snprintf(boundary, sizeof boundary, "FLUTE_BYTERANGES_%016llx",
+           static_cast<unsigned long long>(
+               Timestamp::now().micro_seconds_since_epoch()));
+  const string content_type = get_header("Content-Type");
+  m_file_parts.clear();
+  for (const ByteRange& range : ranges) {
+    FilePart part;
+    part.preamble = "\r\n--";
+    part.preamble += boundary;
+    if (!content_type.empty()) {
+      part.preamble += "\r\nContent-Type: " + content_type;
+    }
+    part.preamble += "\r\nContent-Range: " + content_range_of(range, total_size);
+    part.preamble += "\r\n\r\n";
+    part.zero_copier_ptr =
+        ZeroCopierPtr(new ZeroCopier(path, range.first, range.length()));
+    m_file_parts.push_back(part);
+  }
+  m_file_trailer = "\r\n--";
+  m_file_trailer += boundary;
+  m_file_trailer += "--\r\n";
+  set_content_type(string("multipart/byteranges; boundary=") + boundary);
+}
+
+void HttpResponse::set_range_not_satisfiable() {
+  assert(m_response_body_type == kJPEG && m_file_parts.size() == 1);
+  const size_t total_size = m_file_parts.front().zero_copier_ptr->source_size();
+  set_status_code(k416RangeNotSatisfiable);
+  set_status_message("Range Not Satisfiable");
+  char buf[48];
+  snprintf(buf, sizeof buf, "bytes */%zu", total_size);
+  add_header("Content-Range", buf);
+  // no body at all, but still a file response to keep Content-Length right
+  m_file_parts.front().zero_copier_ptr->set_window(0, 0);
+}
+
+void HttpResponse::set_not_modified() {
+  set_status_code(k304NotModified);
+  set_status_message("Not Modified");
+  m_headers.erase("Content-Range");
+  m_file_parts.clear();
+  m_file_trailer.clear();
+  m_body.clear();
+  m_response_body_type = kHtml;
+}
+
+void HttpResponse::set_file_validators() {
+  const ZeroCopierPtr& zero_copier_ptr = m_file_parts.front().zero_copier_ptr;
+  if (!zero_copier_ptr->is_source_available()) {
+    return;
+  }
+  Timestamp modify_time = zero_copier_ptr->source_modify_time();
+  add_header("ETag", make_file_etag(zero_copier_ptr->source_inode(),
+                                    zero_copier_ptr->source_size(),
+                                    modify_time));
+  add_header("Last-Modified",
+             to_http_date(modify_time.seconds_since_epoch()));
+}
+
 HttpResponse::HttpResponsePtr HttpResponse::response_404() {
   HttpResponsePtr resp_ptr = std::make_shared<HttpResponse>(true);
   resp_ptr->set_status_code(HttpResponse::k404NotFound);
@@ -62,4 +178,10 @@ HttpResponse::HttpResponsePtr HttpResponse::response_400() {
   resp_ptr->set_status_message("Bad Request");
   return resp_ptr;
 }
+HttpResponse::HttpResponsePtr HttpResponse::response_431() {
+  HttpResponsePtr resp_ptr = std::make_shared<HttpResponse>(true);
+  resp_ptr->set_status_code(HttpResponse::k431RequestHeaderFieldsTooLarge);
+  resp_ptr->set_status_message("Request Header Fields Too Large");
+  return resp_ptr;
+}
 }  // namespace flute
\ No newline at end of file
@@ -7,9 +7,11 @@
 
 #include <flute/common/ZeroCopier.h>
 #include <flute/common/types.h>
+#include <flute/net/http/HttpRange.h>
 
 #include <map>
 #include <memory>
+#include <vector>
 
 namespace flute {
 
@@ -17,17 +19,39 @@ enum HttpResponseBodyType { kHtml, kJPEG, kUnSupported };
 
 class Buffer;
 
+namespace detail {
+
+// Count a response of status in flute_http_requests_total, lock free once
+// the status has been seen.
+void count_http_response(int status);
+
+}  // namespace detail
+
 class HttpResponse {
  public:
   enum HttpStatusCode {
     kUnknown,
     k200Ok = 200,
+    k206PartialContent = 206,
     k301MovedPermanently = 301,
+    k304NotModified = 304,
     k400BadRequest = 400,
     k404NotFound = 404,
+    k416RangeNotSatisfiable = 416,
+    k431RequestHeaderFieldsTooLarge = 431,
+    k501NotImplemented = 501,
+    k502BadGateway = 502,
   };
   typedef std::shared_ptr<HttpResponse> HttpResponsePtr;
 
+  // A window of a file sent by ZeroCopier, preceded by some in-memory bytes,
+  // e.g. the part headers of a multipart/byteranges body.
+  struct FilePart {
+    string preamble;
+    ZeroCopierPtr zero_copier_ptr;
+  };
+  typedef std::vector<FilePart> FilePartList;
+
   explicit HttpResponse(bool close)
       : m_status_code(kUnknown),
         m_will_close(close),
@@ -50,36 +74,68 @@ class HttpResponse {
     m_headers[key] = value;
   }
 
+  const string& get_header(const string& key) const;
+
+  HttpStatusCode status_code() const { return m_status_code; }
+
   void set_body(const string& body) {
     m_body = body;
     m_response_body_type = kHtml;
-    m_zero_copier_ptr.reset();
+    m_file_parts.clear();
+    m_file_trailer.clear();
   }
 
   void set_zerocopy(const string& path) {
-    m_zero_copier_ptr = ZeroCopierPtr(new ZeroCopier(path));
+    m_file_parts.clear();
+    m_file_parts.push_back(FilePart());
+    m_file_parts.back().zero_copier_ptr = ZeroCopierPtr(new ZeroCopier(path));
+    m_file_trailer.clear();
     m_response_body_type = kJPEG;
     m_body = "";
+    add_header("Accept-Ranges", "bytes");
+    set_file_validators();
   }
 
+  // Narrow a whole-file response set by set_zerocopy() down to the ranges, as
+  // "206 Partial Content". More than one range makes a multipart/byteranges
+  // body.
+  void set_partial_content(const std::vector<ByteRange>& ranges);
+  // "416 Range Not Satisfiable" for a whole-file response.
+  void set_range_not_satisfiable();
+  // Drop the body and answer "304 Not Modified", keeping the validators.
+  void set_not_modified();
+
   void append_to_buffer(Buffer* out_buf) const;
 
   // common messages
   static HttpResponsePtr response_400();
   static HttpResponsePtr response_404();
+  static HttpResponsePtr response_431();
 
   // When the content is completely written into the buffer, content length is
   // m_body.size(). However, when there are files to send, m_body is empty.
   size_t content_length() const;
-  ZeroCopierPtr zero_copier_ptr() const { return m_zero_copier_ptr; }
+  // the copier of the first file part, or null for an in-memory body
+  ZeroCopierPtr zero_copier_ptr() const {
+    return m_file_parts.empty() ? ZeroCopierPtr()
+                                : m_file_parts.front().zero_copier_ptr;
+  }
+  // The file parts and the trailer are sent after append_to_buffer().
+  const FilePartList& file_parts() const { return m_file_parts; }
+  const string& file_trailer() const { return m_file_trailer; }
   HttpResponseBodyType response_type() const { return m_response_body_type; }
 
  private:
+  // ETag and Last-Modified from the metadata of the file to send.
+  void set_file_validators();
+
   std::map<string, string> m_headers;
   HttpStatusCode m_status_code;
   // FIXME: add http version
   string m_status_message;
-  ZeroCopierPtr m_zero_copier_ptr;
+  FilePartList m_file_parts;
+  // e.g. the closing delimiter of a multipart body
+  string m_file_trailer;
   bool m_will_close;
   string m_body;
   HttpResponseBodyType m_response_body_type;
@@ -1,87 +1,382 @@
 
 //
 
+#include <flute/common/HdrHistogram.h>
 #include <flute/common/LogLine.h>
+#include <flute/common/Metrics.h>
+#include <flute/common/WorkStealingPool.h>
+#include <flute/net/Reactor.h>
 #include <flute/net/http/HttpContext.h>
+#include <flute/net/http/HttpProxy.h>
 #include <flute/net/http/HttpRequest.h>
 #include <flute/net/http/HttpResponse.h>
 #include <flute/net/http/HttpServer.h>
+#include <flute/net/http/HttpValidator.h>
+
+#include <assert.h>
+
+#include <map>
 
 namespace flute {
 
 namespace detail {
 
+LatencyHistogram* const g_parse_latency = MetricsRegistry::instance().latency(
+    "flute_http_parse_seconds", "Parsing of the bytes of a request.");
+LatencyHistogram* const g_handler_latency = MetricsRegistry::instance().latency(
+    "flute_http_handler_seconds",
+    "The response callback, with the conditional and range handling.");
+LatencyHistogram* const g_last_byte_latency =
+    MetricsRegistry::instance().latency(
+        "flute_http_time_to_last_byte_seconds",
+        "From the poll that read a request to the write of its last byte.");
+
 void dummy_404_callback(const HttpRequest&, HttpResponse* resp) {
   resp->set_status_code(HttpResponse::k404NotFound);
   resp->set_status_message("Not Found");
   resp->set_close_conn(true);
 }
 
+// Serve the "Range:" of a whole-file GET response. Other responses are left
+// untouched.
+void handle_range_request(const HttpRequest& req, HttpResponse* resp) {
+  if (req.method() != HttpRequest::kGet ||
+      resp->status_code() != HttpResponse::k200Ok ||
+      resp->response_type() != kJPEG || resp->file_parts().size() != 1) {
+    return;
+  }
+  const string range = req.get_header("Range");
+  ZeroCopierPtr zero_copier_ptr = resp->zero_copier_ptr();
+  if (range.empty() || !zero_copier_ptr->is_source_available()) {
+    return;
+  }
+  // the client copy is stale, the whole file is sent instead
+  const string if_range = req.get_header("If-Range");
+  if (!if_range.empty() &&
+      !if_range_matches(if_range, resp->get_header("ETag"),
+                        resp->get_header("Last-Modified"))) {
+    return;
+  }
+  std::vector<ByteRange> ranges;
+  switch (parse_byte_ranges(range, zero_copier_ptr->source_size(), &ranges)) {
+    case kRangeSatisfiable:
+      resp->set_partial_content(ranges);
+      break;
+    case kRangeNotSatisfiable:
+      resp->set_range_not_satisfiable();
+      break;
+    default:
+      break;
+  }
+}
+
+bool wants_close(const HttpRequest& req) {
+  const string& connection = req.get_header("Connection");
+  return connection == "close" ||
+         (req.get_version() == HttpRequest::kHttp10 &&
+          connection != "Keep-Alive");
+}
+
+// What HttpServer keeps for a connection, its context pointer.
+struct HttpSession {
+  HttpSession()
+      : next_sequence(0),
+        next_to_send(0),
+        num_pending(0),
+        closing(false),
+        last_read(false),
+        proxying(false) {}
+
+  HttpContext context;
+  // With a handler pool, requests are numbered as they arrive and responses
+  // wait in ready until those before them have been sent.
+  uint64_t next_sequence;
+  uint64_t next_to_send;
+  size_t num_pending;
+  struct ReadyResponse {
+    Timestamp receive_time;
+    std::shared_ptr<HttpResponse> response;
+  };
+  std::map<uint64_t, ReadyResponse> ready;
+  // a response has closed the connection, the later ones are dropped
+  bool closing;
+  // A request ending the connection has been read, a bad one or one asking
+  // to close. The bytes pipelined behind it are dropped.
+  bool last_read;
+  // A request is being forwarded by the proxy, or waits in deferred for the
+  // responses before it. The connection does not read meanwhile.
+  bool proxying;
+  HttpProxy::ExchangePtr exchange;
+  std::shared_ptr<HttpRequest> deferred;
+};
+
 }  // namespace detail
 
 HttpServer::HttpServer(Reactor* reactor, const InetAddress& listenAddr,
                        const string& name, TcpServer::Option option)
     : m_tcp_server(reactor, listenAddr, name, option),
-      m_response_callback(detail::dummy_404_callback) {
+      m_response_callback(detail::dummy_404_callback),
+      m_num_handler_threads(0),
+      m_max_pending_requests(0) {
   m_tcp_server.set_conn_callback(
       std::bind(&HttpServer::on_connection, this, _1));
   m_tcp_server.set_message_callback(
       std::bind(&HttpServer::default_on_request, this, _1, _2, _3));
 }
 
+HttpServer::~HttpServer() {
+  if (m_handler_pool) {
+    m_handler_pool->stop();
+  }
+  if (m_proxy) {
+    m_proxy->stop();
+  }
+}
+
+void HttpServer::set_handler_thread_num(int num_threads, size_t max_pending) {
+  assert(max_pending > 0);
+  m_num_handler_threads = num_threads;
+  m_max_pending_requests = max_pending;
+}
+
+void HttpServer::set_proxy(std::unique_ptr<HttpProxy> proxy) {
+  m_proxy = std::move(proxy);
+}
+
 void HttpServer::start() {
   LOG_INFO << "HttpServer[" << m_tcp_server.name() << "] starts listenning on "
            << m_tcp_server.ip_port();
+  if (m_num_handler_threads > 0) {
+    m_handler_pool.reset(new WorkStealingPool(m_tcp_server.name() + "Handler"));
+    m_handler_pool->start(m_num_handler_threads);
+  }
+  if (m_proxy) {
+    m_tcp_server.set_reactor_init_func(
+        std::bind(&HttpProxy::start_in_reactor, m_proxy.get(), _1));
+  }
   m_tcp_server.start();
 }
 
 void HttpServer::on_connection(const TcpConnectionPtr& conn) {
   if (conn->connected()) {
     // FIXME: strongly coupled
-    HttpContext* context = new HttpContext();
-    conn->set_context_ptr(context);
+    conn->set_context_ptr(new detail::HttpSession());
+  } else {
+    detail::HttpSession* session =
+        static_cast<detail::HttpSession*>(conn->get_mutable_context_ptr());
+    if (session->exchange) {
+      m_proxy->cancel(session->exchange);
+    }
+    // responses still in the pool find no session and are dropped
+    delete session;
+    conn->set_context_ptr(NULL);
   }
 }
 
+// Every complete request in buf is handled, pipelined ones included. The
+// responses sent meanwhile are queued in the output buffer of the connection,
+// which writes them out together once the socket is writable.
 void HttpServer::default_on_request(const TcpConnectionPtr& conn, Buffer* buf,
                                     Timestamp receiveTime) {
-  HttpContext* request_context =
-      static_cast<HttpContext*>(conn->get_mutable_context_ptr());
-
-  // ONGOING BUG: What if the received bytes are not the full content of the
-  // HTTP request? Remember that TCP is byte stream.
-  string end = buf->peek_last_as_string(4);
-  if (end != "\r\n\r\n") {
-    LOG_TRACE << "Incomplete html request" << buf->as_string();
-    return;
-  }
-  if (!request_context->parse_request(buf, receiveTime)) {
-    HttpResponse::HttpResponsePtr resp400 = HttpResponse::response_400();
-    Buffer temp_buf;
-    resp400->append_to_buffer(&temp_buf);
-    conn->send_buffer(&temp_buf);
-    // BUG: should tell whether 404 has been sent.
-    conn->shutdown();
-  }
+  detail::HttpSession* session =
+      static_cast<detail::HttpSession*>(conn->get_mutable_context_ptr());
+  HttpContext* request_context = &session->context;
 
-  if (request_context->got_all()) {
+  while (buf->content_bytes_len() > 0 && !session->closing &&
+         !session->last_read && !session->proxying &&
+         (!m_handler_pool ||
+          session->num_pending < m_max_pending_requests)) {
+    Timestamp parse_start = Timestamp::now();
+    bool parsed = request_context->parse_request(buf, receiveTime);
+    detail::g_parse_latency->record_between(parse_start, Timestamp::now());
+    if (!parsed) {
+      session->last_read = true;
+      HttpResponse::HttpResponsePtr error =
+          request_context->head_too_large() ? HttpResponse::response_431()
+                                            : HttpResponse::response_400();
+      if (m_handler_pool) {
+        // behind the responses of the requests before it
+        ++session->num_pending;
+        on_response_ready(conn, session->next_sequence++, receiveTime, error);
+      } else {
+        send_response(conn, *error, receiveTime);
+        session->closing = true;
+      }
+      break;
+    }
+    if (!request_context->got_all()) {
+      // the rest comes with the next read
+      return;
+    }
+    session->last_read = detail::wants_close(request_context->request());
     on_good_request(conn, request_context->request());
     // FIXME: ugly
     request_context->reset();
   }
+  if (session->closing || session->last_read) {
+    buf->retrieve_all();
+  }
 }
 
 // WARNING: This function is not thread safe. It works only because it's binded
 // with certain TCPConnection
 void HttpServer::on_good_request(const TcpConnectionPtr& conn,
                                  const HttpRequest& req) {
-  const string& connection = req.get_header("Connection");
-  bool close =
-      connection == "close" ||
-      (req.get_version() == HttpRequest::kHttp10 && connection != "Keep-Alive");
-  HttpResponse response(close);
-  // generate response
-  m_response_callback(req, &response);
+  if (m_proxy && m_proxy->has_route(req)) {
+    forward_request(conn, req);
+    return;
+  }
+  detail::HttpSession* session =
+      static_cast<detail::HttpSession*>(conn->get_mutable_context_ptr());
+  if (session->closing) {
+    return;
+  }
+  if (m_handler_pool) {
+    if (++session->num_pending >= m_max_pending_requests) {
+      // backpressure, resumed in on_response_ready()
+      conn->stop_read();
+    }
+    std::shared_ptr<HttpRequest> req_copy(new HttpRequest(req));
+    m_handler_pool->push_task(std::bind(&HttpServer::handle_request_in_pool,
+                                        this, conn, session->next_sequence++,
+                                        req_copy));
+    return;
+  }
+
+  HttpResponse response(detail::wants_close(req));
+  generate_response(req, &response);
+  send_response(conn, response, req.receive_time());
+  // the requests pipelined behind are dropped
+  session->closing = response.will_close();
+}
+
+// In the reactor thread, or in a handler thread.
+void HttpServer::generate_response(const HttpRequest& req,
+                                   HttpResponse* response) {
+  if (!m_metrics_path.empty() && req.method() == HttpRequest::kGet &&
+      req.path() == m_metrics_path) {
+    response->set_status_code(HttpResponse::k200Ok);
+    response->set_status_message("OK");
+    response->set_content_type("text/plain; version=0.0.4");
+    response->set_body(MetricsRegistry::instance().to_prometheus());
+    return;
+  }
+  Timestamp start = Timestamp::now();
+  m_response_callback(req, response);
+  if (!detail::handle_conditional_request(req, response)) {
+    detail::handle_range_request(req, response);
+  }
+  detail::g_handler_latency->record_between(start, Timestamp::now());
+}
+
+// In a handler thread.
+void HttpServer::handle_request_in_pool(
+    const TcpConnectionPtr& conn, uint64_t sequence,
+    const std::shared_ptr<HttpRequest>& req) {
+  std::shared_ptr<HttpResponse> response(
+      new HttpResponse(detail::wants_close(*req)));
+  // the conditional and range handling stat the file, off the reactor too
+  generate_response(*req, response.get());
+  conn->get_reactor()->run_asap_in_reactor(
+      std::bind(&HttpServer::on_response_ready, this, conn, sequence,
+                req->receive_time(), response));
+}
+
+// Back in the reactor thread of the connection.
+void HttpServer::on_response_ready(
+    const TcpConnectionPtr& conn, uint64_t sequence, Timestamp receive_time,
+    const std::shared_ptr<HttpResponse>& response) {
+  detail::HttpSession* session =
+      static_cast<detail::HttpSession*>(conn->get_mutable_context_ptr());
+  if (session == NULL) {
+    // disconnected
+    return;
+  }
+  session->ready[sequence].receive_time = receive_time;
+  session->ready[sequence].response = response;
+  auto it = session->ready.begin();
+  while (it != session->ready.end() && it->first == session->next_to_send) {
+    if (!session->closing) {
+      const HttpResponse& resp = *it->second.response;
+      send_response(conn, resp, it->second.receive_time);
+      session->closing = resp.will_close();
+    }
+    it = session->ready.erase(it);
+    ++session->next_to_send;
+    --session->num_pending;
+  }
+  if (session->deferred && session->num_pending == 0 && !session->closing) {
+    std::shared_ptr<HttpRequest> req;
+    req.swap(session->deferred);
+    session->exchange = m_proxy->forward(
+        conn, *req, detail::wants_close(*req),
+        std::bind(&HttpServer::on_proxy_done, this, conn, _1));
+  }
+  // resume at half of the limit, not to toggle on every response
+  if (!session->closing && !session->proxying && !conn->is_reading() &&
+      session->num_pending <= m_max_pending_requests / 2) {
+    conn->start_read();
+    // the pipelined requests read before the stop
+    if (conn->input_buffer()->content_bytes_len() > 0) {
+      default_on_request(conn, conn->input_buffer(), Timestamp::now());
+    }
+  }
+}
+
+void HttpServer::forward_request(const TcpConnectionPtr& conn,
+                                 const HttpRequest& req) {
+  detail::HttpSession* session =
+      static_cast<detail::HttpSession*>(conn->get_mutable_context_ptr());
+  if (session->closing) {
+    return;
+  }
+  session->proxying = true;
+  conn->stop_read();
+  if (session->num_pending > 0) {
+    // after the responses of the handler pool, in on_response_ready()
+    session->deferred.reset(new HttpRequest(req));
+    return;
+  }
+  session->exchange = m_proxy->forward(
+      conn, req, detail::wants_close(req),
+      std::bind(&HttpServer::on_proxy_done, this, conn, _1));
+}
+
+void HttpServer::on_proxy_done(const TcpConnectionPtr& conn, bool keep_alive) {
+  detail::HttpSession* session =
+      static_cast<detail::HttpSession*>(conn->get_mutable_context_ptr());
+  if (session == NULL) {
+    return;
+  }
+  session->proxying = false;
+  session->exchange.reset();
+  if (!keep_alive) {
+    session->closing = true;
+    conn->shutdown();
+    return;
+  }
+  conn->start_read();
+  // a request that came with the forwarded one, handled on its own turn
+  // rather than inside a parse loop that may still be running
+  if (conn->input_buffer()->content_bytes_len() > 0) {
+    conn->get_reactor()->queue_in_reactor(
+        std::bind(&HttpServer::resume_requests, this, conn));
+  }
+}
+
+void HttpServer::resume_requests(const TcpConnectionPtr& conn) {
+  detail::HttpSession* session =
+      static_cast<detail::HttpSession*>(conn->get_mutable_context_ptr());
+  if (session == NULL || session->proxying) {
+    return;
+  }
+  default_on_request(conn, conn->input_buffer(), Timestamp::now());
+}
+
+void HttpServer::send_response(const TcpConnectionPtr& conn,
+                               const HttpResponse& response,
+                               Timestamp receive_time) {
+  detail::count_http_response(response.status_code());
   Buffer buf;
   response.append_to_buffer(&buf);
 
@@ -90,10 +385,19 @@ void HttpServer::on_good_request(const TcpConnectionPtr& conn,
   conn->send_buffer(&buf);
 
   // It response is jpeg, the above step has only setup the headers. We need to
-  // manually start sending the body data.
+  // manually start sending the body data, part by part.
   if (response.response_type() == kJPEG) {
-    conn->enable_zero_copy(response.zero_copier_ptr());
+    for (const HttpResponse::FilePart& part : response.file_parts()) {
+      if (!part.preamble.empty()) {
+        conn->send_string_piece(part.preamble);
+      }
+      conn->enable_zero_copy(part.zero_copier_ptr);
+    }
+    if (!response.file_trailer().empty()) {
+      conn->send_string_piece(response.file_trailer());
+    }
   }
+  conn->record_time_to_last_byte(receive_time, detail::g_last_byte_latency);
   if (response.will_close()) {
     conn->shutdown();
   }
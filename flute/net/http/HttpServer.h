@@ -7,15 +7,21 @@
 
 #include <flute/net/TcpServer.h>
 
+#include <memory>
+
 namespace flute {
 
+class HttpProxy;
 class HttpRequest;
 class HttpResponse;
+class WorkStealingPool;
 
 /// A simple embeddable HTTP server designed for report status of a program.
 /// It is not a fully HTTP 1.1 compliant server, but provides minimum features
 /// that can communicate with HttpClient and Web browser.
 /// It is synchronous, just like Java Servlet.
+/// Requests pipelined on a keep-alive connection are all handled, and their
+/// responses go out in the order of the requests.
 class HttpServer : noncopyable {
  public:
   typedef std::function<void(const HttpRequest&, HttpResponse*)>
@@ -24,10 +30,13 @@ class HttpServer : noncopyable {
   HttpServer(Reactor* reactor, const InetAddress& listenAddr,
              const string& name,
              TcpServer::Option option = TcpServer::kNoReusePort);
+  ~HttpServer();  // force out-line dtor, for std::unique_ptr members.
 
   Reactor* get_reactor() const { return m_tcp_server.get_listen_reactor(); }
 
-  /// Not thread safe, callback be registered before calling start().
+  /// Set before start(). The callback runs in the reactor threads, or with
+  /// set_handler_thread_num() in the handler threads, several at once, so it
+  /// must then be thread safe.
   void set_response_callback(const ReponseCallback& cb) {
     m_response_callback = cb;
   }
@@ -36,6 +45,24 @@ class HttpServer : noncopyable {
     m_tcp_server.set_reactor_pool_size(num_threads);
   }
 
+  /// Run the response callback in a pool of num_threads handler threads
+  /// instead of the reactor threads, so a slow handler stalls no other
+  /// connection. Responses still go out in the order of the requests of a
+  /// connection. A connection stops reading while max_pending of its
+  /// requests are being handled. The response callback is then called
+  /// concurrently and must be thread safe. Call before start().
+  void set_handler_thread_num(int num_threads, size_t max_pending = 16);
+
+  /// Forward the requests matching a route of proxy to its backends instead
+  /// of calling the response callback. A connection reads no more requests
+  /// until the response has been relayed. Call before start().
+  void set_proxy(std::unique_ptr<HttpProxy> proxy);
+
+  /// Answer GET path with the metrics of MetricsRegistry::instance() in the
+  /// Prometheus text format, instead of calling the response callback. Call
+  /// before start().
+  void set_metrics_path(const string& path) { m_metrics_path = path; }
+
   void start();
 
  private:
@@ -43,9 +70,26 @@ class HttpServer : noncopyable {
   void default_on_request(const TcpConnectionPtr& conn, Buffer* buf,
                           Timestamp receiveTime);
   void on_good_request(const TcpConnectionPtr&, const HttpRequest&);
+  void generate_response(const HttpRequest& req, HttpResponse* response);
+  void handle_request_in_pool(const TcpConnectionPtr& conn, uint64_t sequence,
+                              const std::shared_ptr<HttpRequest>& req);
+  void on_response_ready(const TcpConnectionPtr& conn, uint64_t sequence,
+                         Timestamp receive_time,
+                         const std::shared_ptr<HttpResponse>& response);
+  void send_response(const TcpConnectionPtr& conn, const HttpResponse& response,
+                     Timestamp receive_time);
+  void forward_request(const TcpConnectionPtr& conn, const HttpRequest& req);
+  void on_proxy_done(const TcpConnectionPtr& conn, bool keep_alive);
+  void resume_requests(const TcpConnectionPtr& conn);
 
+  // destroyed after the connections, which may cancel their exchanges
+  std::unique_ptr<HttpProxy> m_proxy;
   TcpServer m_tcp_server;
   ReponseCallback m_response_callback;
+  int m_num_handler_threads;
+  size_t m_max_pending_requests;
+  std::unique_ptr<WorkStealingPool> m_handler_pool;
+  string m_metrics_path;
 };
 
 }  // namespace flute
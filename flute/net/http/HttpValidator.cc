@@ -0,0 +1,133 @@
+#include <flute/net/http/HttpValidator.h>
+
+#include <flute/common/StringPiece.h>
+#include <flute/net/http/HttpRequest.h>
+#include <flute/net/http/HttpResponse.h>
+
+#include <ctype.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <algorithm>
+
+namespace flute {
+
+namespace {
+
+// W/"xyz" and "xyz" are the same under the weak comparison
+StringPiece opaque_tag(StringPiece etag) {
+  if (etag.starts_with("W/")) {
+    etag.remove_prefix(2);
+  }
+  return etag;
+}
+
+}  // namespace
+
+string to_http_date(time_t seconds) {
+  struct tm tm_time;
+  ::gmtime_r(&seconds, &tm_time);
+  char buf[32];
+  size_t len =
+      ::strftime(buf, sizeof buf, "%a, %d %b %Y %H:%M:%S GMT", &tm_time);
+  return string(buf, len);
+}
+
+bool parse_http_date(const string& date, time_t* seconds) {
+  // the obsolete forms must still be accepted, RFC 7231 7.1.1.1
+  static const char* const kFormats[] = {
+      "%a, %d %b %Y %H:%M:%S GMT",
+      // two-digit years from 69 are 19xx
+      "%A, %d-%b-%y %H:%M:%S GMT",
+      // asctime(), the day of the month padded with a space
+      "%a %b %e %H:%M:%S %Y",
+  };
+  for (const char* format : kFormats) {
+    struct tm tm_time;
+    mem_zero(&tm_time, sizeof tm_time);
+    const char* end = ::strptime(date.c_str(), format, &tm_time);
+    if (end != NULL && *end == '\0') {
+      *seconds = ::timegm(&tm_time);
+      return *seconds != -1;
+    }
+  }
+  return false;
+}
+
+string make_file_etag(ino_t inode, size_t size, Timestamp modify_time) {
+  char buf[64];
+  snprintf(buf, sizeof buf, "\"%llx-%zx-%llx\"",
+           static_cast<unsigned long long>(inode), size,
+           static_cast<unsigned long long>(
+               modify_time.micro_seconds_since_epoch()));
+  return buf;
+}
+
+bool etag_list_matches(const string& if_none_match, const string& etag) {
+  const char* p = if_none_match.data();
+  const char* end = p + if_none_match.size();
+  StringPiece target = opaque_tag(etag);
+  while (p < end) {
+    const char* comma = std::find(p, end, ',');
+    const char* begin = p;
+    const char* last = comma;
+    while (begin < last && isspace(*begin)) {
+      ++begin;
+    }
+    while (last > begin && isspace(*(last - 1))) {
+      --last;
+    }
+    StringPiece tag(begin, static_cast<int>(last - begin));
+    if (tag == "*" || (!tag.empty() && opaque_tag(tag) == target)) {
+      return true;
+    }
+    p = comma == end ? end : comma + 1;
+  }
+  return false;
+}
+
+bool if_range_matches(const string& if_range, const string& etag,
+                      const string& last_modified) {
+  if (if_range[0] == '"' || StringPiece(if_range).starts_with("W/")) {
+    // weak tags never match under the strong comparison
+    return !etag.empty() && etag[0] == '"' && if_range == etag;
+  }
+  time_t since = 0;
+  time_t modified = 0;
+  return !last_modified.empty() && parse_http_date(if_range, &since) &&
+         parse_http_date(last_modified, &modified) && since == modified;
+}
+
+namespace detail {
+
+bool handle_conditional_request(const HttpRequest& req, HttpResponse* resp) {
+  if ((req.method() != HttpRequest::kGet &&
+       req.method() != HttpRequest::kHead) ||
+      resp->status_code() != HttpResponse::k200Ok) {
+    return false;
+  }
+  bool not_modified = false;
+  const string if_none_match = req.get_header("If-None-Match");
+  if (!if_none_match.empty()) {
+    // If-Modified-Since is ignored when If-None-Match is present
+    const string& etag = resp->get_header("ETag");
+    not_modified = !etag.empty() && etag_list_matches(if_none_match, etag);
+  } else {
+    const string if_modified_since = req.get_header("If-Modified-Since");
+    const string& last_modified = resp->get_header("Last-Modified");
+    time_t since = 0;
+    time_t modified = 0;
+    not_modified = !if_modified_since.empty() && !last_modified.empty() &&
+                   parse_http_date(if_modified_since, &since) &&
+                   parse_http_date(last_modified, &modified) &&
+                   modified <= since;
+  }
+  if (not_modified) {
+    resp->set_not_modified();
+  }
+  return not_modified;
+}
+
+}  // namespace detail
+
+}  // namespace flute
@@ -0,0 +1,50 @@
+//
+// This is a public header file, it must only include public header files.
+
+#ifndef FLUTE_NET_HTTP_HTTPVALIDATOR_H
+#define FLUTE_NET_HTTP_HTTPVALIDATOR_H
+
+#include <flute/common/Timestamp.h>
+#include <flute/common/types.h>
+
+#include <sys/types.h>  // for ino_t
+
+namespace flute {
+
+class HttpRequest;
+class HttpResponse;
+
+/// Validators for conditional requests, RFC 7232.
+
+/// IMF-fixdate, e.g. "Sun, 06 Nov 1994 08:49:37 GMT"
+string to_http_date(time_t seconds);
+
+/// Parse an IMF-fixdate, or one of the obsolete RFC 850 and asctime() forms,
+/// e.g. "Sunday, 06-Nov-94 08:49:37 GMT" and "Sun Nov  6 08:49:37 1994".
+/// Return false if the date is malformed.
+bool parse_http_date(const string& date, time_t* seconds);
+
+/// A strong entity tag derived from file metadata. It changes whenever the
+/// file is replaced or modified.
+string make_file_etag(ino_t inode, size_t size, Timestamp modify_time);
+
+/// Whether the "If-None-Match:" list matches @c etag, with the weak
+/// comparison.
+bool etag_list_matches(const string& if_none_match, const string& etag);
+
+/// Whether the "If-Range:" validator still designates the representation
+/// identified by @c etag and @c last_modified, with the strong comparison.
+bool if_range_matches(const string& if_range, const string& etag,
+                      const string& last_modified);
+
+namespace detail {
+
+// Answer "304 Not Modified" when the client copy is still valid. Return true
+// if the response has become a 304.
+bool handle_conditional_request(const HttpRequest& req, HttpResponse* resp);
+
+}  // namespace detail
+
+}  // namespace flute
+
+#endif  // FLUTE_NET_HTTP_HTTPVALIDATOR_H
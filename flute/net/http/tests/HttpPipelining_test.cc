@@ -0,0 +1,314 @@
+#include <flute/common/CurrentThread.h>
+#include <flute/common/HdrHistogram.h>
+#include <flute/common/LogLine.h>
+#include <flute/common/Metrics.h>
+#include <flute/common/Thread.h>
+#include <flute/common/tests/TestUtil.h>
+#include <flute/net/Reactor.h>
+#include <flute/net/http/HttpContext.h>
+#include <flute/net/http/HttpRequest.h>
+#include <flute/net/http/HttpResponse.h>
+#include <flute/net/http/HttpServer.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+using namespace flute;
+
+namespace {
+
+using flute::test::expect;
+
+const uint16_t kInlinePort = 2090;
+// with a pool of handler threads
+const uint16_t kPoolPort = 2091;
+const size_t kMaxPending = 4;
+
+std::string g_file_path;
+std::string g_file_content;
+
+// seen by the callback of the handler pool
+std::atomic<int> g_reactor_tid(0);
+std::atomic<int> g_calls_in_reactor(0);
+std::atomic<int> g_calls_running(0);
+std::atomic<int> g_max_calls_running(0);
+
+// /file is sent by ZeroCopier, /close closes the connection, any other path
+// is echoed as the body.
+void on_request(const HttpRequest& req, HttpResponse* resp) {
+  resp->set_status_code(HttpResponse::k200Ok);
+  resp->set_status_message("OK");
+  if (req.path() == "/file") {
+    resp->set_content_type("image/jpeg");
+    resp->set_zerocopy(g_file_path);
+    return;
+  }
+  resp->set_content_type("text/plain");
+  resp->set_body(req.path());
+  if (req.path() == "/close") {
+    resp->set_close_conn(true);
+  }
+}
+
+// /slow takes a while. Counts the calls in the reactor thread and how many
+// run at once.
+void on_pool_request(const HttpRequest& req, HttpResponse* resp) {
+  if (CurrentThread::tid() == g_reactor_tid) {
+    ++g_calls_in_reactor;
+  }
+  int running = ++g_calls_running;
+  int max_running = g_max_calls_running;
+  while (running > max_running &&
+         !g_max_calls_running.compare_exchange_weak(max_running, running)) {
+  }
+  if (req.path() == "/slow") {
+    ::usleep(300 * 1000);
+  }
+  on_request(req, resp);
+  --g_calls_running;
+}
+
+std::string request_of(const std::string& path, bool close = false) {
+  return "GET " + path + " HTTP/1.1\r\nHost: test\r\n" +
+         (close ? "Connection: close\r\n" : "") + "\r\n";
+}
+
+// A blocking client, writing requests and reading the bodies of responses.
+class Client {
+ public:
+  explicit Client(uint16_t port)
+      : m_fd(::socket(AF_INET, SOCK_STREAM, 0)), m_closed(false) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    m_connected = ::connect(m_fd, reinterpret_cast<struct sockaddr*>(&addr),
+                            sizeof addr) == 0;
+  }
+  ~Client() { ::close(m_fd); }
+
+  bool connected() const { return m_connected; }
+
+  bool write(const std::string& bytes) {
+    return ::write(m_fd, bytes.data(), bytes.size()) ==
+           static_cast<ssize_t>(bytes.size());
+  }
+
+  // The bodies of the next num responses, fewer if the connection closes.
+  // A response without Content-Length ends with the connection.
+  std::vector<std::string> read_bodies(size_t num) {
+    std::vector<std::string> bodies;
+    while (bodies.size() < num) {
+      size_t head_end = m_input.find("\r\n\r\n");
+      size_t length = m_input.find("Content-Length: ");
+      if (head_end != std::string::npos && length != std::string::npos &&
+          length < head_end) {
+        size_t body = strtoul(m_input.c_str() + length + 16, NULL, 10);
+        if (m_input.size() >= head_end + 4 + body) {
+          bodies.push_back(m_input.substr(head_end + 4, body));
+          m_input.erase(0, head_end + 4 + body);
+          continue;
+        }
+      }
+      if (!read_more()) {
+        m_closed = true;
+        if (head_end != std::string::npos) {
+          bodies.push_back(m_input.substr(head_end + 4));
+          m_input.clear();
+        }
+        break;
+      }
+    }
+    return bodies;
+  }
+
+  // Everything until the server closes the connection.
+  std::string read_to_end() {
+    while (read_more()) {
+    }
+    m_closed = true;
+    std::string input;
+    input.swap(m_input);
+    return input;
+  }
+
+  // Whether the server has closed the connection, nothing more to read.
+  bool closed_by_peer() {
+    return m_input.empty() && (m_closed || !read_more());
+  }
+
+ private:
+  bool read_more() {
+    char buf[16 * 1024];
+    ssize_t n = ::read(m_fd, buf, sizeof buf);
+    if (n <= 0) {
+      return false;
+    }
+    m_input.append(buf, static_cast<size_t>(n));
+    return true;
+  }
+
+  int m_fd;
+  bool m_connected;
+  bool m_closed;
+  std::string m_input;
+};
+
+// The responses whose time to last byte has been recorded so far.
+int64_t last_bytes_recorded() {
+  HdrHistogram merged;
+  int64_t sum = 0;
+  MetricsRegistry::instance()
+      .latency("flute_http_time_to_last_byte_seconds", "")
+      ->snapshot(&merged, &sum);
+  return merged.total_count();
+}
+
+void test_pipelined(uint16_t port, const std::string& server) {
+  const int64_t recorded = last_bytes_recorded();
+  Client client(port);
+  expect(client.connected(), server + ": connect");
+
+  // one write, bytes of the zero-copied files in between
+  std::vector<std::string> paths = {"/a", "/file", "/b", "/file", "/c"};
+  std::string requests;
+  for (const std::string& path : paths) {
+    requests += request_of(path);
+  }
+  client.write(requests);
+  std::vector<std::string> bodies = client.read_bodies(paths.size());
+  bool in_order = bodies.size() == paths.size();
+  for (size_t i = 0; in_order && i < paths.size(); ++i) {
+    in_order = bodies[i] == (paths[i] == "/file" ? g_file_content : paths[i]);
+  }
+  expect(in_order, server + ": pipelined responses in order, files included");
+
+  // more requests than a connection may have pending in the handler pool
+  requests.clear();
+  paths.clear();
+  for (int i = 0; i < 20; ++i) {
+    paths.push_back("/many/" + std::to_string(i));
+    requests += request_of(paths.back());
+  }
+  client.write(requests);
+  expect(client.read_bodies(paths.size()) == paths,
+         server + ": a long pipeline answered");
+
+  // a request split over two writes, the next one behind it
+  client.write("GET /split HTTP/1.1\r\nHo");
+  ::usleep(50 * 1000);
+  client.write("st: test\r\n\r\n" + request_of("/after"));
+  expect(client.read_bodies(2) == std::vector<std::string>({"/split", "/after"}),
+         server + ": request split over reads");
+
+  // nothing is answered after a response closing the connection
+  client.write(request_of("/x") + request_of("/y", true) + request_of("/z"));
+  expect(client.read_bodies(3) == std::vector<std::string>({"/x", "/y"}),
+         server + ": requests after Connection: close dropped");
+  expect(client.closed_by_peer(), server + ": connection closed");
+
+  Client bad(port);
+  bad.write(request_of("/ok") + "BAD REQUEST\r\n\r\n" + request_of("/never"));
+  std::vector<std::string> answered = bad.read_bodies(3);
+  expect(answered.size() == 2 && answered[0] == "/ok" && bad.closed_by_peer(),
+         server + ": bad request answered in order, then closed");
+  // 5 + 20 + 2 + 2 + 2 responses
+  expect(last_bytes_recorded() - recorded == 31,
+         server + ": time to last byte of every pipelined response recorded");
+
+  const std::string k431 = "HTTP/1.1 431 ";
+  Client endless_line(port);
+  endless_line.write(std::string(HttpContext::kMaxHeadSize + 1, 'a'));
+  expect(endless_line.read_to_end().compare(0, k431.size(), k431) == 0,
+         server + ": a line longer than the head limit is a 431");
+  Client endless_headers(port);
+  std::string head = "GET /endless HTTP/1.1\r\n";
+  while (head.size() <= HttpContext::kMaxHeadSize) {
+    head += "X-Filler: 0123456789\r\n";
+  }
+  endless_headers.write(head);
+  expect(endless_headers.read_to_end().compare(0, k431.size(), k431) == 0,
+         server + ": header fields over the head limit are a 431");
+}
+
+// The callbacks run in the handler threads, side by side, and a slow one
+// holds up only the responses queued behind it.
+void test_handler_pool() {
+  Client slow(kPoolPort);
+  Client fast(kPoolPort);
+  Timestamp start = Timestamp::now();
+  slow.write(request_of("/slow") + request_of("/behind"));
+  ::usleep(50 * 1000);
+  fast.write(request_of("/fast"));
+  expect(fast.read_bodies(1) == std::vector<std::string>({"/fast"}) &&
+             second_difference(Timestamp::now(), start) < 0.25,
+         "handler pool: another connection answered during a slow callback");
+  expect(slow.read_bodies(2) ==
+             std::vector<std::string>({"/slow", "/behind"}),
+         "handler pool: a response waits for the slow one before it");
+
+  Client first(kPoolPort);
+  Client second(kPoolPort);
+  g_max_calls_running = 0;
+  start = Timestamp::now();
+  first.write(request_of("/slow"));
+  second.write(request_of("/slow"));
+  bool answered = first.read_bodies(1).size() == 1 &&
+                  second.read_bodies(1).size() == 1;
+  expect(answered && second_difference(Timestamp::now(), start) < 0.55 &&
+             g_max_calls_running == 2,
+         "handler pool: callbacks run concurrently");
+  expect(g_calls_in_reactor == 0,
+         "handler pool: no callback runs in the reactor thread");
+}
+
+void run_client(Reactor* reactor) {
+  ::usleep(100 * 1000);
+  test_pipelined(kInlinePort, "inline");
+  test_pipelined(kPoolPort, "handler pool");
+  test_handler_pool();
+  reactor->mark_quit();
+}
+
+}  // namespace
+
+int main() {
+  LogLine::set_log_level(LogLine::ERROR);
+  char path[] = "/tmp/HttpPipelining_test.XXXXXX";
+  int fd = ::mkstemp(path);
+  g_file_path = path;
+  for (int i = 0; g_file_content.size() < 200 * 1000; ++i) {
+    g_file_content += "line " + std::to_string(i) + " of the file\n";
+  }
+  bool written = ::write(fd, g_file_content.data(), g_file_content.size()) ==
+                 static_cast<ssize_t>(g_file_content.size());
+  ::close(fd);
+  expect(written, "file written");
+
+  Reactor reactor;
+  g_reactor_tid = CurrentThread::tid();
+  HttpServer inline_server(&reactor, InetAddress(kInlinePort, true), "inline");
+  inline_server.set_response_callback(on_request);
+  inline_server.start();
+  HttpServer pool_server(&reactor, InetAddress(kPoolPort, true), "pool");
+  pool_server.set_response_callback(on_pool_request);
+  pool_server.set_handler_thread_num(2, kMaxPending);
+  pool_server.start();
+
+  Thread client(std::bind(run_client, &reactor), "client");
+  client.start();
+  reactor.loop();
+  client.join();
+  ::unlink(path);
+  return flute::test::exit_code();
+}
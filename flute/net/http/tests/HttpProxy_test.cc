@@ -0,0 +1,297 @@
+#include <flute/common/LogLine.h>
+#include <flute/common/Thread.h>
+#include <flute/common/tests/TestUtil.h>
+#include <flute/net/Reactor.h>
+#include <flute/net/SocketsOps.h>
+#include <flute/net/TcpServer.h>
+#include <flute/net/http/HttpProxy.h>
+#include <flute/net/http/HttpRequest.h>
+#include <flute/net/http/HttpResponse.h>
+#include <flute/net/http/HttpServer.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+
+using namespace flute;
+
+namespace {
+
+using flute::test::expect;
+
+const uint16_t kProxyPort = 2080;
+const uint16_t kBackendPorts[] = {2081, 2082};
+// nothing listens there
+const uint16_t kDeadPort = 2083;
+
+std::atomic<int> g_backend_connections(0);
+
+// A stand-in backend: answers every request with its name and the path, a
+// chunked body for /api/chunked in HTTP/1.1, 103 Early Hints before the
+// response to /api/hints, nothing for /api/slow.
+class Backend {
+ public:
+  Backend(Reactor* reactor, uint16_t port, const string& name)
+      : m_server(reactor, InetAddress(port, true), name), m_name(name) {
+    m_server.set_conn_callback([](const TcpConnectionPtr& conn) {
+      if (conn->connected()) {
+        ++g_backend_connections;
+      }
+    });
+    m_server.set_message_callback(
+        std::bind(&Backend::on_message, this, _1, _2));
+    m_server.start();
+  }
+
+ private:
+  void on_message(const TcpConnectionPtr& conn, Buffer* buf) {
+    while (true) {
+      const char* begin = buf->peek_base();
+      const char* end = begin + buf->content_bytes_len();
+      const char* head_end = std::search(begin, end, "\r\n\r\n", "\r\n\r\n" + 4);
+      if (head_end == end) {
+        break;
+      }
+      const char* path = std::find(begin, head_end, ' ') + 1;
+      const char* path_end = std::find(path, head_end, ' ');
+      string target(path, path_end);
+      bool http10 = std::equal(path_end, path_end + 9, " HTTP/1.0");
+      buf->retrieve_until(head_end + 4);
+      string response;
+      if (target == "/api/slow") {
+        continue;
+      } else if (target == "/api/chunked" && !http10) {
+        response =
+            "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+            "5\r\nhello\r\n7;x=y\r\n, world\r\n0\r\nX-Trailer: 1\r\n\r\n";
+      } else {
+        if (target == "/api/hints") {
+          conn->send_string_piece(
+              "HTTP/1.1 103 Early Hints\r\n"
+              "Link: </style.css>; rel=preload\r\n\r\n");
+        }
+        string body = m_name + " " + target;
+        char length[64];
+        snprintf(length, sizeof length, "Content-Length: %zu\r\n\r\n",
+                 body.size());
+        response = "HTTP/1.1 200 OK\r\nConnection: keep-alive\r\n";
+        response += length;
+        response += body;
+      }
+      conn->send_string_piece(response);
+    }
+  }
+
+  TcpServer m_server;
+  const string m_name;
+};
+
+// A blocking client, one keep-alive connection.
+class Client {
+ public:
+  Client() : m_fd(::socket(AF_INET, SOCK_STREAM, 0)) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kProxyPort);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    m_connected = ::connect(m_fd, reinterpret_cast<struct sockaddr*>(&addr),
+                            sizeof addr) == 0;
+  }
+  ~Client() { ::close(m_fd); }
+
+  bool connected() const { return m_connected; }
+
+  // The response, read until it is complete by end_marker or the length.
+  std::string get(const std::string& path, const std::string& end_marker = "") {
+    return send("GET " + path + " HTTP/1.1\r\nHost: test\r\n\r\n",
+                end_marker);
+  }
+
+  // The response to request, a response without a length ends with the
+  // connection.
+  std::string send(const std::string& request,
+                   const std::string& end_marker = "") {
+    if (::write(m_fd, request.data(), request.size()) !=
+        static_cast<ssize_t>(request.size())) {
+      return "";
+    }
+    while (!complete(end_marker)) {
+      char buf[4096];
+      ssize_t n = ::read(m_fd, buf, sizeof buf);
+      if (n <= 0) {
+        break;
+      }
+      m_input.append(buf, n);
+    }
+    std::string response;
+    response.swap(m_input);
+    return response;
+  }
+
+ private:
+  bool complete(const std::string& end_marker) const {
+    size_t head_end = m_input.find("\r\n\r\n");
+    if (head_end == std::string::npos) {
+      return false;
+    }
+    if (!end_marker.empty()) {
+      return m_input.size() >= end_marker.size() &&
+             m_input.compare(m_input.size() - end_marker.size(),
+                             end_marker.size(), end_marker) == 0;
+    }
+    size_t length = m_input.find("Content-Length: ");
+    if (length == std::string::npos || length > head_end) {
+      return false;
+    }
+    size_t body = strtoul(m_input.c_str() + length + 16, NULL, 10);
+    return m_input.size() >= head_end + 4 + body;
+  }
+
+  int m_fd;
+  bool m_connected;
+  std::string m_input;
+};
+
+// /time is answered, any other path is a 404 closing the connection.
+void on_local_request(const HttpRequest& req, HttpResponse* resp) {
+  if (req.path() == "/time") {
+    resp->set_status_code(HttpResponse::k200Ok);
+    resp->set_status_message("OK");
+    resp->set_body("time");
+  } else {
+    resp->set_status_code(HttpResponse::k404NotFound);
+    resp->set_status_message("Not Found");
+    resp->set_close_conn(true);
+  }
+}
+
+bool ends_with(const std::string& s, const std::string& suffix) {
+  return s.size() >= suffix.size() &&
+         s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+bool contains(const std::string& s, const std::string& part) {
+  return s.find(part) != std::string::npos;
+}
+
+void run_client(Reactor* reactor) {
+  // the warm connections
+  ::usleep(200 * 1000);
+  Client client;
+  expect(client.connected(), "connect to the proxy");
+
+  std::string first = client.get("/api/a?x=1");
+  std::string second = client.get("/api/b");
+  expect(contains(first, "200 OK") && contains(second, "200 OK"),
+         "proxied requests answered on one client connection");
+  bool round_robin =
+      (ends_with(first, "backend0 /api/a?x=1") &&
+       ends_with(second, "backend1 /api/b")) ||
+      (ends_with(first, "backend1 /api/a?x=1") &&
+       ends_with(second, "backend0 /api/b"));
+  expect(round_robin, "round-robin over the backends, with the query");
+  expect(contains(first, "Connection: Keep-Alive"),
+         "the client connection is kept alive");
+
+  std::string chunked = client.get("/api/chunked", "0\r\nX-Trailer: 1\r\n\r\n");
+  expect(contains(chunked, "Transfer-Encoding: chunked") &&
+             contains(chunked, "5\r\nhello\r\n7;x=y\r\n, world\r\n"),
+         "chunked body relayed as it is");
+
+  Client http10;
+  std::string unchunked = http10.send(
+      "GET /api/chunked HTTP/1.0\r\nConnection: Keep-Alive\r\n\r\n");
+  expect(contains(unchunked, "200 OK") &&
+             !contains(unchunked, "Transfer-Encoding: chunked") &&
+             ends_with(unchunked, " /api/chunked"),
+         "an HTTP/1.0 request goes to the backend as HTTP/1.0");
+
+  std::string hints = client.get("/api/hints", " /api/hints");
+  size_t early = hints.find("HTTP/1.1 103 Early Hints\r\n");
+  expect(early == 0 && contains(hints, "Link: </style.css>; rel=preload") &&
+             hints.find("200 OK") > early,
+         "an interim 1xx response relayed before the final one");
+  std::string http10_hints = http10.send(
+      "GET /api/hints HTTP/1.0\r\nConnection: Keep-Alive\r\n\r\n");
+  expect(!contains(http10_hints, "103") && contains(http10_hints, "200 OK"),
+         "no 1xx response for an HTTP/1.0 client");
+  std::string next = client.get("/api/next");
+  expect(contains(next, "200 OK") && ends_with(next, " /api/next"),
+         "the backend connection stays in step after a 1xx");
+
+  int connections = g_backend_connections;
+  for (int i = 0; i < 10; ++i) {
+    client.get("/api/again");
+  }
+  expect(g_backend_connections == connections,
+         "backend connections are kept alive and reused");
+
+  std::string dead = client.get("/dead");
+  expect(contains(dead, "502 Bad Gateway"), "unreachable backend is a 502");
+
+  // unhealthy by now, its lease fails at once, before forward() returns
+  Client pipelined;
+  std::string bad_gateway = pipelined.send(
+      "GET /dead HTTP/1.1\r\nHost: test\r\n\r\nGET /time HTTP/1.1\r\nHo");
+  ::usleep(50 * 1000);
+  std::string local_time = pipelined.send("st: test\r\n\r\n");
+  expect(contains(bad_gateway, "502 Bad Gateway") &&
+             contains(local_time, "200 OK") && ends_with(local_time, "time"),
+         "a request split over reads behind a 502 answered");
+
+  std::string local = client.get("/local");
+  expect(contains(local, "404"), "requests of no route go to the callback");
+
+  // the 404 has closed the connection
+  Client waiter;
+  std::string slow = waiter.get("/api/slow");
+  expect(contains(slow, "502 Bad Gateway"), "a backend not answering is a 502");
+  std::string after = waiter.get("/api/after");
+  expect(contains(after, "200 OK") && ends_with(after, " /api/after"),
+         "the client connection goes on after the timeout");
+
+  Client poster;
+  std::string posted = poster.send(
+      "POST /api/post HTTP/1.1\r\nHost: test\r\nContent-Length: 5\r\n\r\n"
+      "hello");
+  expect(contains(posted, "501 Not Implemented") &&
+             contains(posted, "Connection: close"),
+         "a request with a body is answered without the backend, then closed");
+
+  reactor->mark_quit();
+}
+
+}  // namespace
+
+int main() {
+  LogLine::set_log_level(LogLine::ERROR);
+  Reactor reactor;
+  Backend backend0(&reactor, kBackendPorts[0], "backend0");
+  Backend backend1(&reactor, kBackendPorts[1], "backend1");
+
+  std::unique_ptr<HttpProxy> proxy(new HttpProxy);
+  proxy->add_route("/api/", {InetAddress(kBackendPorts[0], true),
+                             InetAddress(kBackendPorts[1], true)});
+  proxy->add_route("/dead", {InetAddress(kDeadPort, true)});
+  proxy->set_response_timeout(0.3);
+
+  HttpServer server(&reactor, InetAddress(kProxyPort, true), "proxy");
+  server.set_thread_num(1);
+  server.set_response_callback(on_local_request);
+  server.set_proxy(std::move(proxy));
+  server.start();
+
+  Thread client(std::bind(run_client, &reactor), "client");
+  client.start();
+  reactor.loop();
+  client.join();
+  return flute::test::exit_code();
+}
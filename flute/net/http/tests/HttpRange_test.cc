@@ -0,0 +1,47 @@
+#include <flute/net/http/HttpRange.h>
+
+#include <stdio.h>
+
+using namespace flute;
+
+int g_failures = 0;
+
+void expect(const string& header, size_t size, RangeParseResult expected,
+            const string& expected_ranges) {
+  std::vector<ByteRange> ranges;
+  RangeParseResult result = parse_byte_ranges(header, size, &ranges);
+  string got;
+  for (const ByteRange& range : ranges) {
+    got += content_range_of(range, size) + ";";
+  }
+  bool ok = result == expected && got == expected_ranges;
+  if (!ok) {
+    ++g_failures;
+  }
+  printf("%s [%s] size=%zu -> %d %s\n", ok ? "OK  " : "FAIL", header.c_str(),
+         size, result, got.c_str());
+}
+
+int main() {
+  printf("================HttpRange Test================\n");
+  expect("bytes=0-99", 1000, kRangeSatisfiable, "bytes 0-99/1000;");
+  expect("bytes=900-", 1000, kRangeSatisfiable, "bytes 900-999/1000;");
+  expect("bytes=-100", 1000, kRangeSatisfiable, "bytes 900-999/1000;");
+  expect("bytes=-5000", 1000, kRangeSatisfiable, "bytes 0-999/1000;");
+  expect("bytes=500-5000", 1000, kRangeSatisfiable, "bytes 500-999/1000;");
+  expect("bytes= 0-0 , 10-19", 1000, kRangeSatisfiable,
+         "bytes 0-0/1000;bytes 10-19/1000;");
+  expect("bytes=1000-", 1000, kRangeNotSatisfiable, "");
+  expect("bytes=-0", 1000, kRangeNotSatisfiable, "");
+  expect("bytes=2000-3000,10-19", 1000, kRangeSatisfiable,
+         "bytes 10-19/1000;");
+  expect("bytes=20-10", 1000, kRangeNone, "");
+  expect("bytes=abc", 1000, kRangeNone, "");
+  expect("items=0-10", 1000, kRangeNone, "");
+  expect("bytes=", 1000, kRangeNone, "");
+  expect("bytes=0-1,2-3,4-5,6-7,8-9,10-11,12-13,14-15,16-17,18-19,20-21,22-23,"
+         "24-25,26-27,28-29,30-31,32-33",
+         1000, kRangeNone, "");
+  printf("%d failure(s)\n", g_failures);
+  return g_failures == 0 ? 0 : 1;
+}
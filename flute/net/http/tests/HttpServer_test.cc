@@ -110,10 +110,17 @@ int main(int argc, char* argv[]) {
     // argv[4] as chunk KB
     ZeroCopier::set_chunk_size(1024 * atoi(argv[4]));
   }
+  int num_handler_threads = 0;
+  if (argc > 5) {
+    // argv[5] as threads running generate_response
+    num_handler_threads = atoi(argv[5]);
+  }
   Reactor reactor;
   HttpServer server(&reactor, InetAddress(8000), "dummy");
   server.set_response_callback(generate_response);
   server.set_thread_num(num_threads);
+  server.set_handler_thread_num(num_handler_threads);
+  server.set_metrics_path("/metrics");
   server.start();
   reactor.loop();
 }
@@ -0,0 +1,169 @@
+#include <flute/common/tests/TestUtil.h>
+#include <flute/net/Buffer.h>
+#include <flute/net/http/HttpRequest.h>
+#include <flute/net/http/HttpResponse.h>
+#include <flute/net/http/HttpValidator.h>
+
+#include <string.h>
+
+#include <string>
+
+using namespace flute;
+
+namespace {
+
+using flute::test::expect;
+
+const char kEtag[] = "\"5f-1a2b\"";
+const char kLastModified[] = "Sun, 06 Nov 1994 08:49:37 GMT";
+const time_t kLastModifiedSeconds = 784111777;
+
+void test_etag_list() {
+  expect(etag_list_matches(kEtag, kEtag), "the same strong tag");
+  expect(etag_list_matches("W/\"5f-1a2b\"", kEtag),
+         "a weak tag matches under the weak comparison");
+  expect(etag_list_matches(kEtag, "W/\"5f-1a2b\""),
+         "a weak entity tag matches a strong one");
+  expect(!etag_list_matches("\"5f-1a2c\"", kEtag), "another tag");
+  expect(etag_list_matches("*", kEtag), "* matches any tag");
+  expect(etag_list_matches("\"a\",\"5f-1a2b\"", kEtag), "a list");
+  expect(etag_list_matches(" \"a\" ,  W/\"5f-1a2b\"  , \"b\"", kEtag),
+         "a list with spaces");
+  expect(!etag_list_matches("\"a\", \"b\"", kEtag), "a list without the tag");
+  expect(!etag_list_matches(" , ,", kEtag), "a list of nothing");
+}
+
+void test_if_range() {
+  expect(if_range_matches(kEtag, kEtag, kLastModified), "the same strong tag");
+  expect(!if_range_matches("W/\"5f-1a2b\"", kEtag, kLastModified),
+         "a weak tag never matches under the strong comparison");
+  expect(!if_range_matches(kEtag, "W/\"5f-1a2b\"", kLastModified),
+         "nor does a weak entity tag");
+  expect(!if_range_matches("\"5f-1a2c\"", kEtag, kLastModified),
+         "another tag");
+  expect(if_range_matches(kLastModified, kEtag, kLastModified),
+         "the Last-Modified date");
+  expect(!if_range_matches("Sun, 06 Nov 1994 08:49:38 GMT", kEtag,
+                           kLastModified),
+         "another date");
+  expect(!if_range_matches(kLastModified, kEtag, ""),
+         "a date without Last-Modified");
+}
+
+void test_http_date() {
+  time_t seconds = 0;
+  expect(parse_http_date(kLastModified, &seconds) &&
+             seconds == kLastModifiedSeconds,
+         "IMF-fixdate parsed");
+  expect(to_http_date(kLastModifiedSeconds) == kLastModified,
+         "IMF-fixdate formatted");
+  const time_t times[] = {0, 951782400, 1700000000, 2147483647};
+  bool round_trip = true;
+  for (time_t t : times) {
+    round_trip = round_trip && parse_http_date(to_http_date(t), &seconds) &&
+                 seconds == t;
+  }
+  expect(round_trip, "to_http_date() parsed back");
+  seconds = 0;
+  expect(parse_http_date("Sunday, 06-Nov-94 08:49:37 GMT", &seconds) &&
+             seconds == kLastModifiedSeconds,
+         "RFC 850 date parsed");
+  seconds = 0;
+  expect(parse_http_date("Sun Nov  6 08:49:37 1994", &seconds) &&
+             seconds == kLastModifiedSeconds,
+         "asctime() date parsed");
+  expect(!parse_http_date("Sun, 06 Nov 1994 08:49:37", &seconds) &&
+             !parse_http_date("Sun, 06 Nov 1994 08:49:37 GMT junk", &seconds) &&
+             !parse_http_date("yesterday", &seconds) &&
+             !parse_http_date("", &seconds),
+         "malformed dates rejected");
+}
+
+HttpRequest make_request(const char* method, const char* field,
+                         const std::string& value) {
+  HttpRequest req;
+  req.set_method(method, method + strlen(method));
+  req.setVersion(HttpRequest::kHttp11);
+  std::string header = std::string(field) + ": " + value;
+  req.add_header(header.data(), header.data() + strlen(field),
+                 header.data() + header.size());
+  return req;
+}
+
+// A keep-alive 200 response with validators.
+void make_response(HttpResponse* resp) {
+  resp->set_status_code(HttpResponse::k200Ok);
+  resp->set_status_message("OK");
+  resp->set_content_type("text/plain");
+  resp->add_header("ETag", kEtag);
+  resp->add_header("Last-Modified", kLastModified);
+  resp->set_body("the representation\n");
+}
+
+bool conditional(const HttpRequest& req, std::string* wire) {
+  HttpResponse resp(false);
+  make_response(&resp);
+  bool not_modified = detail::handle_conditional_request(req, &resp);
+  Buffer buf;
+  resp.append_to_buffer(&buf);
+  wire->assign(buf.peek_base(), buf.content_bytes_len());
+  return not_modified;
+}
+
+void test_conditional_request() {
+  std::string wire;
+  bool not_modified =
+      conditional(make_request("GET", "If-None-Match", kEtag), &wire);
+  size_t head_end = wire.find("\r\n\r\n");
+  expect(not_modified && wire.compare(0, 13, "HTTP/1.1 304 ") == 0,
+         "If-None-Match of the tag is a 304");
+  expect(head_end != std::string::npos && head_end + 4 == wire.size(),
+         "304 has no body");
+  expect(wire.find("Content-Length") == std::string::npos,
+         "304 has no Content-Length");
+  expect(wire.find("Connection: Keep-Alive\r\n") != std::string::npos,
+         "304 keeps the connection alive");
+  expect(wire.find(std::string("ETag: ") + kEtag) != std::string::npos,
+         "304 keeps the validators");
+
+  std::string list = std::string("W/\"x\", ") + kEtag;
+  expect(conditional(make_request("HEAD", "If-None-Match", list), &wire),
+         "HEAD with a list holding the tag is a 304");
+  expect(!conditional(make_request("GET", "If-None-Match", "\"x\""), &wire) &&
+             wire.compare(0, 13, "HTTP/1.1 200 ") == 0 &&
+             wire.find("Content-Length: 19\r\n") != std::string::npos,
+         "another tag is the 200");
+  expect(!conditional(make_request("POST", "If-None-Match", kEtag), &wire),
+         "POST is never a 304");
+
+  expect(conditional(make_request("GET", "If-Modified-Since", kLastModified),
+                     &wire),
+         "If-Modified-Since of Last-Modified is a 304");
+  expect(conditional(make_request("GET", "If-Modified-Since",
+                                  "Sun Nov  6 08:49:38 1994"),
+                     &wire),
+         "If-Modified-Since later, as asctime(), is a 304");
+  expect(!conditional(make_request("GET", "If-Modified-Since",
+                                   "Sun, 06 Nov 1994 08:49:36 GMT"),
+                      &wire),
+         "If-Modified-Since earlier is the 200");
+  expect(!conditional(make_request("GET", "If-Modified-Since", "not a date"),
+                      &wire),
+         "a malformed If-Modified-Since is the 200");
+
+  HttpRequest both = make_request("GET", "If-None-Match", "\"x\"");
+  std::string since = std::string("If-Modified-Since: ") + kLastModified;
+  both.add_header(since.data(), since.data() + 17, since.data() + since.size());
+  expect(!conditional(both, &wire),
+         "If-Modified-Since ignored with If-None-Match");
+}
+
+}  // namespace
+
+int main() {
+  test_etag_list();
+  test_if_range();
+  test_http_date();
+  test_conditional_request();
+  return flute::test::exit_code();
+}
@@ -0,0 +1,290 @@
+#include <flute/common/AsyncLogging.h>
+#include <flute/common/HdrHistogram.h>
+#include <flute/common/LogLine.h>
+#include <flute/common/LogStream.h>
+#include <flute/common/TaskDeque.h>
+#include <flute/net/Buffer.h>
+#include <flute/net/Reactor.h>
+#include <flute/net/ReactorThread.h>
+#include <flute/net/http/HttpContext.h>
+
+#include <glob.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <functional>
+#include <vector>
+
+// Usage: Micro_bench [filter] [min_seconds]
+// Times the hot paths of the core data structures, those whose name contains
+// filter if given. Each benchmark runs for at least min_seconds, 0.2 by
+// default, and prints one JSON object per line:
+//   {"benchmark":"buffer_append_64","iterations":4194304,"ns_per_op":5.1,
+//    "ops_per_sec":196078431.4}
+// with "p50_ns", "p99_ns" and "p999_ns" too for the latency ones, so that the
+// results of each commit can be collected and compared by a script. The
+// microbench target runs them all.
+
+using namespace flute;
+
+namespace {
+
+volatile int64_t g_sink = 0;
+const char* g_filter = "";
+double g_min_seconds = 0.2;
+
+int64_t now_ns() {
+  struct timespec ts;
+  ::clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000 * 1000 * 1000 + ts.tv_nsec;
+}
+
+bool selected(const char* name) { return strstr(name, g_filter) != NULL; }
+
+void print_result(const char* name, int64_t iterations, int64_t elapsed_ns,
+                  const HdrHistogram* latencies) {
+  double ns_per_op =
+      static_cast<double>(elapsed_ns) / static_cast<double>(iterations);
+  printf("{\"benchmark\":\"%s\",\"iterations\":%lld,\"ns_per_op\":%.2f,"
+         "\"ops_per_sec\":%.1f",
+         name, static_cast<long long>(iterations), ns_per_op, 1e9 / ns_per_op);
+  if (latencies) {
+    printf(",\"p50_ns\":%lld,\"p99_ns\":%lld,\"p999_ns\":%lld",
+           static_cast<long long>(latencies->value_at_percentile(50)),
+           static_cast<long long>(latencies->value_at_percentile(99)),
+           static_cast<long long>(latencies->value_at_percentile(99.9)));
+  }
+  printf("}\n");
+  fflush(stdout);
+}
+
+// Runs batch(n) with n doubling until a batch takes min_seconds.
+void run(const char* name, const std::function<void(int64_t)>& batch) {
+  if (!selected(name)) {
+    return;
+  }
+  const int64_t min_ns = static_cast<int64_t>(g_min_seconds * 1e9);
+  int64_t iterations = 1;
+  while (true) {
+    int64_t start = now_ns();
+    batch(iterations);
+    int64_t elapsed = now_ns() - start;
+    if (elapsed >= min_ns || iterations >= (static_cast<int64_t>(1) << 40)) {
+      print_result(name, iterations, elapsed, NULL);
+      return;
+    }
+    iterations *= 2;
+  }
+}
+
+void bench_buffer() {
+  const string chunk(64, 'x');
+  run("buffer_append_64", [&](int64_t n) {
+    Buffer buf;
+    for (int64_t i = 0; i < n; ++i) {
+      buf.append(chunk.data(), chunk.size());
+      if (buf.content_bytes_len() >= 64 * 1024) {
+        buf.retrieve_all();
+      }
+    }
+    g_sink += static_cast<int64_t>(buf.content_bytes_len());
+  });
+  run("buffer_append_retrieve_64", [&](int64_t n) {
+    Buffer buf;
+    for (int64_t i = 0; i < n; ++i) {
+      buf.append(chunk.data(), chunk.size());
+      buf.retrieve(chunk.size());
+    }
+    g_sink += static_cast<int64_t>(buf.content_bytes_len());
+  });
+
+  // the lines of a typical request head, found one after the other
+  string head = "GET /index.html HTTP/1.1\r\n";
+  for (int i = 0; i < 10; ++i) {
+    head += "X-Header-" + std::to_string(i) + ": some value of a header\r\n";
+  }
+  head += "\r\n";
+  Buffer buf;
+  buf.append(head.data(), head.size());
+  run("buffer_find_crlf", [&](int64_t n) {
+    const char* start = buf.peek_base();
+    for (int64_t i = 0; i < n; ++i) {
+      const char* crlf = buf.find_CRLF(start);
+      if (crlf) {
+        start = crlf + 2;
+      } else {
+        start = buf.peek_base();
+      }
+      g_sink += start - buf.peek_base();
+    }
+  });
+}
+
+void bench_log_stream() {
+  LogStream stream;
+  run("log_stream_format", [&](int64_t n) {
+    for (int64_t i = 0; i < n; ++i) {
+      stream << "request " << i << " took " << static_cast<double>(i) * 0.001
+             << " ms, " << 1000000007LL * i << " bytes";
+      g_sink += stream.m_buffer.length();
+      stream.m_buffer.reset_cur();
+    }
+  });
+}
+
+void bench_async_logging() {
+  if (!selected("async_logging_append")) {
+    return;
+  }
+  char dir[] = "/tmp/Micro_bench.XXXXXX";
+  if (::mkdtemp(dir) == NULL) {
+    perror("temporary directory");
+    return;
+  }
+  const string line =
+      "20260101 00:00:00.000000 12345 INFO Micro_bench line of about a "
+      "hundred bytes - Micro_bench.cc:1\n";
+  {
+    AsyncLogging logging(string(dir) + "/Micro_bench", 1024 * 1024 * 1024);
+    logging.start();
+    // the front end only, the backend writes on meanwhile
+    run("async_logging_append", [&](int64_t n) {
+      for (int64_t i = 0; i < n; ++i) {
+        logging.append(line.data(), static_cast<int>(line.size()));
+      }
+    });
+  }
+  glob_t files;
+  if (::glob((string(dir) + "/*").c_str(), 0, NULL, &files) == 0) {
+    for (size_t i = 0; i < files.gl_pathc; ++i) {
+      ::unlink(files.gl_pathv[i]);
+    }
+    ::globfree(&files);
+  }
+  ::rmdir(dir);
+}
+
+void bench_task_deque() {
+  if (!selected("task_deque_push_take")) {
+    return;
+  }
+  TaskDeque deque("Micro_bench");
+  deque.set_max_deque_size(1024);
+  deque.start(1);
+  std::atomic<int64_t> taken(0);
+  // from the first push to the last task run by the worker
+  run("task_deque_push_take", [&](int64_t n) {
+    taken = 0;
+    for (int64_t i = 0; i < n; ++i) {
+      deque.push_task_back([&taken]() { ++taken; });
+    }
+    while (taken.load() < n) {
+      ::sched_yield();
+    }
+  });
+  deque.stop();
+}
+
+void bench_timer_queue() {
+  if (!selected("timer_queue_add_cancel")) {
+    return;
+  }
+  // not looping, the timers are added and canceled inline in this thread
+  Reactor reactor;
+  std::vector<TimerId> timers;
+  run("timer_queue_add_cancel", [&](int64_t n) {
+    const int kPending = 64;
+    Timestamp now = Timestamp::now();
+    for (int64_t i = 0; i < n; ++i) {
+      timers.push_back(reactor.run_at(
+          add_second(now, 10.0 + static_cast<double>(i % 1000) / 1000), [] {}));
+      if (timers.size() == kPending) {
+        for (const TimerId& timer : timers) {
+          reactor.remove(timer);
+        }
+        timers.clear();
+      }
+    }
+    for (const TimerId& timer : timers) {
+      reactor.remove(timer);
+    }
+    timers.clear();
+  });
+}
+
+void bench_queue_in_reactor() {
+  const char* kName = "queue_in_reactor_latency";
+  if (!selected(kName)) {
+    return;
+  }
+  ReactorThread thread(ReactorThread::ThreadInitFunctor(), "Micro_bench");
+  Reactor* reactor = thread.start_reactor();
+  // one task at a time, from the queueing to the task run in the loop thread
+  HdrHistogram latencies;
+  std::atomic<int64_t> done(0);
+  const int64_t min_ns = static_cast<int64_t>(g_min_seconds * 1e9);
+  int64_t iterations = 0;
+  int64_t start = now_ns();
+  while (now_ns() - start < min_ns) {
+    int64_t queued = now_ns();
+    reactor->queue_in_reactor([&latencies, &done, queued]() {
+      latencies.record(now_ns() - queued);
+      done.store(1, std::memory_order_release);
+    });
+    while (done.load(std::memory_order_acquire) == 0) {
+      ::sched_yield();
+    }
+    done.store(0, std::memory_order_relaxed);
+    ++iterations;
+  }
+  print_result(kName, iterations, now_ns() - start, &latencies);
+}
+
+void bench_http_context() {
+  const string request =
+      "GET /index.html?user=flute&page=2 HTTP/1.1\r\n"
+      "Host: www.example.com\r\n"
+      "User-Agent: Mozilla/5.0 (X11; Linux x86_64) Gecko/20100101 Firefox/120.0\r\n"
+      "Accept: text/html,application/xhtml+xml,application/xml;q=0.9\r\n"
+      "Accept-Language: en-US,en;q=0.5\r\n"
+      "Accept-Encoding: gzip, deflate\r\n"
+      "Connection: keep-alive\r\n"
+      "\r\n";
+  // the request is copied into the buffer each time, as read from a socket
+  run("http_parse_request", [&](int64_t n) {
+    Buffer buf;
+    HttpContext context;
+    Timestamp now = Timestamp::now();
+    for (int64_t i = 0; i < n; ++i) {
+      buf.append(request.data(), request.size());
+      context.parse_request(&buf, now);
+      g_sink += context.got_all();
+      context.reset();
+    }
+  });
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  LogLine::set_log_level(LogLine::ERROR);
+  if (argc > 1) {
+    g_filter = argv[1];
+  }
+  if (argc > 2) {
+    g_min_seconds = atof(argv[2]);
+  }
+  bench_buffer();
+  bench_log_stream();
+  bench_async_logging();
+  bench_task_deque();
+  bench_timer_queue();
+  bench_queue_in_reactor();
+  bench_http_context();
+  return 0;
+}
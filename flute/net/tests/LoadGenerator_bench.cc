@@ -0,0 +1,471 @@
+#include <flute/common/CountdownLatch.h>
+#include <flute/common/HdrHistogram.h>
+#include <flute/common/LogLine.h>
+#include <flute/net/Reactor.h>
+#include <flute/net/ReactorThreadPool.h>
+#include <flute/net/TcpClient.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <vector>
+
+// Usage: LoadGenerator_bench [-m http|echo] [-a address] [-p port] [-u path]
+//                            [-c connections] [-t threads] [-d seconds]
+//                            [-r rate] [-k pipeline] [-C] [-s message_size]
+//                            [-i expected_interval_us] [-n name]
+//
+// Keeps connections to an HTTP or echo server busy for a while and reports
+// the throughput and the latency percentiles, ending with one RESULT line.
+//
+// Closed loop, the default, sends the next request of a connection once a
+// response comes back, keeping -k requests in flight. A stall then holds back
+// the requests that would have been sent meanwhile, which is corrected as
+// HdrHistogram does, with -i or the median as the expected interval.
+//
+// Open loop, -r requests per second over all connections, sends on a fixed
+// schedule whatever the responses. A request waiting for a free pipeline slot
+// counts from the time it was due, so no correction is needed.
+//
+// -C sends "Connection: close" and connects again for every HTTP request.
+// See load_scenarios.sh and the bench_* targets for the standard scenarios.
+
+using namespace flute;
+
+namespace {
+
+struct Options {
+  Options()
+      : protocol("http"),
+        address("127.0.0.1"),
+        port(8000),
+        path("/time"),
+        connections(16),
+        threads(1),
+        seconds(10.0),
+        rate(0.0),
+        pipeline(1),
+        keep_alive(true),
+        message_size(64),
+        expected_interval_us(0) {}
+
+  string protocol;
+  string address;
+  uint16_t port;
+  string path;
+  int connections;
+  int threads;
+  double seconds;
+  double rate;
+  int pipeline;
+  bool keep_alive;
+  int message_size;
+  int64_t expected_interval_us;
+  string name;
+};
+
+Options g_options;
+string g_request;
+std::atomic<bool> g_running(false);
+std::atomic<int64_t> g_completed(0);
+std::atomic<int64_t> g_errors(0);
+std::atomic<int64_t> g_non_2xx(0);
+std::atomic<int64_t> g_bytes_read(0);
+// from the time a request was due, and from the time it was sent
+LatencyHistogram g_response_time;
+LatencyHistogram g_service_time;
+
+bool is_http() { return g_options.protocol == "http"; }
+
+bool open_loop() { return g_options.rate > 0; }
+
+// One connection and its requests in flight, in the thread of its reactor.
+class Session : noncopyable {
+ public:
+  Session(Reactor* reactor, const InetAddress& server_addr, int index)
+      : m_reactor(reactor),
+        m_client(reactor, server_addr, "LoadGenerator"),
+        m_index(index),
+        m_interval(0.0),
+        m_response_left(0),
+        m_in_response(false),
+        m_until_close(false),
+        m_status(0) {
+    m_client.set_conn_callback(std::bind(&Session::on_connection, this, _1));
+    m_client.set_msg_callback(
+        std::bind(&Session::on_message, this, _1, _2, _3));
+    // a closed connection is connected again, as -C needs
+    m_client.enable_retry();
+  }
+
+  void start() {
+    if (open_loop()) {
+      // the connections take turns over one interval
+      m_interval = g_options.connections / g_options.rate;
+      m_next_due = add_second(Timestamp::now(),
+                              m_interval * m_index / g_options.connections);
+      m_tick = m_reactor->run_at(m_next_due, std::bind(&Session::on_tick, this));
+    }
+    m_client.connect();
+  }
+
+  // Left alive afterwards, the connection may still call back.
+  void stop() {
+    m_reactor->remove(m_tick);
+    m_client.stop();
+    if (m_conn) {
+      m_conn->force_close();
+    }
+  }
+
+ private:
+  struct Request {
+    Timestamp due;
+    Timestamp sent;
+  };
+
+  void on_connection(const TcpConnectionPtr& conn) {
+    if (conn->connected()) {
+      conn->set_tcp_nodelay(true);
+      m_conn = conn;
+      fill_pipeline();
+      return;
+    }
+    m_conn.reset();
+    if (m_until_close && !m_in_flight.empty()) {
+      // the body of a response without Content-Length ends here
+      complete_one();
+    }
+    if (!m_in_flight.empty() && g_running) {
+      g_errors += static_cast<int64_t>(m_in_flight.size());
+    }
+    m_in_flight.clear();
+    m_in_response = false;
+    m_until_close = false;
+    m_response_left = 0;
+  }
+
+  void on_message(const TcpConnectionPtr&, Buffer* buf, Timestamp) {
+    g_bytes_read += static_cast<int64_t>(buf->content_bytes_len());
+    if (is_http()) {
+      parse_http(buf);
+    } else {
+      parse_echo(buf);
+    }
+  }
+
+  void parse_echo(Buffer* buf) {
+    while (buf->content_bytes_len() > 0 && !m_in_flight.empty()) {
+      if (!m_in_response) {
+        m_in_response = true;
+        m_response_left = static_cast<size_t>(g_options.message_size);
+      }
+      size_t n = std::min(m_response_left, buf->content_bytes_len());
+      buf->retrieve(n);
+      m_response_left -= n;
+      if (m_response_left == 0) {
+        m_in_response = false;
+        m_status = 200;
+        complete_one();
+      }
+    }
+    buf->retrieve_all();
+  }
+
+  void parse_http(Buffer* buf) {
+    while (true) {
+      if (!m_in_response) {
+        static const char kEndOfHead[] = "\r\n\r\n";
+        const char* begin = buf->peek_base();
+        const char* limit = begin + buf->content_bytes_len();
+        const char* end = std::search(begin, limit, kEndOfHead, kEndOfHead + 4);
+        if (end == limit) {
+          return;
+        }
+        string head(begin, end);
+        buf->retrieve_until(end + 4);
+        parse_head(head);
+      }
+      if (m_until_close) {
+        buf->retrieve_all();
+        return;
+      }
+      size_t n = std::min(m_response_left, buf->content_bytes_len());
+      buf->retrieve(n);
+      m_response_left -= n;
+      if (m_response_left > 0) {
+        return;
+      }
+      m_in_response = false;
+      complete_one();
+    }
+  }
+
+  void parse_head(const string& head) {
+    m_in_response = true;
+    m_status = head.size() > 12 && head.compare(0, 5, "HTTP/") == 0
+                   ? atoi(head.c_str() + 9)
+                   : 0;
+    const char* length = strcasestr(head.c_str(), "\r\nContent-Length:");
+    if (length) {
+      m_response_left = static_cast<size_t>(atoll(length + 17));
+    } else {
+      m_response_left = 0;
+      m_until_close = strcasestr(head.c_str(), "\r\nConnection: close") != NULL;
+    }
+  }
+
+  void complete_one() {
+    assert(!m_in_flight.empty());
+    Request request = m_in_flight.front();
+    m_in_flight.pop_front();
+    m_until_close = false;
+    if (g_running) {
+      Timestamp now = Timestamp::now();
+      g_response_time.record_between(request.due, now);
+      g_service_time.record_between(request.sent, now);
+      if (m_status >= 200 && m_status < 300) {
+        ++g_completed;
+      } else {
+        ++g_non_2xx;
+      }
+    }
+    fill_pipeline();
+  }
+
+  void on_tick() {
+    Timestamp now = Timestamp::now();
+    while (!(now < m_next_due)) {
+      m_backlog.push_back(m_next_due);
+      m_next_due = add_second(m_next_due, m_interval);
+    }
+    fill_pipeline();
+    if (g_running) {
+      m_tick = m_reactor->run_at(m_next_due, std::bind(&Session::on_tick, this));
+    }
+  }
+
+  void fill_pipeline() {
+    if (!m_conn || !g_running) {
+      return;
+    }
+    size_t depth = g_options.keep_alive ? g_options.pipeline : 1;
+    Timestamp now = Timestamp::now();
+    while (m_in_flight.size() < depth) {
+      Request request;
+      request.sent = now;
+      if (open_loop()) {
+        if (m_backlog.empty()) {
+          break;
+        }
+        request.due = m_backlog.front();
+        m_backlog.pop_front();
+      } else {
+        request.due = now;
+      }
+      m_in_flight.push_back(request);
+      m_conn->send_string_piece(g_request);
+    }
+  }
+
+  Reactor* m_reactor;
+  TcpClient m_client;
+  const int m_index;
+  TcpConnectionPtr m_conn;
+  std::deque<Request> m_in_flight;
+  // open loop: the due requests waiting for a pipeline slot
+  std::deque<Timestamp> m_backlog;
+  double m_interval;
+  Timestamp m_next_due;
+  TimerId m_tick;
+  // the response being read
+  size_t m_response_left;
+  bool m_in_response;
+  bool m_until_close;
+  int m_status;
+};
+
+std::vector<Session*> g_sessions;
+std::vector<Reactor*> g_session_reactors;
+
+void print_percentiles(const char* title, const HdrHistogram& histogram) {
+  printf("%-12s p50 %.3f ms  p90 %.3f ms  p99 %.3f ms  p999 %.3f ms  max %.3f ms\n",
+         title, static_cast<double>(histogram.value_at_percentile(50)) / 1000,
+         static_cast<double>(histogram.value_at_percentile(90)) / 1000,
+         static_cast<double>(histogram.value_at_percentile(99)) / 1000,
+         static_cast<double>(histogram.value_at_percentile(99.9)) / 1000,
+         static_cast<double>(histogram.value_at_percentile(100)) / 1000);
+}
+
+void report(double elapsed) {
+  HdrHistogram response;
+  HdrHistogram service;
+  int64_t sum = 0;
+  g_response_time.snapshot(&response, &sum);
+  g_service_time.snapshot(&service, &sum);
+  HdrHistogram corrected;
+  int64_t interval = 0;
+  if (open_loop()) {
+    corrected = response;
+  } else {
+    interval = g_options.expected_interval_us > 0
+                   ? g_options.expected_interval_us
+                   : service.value_at_percentile(50);
+    corrected = service.corrected(interval);
+  }
+
+  printf("%s %s, %s loop", g_options.protocol.c_str(),
+         g_options.keep_alive ? "keep-alive" : "close",
+         open_loop() ? "open" : "closed");
+  if (open_loop()) {
+    printf(" at %.0f/s", g_options.rate);
+  }
+  printf(", %d connections, %d threads, pipeline %d, %.1f s\n",
+         g_options.connections, g_options.threads, g_options.pipeline,
+         elapsed);
+  printf("%-12s %lld, %.1f/s, %lld errors, %lld non-2xx, %.1f MiB read\n",
+         "requests", static_cast<long long>(g_completed.load()),
+         static_cast<double>(g_completed.load()) / elapsed,
+         static_cast<long long>(g_errors.load()),
+         static_cast<long long>(g_non_2xx.load()),
+         static_cast<double>(g_bytes_read.load()) / (1024 * 1024));
+  print_percentiles("latency", corrected);
+  print_percentiles("uncorrected", service);
+  if (!open_loop()) {
+    printf("%-12s expected interval %.3f ms\n", "corrected by",
+           static_cast<double>(interval) / 1000);
+  }
+  printf("RESULT name=%s requests=%lld rps=%.1f errors=%lld p50_us=%lld "
+         "p90_us=%lld p99_us=%lld p999_us=%lld max_us=%lld\n",
+         g_options.name.empty() ? g_options.protocol.c_str()
+                                : g_options.name.c_str(),
+         static_cast<long long>(g_completed.load()),
+         static_cast<double>(g_completed.load()) / elapsed,
+         static_cast<long long>(g_errors.load() + g_non_2xx.load()),
+         static_cast<long long>(corrected.value_at_percentile(50)),
+         static_cast<long long>(corrected.value_at_percentile(90)),
+         static_cast<long long>(corrected.value_at_percentile(99)),
+         static_cast<long long>(corrected.value_at_percentile(99.9)),
+         static_cast<long long>(corrected.value_at_percentile(100)));
+}
+
+void stop_session(Session* session, CountdownLatch* latch) {
+  session->stop();
+  latch->countdown();
+}
+
+void finish(Reactor* reactor, Timestamp start) {
+  g_running = false;
+  double elapsed = second_difference(Timestamp::now(), start);
+  CountdownLatch latch(g_options.connections);
+  for (size_t i = 0; i < g_sessions.size(); ++i) {
+    g_session_reactors[i]->run_asap_in_reactor(
+        std::bind(stop_session, g_sessions[i], &latch));
+  }
+  latch.wait();
+  report(elapsed);
+  // let the connections close before the threads go
+  reactor->run_after(0.1, std::bind(&Reactor::mark_quit, reactor));
+}
+
+void create_session(size_t index, const InetAddress& server_addr,
+                    CountdownLatch* latch) {
+  Session* session = new Session(g_session_reactors[index], server_addr,
+                                 static_cast<int>(index));
+  g_sessions[index] = session;
+  session->start();
+  latch->countdown();
+}
+
+void parse_options(int argc, char* argv[]) {
+  int opt;
+  while ((opt = getopt(argc, argv, "m:a:p:u:c:t:d:r:k:Cs:i:n:")) != -1) {
+    switch (opt) {
+      case 'm':
+        g_options.protocol = optarg;
+        break;
+      case 'a':
+        g_options.address = optarg;
+        break;
+      case 'p':
+        g_options.port = static_cast<uint16_t>(atoi(optarg));
+        break;
+      case 'u':
+        g_options.path = optarg;
+        break;
+      case 'c':
+        g_options.connections = std::max(atoi(optarg), 1);
+        break;
+      case 't':
+        g_options.threads = std::max(atoi(optarg), 0);
+        break;
+      case 'd':
+        g_options.seconds = atof(optarg);
+        break;
+      case 'r':
+        g_options.rate = atof(optarg);
+        break;
+      case 'k':
+        g_options.pipeline = std::max(atoi(optarg), 1);
+        break;
+      case 'C':
+        g_options.keep_alive = false;
+        break;
+      case 's':
+        g_options.message_size = std::max(atoi(optarg), 1);
+        break;
+      case 'i':
+        g_options.expected_interval_us = atoll(optarg);
+        break;
+      case 'n':
+        g_options.name = optarg;
+        break;
+      default:
+        fprintf(stderr, "see the usage at the top of LoadGenerator_bench.cc\n");
+        exit(1);
+    }
+  }
+  if (is_http()) {
+    g_request = "GET " + g_options.path + " HTTP/1.1\r\nHost: " +
+                g_options.address + "\r\n" +
+                (g_options.keep_alive ? "" : "Connection: close\r\n") + "\r\n";
+  } else {
+    g_request.assign(static_cast<size_t>(g_options.message_size), 'x');
+  }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  LogLine::set_log_level(LogLine::ERROR);
+  parse_options(argc, argv);
+  InetAddress server_addr(g_options.address, g_options.port);
+
+  Reactor reactor;
+  ReactorThreadPool pool(&reactor, "LoadGenerator");
+  pool.set_pool_size(g_options.threads);
+  pool.start();
+
+  g_running = true;
+  Timestamp start = Timestamp::now();
+  g_sessions.resize(static_cast<size_t>(g_options.connections));
+  CountdownLatch latch(g_options.connections);
+  for (size_t i = 0; i < g_sessions.size(); ++i) {
+    g_session_reactors.push_back(pool.get_next_reactor());
+    g_session_reactors[i]->run_asap_in_reactor(
+        std::bind(create_session, i, server_addr, &latch));
+  }
+  latch.wait();
+  reactor.run_after(g_options.seconds,
+                    std::bind(finish, &reactor, start));
+  reactor.loop();
+  // the sessions are not deleted, their threads are gone
+  return 0;
+}
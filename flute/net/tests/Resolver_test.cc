@@ -0,0 +1,354 @@
+#include <flute/common/LogLine.h>
+#include <flute/common/Thread.h>
+#include <flute/common/tests/TestUtil.h>
+#include <flute/net/Connector.h>
+#include <flute/net/Reactor.h>
+#include <flute/net/Resolver.h>
+#include <flute/net/TcpServer.h>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace flute;
+
+namespace {
+
+using flute::test::expect;
+
+const uint16_t kDnsPort = 2053;
+// IPv4 only, nothing listens at [::1]
+const uint16_t kFallbackPort = 2054;
+// IPv4 listens, [::1] takes no more connects
+const uint16_t kRacePort = 2055;
+
+std::atomic<int> g_questions(0);
+std::atomic<int> g_dual_questions(0);
+std::atomic<bool> g_stub_quit(false);
+
+void put16(std::string* packet, uint16_t value) {
+  packet->push_back(static_cast<char>(value >> 8));
+  packet->push_back(static_cast<char>(value & 0xff));
+}
+
+void put_record(std::string* packet, uint16_t type, const void* rdata,
+                uint16_t rdlength, uint16_t ttl = 60) {
+  put16(packet, 0xc00c);  // the name of the question
+  put16(packet, type);
+  put16(packet, 1);
+  put16(packet, 0);
+  put16(packet, ttl);
+  put16(packet, rdlength);
+  packet->append(static_cast<const char*>(rdata), rdlength);
+}
+
+// An answer to the question of id, for name and type, with one A record.
+std::string forged_answer(const char* id, const std::string& name,
+                          uint16_t type, in_addr_t ip) {
+  std::string answer(id, 2);
+  put16(&answer, 0x8180);
+  put16(&answer, 1);
+  put16(&answer, 1);
+  put16(&answer, 0);
+  put16(&answer, 0);
+  size_t begin = 0;
+  while (begin < name.size()) {
+    size_t end = std::min(name.find('.', begin), name.size());
+    answer.push_back(static_cast<char>(end - begin));
+    answer.append(name, begin, end - begin);
+    begin = end + 1;
+  }
+  answer.push_back('\0');
+  put16(&answer, type);
+  put16(&answer, 1);
+  put_record(&answer, 1, &ip, 4);
+  return answer;
+}
+
+// A stub name server on the loopback: dual.test, race.test and fallback.test
+// are ::1 and 127.0.0.1, v4.test is 127.0.0.1 only, nx.test does not exist
+// and slow.test is never answered. zero.test has an AAAA record of no TTL
+// before its A record of 60 seconds. The questions of spoof.test are first
+// answered for another name, and for the other type.
+void run_stub_dns() {
+  int fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(kDnsPort);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  ::bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof addr);
+  struct timeval timeout = {0, 100 * 1000};
+  ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+
+  while (!g_stub_quit) {
+    unsigned char buf[512];
+    struct sockaddr_in peer;
+    socklen_t peer_len = sizeof peer;
+    ssize_t n = ::recvfrom(fd, buf, sizeof buf, 0,
+                           reinterpret_cast<struct sockaddr*>(&peer), &peer_len);
+    if (n < 12) {
+      continue;
+    }
+    ++g_questions;
+    std::string name;
+    size_t pos = 12;
+    while (pos < static_cast<size_t>(n) && buf[pos] != 0) {
+      if (!name.empty()) {
+        name += '.';
+      }
+      name.append(reinterpret_cast<char*>(buf) + pos + 1, buf[pos]);
+      pos += 1 + buf[pos];
+    }
+    pos += 1;
+    uint16_t type = static_cast<uint16_t>(buf[pos] << 8 | buf[pos + 1]);
+    pos += 4;
+    if (name == "dual.test") {
+      ++g_dual_questions;
+    }
+    if (name == "slow.test") {
+      continue;
+    }
+    if (name == "spoof.test") {
+      in_addr_t forged = htonl(0x0a000001);
+      std::string answers[] = {
+          forged_answer(reinterpret_cast<char*>(buf), "evil.test", type,
+                        forged),
+          forged_answer(reinterpret_cast<char*>(buf), name,
+                        static_cast<uint16_t>(type == 1 ? 28 : 1), forged)};
+      for (const std::string& answer : answers) {
+        ::sendto(fd, answer.data(), answer.size(), 0,
+                 reinterpret_cast<struct sockaddr*>(&peer), peer_len);
+      }
+    }
+    bool has_v6 = name == "dual.test" || name == "race.test" ||
+                  name == "fallback.test" || name == "zero.test";
+    bool has_v4 = has_v6 || name == "v4.test" || name == "spoof.test";
+    std::string answer(reinterpret_cast<char*>(buf), 2);
+    put16(&answer, static_cast<uint16_t>(has_v4 ? 0x8180 : 0x8183));
+    put16(&answer, 1);
+    bool answered = (type == 28 && has_v6) || (type == 1 && has_v4);
+    put16(&answer, answered ? 1 : 0);
+    put16(&answer, 0);
+    put16(&answer, 0);
+    answer.append(reinterpret_cast<char*>(buf) + 12, pos - 12);
+    if (answered && type == 28) {
+      put_record(&answer, 28, &in6addr_loopback, 16,
+                 static_cast<uint16_t>(name == "zero.test" ? 0 : 60));
+    } else if (answered) {
+      in_addr_t loopback = htonl(INADDR_LOOPBACK);
+      put_record(&answer, 1, &loopback, 4);
+    }
+    ::sendto(fd, answer.data(), answer.size(), 0,
+             reinterpret_cast<struct sockaddr*>(&peer), peer_len);
+  }
+  ::close(fd);
+}
+
+// A listener at [::1]:kRacePort whose accept queue is full, so that a connect
+// to it hangs as to a blackholed address.
+std::vector<int> make_full_ipv6_listener() {
+  std::vector<int> fds;
+  int listen_fd = ::socket(AF_INET6, SOCK_STREAM, 0);
+  struct sockaddr_in6 addr;
+  memset(&addr, 0, sizeof addr);
+  addr.sin6_family = AF_INET6;
+  addr.sin6_port = htons(kRacePort);
+  addr.sin6_addr = in6addr_loopback;
+  int on = 1;
+  ::setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on);
+  ::bind(listen_fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof addr);
+  ::listen(listen_fd, 0);
+  fds.push_back(listen_fd);
+  for (int i = 0; i < 2; ++i) {
+    int fd = ::socket(AF_INET6, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    ::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof addr);
+    fds.push_back(fd);
+  }
+  ::usleep(100 * 1000);
+  return fds;
+}
+
+typedef std::shared_ptr<Connector> ConnectorPtr;
+
+Reactor* g_reactor;
+std::unique_ptr<Resolver> g_resolver;
+ConnectorPtr g_connector;
+Timestamp g_connect_start;
+
+std::vector<InetAddress> resolve_now(const std::string& hostname,
+                                     bool* called) {
+  std::vector<InetAddress> result;
+  *called = false;
+  g_resolver->resolve(hostname, [&](const std::vector<InetAddress>& addrs) {
+    *called = true;
+    result = addrs;
+  });
+  return result;
+}
+
+void test_race();
+void test_stop();
+void finish();
+
+void hold_connector(const ConnectorPtr&) {}
+
+// A Connector resets its channels in tasks queued by itself.
+void release_connector() {
+  ConnectorPtr connector;
+  connector.swap(g_connector);
+  g_reactor->queue_in_reactor([connector]() {
+    g_reactor->queue_in_reactor(std::bind(&hold_connector, connector));
+  });
+}
+
+void on_fallback_connected(int sockfd) {
+  expect(g_connector->serverAddress().family() == AF_INET &&
+             g_connector->serverAddress().to_port() == kFallbackPort,
+         "refused IPv6, connected over IPv4");
+  ::close(sockfd);
+  release_connector();
+  test_race();
+}
+
+void test_fallback() {
+  g_connector.reset(
+      new Connector(g_reactor, g_resolver.get(), "fallback.test", kFallbackPort));
+  g_connector->set_new_conn_callback(on_fallback_connected);
+  g_connector->start();
+}
+
+void on_race_connected(int sockfd) {
+  double elapsed = second_difference(Timestamp::now(), g_connect_start);
+  expect(g_connector->serverAddress().family() == AF_INET,
+         "hanging IPv6 raced by IPv4");
+  expect(elapsed > 0.2 && elapsed < 0.9, "IPv4 started after the race delay");
+  ::close(sockfd);
+  release_connector();
+  test_stop();
+}
+
+void test_race() {
+  g_connect_start = Timestamp::now();
+  g_connector.reset(
+      new Connector(g_reactor, g_resolver.get(), "race.test", kRacePort));
+  g_connector->set_new_conn_callback(on_race_connected);
+  g_connector->start();
+}
+
+bool g_connect_failed = false;
+
+void on_stopped() {
+  expect(!g_connect_failed, "stopped while connecting, not a failure");
+  release_connector();
+  finish();
+}
+
+// The connect to the full listener hangs until stopped.
+void test_stop() {
+  g_connector.reset(
+      new Connector(g_reactor, InetAddress("::1", kRacePort, true)));
+  g_connector->set_connect_failed_callback([]() { g_connect_failed = true; });
+  g_connector->start();
+  g_reactor->run_after(0.1, []() {
+    g_connector->stop();
+    g_reactor->run_after(0.1, on_stopped);
+  });
+}
+
+void test_resolve() {
+  bool called;
+  std::vector<InetAddress> literal = resolve_now("127.0.0.1", &called);
+  expect(called && literal.size() == 1 && literal[0].to_ip() == "127.0.0.1",
+         "IP literal resolved at once");
+
+  g_resolver->resolve("dual.test", [](const std::vector<InetAddress>& addrs) {
+    expect(addrs.size() == 2 && addrs[0].family() == AF_INET6 &&
+               addrs[0].to_ip() == "::1" && addrs[1].to_ip() == "127.0.0.1",
+           "AAAA and A answers, IPv6 first");
+    int questions = g_questions;
+    bool cached;
+    std::vector<InetAddress> again = resolve_now("dual.test", &cached);
+    expect(cached && again.size() == 2 && g_questions == questions,
+           "answer cached for its TTL");
+  });
+  // merged with the lookup in flight
+  g_resolver->resolve("dual.test", [](const std::vector<InetAddress>& addrs) {
+    expect(addrs.size() == 2 && g_dual_questions == 2,
+           "one lookup for concurrent resolves");
+  });
+  g_resolver->resolve("v4.test", [](const std::vector<InetAddress>& addrs) {
+    expect(addrs.size() == 1 && addrs[0].family() == AF_INET,
+           "A answer only");
+  });
+  g_resolver->resolve("spoof.test", [](const std::vector<InetAddress>& addrs) {
+    expect(addrs.size() == 1 && addrs[0].to_ip() == "127.0.0.1",
+           "answers to another question dropped");
+  });
+  g_resolver->resolve("zero.test", [](const std::vector<InetAddress>& addrs) {
+    std::shared_ptr<bool> cached(new bool(false));
+    g_resolver->resolve("zero.test",
+                        [cached](const std::vector<InetAddress>&) {
+                          *cached = true;
+                        });
+    expect(addrs.size() == 2 && !*cached,
+           "a record of no TTL is not cached for the TTL of another");
+  });
+  g_resolver->resolve("nx.test", [](const std::vector<InetAddress>& addrs) {
+    expect(addrs.empty(), "NXDOMAIN is empty");
+  });
+  Timestamp start = Timestamp::now();
+  g_resolver->resolve("slow.test", [start](const std::vector<InetAddress>& addrs) {
+    double elapsed = second_difference(Timestamp::now(), start);
+    expect(addrs.empty() && elapsed > 0.15, "unanswered lookup times out");
+    test_fallback();
+  });
+}
+
+void finish() {
+  expect(g_resolver->num_cached() == 6, "answers cached");
+  g_resolver.reset();
+  g_stub_quit = true;
+  g_reactor->run_after(0.1, std::bind(&Reactor::mark_quit, g_reactor));
+}
+
+}  // namespace
+
+int main() {
+  LogLine::set_log_level(LogLine::ERROR);
+  Thread stub(run_stub_dns, "stub-dns");
+  stub.start();
+  std::vector<int> full_listener = make_full_ipv6_listener();
+
+  Reactor reactor;
+  g_reactor = &reactor;
+  TcpServer fallback_server(&reactor, InetAddress(kFallbackPort, true),
+                            "FallbackServer");
+  fallback_server.start();
+  TcpServer race_server(&reactor, InetAddress(kRacePort, true), "RaceServer");
+  race_server.start();
+
+  g_resolver.reset(
+      new Resolver(&reactor, InetAddress("127.0.0.1", kDnsPort)));
+  g_resolver->set_timeout(0.1);
+  g_resolver->set_max_tries(2);
+  g_resolver->set_ttl_range(0.0, 3600.0);
+  reactor.run_after(0.1, test_resolve);
+  reactor.loop();
+  stub.join();
+  for (int fd : full_listener) {
+    ::close(fd);
+  }
+  return flute::test::exit_code();
+}
@@ -0,0 +1,116 @@
+#include <flute/common/LogLine.h>
+#include <flute/common/tests/TestUtil.h>
+#include <flute/net/Channel.h>
+#include <flute/net/Reactor.h>
+
+#include <stdio.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+using namespace flute;
+
+// Outside of the anonymous namespace, so that the symbols name them.
+__attribute__((noinline)) void spin_in_slow_callback(double seconds) {
+  Timestamp start = Timestamp::now();
+  while (second_difference(Timestamp::now(), start) < seconds) {
+  }
+}
+
+void slow_task() { spin_in_slow_callback(0.2); }
+
+namespace {
+
+using flute::test::expect;
+
+bool contains(const std::string& s, const std::string& part) {
+  return s.find(part) != std::string::npos;
+}
+
+const double kThreshold = 0.05;
+const double kSlow = 0.2;
+
+struct Report {
+  std::string callback;
+  double seconds;
+  std::string stack;
+};
+
+std::vector<Report> g_reports;
+
+void on_slow_callback(const string& callback, double seconds,
+                      const string& stack) {
+  g_reports.push_back(Report{callback, seconds, stack});
+}
+
+struct SlowTimer {
+  void operator()() const { spin_in_slow_callback(kSlow); }
+};
+
+struct SlowReader {
+  void operator()(Timestamp) const {
+    uint64_t one = 0;
+    ::read(fd, &one, sizeof one);
+    spin_in_slow_callback(kSlow);
+  }
+  int fd;
+};
+
+void fast_task() {}
+
+bool flagged(const std::string& kind, const std::string& name) {
+  for (const Report& report : g_reports) {
+    if (report.callback.compare(0, kind.size(), kind) == 0 &&
+        contains(report.callback, name)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void check_reports(Reactor* reactor) {
+  expect(g_reports.size() == 3, "three slow callbacks flagged");
+  expect(flagged("task", "slow_task"), "queued task named by its symbol");
+  expect(flagged("timer", "SlowTimer"), "timer named, not as its channel");
+  expect(flagged("channel", "SlowReader"), "channel callback named");
+  bool timed = true;
+  bool sampled = true;
+  for (const Report& report : g_reports) {
+    timed = timed && report.seconds >= kSlow && report.seconds < 1.0;
+    sampled = sampled && contains(report.stack, "spin_in_slow_callback");
+  }
+  expect(timed, "run times reported");
+  expect(sampled, "stacks sampled inside the callbacks");
+  reactor->mark_quit();
+}
+
+}  // namespace
+
+int main() {
+  LogLine::set_log_level(LogLine::ERROR);
+  Reactor reactor;
+  reactor.set_slow_callback_handler(on_slow_callback);
+  reactor.set_slow_callback_threshold(kThreshold);
+
+  int event_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  Channel channel(&reactor, event_fd);
+  channel.set_read_callback(SlowReader{event_fd});
+  channel.wang_to_read();
+
+  reactor.queue_in_reactor(fast_task);
+  reactor.queue_in_reactor(slow_task);
+  reactor.run_after(0.3, SlowTimer());
+  reactor.run_after(0.6, [event_fd]() {
+    uint64_t one = 1;
+    ::write(event_fd, &one, sizeof one);
+  });
+  reactor.run_after(1.0, std::bind(check_reports, &reactor));
+  reactor.loop();
+
+  channel.end_all();
+  channel.remove_self_from_reactor();
+  ::close(event_fd);
+  return flute::test::exit_code();
+}
@@ -0,0 +1,153 @@
+#include <flute/common/LogLine.h>
+#include <flute/common/Thread.h>
+#include <flute/common/tests/TestUtil.h>
+#include <flute/net/Reactor.h>
+#include <flute/net/SpliceRelay.h>
+#include <flute/net/TcpClientPool.h>
+#include <flute/net/TcpServer.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace flute;
+
+namespace {
+
+using flute::test::expect;
+
+const uint16_t kEchoPort = 2018;
+const uint16_t kTunnelPort = 2019;
+const size_t kTotalBytes = 4 * 1024 * 1024;
+
+Reactor* g_reactor;
+std::unique_ptr<TcpClientPool> g_pool;
+TcpConnectionPtr g_client_conn;
+SpliceRelayPtr g_relay;
+// received by the tunnel before the relay started
+size_t g_bytes_before_relay = 0;
+// seen by the message callbacks of the tunnel once relaying
+size_t g_bytes_after_relay = 0;
+
+void on_echo_message(const TcpConnectionPtr& conn, Buffer* buf, Timestamp) {
+  conn->send_buffer(buf);
+}
+
+void on_tunnel_message(const TcpConnectionPtr&, Buffer* buf, Timestamp) {
+  // left in the buffer, SpliceRelay::start() sends it
+  if (g_relay) {
+    g_bytes_after_relay += buf->content_bytes_len();
+  }
+}
+
+void on_tunnel_conn(const TcpConnectionPtr& conn) {
+  if (!conn->connected()) {
+    return;
+  }
+  g_client_conn = conn;
+  g_pool->lease(0, [conn](const TcpConnectionPtr& upstream) {
+    expect(upstream && conn->connected(), "upstream leased for the tunnel");
+    g_bytes_before_relay = conn->input_buffer()->content_bytes_len();
+    upstream->set_message_callback(on_tunnel_message);
+    g_relay = SpliceRelay::start(conn, upstream);
+    expect(g_relay != nullptr, "relay started");
+  });
+}
+
+void check_relay() {
+  expect(g_bytes_after_relay == 0,
+         "no relayed byte went through a message callback");
+  expect(g_relay && g_relay->bytes_relayed_from(g_client_conn) +
+                            g_bytes_before_relay ==
+                        kTotalBytes,
+         "bytes of the client relayed by splice");
+  g_relay.reset();
+  g_client_conn.reset();
+  g_pool.reset();
+  g_reactor->run_after(0.1, std::bind(&Reactor::mark_quit, g_reactor));
+}
+
+char pattern_at(size_t i) { return static_cast<char>(i % 251); }
+
+void write_all(int fd) {
+  std::vector<char> chunk(64 * 1024);
+  size_t written = 0;
+  while (written < kTotalBytes) {
+    for (size_t i = 0; i < chunk.size(); ++i) {
+      chunk[i] = pattern_at(written + i);
+    }
+    ssize_t n = ::write(fd, chunk.data(), chunk.size());
+    if (n <= 0) {
+      break;
+    }
+    written += static_cast<size_t>(n);
+  }
+}
+
+void run_client() {
+  ::usleep(200 * 1000);
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(kTunnelPort);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  bool connected = ::connect(fd, reinterpret_cast<struct sockaddr*>(&addr),
+                             sizeof addr) == 0;
+  expect(connected, "connect to the tunnel");
+
+  Thread writer(std::bind(write_all, fd), "writer");
+  writer.start();
+  size_t received = 0;
+  bool same = true;
+  char buf[64 * 1024];
+  ssize_t n = 0;
+  while (received < kTotalBytes && (n = ::read(fd, buf, sizeof buf)) > 0) {
+    for (ssize_t i = 0; i < n; ++i) {
+      same = same && buf[i] == pattern_at(received + static_cast<size_t>(i));
+    }
+    received += static_cast<size_t>(n);
+  }
+  writer.join();
+  expect(received == kTotalBytes && same, "echoed bytes came back in order");
+  // the end goes through to the echo server, which closes, and back
+  ::shutdown(fd, SHUT_WR);
+  n = ::read(fd, buf, sizeof buf);
+  expect(n == 0, "the end of the stream relayed both ways");
+  ::close(fd);
+  g_reactor->run_asap_in_reactor(check_relay);
+}
+
+}  // namespace
+
+int main() {
+  LogLine::set_log_level(LogLine::ERROR);
+  Reactor reactor;
+  g_reactor = &reactor;
+
+  TcpServer echo_server(&reactor, InetAddress(kEchoPort, true), "EchoServer");
+  echo_server.set_message_callback(on_echo_message);
+  echo_server.start();
+
+  g_pool.reset(new TcpClientPool(&reactor, "Pool"));
+  g_pool->set_warm_connections(1);
+  g_pool->add_upstream(InetAddress(kEchoPort, true));
+
+  TcpServer tunnel(&reactor, InetAddress(kTunnelPort, true), "Tunnel");
+  tunnel.set_conn_callback(on_tunnel_conn);
+  tunnel.set_message_callback(on_tunnel_message);
+  tunnel.start();
+
+  Thread client(run_client, "client");
+  client.start();
+  reactor.loop();
+  client.join();
+  return flute::test::exit_code();
+}
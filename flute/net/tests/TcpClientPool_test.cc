@@ -0,0 +1,125 @@
+#include <flute/common/LogLine.h>
+#include <flute/common/tests/TestUtil.h>
+#include <flute/net/Reactor.h>
+#include <flute/net/TcpClientPool.h>
+#include <flute/net/TcpServer.h>
+
+#include <stdio.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace flute;
+using std::placeholders::_1;
+using std::placeholders::_2;
+
+namespace {
+
+using flute::test::expect;
+
+const uint16_t kEchoPort = 2017;
+// nothing listens there
+const uint16_t kClosedPort = 1;
+
+void on_echo_message(const TcpConnectionPtr& conn, Buffer* buf, Timestamp) {
+  conn->send_buffer(buf);
+}
+
+Reactor* g_reactor;
+std::unique_ptr<TcpClientPool> g_pool;
+std::unique_ptr<TcpClientPool> g_bad_pool;
+std::vector<TcpConnectionPtr> g_leased;
+TcpConnectionPtr g_waiter_conn;
+bool g_waiter_called = false;
+
+void on_reply(const TcpConnectionPtr& conn, Buffer* buf, Timestamp) {
+  if (buf->content_bytes_len() < 5) {
+    return;
+  }
+  expect(buf->readout_all_as_string() == "hello", "echo over a leased connection");
+  g_pool->give_back(conn);
+}
+
+void test_lease_and_echo() {
+  expect(g_pool->num_idle(0) == 2, "warm connections are idle");
+  TcpConnectionPtr conn;
+  g_pool->lease(0, [&conn](const TcpConnectionPtr& c) { conn = c; });
+  expect(conn && conn->connected(), "lease an idle connection at once");
+  expect(g_pool->num_leased(0) == 1, "one leased");
+  expect(g_pool->num_connecting(0) == 0,
+         "leasing a warm connection opens no other");
+  conn->set_message_callback(on_reply);
+  conn->send_string_piece("hello");
+}
+
+void test_limits() {
+  expect(g_pool->num_idle(0) == 2 && g_pool->num_leased(0) == 0,
+         "given back, the pool is warm again");
+  for (int i = 0; i < 3; ++i) {
+    g_pool->lease(0, [](const TcpConnectionPtr& c) { g_leased.push_back(c); });
+  }
+  g_pool->lease(0, [](const TcpConnectionPtr& c) {
+    g_waiter_called = true;
+    g_waiter_conn = c;
+  });
+}
+
+void test_waiter() {
+  expect(g_leased.size() == 3 && g_pool->num_leased(0) == 3,
+         "leases up to the connection limit");
+  expect(!g_waiter_called, "a lease over the limit waits");
+  g_pool->give_back(g_leased[0]);
+  expect(g_waiter_called && g_waiter_conn == g_leased[0],
+         "a given back connection goes to the waiting lease");
+  g_pool->give_back(g_leased[1], false);
+  g_pool->give_back(g_leased[2]);
+  g_pool->give_back(g_waiter_conn);
+}
+
+void test_unhealthy() {
+  expect(g_pool->num_leased(0) == 0 && g_pool->num_idle(0) == 2,
+         "not reusable connection closed, the others idle");
+  expect(!g_bad_pool->is_healthy(0), "unreachable upstream is unhealthy");
+  bool called = false;
+  TcpConnectionPtr conn;
+  g_bad_pool->lease(0, [&](const TcpConnectionPtr& c) {
+    called = true;
+    conn = c;
+  });
+  expect(called && !conn, "lease from an unhealthy upstream fails at once");
+  g_leased.clear();
+  g_waiter_conn.reset();
+  g_pool.reset();
+  g_bad_pool.reset();
+  g_reactor->run_after(0.1, std::bind(&Reactor::mark_quit, g_reactor));
+}
+
+}  // namespace
+
+int main() {
+  LogLine::set_log_level(LogLine::WARN);
+  Reactor reactor;
+  g_reactor = &reactor;
+
+  TcpServer server(&reactor, InetAddress(kEchoPort, true), "EchoServer");
+  server.set_message_callback(on_echo_message);
+  server.start();
+
+  g_pool.reset(new TcpClientPool(&reactor, "Pool"));
+  g_pool->set_warm_connections(2);
+  g_pool->set_max_connections(3);
+  g_pool->add_upstream(InetAddress(kEchoPort, true));
+
+  g_bad_pool.reset(new TcpClientPool(&reactor, "BadPool"));
+  g_bad_pool->set_max_failures(2);
+  g_bad_pool->set_retry_delay(10.0);
+  g_bad_pool->add_upstream(InetAddress(kClosedPort, true));
+
+  reactor.run_after(0.3, test_lease_and_echo);
+  reactor.run_after(0.6, test_limits);
+  reactor.run_after(0.9, test_waiter);
+  reactor.run_after(1.2, test_unhealthy);
+  reactor.loop();
+  return flute::test::exit_code();
+}
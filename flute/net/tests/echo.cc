@@ -5,6 +5,8 @@
 
 #include "echo.h"
 
+#include <stdlib.h>
+
 using std::placeholders::_1;
 using std::placeholders::_2;
 using std::placeholders::_3;
@@ -35,7 +37,11 @@ void EchoServer::on_message(const flute::TcpConnectionPtr& conn,
   conn->send_string_piece(StringPiece(msg));
 }
 
-int main() {
+// Usage: echo [log_level]
+int main(int argc, char* argv[]) {
+  if (argc > 1) {
+    LogLine::set_log_level(static_cast<LogLine::LogLevel>(atoi(argv[1])));
+  }
   LOG_INFO << "pid = " << CurrentThread::tid();
   flute::Reactor reactor;
   flute::InetAddress listenAddr(2007);
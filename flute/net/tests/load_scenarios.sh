@@ -0,0 +1,41 @@
+#!/bin/sh
+# Runs one load scenario of LoadGenerator_bench against a local server.
+# Usage: load_scenarios.sh <directory of the binaries> <scenario>
+#
+# The bench_<scenario> targets run these, bench runs all of them.
+# DURATION, in seconds, defaults to 5.
+
+BIN_DIR=$1
+SCENARIO=$2
+DURATION=${DURATION:-5}
+
+case ${SCENARIO} in
+  echo*)
+    # log level 4 is ERROR
+    ${BIN_DIR}/echo 4 > /dev/null 2>&1 &
+    ;;
+  http*)
+    ${BIN_DIR}/HttpServer_test 1 4 > /dev/null 2>&1 &
+    ;;
+  *)
+    echo "unknown scenario ${SCENARIO}" >&2
+    exit 1
+    ;;
+esac
+SERVER_PID=$!
+trap 'kill ${SERVER_PID} 2> /dev/null' EXIT INT TERM
+sleep 0.5
+
+LOAD="${BIN_DIR}/LoadGenerator_bench -d ${DURATION} -n ${SCENARIO}"
+case ${SCENARIO} in
+  echo)           ${LOAD} -m echo -p 2007 -c 16 ;;
+  echo_pipelined) ${LOAD} -m echo -p 2007 -c 16 -k 16 ;;
+  http_keepalive) ${LOAD} -c 16 ;;
+  http_pipelined) ${LOAD} -c 16 -k 8 ;;
+  http_close)     ${LOAD} -c 16 -C ;;
+  http_open_loop) ${LOAD} -c 16 -r 20000 ;;
+  *)
+    echo "unknown scenario ${SCENARIO}" >&2
+    exit 1
+    ;;
+esac